@@ -82,6 +82,9 @@ static BlockDriverAIOCB *bdrv_co_aio_rw_vector(BlockDriverState *bs,
 static void coroutine_fn bdrv_co_do_rw(void *opaque);
 static int coroutine_fn bdrv_co_do_write_zeroes(BlockDriverState *bs,
     int64_t sector_num, int nb_sectors);
+static void bdrv_alloc_map_invalidate(BlockDriverState *bs, int64_t sector_num,
+                                      int nb_sectors);
+static void bdrv_alloc_map_free(BlockDriverState *bs);
 
 static bool bdrv_exceed_bps_limits(BlockDriverState *bs, int nb_sectors,
         bool is_write, double elapsed_time, uint64_t *wait);
@@ -310,6 +313,7 @@ BlockDriverState *bdrv_new(const char *device_name)
         QTAILQ_INSERT_TAIL(&bdrv_states, bs, list);
     }
     bdrv_iostatus_disable(bs);
+    bdrv_alloc_map_invalidate(bs, 0, -1);
     return bs;
 }
 
@@ -618,6 +622,31 @@ void bdrv_disable_copy_on_read(BlockDriverState *bs)
     bs->copy_on_read--;
 }
 
+#define BDRV_COR_PREFETCH_SLICE_NS  100000000LL
+
+/*
+ * Configure prefetching for copy-on-read.  Once the guest is detected to read
+ * sequentially, up to window_bytes beyond its current position are copied
+ * from the backing file in the background, at no more than bps bytes per
+ * second (0 means no limit).  A window of 0 disables prefetching.
+ *
+ * Prefetching only happens while copy-on-read is enabled.
+ */
+void bdrv_set_cor_prefetch(BlockDriverState *bs, int64_t window_bytes,
+                           int64_t bps)
+{
+    BdrvCorPrefetch *p = &bs->cor_prefetch;
+
+    p->window = window_bytes >> BDRV_SECTOR_BITS;
+    p->slice_quota = (bps * BDRV_COR_PREFETCH_SLICE_NS / 1000000000LL)
+                     >> BDRV_SECTOR_BITS;
+    if (bps && !p->slice_quota) {
+        p->slice_quota = 1;
+    }
+    p->seq_reads = 0;
+    p->target = p->pos;
+}
+
 /*
  * Common part for opening disk images and files
  */
@@ -885,6 +914,11 @@ void bdrv_close(BlockDriverState *bs)
         bs->opaque = NULL;
         bs->drv = NULL;
         bs->copy_on_read = 0;
+        assert(bs->cor_prefetch.co == NULL);
+        bs->cor_prefetch.seq_reads = 0;
+        bs->cor_prefetch.next_sector = 0;
+        bs->cor_prefetch.pos = 0;
+        bs->cor_prefetch.target = 0;
         bs->backing_file[0] = '\0';
         bs->backing_format[0] = '\0';
         bs->total_sectors = 0;
@@ -892,6 +926,8 @@ void bdrv_close(BlockDriverState *bs)
         bs->valid_key = 0;
         bs->sg = 0;
         bs->growable = 0;
+        bdrv_alloc_map_free(bs);
+        bdrv_alloc_map_invalidate(bs, 0, -1);
 
         if (bs->file != NULL) {
             bdrv_delete(bs->file);
@@ -983,6 +1019,7 @@ static void bdrv_move_feature_fields(BlockDriverState *bs_dest,
     bs_dest->dev                = bs_src->dev;
     bs_dest->buffer_alignment   = bs_src->buffer_alignment;
     bs_dest->copy_on_read       = bs_src->copy_on_read;
+    bs_dest->cor_prefetch       = bs_src->cor_prefetch;
 
     bs_dest->enable_write_cache = bs_src->enable_write_cache;
 
@@ -1062,6 +1099,12 @@ void bdrv_swap(BlockDriverState *bs_new, BlockDriverState *bs_old)
     assert(bs_new->io_limits_enabled == false);
     assert(bs_new->block_timer == NULL);
 
+    /* the allocation maps describe the chain below the old location */
+    bdrv_alloc_map_free(bs_new);
+    bdrv_alloc_map_free(bs_old);
+    bdrv_alloc_map_invalidate(bs_new, 0, -1);
+    bdrv_alloc_map_invalidate(bs_old, 0, -1);
+
     bdrv_rebind(bs_new);
     bdrv_rebind(bs_old);
 }
@@ -1338,6 +1381,7 @@ int bdrv_commit(BlockDriverState *bs)
 
     if (drv->bdrv_make_empty) {
         ret = drv->bdrv_make_empty(bs);
+        bdrv_alloc_map_invalidate(bs, 0, -1);
         bdrv_flush(bs);
     }
 
@@ -1524,6 +1568,7 @@ int bdrv_change_backing_file(BlockDriverState *bs,
     if (ret == 0) {
         pstrcpy(bs->backing_file, sizeof(bs->backing_file), backing_file ?: "");
         pstrcpy(bs->backing_format, sizeof(bs->backing_format), backing_fmt ?: "");
+        bdrv_alloc_map_invalidate(bs, 0, -1);
     }
     return ret;
 }
@@ -1855,6 +1900,7 @@ static int coroutine_fn bdrv_co_do_copy_on_readv(BlockDriverState *bs,
         ret = drv->bdrv_co_writev(bs, cluster_sector_num, cluster_nb_sectors,
                                   &bounce_qiov);
     }
+    bdrv_alloc_map_invalidate(bs, cluster_sector_num, cluster_nb_sectors);
 
     if (ret < 0) {
         /* It might be okay to ignore write errors for guest requests.  If this
@@ -1873,6 +1919,188 @@ err:
     return ret;
 }
 
+/*
+ * Copy-on-read only the parts of the request that are not allocated in bs,
+ * read the rest directly.  The image streaming job hands us large requests
+ * that the prefetcher may already have populated in part.
+ */
+static int coroutine_fn bdrv_co_do_copy_on_readv_holes(BlockDriverState *bs,
+        int64_t sector_num, int nb_sectors, QEMUIOVector *qiov)
+{
+    QEMUIOVector piece;
+    int done = 0;
+    int ret = 0;
+
+    qemu_iovec_init(&piece, qiov->niov);
+    while (done < nb_sectors) {
+        int pnum;
+
+        ret = bdrv_co_is_allocated(bs, sector_num + done, nb_sectors - done,
+                                   &pnum);
+        if (ret < 0) {
+            break;
+        }
+        if (pnum == 0) {
+            /* Should not happen, but don't loop forever */
+            ret = 0;
+            pnum = nb_sectors - done;
+        }
+
+        qemu_iovec_reset(&piece);
+        qemu_iovec_concat(&piece, qiov, done * BDRV_SECTOR_SIZE,
+                          pnum * BDRV_SECTOR_SIZE);
+        if (ret) {
+            ret = bs->drv->bdrv_co_readv(bs, sector_num + done, pnum, &piece);
+        } else {
+            ret = bdrv_co_do_copy_on_readv(bs, sector_num + done, pnum,
+                                           &piece);
+        }
+        if (ret < 0) {
+            break;
+        }
+        done += pnum;
+    }
+    qemu_iovec_destroy(&piece);
+
+    return ret < 0 ? ret : 0;
+}
+
+/* Sequential guest reads needed before prefetching starts */
+#define BDRV_COR_PREFETCH_SEQ_READS 2
+/* Largest request issued by the prefetcher */
+#define BDRV_COR_PREFETCH_CHUNK     1024 /* in sectors */
+
+/* Returns true if n more sectors would exceed the bandwidth cap */
+static bool bdrv_cor_prefetch_throttled(BdrvCorPrefetch *p, int n)
+{
+    int64_t now;
+
+    if (!p->slice_quota) {
+        return false;
+    }
+
+    now = qemu_get_clock_ns(rt_clock);
+    if (now >= p->slice_end) {
+        p->slice_end = now + BDRV_COR_PREFETCH_SLICE_NS;
+        p->slice_dispatched = 0;
+    }
+    if (p->slice_dispatched && p->slice_dispatched + n > p->slice_quota) {
+        return true;
+    }
+    p->slice_dispatched += n;
+    return false;
+}
+
+/*
+ * Populates [pos, target) of the top image from the backing chain.  The
+ * requests go through bdrv_co_copy_on_readv() so that they are serialised
+ * against guest writes like any other copy-on-read request.
+ *
+ * The coroutine never sleeps: when the bandwidth cap is reached it simply
+ * stops, and the next sequential guest read restarts it.  This way it always
+ * has I/O in flight while it exists and bdrv_drain_all() waits for it.
+ */
+static void coroutine_fn bdrv_cor_prefetch_entry(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BdrvCorPrefetch *p = &bs->cor_prefetch;
+    QEMUIOVector qiov;
+    struct iovec iov;
+    void *buf;
+    int ret = 0;
+
+    buf = qemu_blockalign(bs, BDRV_COR_PREFETCH_CHUNK * BDRV_SECTOR_SIZE);
+
+    while (p->pos < p->target && bs->copy_on_read && bs->backing_hd) {
+        /* A new stream may start while this chunk is in flight */
+        uint64_t stream = p->stream;
+        int64_t pos = p->pos;
+        int n = MIN(p->target - pos, BDRV_COR_PREFETCH_CHUNK);
+
+        ret = bdrv_co_is_allocated(bs, pos, n, &n);
+        if (ret == 0) {
+            /* Skip what the backing chain does not have either */
+            ret = bdrv_co_is_allocated_above(bs->backing_hd, NULL, pos, n,
+                                             &n);
+        } else if (ret > 0) {
+            /* Already populated by the guest or by the streaming job */
+            ret = 0;
+            goto next;
+        }
+        if (ret < 0) {
+            goto next;
+        } else if (n == 0) {
+            break;
+        }
+
+        if (ret == 1) {
+            if (bdrv_cor_prefetch_throttled(p, n)) {
+                break;
+            }
+
+            trace_bdrv_cor_prefetch(bs, pos, n);
+            iov.iov_base = buf;
+            iov.iov_len = n * BDRV_SECTOR_SIZE;
+            qemu_iovec_init_external(&qiov, &iov, 1);
+            ret = bdrv_co_copy_on_readv(bs, pos, n, &qiov);
+        }
+next:
+        if (p->stream != stream) {
+            /* Continue with the new stream, the old one is forgotten */
+            ret = 0;
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+        p->pos = pos + n;
+    }
+
+    if (ret < 0) {
+        /* Give up on this stream, the guest will see the error itself */
+        p->seq_reads = 0;
+        p->target = p->pos;
+    }
+
+    qemu_vfree(buf);
+    p->co = NULL;
+}
+
+/* Called after each guest read while copy-on-read is enabled */
+static void bdrv_cor_prefetch_update(BlockDriverState *bs,
+                                     int64_t sector_num, int nb_sectors)
+{
+    BdrvCorPrefetch *p = &bs->cor_prefetch;
+    int64_t end = sector_num + nb_sectors;
+
+    if (!p->window || !bs->backing_hd) {
+        return;
+    }
+
+    if (sector_num == p->next_sector) {
+        p->seq_reads++;
+    } else {
+        /* New stream, forget about the old one */
+        p->stream++;
+        p->seq_reads = 0;
+        p->pos = end;
+        p->target = end;
+    }
+    p->next_sector = end;
+
+    if (p->seq_reads < BDRV_COR_PREFETCH_SEQ_READS) {
+        return;
+    }
+
+    p->pos = MAX(p->pos, end);
+    p->target = MAX(p->target, MIN(end + p->window, bs->total_sectors));
+
+    if (!p->co && p->pos < p->target) {
+        p->co = qemu_coroutine_create(bdrv_cor_prefetch_entry);
+        qemu_coroutine_enter(p->co, bs);
+    }
+}
+
 /*
  * Handle a read request in coroutine context
  */
@@ -1882,6 +2110,7 @@ static int coroutine_fn bdrv_co_do_readv(BlockDriverState *bs,
 {
     BlockDriver *drv = bs->drv;
     BdrvTrackedRequest req;
+    bool guest_cor;
     int ret;
 
     if (!drv) {
@@ -1896,6 +2125,10 @@ static int coroutine_fn bdrv_co_do_readv(BlockDriverState *bs,
         bdrv_io_limits_intercept(bs, false, nb_sectors);
     }
 
+    /* Only guest reads feed the prefetcher, not explicit copy-on-read
+     * requests from the prefetcher itself or from the streaming job */
+    guest_cor = bs->copy_on_read && !(flags & BDRV_REQ_COPY_ON_READ);
+
     if (bs->copy_on_read) {
         flags |= BDRV_REQ_COPY_ON_READ;
     }
@@ -1917,9 +2150,13 @@ static int coroutine_fn bdrv_co_do_readv(BlockDriverState *bs,
             goto out;
         }
 
-        if (!ret || pnum != nb_sectors) {
+        if (!ret) {
             ret = bdrv_co_do_copy_on_readv(bs, sector_num, nb_sectors, qiov);
             goto out;
+        } else if (pnum != nb_sectors) {
+            ret = bdrv_co_do_copy_on_readv_holes(bs, sector_num, nb_sectors,
+                                                 qiov);
+            goto out;
         }
     }
 
@@ -1932,6 +2169,10 @@ out:
         bs->copy_on_read_in_flight--;
     }
 
+    if (guest_cor && ret >= 0) {
+        bdrv_cor_prefetch_update(bs, sector_num, nb_sectors);
+    }
+
     return ret;
 }
 
@@ -2020,6 +2261,7 @@ static int coroutine_fn bdrv_co_do_writev(BlockDriverState *bs,
     } else {
         ret = drv->bdrv_co_writev(bs, sector_num, nb_sectors, qiov);
     }
+    bdrv_alloc_map_invalidate(bs, sector_num, nb_sectors);
 
     if (ret == 0 && !bs->enable_write_cache) {
         ret = bdrv_co_flush(bs);
@@ -2071,6 +2313,7 @@ int bdrv_truncate(BlockDriverState *bs, int64_t offset)
     if (bdrv_in_use(bs))
         return -EBUSY;
     ret = drv->bdrv_truncate(bs, offset);
+    bdrv_alloc_map_invalidate(bs, 0, -1);
     if (ret == 0) {
         ret = refresh_total_sectors(bs, offset >> BDRV_SECTOR_BITS);
         bdrv_dev_resize_cb(bs);
@@ -2365,6 +2608,397 @@ int bdrv_is_allocated(BlockDriverState *bs, int64_t sector_num, int nb_sectors,
     return data.ret;
 }
 
+/*
+ * Returns the allocation status of the specified sectors as a combination of
+ * BDRV_BLOCK_* flags, or a negative errno value.
+ *
+ * If BDRV_BLOCK_OFFSET_VALID is set, the bits covered by
+ * BDRV_BLOCK_OFFSET_MASK hold the offset in bs->file where the data of
+ * 'sector_num' is stored (for protocols, in the protocol itself).
+ *
+ * If neither BDRV_BLOCK_DATA nor BDRV_BLOCK_ZERO is set, the sectors are not
+ * allocated in bs and read from its backing file.
+ *
+ * 'pnum' and 'nb_sectors' work like for bdrv_co_is_allocated().
+ */
+int64_t coroutine_fn bdrv_co_get_block_status(BlockDriverState *bs,
+                                              int64_t sector_num,
+                                              int nb_sectors, int *pnum)
+{
+    int64_t n, ret;
+
+    if (sector_num >= bs->total_sectors) {
+        *pnum = 0;
+        return 0;
+    }
+
+    n = bs->total_sectors - sector_num;
+    if (n < nb_sectors) {
+        nb_sectors = n;
+    }
+
+    if (bs->drv->bdrv_co_get_block_status) {
+        ret = bs->drv->bdrv_co_get_block_status(bs, sector_num, nb_sectors,
+                                                pnum);
+    } else {
+        ret = bdrv_co_is_allocated(bs, sector_num, nb_sectors, pnum);
+        if (ret > 0) {
+            ret = BDRV_BLOCK_DATA;
+            if (bs->drv->protocol_name) {
+                ret |= BDRV_BLOCK_OFFSET_VALID |
+                       (sector_num << BDRV_SECTOR_BITS);
+            }
+        }
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (ret & BDRV_BLOCK_RAW) {
+        assert(ret & BDRV_BLOCK_OFFSET_VALID);
+        return bdrv_co_get_block_status(bs->file,
+                                        ret >> BDRV_SECTOR_BITS,
+                                        *pnum, pnum);
+    }
+
+    if (!(ret & (BDRV_BLOCK_DATA | BDRV_BLOCK_ZERO)) &&
+        !bs->backing_hd && bdrv_has_zero_init(bs)) {
+        /* Unallocated sectors without a backing file read as zeroes */
+        ret |= BDRV_BLOCK_ZERO;
+    }
+
+    return ret;
+}
+
+typedef struct BdrvCoGetBlockStatusData {
+    BlockDriverState *bs;
+    int64_t sector_num;
+    int nb_sectors;
+    int *pnum;
+    int64_t ret;
+    bool done;
+} BdrvCoGetBlockStatusData;
+
+/* Coroutine wrapper for bdrv_get_block_status() */
+static void coroutine_fn bdrv_get_block_status_co_entry(void *opaque)
+{
+    BdrvCoGetBlockStatusData *data = opaque;
+
+    data->ret = bdrv_co_get_block_status(data->bs, data->sector_num,
+                                         data->nb_sectors, data->pnum);
+    data->done = true;
+}
+
+/*
+ * Synchronous wrapper around bdrv_co_get_block_status().
+ *
+ * See bdrv_co_get_block_status() for details.
+ */
+int64_t bdrv_get_block_status(BlockDriverState *bs, int64_t sector_num,
+                              int nb_sectors, int *pnum)
+{
+    Coroutine *co;
+    BdrvCoGetBlockStatusData data = {
+        .bs = bs,
+        .sector_num = sector_num,
+        .nb_sectors = nb_sectors,
+        .pnum = pnum,
+        .done = false,
+    };
+
+    co = qemu_coroutine_create(bdrv_get_block_status_co_entry);
+    qemu_coroutine_enter(co, &data);
+    while (!data.done) {
+        qemu_aio_wait();
+    }
+    return data.ret;
+}
+
+/*
+ * Allocation map cache for backing chains
+ *
+ * Finding the image that holds the data for a sector means asking each layer
+ * of the chain in turn, which gets expensive for long chains.  The results
+ * are cached per top image as extents of sectors that share the same owning
+ * layer.  An extent is "exact" if the owner is known (or the range is
+ * unallocated in the whole chain), otherwise it only records that the layers
+ * above 'depth' are unallocated because the lookup stopped at a base image.
+ *
+ * Writes to the top image drop the overlapping extents.  Changes to any of
+ * the lower layers, or to the shape of the chain, are detected through the
+ * per-image allocation generation and flush the whole map.
+ */
+
+#define BDRV_ALLOC_MAP_MAX_EXTENTS   4096
+#define BDRV_ALLOC_MAP_QUERY_SECTORS 2048
+
+typedef struct BdrvAllocExtent {
+    int64_t start;
+    int64_t end;
+    int depth;
+    bool exact;
+} BdrvAllocExtent;
+
+struct BdrvAllocMap {
+    GTree *extents;
+    int nb_extents;
+
+    /* Snapshot of the chain below the top image when the map was filled */
+    int nb_layers;
+    BlockDriverState **layers;
+    uint64_t *gens;
+
+    /* Incremented whenever extents are dropped, see bdrv_co_find_owner() */
+    uint64_t epoch;
+
+    /* Allocation granularity of the top image in sectors, 0 if unknown */
+    int64_t granularity;
+};
+
+static uint64_t bdrv_alloc_gen_counter;
+
+/* Overlapping extents compare equal, so lookups can use any sub-range */
+static gint bdrv_alloc_extent_cmp(gconstpointer a, gconstpointer b)
+{
+    const BdrvAllocExtent *e1 = a, *e2 = b;
+
+    if (e1->end <= e2->start) {
+        return -1;
+    } else if (e1->start >= e2->end) {
+        return 1;
+    }
+    return 0;
+}
+
+static void bdrv_alloc_map_fill_layers(BlockDriverState *top,
+                                       BdrvAllocMap *map)
+{
+    BlockDriverState *bs;
+    int i;
+
+    map->nb_layers = 0;
+    for (bs = top; bs; bs = bs->backing_hd) {
+        map->nb_layers++;
+    }
+
+    map->layers = g_renew(BlockDriverState *, map->layers, map->nb_layers);
+    map->gens = g_renew(uint64_t, map->gens, map->nb_layers);
+    for (i = 0, bs = top; bs; bs = bs->backing_hd, i++) {
+        map->layers[i] = bs;
+        map->gens[i] = bs->alloc_gen;
+    }
+}
+
+static void bdrv_alloc_map_clear(BdrvAllocMap *map)
+{
+    g_tree_destroy(map->extents);
+    map->extents = g_tree_new_full((GCompareDataFunc)bdrv_alloc_extent_cmp,
+                                   NULL, g_free, NULL);
+    map->nb_extents = 0;
+    map->epoch++;
+}
+
+/*
+ * Check that the chain below the top image is still the one the map was
+ * filled for.  The generation of the top image itself is not checked because
+ * writes to it invalidate the affected extents directly.
+ */
+static bool bdrv_alloc_map_valid(BlockDriverState *top, BdrvAllocMap *map)
+{
+    BlockDriverState *bs;
+    int i;
+
+    for (i = 1, bs = top->backing_hd; bs; bs = bs->backing_hd, i++) {
+        if (i >= map->nb_layers || map->layers[i] != bs ||
+            map->gens[i] != bs->alloc_gen) {
+            return false;
+        }
+    }
+    return i == map->nb_layers;
+}
+
+static BdrvAllocMap *bdrv_alloc_map_get(BlockDriverState *top)
+{
+    BdrvAllocMap *map = top->alloc_map;
+    BlockDriverInfo bdi;
+
+    if (!map) {
+        map = g_malloc0(sizeof(*map));
+        map->extents = g_tree_new_full(
+            (GCompareDataFunc)bdrv_alloc_extent_cmp, NULL, g_free, NULL);
+        if (bdrv_get_info(top, &bdi) == 0 && bdi.cluster_size > 0) {
+            map->granularity = bdi.cluster_size >> BDRV_SECTOR_BITS;
+        }
+        bdrv_alloc_map_fill_layers(top, map);
+        top->alloc_map = map;
+    } else if (!bdrv_alloc_map_valid(top, map)) {
+        bdrv_alloc_map_clear(map);
+        bdrv_alloc_map_fill_layers(top, map);
+    }
+
+    return map;
+}
+
+static void bdrv_alloc_map_insert(BdrvAllocMap *map, int64_t start,
+                                  int64_t end, int depth, bool exact)
+{
+    BdrvAllocExtent *e = g_malloc(sizeof(*e));
+    BdrvAllocExtent *old;
+
+    *e = (BdrvAllocExtent) {
+        .start  = start,
+        .end    = end,
+        .depth  = depth,
+        .exact  = exact,
+    };
+
+    while ((old = g_tree_lookup(map->extents, e)) != NULL) {
+        g_tree_remove(map->extents, old);
+        map->nb_extents--;
+    }
+
+    if (map->nb_extents >= BDRV_ALLOC_MAP_MAX_EXTENTS) {
+        bdrv_alloc_map_clear(map);
+    }
+
+    g_tree_insert(map->extents, e, e);
+    map->nb_extents++;
+}
+
+/*
+ * Called whenever the allocation status of @bs may have changed in the given
+ * range.  A negative @nb_sectors means that the whole image is affected.
+ */
+static void bdrv_alloc_map_invalidate(BlockDriverState *bs, int64_t sector_num,
+                                      int nb_sectors)
+{
+    BdrvAllocMap *map = bs->alloc_map;
+    BdrvAllocExtent key, *old;
+
+    bs->alloc_gen = ++bdrv_alloc_gen_counter;
+    if (!map) {
+        return;
+    }
+
+    if (nb_sectors < 0 || !map->granularity) {
+        bdrv_alloc_map_clear(map);
+        return;
+    }
+
+    key.start = sector_num - sector_num % map->granularity;
+    key.end = sector_num + nb_sectors + map->granularity - 1;
+    key.end -= key.end % map->granularity;
+    if (key.end <= key.start) {
+        key.end = key.start + map->granularity;
+    }
+
+    while ((old = g_tree_lookup(map->extents, &key)) != NULL) {
+        g_tree_remove(map->extents, old);
+        map->nb_extents--;
+    }
+    map->epoch++;
+}
+
+static void bdrv_alloc_map_free(BlockDriverState *bs)
+{
+    BdrvAllocMap *map = bs->alloc_map;
+
+    if (map) {
+        g_tree_destroy(map->extents);
+        g_free(map->layers);
+        g_free(map->gens);
+        g_free(map);
+        bs->alloc_map = NULL;
+    }
+}
+
+/*
+ * Find the image in the chain between @top (inclusive) and @base (exclusive)
+ * that holds the data for @sector_num.
+ *
+ * Return 1 and set @owner if such an image exists, 0 if the sector is not
+ * allocated above @base, or -errno.  'pnum' is set to the number of sectors
+ * (including and immediately following the specified sector) that are known
+ * to have the same owner.
+ */
+static int coroutine_fn bdrv_co_find_owner(BlockDriverState *top,
+                                           BlockDriverState *base,
+                                           int64_t sector_num, int nb_sectors,
+                                           int *pnum,
+                                           BlockDriverState **owner)
+{
+    BdrvAllocMap *map;
+    BdrvAllocExtent key, *e;
+    BlockDriverState *bs;
+    uint64_t epoch;
+    int base_depth, depth, query, ret, n, pnum_inter = 0;
+
+    map = bdrv_alloc_map_get(top);
+    for (base_depth = 0; base_depth < map->nb_layers; base_depth++) {
+        if (map->layers[base_depth] == base) {
+            break;
+        }
+    }
+
+    key.start = sector_num;
+    key.end = sector_num + 1;
+    e = g_tree_lookup(map->extents, &key);
+    if (e && e->depth <= map->nb_layers &&
+        (e->exact || e->depth >= base_depth)) {
+        trace_bdrv_co_find_owner(top, sector_num, nb_sectors, e->depth, true);
+        *pnum = MIN(e->end - sector_num, nb_sectors);
+        if (e->exact && e->depth < base_depth) {
+            *owner = map->layers[e->depth];
+            return 1;
+        }
+        *owner = NULL;
+        return 0;
+    }
+
+    /* Ask for more than needed so that sequential lookups hit the cache */
+    epoch = map->epoch;
+    query = MAX(nb_sectors, BDRV_ALLOC_MAP_QUERY_SECTORS);
+    n = query;
+    ret = 0;
+    for (bs = top, depth = 0; bs && bs != base; bs = bs->backing_hd, depth++) {
+        ret = bdrv_co_is_allocated(bs, sector_num, query, &pnum_inter);
+        if (ret < 0) {
+            return ret;
+        } else if (ret) {
+            break;
+        }
+
+        /*
+         * [sector_num, nb_sectors] is unallocated on top but intermediate
+         * might have
+         *
+         * [sector_num+x, nr_sectors] allocated.
+         */
+        n = MIN(n, pnum_inter);
+    }
+    trace_bdrv_co_find_owner(top, sector_num, nb_sectors, depth, false);
+
+    if (ret) {
+        *owner = bs;
+        if (n == 0) {
+            /* Some layer above ends before sector_num, don't cache this */
+            *pnum = MIN(pnum_inter, nb_sectors);
+            return 1;
+        }
+        n = MIN(n, pnum_inter);
+    } else {
+        *owner = NULL;
+    }
+
+    if (n > 0 && map->epoch == epoch) {
+        bdrv_alloc_map_insert(map, sector_num, sector_num + n, depth,
+                              ret || bs == NULL);
+    }
+
+    *pnum = MIN(n, nb_sectors);
+    return ret;
+}
+
 /*
  * Given an image chain: ... -> [BASE] -> [INTER1] -> [INTER2] -> [TOP]
  *
@@ -2382,36 +3016,112 @@ int coroutine_fn bdrv_co_is_allocated_above(BlockDriverState *top,
                                             int64_t sector_num,
                                             int nb_sectors, int *pnum)
 {
-    BlockDriverState *intermediate;
-    int ret, n = nb_sectors;
+    BlockDriverState *owner;
+
+    return bdrv_co_find_owner(top, base, sector_num, nb_sectors, pnum, &owner);
+}
+
+typedef struct BdrvCoIsAllocatedAboveData {
+    BlockDriverState *top;
+    BlockDriverState *base;
+    int64_t sector_num;
+    int nb_sectors;
+    int *pnum;
+    int ret;
+    bool done;
+} BdrvCoIsAllocatedAboveData;
+
+/* Coroutine wrapper for bdrv_is_allocated_above() */
+static void coroutine_fn bdrv_is_allocated_above_co_entry(void *opaque)
+{
+    BdrvCoIsAllocatedAboveData *data = opaque;
+
+    data->ret = bdrv_co_is_allocated_above(data->top, data->base,
+                                           data->sector_num, data->nb_sectors,
+                                           data->pnum);
+    data->done = true;
+}
+
+/*
+ * Synchronous wrapper around bdrv_co_is_allocated_above().
+ *
+ * See bdrv_co_is_allocated_above() for details.
+ */
+int bdrv_is_allocated_above(BlockDriverState *top, BlockDriverState *base,
+                            int64_t sector_num, int nb_sectors, int *pnum)
+{
+    Coroutine *co;
+    BdrvCoIsAllocatedAboveData data = {
+        .top = top,
+        .base = base,
+        .sector_num = sector_num,
+        .nb_sectors = nb_sectors,
+        .pnum = pnum,
+        .done = false,
+    };
 
-    intermediate = top;
-    while (intermediate && intermediate != base) {
-        int pnum_inter;
-        ret = bdrv_co_is_allocated(intermediate, sector_num, nb_sectors,
-                                   &pnum_inter);
+    co = qemu_coroutine_create(bdrv_is_allocated_above_co_entry);
+    qemu_coroutine_enter(co, &data);
+    while (!data.done) {
+        qemu_aio_wait();
+    }
+    return data.ret;
+}
+
+/*
+ * Read from the image chain starting at @bs.  Instead of going through each
+ * layer, the data is read directly from the image that holds it.  Format
+ * drivers use this to read from their backing file.
+ */
+int coroutine_fn bdrv_co_readv_chain(BlockDriverState *bs, int64_t sector_num,
+                                     int nb_sectors, QEMUIOVector *qiov)
+{
+    BlockDriverState *owner, *bottom;
+    QEMUIOVector hd_qiov;
+    size_t bytes_done = 0;
+    int ret = 0, n;
+
+    /*
+     * Layers that are shorter than the image above them read as zeroes past
+     * their end; leave this case to the format drivers.
+     */
+    for (bottom = bs; ; bottom = bottom->backing_hd) {
+        if (sector_num + nb_sectors > bottom->total_sectors) {
+            return bdrv_co_readv(bs, sector_num, nb_sectors, qiov);
+        }
+        if (!bottom->backing_hd) {
+            break;
+        }
+    }
+
+    qemu_iovec_init(&hd_qiov, qiov->niov);
+
+    while (nb_sectors > 0) {
+        ret = bdrv_co_find_owner(bs, NULL, sector_num, nb_sectors, &n, &owner);
         if (ret < 0) {
-            return ret;
-        } else if (ret) {
-            *pnum = pnum_inter;
-            return 1;
+            break;
         }
+        assert(n > 0);
 
-        /*
-         * [sector_num, nb_sectors] is unallocated on top but intermediate
-         * might have
-         *
-         * [sector_num+x, nr_sectors] allocated.
-         */
-        if (n > pnum_inter) {
-            n = pnum_inter;
+        /* Unallocated everywhere, the bottom image decides what to read */
+        if (!owner) {
+            owner = bottom;
         }
 
-        intermediate = intermediate->backing_hd;
+        qemu_iovec_reset(&hd_qiov);
+        qemu_iovec_concat(&hd_qiov, qiov, bytes_done, n * BDRV_SECTOR_SIZE);
+        ret = bdrv_co_readv(owner, sector_num, n, &hd_qiov);
+        if (ret < 0) {
+            break;
+        }
+
+        sector_num += n;
+        nb_sectors -= n;
+        bytes_done += n * BDRV_SECTOR_SIZE;
     }
 
-    *pnum = n;
-    return 0;
+    qemu_iovec_destroy(&hd_qiov);
+    return ret < 0 ? ret : 0;
 }
 
 BlockInfoList *qmp_query_block(Error **errp)
@@ -2554,6 +3264,8 @@ int bdrv_write_compressed(BlockDriverState *bs, int64_t sector_num,
                           const uint8_t *buf, int nb_sectors)
 {
     BlockDriver *drv = bs->drv;
+    int ret;
+
     if (!drv)
         return -ENOMEDIUM;
     if (!drv->bdrv_write_compressed)
@@ -2565,7 +3277,9 @@ int bdrv_write_compressed(BlockDriverState *bs, int64_t sector_num,
         set_dirty_bitmap(bs, sector_num, nb_sectors, 1);
     }
 
-    return drv->bdrv_write_compressed(bs, sector_num, buf, nb_sectors);
+    ret = drv->bdrv_write_compressed(bs, sector_num, buf, nb_sectors);
+    bdrv_alloc_map_invalidate(bs, sector_num, nb_sectors);
+    return ret;
 }
 
 int bdrv_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
@@ -2681,8 +3395,14 @@ int bdrv_snapshot_goto(BlockDriverState *bs,
 
     if (!drv)
         return -ENOMEDIUM;
-    if (drv->bdrv_snapshot_goto)
-        return drv->bdrv_snapshot_goto(bs, snapshot_id);
+    if (drv->bdrv_snapshot_goto) {
+        ret = drv->bdrv_snapshot_goto(bs, snapshot_id);
+        if (ret == 0) {
+            /* The whole image changed, not just the extents it wrote */
+            bdrv_alloc_map_invalidate(bs, 0, -1);
+        }
+        return ret;
+    }
 
     if (bs->file) {
         drv->bdrv_close(bs);
@@ -2693,6 +3413,9 @@ int bdrv_snapshot_goto(BlockDriverState *bs,
             bs->drv = NULL;
             return open_ret;
         }
+        if (ret == 0) {
+            bdrv_alloc_map_invalidate(bs, 0, -1);
+        }
         return ret;
     }
 
@@ -3634,6 +4357,8 @@ static void coroutine_fn bdrv_discard_co_entry(void *opaque)
 int coroutine_fn bdrv_co_discard(BlockDriverState *bs, int64_t sector_num,
                                  int nb_sectors)
 {
+    int ret;
+
     if (!bs->drv) {
         return -ENOMEDIUM;
     } else if (bdrv_check_request(bs, sector_num, nb_sectors)) {
@@ -3641,7 +4366,9 @@ int coroutine_fn bdrv_co_discard(BlockDriverState *bs, int64_t sector_num,
     } else if (bs->read_only) {
         return -EROFS;
     } else if (bs->drv->bdrv_co_discard) {
-        return bs->drv->bdrv_co_discard(bs, sector_num, nb_sectors);
+        ret = bs->drv->bdrv_co_discard(bs, sector_num, nb_sectors);
+        bdrv_alloc_map_invalidate(bs, sector_num, nb_sectors);
+        return ret;
     } else if (bs->drv->bdrv_aio_discard) {
         BlockDriverAIOCB *acb;
         CoroutineIOCompletion co = {
@@ -3654,6 +4381,7 @@ int coroutine_fn bdrv_co_discard(BlockDriverState *bs, int64_t sector_num,
             return -EIO;
         } else {
             qemu_coroutine_yield();
+            bdrv_alloc_map_invalidate(bs, sector_num, nb_sectors);
             return co.ret;
         }
     } else {
@@ -0,0 +1,327 @@
+/*
+ * Null block driver
+ *
+ * Requests complete immediately without touching any storage, which makes
+ * this protocol useful for measuring the overhead of the block layer itself.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu-common.h"
+#include "qemu-timer.h"
+#include "block_int.h"
+#include "module.h"
+
+#define NULL_OPT_SIZE           "size"
+#define NULL_OPT_LATENCY        "latency-ns"
+#define NULL_OPT_ZEROES         "read-zeroes"
+
+#define NULL_DEFAULT_SIZE       (1ULL << 30)
+
+typedef struct BDRVNullState {
+    int64_t length;
+    int64_t latency_ns;
+    bool read_zeroes;
+} BDRVNullState;
+
+/*
+ * Completes a request once the emulated latency has passed.  The main loop
+ * runs an rt_clock timer for it.  Synchronous requests are completed from
+ * qemu_aio_wait(), which does not run timers, so an idle bottom half checks
+ * the deadline as a fallback: it spins while a synchronous request waits,
+ * but the main loop only polls it every 10ms.
+ */
+typedef struct NullDelay {
+    QEMUTimer *timer;
+    QEMUBH *bh;
+    int64_t deadline;
+    void (*cb)(void *opaque);
+    void *opaque;
+} NullDelay;
+
+typedef struct NullAIOCB {
+    BlockDriverAIOCB common;
+    QEMUBH *bh;         /* without latency */
+    NullDelay delay;    /* with latency */
+} NullAIOCB;
+
+static QemuOptsList null_runtime_opts = {
+    .name = "null",
+    .head = QTAILQ_HEAD_INITIALIZER(null_runtime_opts.head),
+    .desc = {
+        {
+            .name = NULL_OPT_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "size of the null block device",
+        },
+        {
+            .name = NULL_OPT_LATENCY,
+            .type = QEMU_OPT_NUMBER,
+            .help = "nanoseconds to delay the completion of each request "
+                    "(synchronous requests busy-wait for it)",
+        },
+        {
+            .name = NULL_OPT_ZEROES,
+            .type = QEMU_OPT_BOOL,
+            .help = "return zeroes instead of leaving read buffers untouched",
+        },
+        { /* end of list */ }
+    },
+};
+
+/*
+ * Valid filenames look like null-co://[size=N][,latency-ns=N][,read-zeroes=on]
+ * (and the same for null-aio://).
+ */
+static int null_open_common(BlockDriverState *bs, const char *protocol,
+                            const char *filename)
+{
+    BDRVNullState *s = bs->opaque;
+    QemuOpts *opts;
+
+    if (!strstart(filename, protocol, &filename) ||
+        !strstart(filename, "://", &filename)) {
+        return -EINVAL;
+    }
+
+    opts = qemu_opts_parse(&null_runtime_opts, filename, 0);
+    if (opts == NULL) {
+        return -EINVAL;
+    }
+
+    s->length = qemu_opt_get_size(opts, NULL_OPT_SIZE, NULL_DEFAULT_SIZE);
+    s->latency_ns = qemu_opt_get_number(opts, NULL_OPT_LATENCY, 0);
+    s->read_zeroes = qemu_opt_get_bool(opts, NULL_OPT_ZEROES, false);
+    qemu_opts_del(opts);
+
+    if (s->length & (BDRV_SECTOR_SIZE - 1)) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int null_co_file_open(BlockDriverState *bs, const char *filename,
+                             int flags)
+{
+    return null_open_common(bs, "null-co", filename);
+}
+
+static int null_aio_file_open(BlockDriverState *bs, const char *filename,
+                              int flags)
+{
+    return null_open_common(bs, "null-aio", filename);
+}
+
+static void null_close(BlockDriverState *bs)
+{
+}
+
+static int64_t null_getlength(BlockDriverState *bs)
+{
+    BDRVNullState *s = bs->opaque;
+    return s->length;
+}
+
+static void null_delay_cancel(NullDelay *d)
+{
+    qemu_del_timer(d->timer);
+    qemu_free_timer(d->timer);
+    qemu_bh_delete(d->bh);
+}
+
+static void null_delay_done(NullDelay *d)
+{
+    null_delay_cancel(d);
+    d->cb(d->opaque);
+}
+
+static void null_delay_timer(void *opaque)
+{
+    null_delay_done(opaque);
+}
+
+static void null_delay_bh(void *opaque)
+{
+    NullDelay *d = opaque;
+
+    if (qemu_get_clock_ns(rt_clock) < d->deadline) {
+        qemu_bh_schedule_idle(d->bh);
+        return;
+    }
+    null_delay_done(d);
+}
+
+static void null_delay_start(NullDelay *d, int64_t latency_ns,
+                             void (*cb)(void *opaque), void *opaque)
+{
+    d->deadline = qemu_get_clock_ns(rt_clock) + latency_ns;
+    d->cb = cb;
+    d->opaque = opaque;
+    d->timer = qemu_new_timer_ns(rt_clock, null_delay_timer, d);
+    d->bh = qemu_bh_new(null_delay_bh, d);
+    qemu_mod_timer(d->timer, d->deadline);
+    qemu_bh_schedule_idle(d->bh);
+}
+
+static void null_co_delay_done(void *opaque)
+{
+    qemu_coroutine_enter(opaque, NULL);
+}
+
+static void coroutine_fn null_co_delay(BlockDriverState *bs)
+{
+    BDRVNullState *s = bs->opaque;
+    NullDelay d;
+
+    if (!s->latency_ns) {
+        return;
+    }
+
+    null_delay_start(&d, s->latency_ns, null_co_delay_done,
+                     qemu_coroutine_self());
+    qemu_coroutine_yield();
+}
+
+static coroutine_fn int null_co_readv(BlockDriverState *bs,
+                                      int64_t sector_num, int nb_sectors,
+                                      QEMUIOVector *qiov)
+{
+    BDRVNullState *s = bs->opaque;
+
+    if (s->read_zeroes) {
+        qemu_iovec_memset(qiov, 0, 0, nb_sectors * BDRV_SECTOR_SIZE);
+    }
+
+    null_co_delay(bs);
+    return 0;
+}
+
+static coroutine_fn int null_co_writev(BlockDriverState *bs,
+                                       int64_t sector_num, int nb_sectors,
+                                       QEMUIOVector *qiov)
+{
+    null_co_delay(bs);
+    return 0;
+}
+
+static coroutine_fn int null_co_flush(BlockDriverState *bs)
+{
+    null_co_delay(bs);
+    return 0;
+}
+
+static void null_aio_cancel(BlockDriverAIOCB *blockacb)
+{
+    NullAIOCB *acb = container_of(blockacb, NullAIOCB, common);
+
+    if (acb->bh) {
+        qemu_bh_delete(acb->bh);
+    } else {
+        null_delay_cancel(&acb->delay);
+    }
+    qemu_aio_release(acb);
+}
+
+static AIOPool null_aio_pool = {
+    .aiocb_size         = sizeof(NullAIOCB),
+    .cancel             = null_aio_cancel,
+};
+
+static void null_aio_complete(void *opaque)
+{
+    NullAIOCB *acb = opaque;
+
+    acb->common.cb(acb->common.opaque, 0);
+    qemu_aio_release(acb);
+}
+
+static void null_aio_bh(void *opaque)
+{
+    NullAIOCB *acb = opaque;
+
+    qemu_bh_delete(acb->bh);
+    null_aio_complete(acb);
+}
+
+static BlockDriverAIOCB *null_aio_common(BlockDriverState *bs,
+                                         BlockDriverCompletionFunc *cb,
+                                         void *opaque)
+{
+    BDRVNullState *s = bs->opaque;
+    NullAIOCB *acb;
+
+    acb = qemu_aio_get(&null_aio_pool, bs, cb, opaque);
+    if (s->latency_ns) {
+        acb->bh = NULL;
+        null_delay_start(&acb->delay, s->latency_ns, null_aio_complete, acb);
+    } else {
+        acb->bh = qemu_bh_new(null_aio_bh, acb);
+        qemu_bh_schedule(acb->bh);
+    }
+
+    return &acb->common;
+}
+
+static BlockDriverAIOCB *null_aio_readv(BlockDriverState *bs,
+    int64_t sector_num, QEMUIOVector *qiov, int nb_sectors,
+    BlockDriverCompletionFunc *cb, void *opaque)
+{
+    BDRVNullState *s = bs->opaque;
+
+    if (s->read_zeroes) {
+        qemu_iovec_memset(qiov, 0, 0, nb_sectors * BDRV_SECTOR_SIZE);
+    }
+
+    return null_aio_common(bs, cb, opaque);
+}
+
+static BlockDriverAIOCB *null_aio_writev(BlockDriverState *bs,
+    int64_t sector_num, QEMUIOVector *qiov, int nb_sectors,
+    BlockDriverCompletionFunc *cb, void *opaque)
+{
+    return null_aio_common(bs, cb, opaque);
+}
+
+static BlockDriverAIOCB *null_aio_flush(BlockDriverState *bs,
+    BlockDriverCompletionFunc *cb, void *opaque)
+{
+    return null_aio_common(bs, cb, opaque);
+}
+
+static BlockDriver bdrv_null_co = {
+    .format_name            = "null-co",
+    .protocol_name          = "null-co",
+    .instance_size          = sizeof(BDRVNullState),
+
+    .bdrv_file_open         = null_co_file_open,
+    .bdrv_close             = null_close,
+    .bdrv_getlength         = null_getlength,
+
+    .bdrv_co_readv          = null_co_readv,
+    .bdrv_co_writev         = null_co_writev,
+    .bdrv_co_flush_to_disk  = null_co_flush,
+};
+
+static BlockDriver bdrv_null_aio = {
+    .format_name            = "null-aio",
+    .protocol_name          = "null-aio",
+    .instance_size          = sizeof(BDRVNullState),
+
+    .bdrv_file_open         = null_aio_file_open,
+    .bdrv_close             = null_close,
+    .bdrv_getlength         = null_getlength,
+
+    .bdrv_aio_readv         = null_aio_readv,
+    .bdrv_aio_writev        = null_aio_writev,
+    .bdrv_aio_flush         = null_aio_flush,
+};
+
+static void bdrv_null_init(void)
+{
+    bdrv_register(&bdrv_null_co);
+    bdrv_register(&bdrv_null_aio);
+}
+
+block_init(bdrv_null_init);
@@ -28,6 +28,7 @@
 #include "block_int.h"
 #include "block/qcow2.h"
 #include "trace.h"
+#include "thread-pool.h"
 
 int qcow2_grow_l1_table(BlockDriverState *bs, int min_size, bool exact_size)
 {
@@ -1021,28 +1022,192 @@ static int decompress_buffer(uint8_t *out_buf, int out_buf_size,
     return 0;
 }
 
-int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t cluster_offset)
+typedef struct Qcow2DecompressJob {
+    uint8_t *out_buf;
+    int out_buf_size;
+    const uint8_t *buf;
+    int buf_size;
+} Qcow2DecompressJob;
+
+static int qcow2_decompress_worker(void *opaque)
+{
+    Qcow2DecompressJob *job = opaque;
+
+    if (decompress_buffer(job->out_buf, job->out_buf_size,
+                          job->buf, job->buf_size) < 0) {
+        return -EIO;
+    }
+    return 0;
+}
+
+void qcow2_decompressed_cache_init(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < DECOMPRESSED_CACHE_SIZE; i++) {
+        s->decompressed_cache[i].offset = -1;
+        s->decompressed_cache[i].lru_stamp = 0;
+        s->decompressed_cache[i].data = NULL;
+    }
+    s->decompressed_cache_lru = 0;
+    s->decompressed_cache_gen = 0;
+    QLIST_INIT(&s->compressed_reads);
+}
+
+void qcow2_decompressed_cache_destroy(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < DECOMPRESSED_CACHE_SIZE; i++) {
+        qemu_vfree(s->decompressed_cache[i].data);
+        s->decompressed_cache[i].data = NULL;
+        s->decompressed_cache[i].offset = -1;
+    }
+}
+
+/*
+ * Must be called whenever a host cluster may be reused for different data,
+ * because cached entries are looked up by the offset of the compressed data.
+ * Decompressions that are in flight at this point are not added to the cache.
+ */
+void qcow2_decompressed_cache_invalidate(BlockDriverState *bs)
+{
+    BDRVQcowState *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < DECOMPRESSED_CACHE_SIZE; i++) {
+        s->decompressed_cache[i].offset = -1;
+    }
+    s->decompressed_cache_gen++;
+}
+
+static Qcow2DecompressedCluster *decompressed_cache_find(BDRVQcowState *s,
+                                                         uint64_t coffset)
+{
+    int i;
+
+    for (i = 0; i < DECOMPRESSED_CACHE_SIZE; i++) {
+        if (s->decompressed_cache[i].offset == coffset) {
+            s->decompressed_cache[i].lru_stamp = ++s->decompressed_cache_lru;
+            return &s->decompressed_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static Qcow2DecompressedCluster *decompressed_cache_victim(BDRVQcowState *s)
+{
+    Qcow2DecompressedCluster *victim = &s->decompressed_cache[0];
+    int i;
+
+    for (i = 1; i < DECOMPRESSED_CACHE_SIZE; i++) {
+        if (s->decompressed_cache[i].lru_stamp < victim->lru_stamp) {
+            victim = &s->decompressed_cache[i];
+        }
+    }
+    return victim;
+}
+
+/*
+ * Reads nb_sectors starting at index_in_cluster from the compressed cluster
+ * described by the L2 entry cluster_offset into qiov.
+ *
+ * Must be called with s->lock held.  The lock is dropped while the
+ * compressed data is read and inflated in the thread pool, so several
+ * compressed clusters can be decompressed in parallel.
+ */
+int coroutine_fn qcow2_co_read_compressed(BlockDriverState *bs,
+    uint64_t cluster_offset, int index_in_cluster, int nb_sectors,
+    QEMUIOVector *qiov)
 {
     BDRVQcowState *s = bs->opaque;
+    Qcow2DecompressedCluster *entry;
+    Qcow2DecompressJob job;
+    Qcow2CompressedRead req, *other;
+    QEMUIOVector hd_qiov;
+    struct iovec iov;
+    uint64_t coffset, gen;
+    uint8_t *buf, *out_buf;
     int ret, csize, nb_csectors, sector_offset;
-    uint64_t coffset;
 
     coffset = cluster_offset & s->cluster_offset_mask;
-    if (s->cluster_cache_offset != coffset) {
-        nb_csectors = ((cluster_offset >> s->csize_shift) & s->csize_mask) + 1;
-        sector_offset = coffset & 511;
-        csize = nb_csectors * 512 - sector_offset;
-        BLKDBG_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
-        ret = bdrv_read(bs->file, coffset >> 9, s->cluster_data, nb_csectors);
-        if (ret < 0) {
-            return ret;
-        }
-        if (decompress_buffer(s->cluster_cache, s->cluster_size,
-                              s->cluster_data + sector_offset, csize) < 0) {
-            return -EIO;
+again:
+    entry = decompressed_cache_find(s, coffset);
+    if (entry) {
+        qemu_iovec_from_buf(qiov, 0, entry->data + index_in_cluster * 512,
+                            nb_sectors * 512);
+        return 0;
+    }
+
+    /* Sequential readers tend to hit the same cluster at the same time,
+     * decompress it only once */
+    QLIST_FOREACH(other, &s->compressed_reads, next) {
+        if (other->offset == coffset) {
+            qemu_co_mutex_unlock(&s->lock);
+            qemu_co_queue_wait(&other->waiters);
+            qemu_co_mutex_lock(&s->lock);
+            goto again;
         }
-        s->cluster_cache_offset = coffset;
     }
+
+    req.offset = coffset;
+    qemu_co_queue_init(&req.waiters);
+    QLIST_INSERT_HEAD(&s->compressed_reads, &req, next);
+
+    nb_csectors = ((cluster_offset >> s->csize_shift) & s->csize_mask) + 1;
+    sector_offset = coffset & 511;
+    csize = nb_csectors * 512 - sector_offset;
+
+    buf = qemu_blockalign(bs, nb_csectors * 512);
+    out_buf = qemu_blockalign(bs, s->cluster_size);
+    gen = s->decompressed_cache_gen;
+
+    qemu_co_mutex_unlock(&s->lock);
+
+    iov.iov_base = buf;
+    iov.iov_len = nb_csectors * 512;
+    qemu_iovec_init_external(&hd_qiov, &iov, 1);
+
+    BLKDBG_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
+    ret = bdrv_co_readv(bs->file, coffset >> 9, nb_csectors, &hd_qiov);
+    if (ret >= 0) {
+        job = (Qcow2DecompressJob) {
+            .out_buf        = out_buf,
+            .out_buf_size   = s->cluster_size,
+            .buf            = buf + sector_offset,
+            .buf_size       = csize,
+        };
+        ret = thread_pool_submit_co(qcow2_decompress_worker, &job);
+    }
+
+    qemu_co_mutex_lock(&s->lock);
+    qemu_vfree(buf);
+
+    QLIST_REMOVE(&req, next);
+    qemu_co_queue_restart_all(&req.waiters);
+
+    if (ret < 0) {
+        qemu_vfree(out_buf);
+        return ret;
+    }
+
+    qemu_iovec_from_buf(qiov, 0, out_buf + index_in_cluster * 512,
+                        nb_sectors * 512);
+
+    /* Another request may have decompressed the same cluster meanwhile */
+    if (gen == s->decompressed_cache_gen &&
+        !decompressed_cache_find(s, coffset)) {
+        entry = decompressed_cache_victim(s);
+        qemu_vfree(entry->data);
+        entry->data = out_buf;
+        entry->offset = coffset;
+        entry->lru_stamp = ++s->decompressed_cache_lru;
+    } else {
+        qemu_vfree(out_buf);
+    }
+
     return 0;
 }
 
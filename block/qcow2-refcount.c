@@ -475,8 +475,12 @@ static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
             ret = -EINVAL;
             goto fail;
         }
-        if (refcount == 0 && cluster_index < s->free_cluster_index) {
-            s->free_cluster_index = cluster_index;
+        if (refcount == 0) {
+            if (cluster_index < s->free_cluster_index) {
+                s->free_cluster_index = cluster_index;
+            }
+            /* The cluster may be reused, drop any decompressed copy */
+            qcow2_decompressed_cache_invalidate(bs);
         }
         refcount_block[block_index] = cpu_to_be16(refcount);
     }
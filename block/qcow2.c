@@ -30,6 +30,7 @@
 #include "qemu-error.h"
 #include "qerror.h"
 #include "trace.h"
+#include "thread-pool.h"
 
 /*
   Differences with QCOW:
@@ -432,11 +433,7 @@ static int qcow2_open(BlockDriverState *bs, int flags)
     s->l2_table_cache = qcow2_cache_create(bs, L2_CACHE_SIZE);
     s->refcount_block_cache = qcow2_cache_create(bs, REFCOUNT_CACHE_SIZE);
 
-    s->cluster_cache = g_malloc(s->cluster_size);
-    /* one more sector for decompressed data alignment */
-    s->cluster_data = qemu_blockalign(bs, QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size
-                                  + 512);
-    s->cluster_cache_offset = -1;
+    qcow2_decompressed_cache_init(bs);
     s->flags = flags;
 
     ret = qcow2_refcount_init(bs);
@@ -511,8 +508,7 @@ static int qcow2_open(BlockDriverState *bs, int flags)
     if (s->l2_table_cache) {
         qcow2_cache_destroy(bs, s->l2_table_cache);
     }
-    g_free(s->cluster_cache);
-    qemu_vfree(s->cluster_data);
+    qcow2_decompressed_cache_destroy(bs);
     return ret;
 }
 
@@ -578,6 +574,44 @@ static int coroutine_fn qcow2_co_is_allocated(BlockDriverState *bs,
     return (cluster_offset != 0);
 }
 
+static int64_t coroutine_fn qcow2_co_get_block_status(BlockDriverState *bs,
+        int64_t sector_num, int nb_sectors, int *pnum)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t cluster_offset;
+    int index_in_cluster, ret;
+    int64_t status = 0;
+
+    *pnum = nb_sectors;
+    qemu_co_mutex_lock(&s->lock);
+    ret = qcow2_get_cluster_offset(bs, sector_num << 9, pnum, &cluster_offset);
+    qemu_co_mutex_unlock(&s->lock);
+    if (ret < 0) {
+        return ret;
+    }
+
+    switch (ret) {
+    case QCOW2_CLUSTER_NORMAL:
+        status |= BDRV_BLOCK_DATA;
+        if (!s->crypt_method) {
+            index_in_cluster = sector_num & (s->cluster_sectors - 1);
+            status |= BDRV_BLOCK_OFFSET_VALID |
+                      (cluster_offset + (index_in_cluster << 9));
+        }
+        break;
+    case QCOW2_CLUSTER_COMPRESSED:
+        status |= BDRV_BLOCK_DATA;
+        break;
+    case QCOW2_CLUSTER_ZERO:
+        status |= BDRV_BLOCK_ZERO;
+        break;
+    case QCOW2_CLUSTER_UNALLOCATED:
+        break;
+    }
+
+    return status;
+}
+
 /* handle reading after the end of the backing file */
 int qcow2_backing_read1(BlockDriverState *bs, QEMUIOVector *qiov,
                   int64_t sector_num, int nb_sectors)
@@ -642,8 +676,8 @@ static coroutine_fn int qcow2_co_readv(BlockDriverState *bs, int64_t sector_num,
                 if (n1 > 0) {
                     BLKDBG_EVENT(bs->file, BLKDBG_READ_BACKING_AIO);
                     qemu_co_mutex_unlock(&s->lock);
-                    ret = bdrv_co_readv(bs->backing_hd, sector_num,
-                                        n1, &hd_qiov);
+                    ret = bdrv_co_readv_chain(bs->backing_hd, sector_num,
+                                              n1, &hd_qiov);
                     qemu_co_mutex_lock(&s->lock);
                     if (ret < 0) {
                         goto fail;
@@ -664,15 +698,12 @@ static coroutine_fn int qcow2_co_readv(BlockDriverState *bs, int64_t sector_num,
             break;
 
         case QCOW2_CLUSTER_COMPRESSED:
-            /* add AIO support for compressed blocks ? */
-            ret = qcow2_decompress_cluster(bs, cluster_offset);
+            ret = qcow2_co_read_compressed(bs, cluster_offset,
+                                           index_in_cluster, cur_nr_sectors,
+                                           &hd_qiov);
             if (ret < 0) {
                 goto fail;
             }
-
-            qemu_iovec_from_buf(&hd_qiov, 0,
-                s->cluster_cache + index_in_cluster * 512,
-                512 * cur_nr_sectors);
             break;
 
         case QCOW2_CLUSTER_NORMAL:
@@ -776,8 +807,6 @@ static coroutine_fn int qcow2_co_writev(BlockDriverState *bs,
 
     qemu_iovec_init(&hd_qiov, qiov->niov);
 
-    s->cluster_cache_offset = -1; /* disable compressed cache */
-
     qemu_co_mutex_lock(&s->lock);
 
     while (remaining_sectors != 0) {
@@ -880,8 +909,7 @@ static void qcow2_close(BlockDriverState *bs)
     g_free(s->unknown_header_fields);
     cleanup_unknown_header_ext(bs);
 
-    g_free(s->cluster_cache);
-    qemu_vfree(s->cluster_data);
+    qcow2_decompressed_cache_destroy(bs);
     qcow2_refcount_close(bs);
     qcow2_free_snapshots(bs);
 }
@@ -1463,15 +1491,74 @@ static int qcow2_truncate(BlockDriverState *bs, int64_t offset)
     return 0;
 }
 
+/* One cluster to deflate in the thread pool */
+typedef struct Qcow2CompressJob {
+    const uint8_t *buf;
+    uint8_t *out_buf;
+    int cluster_size;
+    int out_len;    /* -1 if the cluster does not compress */
+} Qcow2CompressJob;
+
+/* Runs in a worker thread, so it must not touch any BDRVQcowState fields */
+static int qcow2_compress_worker(void *opaque)
+{
+    Qcow2CompressJob *job = opaque;
+    z_stream strm;
+    int ret;
+
+    /* best compression, small window, no zlib header */
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION,
+                       Z_DEFLATED, -12,
+                       9, Z_DEFAULT_STRATEGY);
+    if (ret != 0) {
+        return -EINVAL;
+    }
+
+    strm.avail_in = job->cluster_size;
+    strm.next_in = (uint8_t *)job->buf;
+    strm.avail_out = job->cluster_size;
+    strm.next_out = job->out_buf;
+
+    ret = deflate(&strm, Z_FINISH);
+    if (ret != Z_STREAM_END && ret != Z_OK) {
+        deflateEnd(&strm);
+        return -EINVAL;
+    }
+    job->out_len = strm.next_out - job->out_buf;
+
+    deflateEnd(&strm);
+
+    if (ret != Z_STREAM_END || job->out_len >= job->cluster_size) {
+        job->out_len = -1;
+    }
+    return 0;
+}
+
+typedef struct Qcow2CompressBatch {
+    int in_flight;
+    int ret;
+} Qcow2CompressBatch;
+
+static void qcow2_compress_cb(void *opaque, int ret)
+{
+    Qcow2CompressBatch *batch = opaque;
+
+    if (ret < 0 && batch->ret == 0) {
+        batch->ret = ret;
+    }
+    batch->in_flight--;
+}
+
 /* XXX: put compressed sectors first, then all the cluster aligned
    tables to avoid losing bytes in alignment */
 static int qcow2_write_compressed(BlockDriverState *bs, int64_t sector_num,
                                   const uint8_t *buf, int nb_sectors)
 {
     BDRVQcowState *s = bs->opaque;
-    z_stream strm;
-    int ret, out_len;
-    uint8_t *out_buf;
+    Qcow2CompressBatch batch = { .in_flight = 0, .ret = 0 };
+    Qcow2CompressJob *jobs;
+    int ret, i, nb_clusters;
     uint64_t cluster_offset;
 
     if (nb_sectors == 0) {
@@ -1483,52 +1570,58 @@ static int qcow2_write_compressed(BlockDriverState *bs, int64_t sector_num,
         return 0;
     }
 
-    if (nb_sectors != s->cluster_sectors)
+    if (nb_sectors % s->cluster_sectors) {
         return -EINVAL;
+    }
 
-    out_buf = g_malloc(s->cluster_size + (s->cluster_size / 1000) + 128);
-
-    /* best compression, small window, no zlib header */
-    memset(&strm, 0, sizeof(strm));
-    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION,
-                       Z_DEFLATED, -12,
-                       9, Z_DEFAULT_STRATEGY);
-    if (ret != 0) {
-        ret = -EINVAL;
-        goto fail;
+    /* All clusters of the request are deflated in parallel in the thread
+       pool.  The compressed data is then written out in order, so that the
+       layout of the image file does not depend on the order in which the
+       workers finish.  */
+    nb_clusters = nb_sectors / s->cluster_sectors;
+    jobs = g_new0(Qcow2CompressJob, nb_clusters);
+    for (i = 0; i < nb_clusters; i++) {
+        jobs[i].buf = buf + (size_t)i * s->cluster_size;
+        jobs[i].out_buf = g_malloc(s->cluster_size +
+                                   (s->cluster_size / 1000) + 128);
+        jobs[i].cluster_size = s->cluster_size;
+        batch.in_flight++;
+        thread_pool_submit_aio(qcow2_compress_worker, &jobs[i],
+                               qcow2_compress_cb, &batch);
     }
 
-    strm.avail_in = s->cluster_size;
-    strm.next_in = (uint8_t *)buf;
-    strm.avail_out = s->cluster_size;
-    strm.next_out = out_buf;
+    while (batch.in_flight > 0) {
+        qemu_aio_wait();
+    }
 
-    ret = deflate(&strm, Z_FINISH);
-    if (ret != Z_STREAM_END && ret != Z_OK) {
-        deflateEnd(&strm);
-        ret = -EINVAL;
+    ret = batch.ret;
+    if (ret < 0) {
         goto fail;
     }
-    out_len = strm.next_out - out_buf;
 
-    deflateEnd(&strm);
+    for (i = 0; i < nb_clusters; i++) {
+        int64_t cluster_sector = sector_num + i * s->cluster_sectors;
 
-    if (ret != Z_STREAM_END || out_len >= s->cluster_size) {
-        /* could not compress: write normal cluster */
-        ret = bdrv_write(bs, sector_num, buf, s->cluster_sectors);
-        if (ret < 0) {
-            goto fail;
+        if (jobs[i].out_len < 0) {
+            /* could not compress: write normal cluster */
+            ret = bdrv_write(bs, cluster_sector, jobs[i].buf,
+                             s->cluster_sectors);
+            if (ret < 0) {
+                goto fail;
+            }
+            continue;
         }
-    } else {
+
         cluster_offset = qcow2_alloc_compressed_cluster_offset(bs,
-            sector_num << 9, out_len);
+            cluster_sector << 9, jobs[i].out_len);
         if (!cluster_offset) {
             ret = -EIO;
             goto fail;
         }
         cluster_offset &= s->cluster_offset_mask;
         BLKDBG_EVENT(bs->file, BLKDBG_WRITE_COMPRESSED);
-        ret = bdrv_pwrite(bs->file, cluster_offset, out_buf, out_len);
+        ret = bdrv_pwrite(bs->file, cluster_offset, jobs[i].out_buf,
+                          jobs[i].out_len);
         if (ret < 0) {
             goto fail;
         }
@@ -1536,7 +1629,10 @@ static int qcow2_write_compressed(BlockDriverState *bs, int64_t sector_num,
 
     ret = 0;
 fail:
-    g_free(out_buf);
+    for (i = 0; i < nb_clusters; i++) {
+        g_free(jobs[i].out_buf);
+    }
+    g_free(jobs);
     return ret;
 }
 
@@ -1681,6 +1777,7 @@ static BlockDriver bdrv_qcow2 = {
     .bdrv_close         = qcow2_close,
     .bdrv_create        = qcow2_create,
     .bdrv_co_is_allocated = qcow2_co_is_allocated,
+    .bdrv_co_get_block_status = qcow2_co_get_block_status,
     .bdrv_set_key       = qcow2_set_key,
     .bdrv_make_empty    = qcow2_make_empty,
 
@@ -56,6 +56,9 @@
 /* Must be at least 4 to cover all cases of refcount table growth */
 #define REFCOUNT_CACHE_SIZE 4
 
+/* Number of decompressed clusters kept around for compressed images */
+#define DECOMPRESSED_CACHE_SIZE 16
+
 #define DEFAULT_CLUSTER_SIZE 65536
 
 typedef struct QCowHeader {
@@ -97,6 +100,18 @@ typedef struct QCowSnapshot {
 struct Qcow2Cache;
 typedef struct Qcow2Cache Qcow2Cache;
 
+typedef struct Qcow2DecompressedCluster {
+    uint64_t offset;        /* host offset of the compressed data, or -1 */
+    uint64_t lru_stamp;
+    uint8_t *data;
+} Qcow2DecompressedCluster;
+
+typedef struct Qcow2CompressedRead {
+    uint64_t offset;
+    CoQueue waiters;
+    QLIST_ENTRY(Qcow2CompressedRead) next;
+} Qcow2CompressedRead;
+
 typedef struct Qcow2UnknownHeaderExtension {
     uint32_t magic;
     uint32_t len;
@@ -149,9 +164,11 @@ typedef struct BDRVQcowState {
     Qcow2Cache* l2_table_cache;
     Qcow2Cache* refcount_block_cache;
 
-    uint8_t *cluster_cache;
-    uint8_t *cluster_data;
-    uint64_t cluster_cache_offset;
+    Qcow2DecompressedCluster decompressed_cache[DECOMPRESSED_CACHE_SIZE];
+    uint64_t decompressed_cache_lru;
+    /* Bumped whenever host clusters are freed, see update_refcount() */
+    uint64_t decompressed_cache_gen;
+    QLIST_HEAD(, Qcow2CompressedRead) compressed_reads;
     QLIST_HEAD(QCowClusterAlloc, QCowL2Meta) cluster_allocs;
 
     uint64_t *refcount_table;
@@ -288,7 +305,12 @@ int qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
 /* qcow2-cluster.c functions */
 int qcow2_grow_l1_table(BlockDriverState *bs, int min_size, bool exact_size);
 void qcow2_l2_cache_reset(BlockDriverState *bs);
-int qcow2_decompress_cluster(BlockDriverState *bs, uint64_t cluster_offset);
+void qcow2_decompressed_cache_init(BlockDriverState *bs);
+void qcow2_decompressed_cache_destroy(BlockDriverState *bs);
+void qcow2_decompressed_cache_invalidate(BlockDriverState *bs);
+int coroutine_fn qcow2_co_read_compressed(BlockDriverState *bs,
+    uint64_t cluster_offset, int index_in_cluster, int nb_sectors,
+    QEMUIOVector *qiov);
 void qcow2_encrypt_sectors(BDRVQcowState *s, int64_t sector_num,
                      uint8_t *out_buf, const uint8_t *in_buf,
                      int nb_sectors, int enc,
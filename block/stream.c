@@ -91,9 +91,10 @@ static void coroutine_fn stream_run(void *opaque)
     buf = qemu_blockalign(bs, STREAM_BUFFER_SIZE);
 
     /* Turn on copy-on-read for the whole block device so that guest read
-     * requests help us make progress.  Only do this when copying the entire
-     * backing chain since the copy-on-read operation does not take base into
-     * account.
+     * requests, and the prefetching they trigger if configured with
+     * bdrv_set_cor_prefetch(), help us make progress.  Regions populated this
+     * way are skipped below.  Only do this when copying the entire backing
+     * chain since the copy-on-read operation does not take base into account.
      */
     if (!base) {
         bdrv_enable_copy_on_read(bs);
@@ -56,6 +56,25 @@
 #define BLOCK_OPT_LAZY_REFCOUNTS    "lazy_refcounts"
 
 typedef struct BdrvTrackedRequest BdrvTrackedRequest;
+typedef struct BdrvAllocMap BdrvAllocMap;
+
+typedef struct BdrvCorPrefetch {
+    /* configuration */
+    int64_t window;             /* in sectors, 0 means disabled */
+    uint64_t slice_quota;       /* sectors per slice, 0 means unlimited */
+
+    /* sequential stream detection */
+    int64_t next_sector;        /* end of the last guest read */
+    int seq_reads;
+    uint64_t stream;            /* bumped when a new stream starts */
+
+    /* background population */
+    Coroutine *co;
+    int64_t pos;                /* next sector to prefetch */
+    int64_t target;             /* prefetch up to this sector */
+    int64_t slice_end;
+    uint64_t slice_dispatched;
+} BdrvCorPrefetch;
 
 typedef struct BlockIOLimit {
     int64_t bps[3];
@@ -179,6 +198,9 @@ struct BlockDriver {
         int64_t sector_num, int nb_sectors);
     int coroutine_fn (*bdrv_co_is_allocated)(BlockDriverState *bs,
         int64_t sector_num, int nb_sectors, int *pnum);
+    /* Returns BDRV_BLOCK_* flags, see bdrv_co_get_block_status() */
+    int64_t coroutine_fn (*bdrv_co_get_block_status)(BlockDriverState *bs,
+        int64_t sector_num, int nb_sectors, int *pnum);
 
     /*
      * Invalidate any cached meta-data.
@@ -202,6 +224,8 @@ struct BlockDriver {
     int (*bdrv_truncate)(BlockDriverState *bs, int64_t offset);
     int64_t (*bdrv_getlength)(BlockDriverState *bs);
     int64_t (*bdrv_get_allocated_file_size)(BlockDriverState *bs);
+    /* nb_sectors is a multiple of the cluster size; drivers may compress
+     * the clusters of one request in parallel */
     int (*bdrv_write_compressed)(BlockDriverState *bs, int64_t sector_num,
                                  const uint8_t *buf, int nb_sectors);
 
@@ -293,9 +317,18 @@ struct BlockDriverState {
     BlockDriverState *backing_hd;
     BlockDriverState *file;
 
+    /* which layer of the backing chain holds the data, see
+       bdrv_co_is_allocated_above() */
+    BdrvAllocMap *alloc_map;
+    /* changed whenever the allocation status of the image may change */
+    uint64_t alloc_gen;
+
     /* number of in-flight copy-on-read requests */
     unsigned int copy_on_read_in_flight;
 
+    /* copy-on-read prefetching, see bdrv_set_cor_prefetch() */
+    BdrvCorPrefetch cor_prefetch;
+
     /* the time for latest disk I/O */
     int64_t slice_time;
     int64_t slice_start;
@@ -340,6 +373,9 @@ struct BlockDriverState {
 
 int get_tmp_filename(char *filename, int size);
 
+int coroutine_fn bdrv_co_readv_chain(BlockDriverState *bs, int64_t sector_num,
+                                     int nb_sectors, QEMUIOVector *qiov);
+
 void bdrv_set_io_limits(BlockDriverState *bs,
                         BlockIOLimit *io_limits);
 
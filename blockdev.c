@@ -295,6 +295,7 @@ DriveInfo *drive_init(QemuOpts *opts, int default_to_scsi)
     BlockIOLimit io_limits;
     int snapshot = 0;
     bool copy_on_read;
+    int64_t cor_prefetch, cor_prefetch_bps;
     int ret;
 
     translation = BIOS_ATA_TRANSLATION_AUTO;
@@ -312,6 +313,9 @@ DriveInfo *drive_init(QemuOpts *opts, int default_to_scsi)
     snapshot = qemu_opt_get_bool(opts, "snapshot", 0);
     ro = qemu_opt_get_bool(opts, "readonly", 0);
     copy_on_read = qemu_opt_get_bool(opts, "copy-on-read", false);
+    cor_prefetch = qemu_opt_get_size(opts, "copy-on-read-prefetch", 0);
+    cor_prefetch_bps = qemu_opt_get_number(opts, "copy-on-read-prefetch-bps",
+                                           0);
 
     file = qemu_opt_get(opts, "file");
     serial = qemu_opt_get(opts, "serial");
@@ -606,6 +610,12 @@ DriveInfo *drive_init(QemuOpts *opts, int default_to_scsi)
         error_report("warning: disabling copy_on_read on readonly drive");
     }
 
+    if (cor_prefetch_bps < 0) {
+        error_report("copy-on-read-prefetch-bps must not be negative");
+        goto err;
+    }
+    bdrv_set_cor_prefetch(dinfo->bdrv, cor_prefetch, cor_prefetch_bps);
+
     ret = bdrv_open(dinfo->bdrv, file, bdrv_flags, drv);
     if (ret < 0) {
         error_report("could not open disk image %s: %s",
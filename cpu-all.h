@@ -476,6 +476,7 @@ void cpu_watchpoint_remove_all(CPUArchState *env, int mask);
 void cpu_single_step(CPUArchState *env, int enabled);
 int cpu_is_stopped(CPUArchState *env);
 void run_on_cpu(CPUArchState *env, void (*func)(void *data), void *data);
+void async_run_on_cpu(CPUArchState *env, void (*func)(void *data), void *data);
 
 #if !defined(CONFIG_USER_ONLY)
 
@@ -525,6 +526,23 @@ extern int mem_prealloc;
 /* Set if TLB entry is an IO callback.  */
 #define TLB_MMIO        (1 << 5)
 
+/* Number of entries of the TLB of MMU mode 'mmu_idx'.  */
+static inline size_t tlb_n_entries(CPUArchState *env, int mmu_idx)
+{
+#ifdef CPU_TLB_DYN
+    return (env->tlb_mask[mmu_idx] >> CPU_TLB_ENTRY_BITS) + 1;
+#else
+    return CPU_TLB_SIZE;
+#endif
+}
+
+/* Index of the entry for 'addr' in the TLB of MMU mode 'mmu_idx'.  */
+static inline unsigned int tlb_index(CPUArchState *env, int mmu_idx,
+                                     target_ulong addr)
+{
+    return (addr >> TARGET_PAGE_BITS) & (tlb_n_entries(env, mmu_idx) - 1);
+}
+
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf);
 #endif /* !CONFIG_USER_ONLY */
 
@@ -80,6 +80,18 @@ typedef uint64_t target_ulong __attribute__((aligned(TARGET_LONG_ALIGNMENT)));
 #define CPU_TLB_BITS 8
 #define CPU_TLB_SIZE (1 << CPU_TLB_BITS)
 
+/* TCG backends that load the TLB mask and table pointer from
+   CPUArchState instead of embedding CPU_TLB_SIZE in the generated code.
+   With these, the TLB of each MMU mode is sized at flush time between
+   CPU_TLB_DYN_MIN_BITS and CPU_TLB_DYN_MAX_BITS, starting at
+   CPU_TLB_BITS.  Other backends keep a fixed size TLB.  */
+#if defined(CONFIG_TCG_INTERPRETER) || \
+    defined(__i386__) || defined(__x86_64__)
+#define CPU_TLB_DYN
+#define CPU_TLB_DYN_MIN_BITS 6
+#define CPU_TLB_DYN_MAX_BITS 16
+#endif
+
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
 #else
@@ -108,16 +120,69 @@ typedef struct CPUTLBEntry {
 
 extern int CPUTLBEntry_wrong_size[sizeof(CPUTLBEntry) == (1 << CPU_TLB_ENTRY_BITS) ? 1 : -1];
 
+/* Fully associative victim TLB, holding the entries recently evicted from
+   the direct mapped TLB.  It is searched before walking the page tables. */
+#define CPU_VTLB_SIZE 8
+
+/* Number of pages larger than TARGET_PAGE_SIZE that are tracked
+   individually, so that tlb_flush_page of one of them only flushes the
+   entries it covers.  Past that, they are merged into a single region
+   whose invalidation flushes the whole TLB.  */
+#define CPU_TLB_LARGE_PAGES 8
+
+typedef struct CPUTLBLargePage {
+    target_ulong addr;
+    target_ulong mask;
+} CPUTLBLargePage;
+
+#ifdef CPU_TLB_DYN
+/* Sizing state of the TLB of one MMU mode.  */
+typedef struct CPUTLBDesc {
+    /* number of valid entries filled since the last flush */
+    size_t n_used;
+    /* highest n_used seen at a flush in the current window */
+    size_t window_max_used;
+    int64_t window_begin_ns;
+} CPUTLBDesc;
+
+/* The tables are allocated by tlb_init and must survive CPU reset, so
+   this goes after the "preserved by CPU reset" mark.  tlb_mask holds
+   (number of entries - 1) << CPU_TLB_ENTRY_BITS, ready to be and'ed
+   with the shifted virtual address by the generated code.  */
+#define CPU_COMMON_TLB_DYN                                              \
+    uintptr_t tlb_mask[NB_MMU_MODES];                                   \
+    CPUTLBEntry *tlb_table[NB_MMU_MODES];                               \
+    target_phys_addr_t *iotlb[NB_MMU_MODES];                            \
+    CPUTLBDesc tlb_desc[NB_MMU_MODES];                                  \
+    unsigned int tlb_resize_count;
+
+#define CPU_COMMON_TLB_FIXED
+#else
+#define CPU_COMMON_TLB_DYN
+#define CPU_COMMON_TLB_FIXED                                            \
+    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
+    target_phys_addr_t iotlb[NB_MMU_MODES][CPU_TLB_SIZE];
+#endif
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
-    CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
-    target_phys_addr_t iotlb[NB_MMU_MODES][CPU_TLB_SIZE];               \
+    CPU_COMMON_TLB_FIXED                                                \
+    CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
+    target_phys_addr_t iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];            \
+    CPUTLBLargePage tlb_large_pages[CPU_TLB_LARGE_PAGES];               \
+    int tlb_nb_large_pages;                                             \
     target_ulong tlb_flush_addr;                                        \
-    target_ulong tlb_flush_mask;
+    target_ulong tlb_flush_mask;                                        \
+    unsigned int vtlb_index;                                            \
+    /* statistics for "info jit" */                                     \
+    uint64_t tlb_fill_count;                                            \
+    uint64_t tlb_victim_hit_count;                                      \
+    uint64_t tlb_victim_miss_count;
 
 #else
 
 #define CPU_COMMON_TLB
+#define CPU_COMMON_TLB_DYN
 
 #endif
 
@@ -151,6 +216,18 @@ typedef struct CPUWatchpoint {
     QTAILQ_ENTRY(CPUWatchpoint) entry;
 } CPUWatchpoint;
 
+/* Ways out of translated code, counted in env->tb_exit_count[] */
+enum {
+    TB_EXIT_INDIRECT,   /* end of TB that cannot be chained */
+    TB_EXIT_UNLINKED,   /* direct jump not (yet) chained to its target */
+    TB_EXIT_ICOUNT,     /* instruction budget spent, or cpu_exit() */
+    TB_EXIT_HOT,        /* hot TB to be retranslated as a superblock */
+    TB_EXIT_EXCEPTION,  /* guest exception or cpu_loop_exit() */
+    TB_EXIT_INTERRUPT,  /* interrupt request checked */
+    TB_EXIT_REQUEST,    /* back to the main loop: exit request, halt... */
+    TB_EXIT_NB
+};
+
 #define CPU_TEMP_BUF_NLONGS 128
 #define CPU_COMMON                                                      \
     struct TranslationBlock *current_tb; /* currently executing TB  */  \
@@ -167,6 +244,7 @@ typedef struct CPUWatchpoint {
     volatile sig_atomic_t exit_request;                                 \
     CPU_COMMON_TLB                                                      \
     struct TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];           \
+    uint64_t tb_exit_count[TB_EXIT_NB]; /* statistics for "info jit" */ \
     /* buffer for temporaries in the code generator */                  \
     long temp_buf[CPU_TEMP_BUF_NLONGS];                                 \
                                                                         \
@@ -214,6 +292,7 @@ typedef struct CPUWatchpoint {
     struct KVMState *kvm_state;                                         \
     struct kvm_run *kvm_run;                                            \
     int kvm_fd;                                                         \
-    int kvm_vcpu_dirty;
+    int kvm_vcpu_dirty;                                                 \
+    CPU_COMMON_TLB_DYN
 
 #endif
@@ -22,6 +22,9 @@
 #include "tcg.h"
 #include "qemu-barrier.h"
 #include "qtest.h"
+#if !defined(CONFIG_USER_ONLY)
+#include "main-loop.h"
+#endif
 
 int tb_invalidated_flag;
 
@@ -54,7 +57,7 @@ void cpu_resume_from_signal(CPUArchState *env, void *puc)
 /* Execute the code without caching the generated code. An interpreter
    could be used if available. */
 static void cpu_exec_nocache(CPUArchState *env, int max_cycles,
-                             TranslationBlock *orig_tb)
+                             target_ulong pc, target_ulong cs_base, int flags)
 {
     tcg_target_ulong next_tb;
     TranslationBlock *tb;
@@ -64,8 +67,9 @@ static void cpu_exec_nocache(CPUArchState *env, int max_cycles,
     if (max_cycles > CF_COUNT_MASK)
         max_cycles = CF_COUNT_MASK;
 
-    tb = tb_gen_code(env, orig_tb->pc, orig_tb->cs_base, orig_tb->flags,
-                     max_cycles);
+    tb_lock_acquire();
+    tb = tb_gen_code(env, pc, cs_base, flags, max_cycles);
+    tb_lock_release();
     env->current_tb = tb;
     /* execute the generated code */
     next_tb = tcg_qemu_tb_exec(env, tb->tc_ptr);
@@ -76,8 +80,59 @@ static void cpu_exec_nocache(CPUArchState *env, int max_cycles,
            the TB starts executing.  */
         cpu_pc_from_tb(env, tb);
     }
+    tb_lock_acquire();
     tb_phys_invalidate(tb, -1);
     tb_free(tb);
+    tb_lock_release();
+}
+
+typedef struct TBLookupKey {
+    CPUArchState *env;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint64_t flags;
+    tb_page_addr_t phys_page1;
+} TBLookupKey;
+
+static bool tb_lookup_cmp(TranslationBlock *tb, const void *opaque)
+{
+    const TBLookupKey *key = opaque;
+
+    if (tb->pc == key->pc &&
+        tb->page_addr[0] == key->phys_page1 &&
+        tb->cs_base == key->cs_base &&
+        tb->flags == key->flags) {
+        /* check next page if needed */
+        if (tb->page_addr[1] != -1) {
+            tb_page_addr_t phys_page2;
+            target_ulong virt_page2;
+
+            virt_page2 = (key->pc & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+            phys_page2 = get_page_addr_code(key->env, virt_page2);
+            return tb->page_addr[1] == phys_page2;
+        }
+        return true;
+    }
+    return false;
+}
+
+/* find translated block using physical mappings */
+static TranslationBlock *tb_find_physical(CPUArchState *env,
+                                          target_ulong pc,
+                                          target_ulong cs_base,
+                                          uint64_t flags)
+{
+    tb_page_addr_t phys_pc;
+    TBLookupKey key;
+
+    phys_pc = get_page_addr_code(env, pc);
+    key.env = env;
+    key.pc = pc;
+    key.cs_base = cs_base;
+    key.flags = flags;
+    key.phys_page1 = phys_pc & TARGET_PAGE_MASK;
+    return tb_htable_lookup(tb_hash_func(phys_pc, pc, flags, cs_base),
+                            tb_lookup_cmp, &key);
 }
 
 static TranslationBlock *tb_find_slow(CPUArchState *env,
@@ -85,52 +140,33 @@ static TranslationBlock *tb_find_slow(CPUArchState *env,
                                       target_ulong cs_base,
                                       uint64_t flags)
 {
-    TranslationBlock *tb, **ptb1;
-    unsigned int h;
-    tb_page_addr_t phys_pc, phys_page1;
-    target_ulong virt_page2;
+    TranslationBlock *tb;
 
     tb_invalidated_flag = 0;
 
-    /* find translated block using physical mappings */
-    phys_pc = get_page_addr_code(env, pc);
-    phys_page1 = phys_pc & TARGET_PAGE_MASK;
-    h = tb_phys_hash_func(phys_pc);
-    ptb1 = &tb_phys_hash[h];
-    for(;;) {
-        tb = *ptb1;
-        if (!tb)
-            goto not_found;
-        if (tb->pc == pc &&
-            tb->page_addr[0] == phys_page1 &&
-            tb->cs_base == cs_base &&
-            tb->flags == flags) {
-            /* check next page if needed */
-            if (tb->page_addr[1] != -1) {
-                tb_page_addr_t phys_page2;
-
-                virt_page2 = (pc & TARGET_PAGE_MASK) +
-                    TARGET_PAGE_SIZE;
-                phys_page2 = get_page_addr_code(env, virt_page2);
-                if (tb->page_addr[1] == phys_page2)
-                    goto found;
-            } else {
-                goto found;
-            }
+#if defined(CONFIG_USER_ONLY)
+    /* the hash table can be searched without tb_lock, which guest threads
+       would otherwise take for every indirect branch */
+    tb = tb_find_physical(env, pc, cs_base, flags);
+    if (tb) {
+        goto found;
+    }
+#endif
+    tb_lock_acquire();
+    tb = tb_find_physical(env, pc, cs_base, flags);
+    if (!tb) {
+        if (unlikely(tb_page_nocache(get_page_addr_code(env, pc)))) {
+            tb_lock_release();
+            return NULL;
         }
-        ptb1 = &tb->phys_hash_next;
+        /* if no translated code available, then translate it now */
+        tb = tb_gen_code(env, pc, cs_base, flags, 0);
     }
- not_found:
-   /* if no translated code available, then translate it now */
-    tb = tb_gen_code(env, pc, cs_base, flags, 0);
+    tb_lock_release();
 
+#if defined(CONFIG_USER_ONLY)
  found:
-    /* Move the last found TB to the head of the list */
-    if (likely(*ptb1)) {
-        *ptb1 = tb->phys_hash_next;
-        tb->phys_hash_next = tb_phys_hash[h];
-        tb_phys_hash[h] = tb;
-    }
+#endif
     /* we add the TB in the virtual pc hash table */
     env->tb_jmp_cache[tb_jmp_cache_hash_func(pc)] = tb;
     return tb;
@@ -154,6 +190,85 @@ static inline TranslationBlock *tb_find_fast(CPUArchState *env)
     return tb;
 }
 
+/* Called by translated code at the end of an indirect branch, which
+   has already stored the new pc in env.  Return the host code of the
+   next TB, or the epilogue so that cpu_exec() translates it.  The TB
+   becomes env->current_tb so that cpu_unlink_tb() still breaks the
+   loops it is part of.  */
+void *helper_lookup_tb_ptr(CPUArchState *env)
+{
+    TranslationBlock *tb;
+    target_ulong cs_base, pc;
+    unsigned int h;
+    int flags;
+
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    h = tb_jmp_cache_hash_func(pc);
+    tb = env->tb_jmp_cache[h];
+    if (unlikely(!tb || tb->pc != pc || tb->cs_base != cs_base ||
+                 tb->flags != flags)) {
+#if defined(CONFIG_USER_ONLY)
+        tb = tb_find_physical(env, pc, cs_base, flags);
+#else
+        tb_lock_acquire();
+        tb = tb_find_physical(env, pc, cs_base, flags);
+        tb_lock_release();
+#endif
+        if (!tb) {
+            return tcg_ctx.code_gen_epilogue;
+        }
+        env->tb_jmp_cache[h] = tb;
+    }
+    env->current_tb = tb;
+    barrier();
+    if (unlikely(env->exit_request || env->interrupt_request)) {
+        return tcg_ctx.code_gen_epilogue;
+    }
+    return tb->tc_ptr;
+}
+
+/* With parallel vCPUs both TBs are found without tb_lock, so either one
+   may have been invalidated by another thread in the meantime (e.g. the
+   source replaced by a superblock).  Only chain them if both can still be
+   found in the physical hash table, otherwise the jump would be patched
+   into, or point to, code that is about to be reused.  */
+static void tb_add_jump_parallel(TranslationBlock *tb, int n,
+                                 TranslationBlock *tb_next)
+{
+    if (tb->jmp_next[n]) {
+        return;
+    }
+    tb_lock_acquire();
+    if (tb_htable_contains(tb) && tb_htable_contains(tb_next)) {
+        tb_add_jump(tb, n, tb_next);
+    }
+    tb_lock_release();
+}
+
+#if !defined(CONFIG_USER_ONLY)
+static inline void cpu_exec_lock_iothread(void)
+{
+    if (parallel_cpus) {
+        qemu_mutex_lock_iothread();
+    }
+}
+
+static inline void cpu_exec_unlock_iothread(void)
+{
+    if (parallel_cpus) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+#else
+static inline void cpu_exec_lock_iothread(void)
+{
+}
+
+static inline void cpu_exec_unlock_iothread(void)
+{
+}
+#endif
+
 static CPUDebugExcpHandler *debug_excp_handler;
 
 void cpu_set_debug_excp_handler(CPUDebugExcpHandler *handler)
@@ -187,6 +302,8 @@ int cpu_exec(CPUArchState *env)
     int ret, interrupt_request;
     TranslationBlock *tb;
     uint8_t *tc_ptr;
+    target_ulong pc, cs_base;
+    int flags;
     tcg_target_ulong next_tb;
 
     if (env->halted) {
@@ -240,6 +357,7 @@ int cpu_exec(CPUArchState *env)
             if (env->exception_index >= 0) {
                 if (env->exception_index >= EXCP_INTERRUPT) {
                     /* exit request from the cpu execution loop */
+                    env->tb_exit_count[TB_EXIT_REQUEST]++;
                     ret = env->exception_index;
                     if (ret == EXCP_DEBUG) {
                         cpu_handle_debug_exception(env);
@@ -264,8 +382,16 @@ int cpu_exec(CPUArchState *env)
 
             next_tb = 0; /* force lookup of first TB */
             for(;;) {
+                if (parallel_cpus) {
+                    /* re-arm the exit check done at the start of each TB,
+                       see cpu_exit() */
+                    env->icount_decr.u16.high = 0;
+                    smp_mb();
+                }
                 interrupt_request = env->interrupt_request;
                 if (unlikely(interrupt_request)) {
+                    env->tb_exit_count[TB_EXIT_INTERRUPT]++;
+                    cpu_exec_lock_iothread();
                     if (unlikely(env->singlestep_enabled & SSTEP_NOIRQ)) {
                         /* Mask out external interrupts for this step. */
                         interrupt_request &= ~CPU_INTERRUPT_SSTEP_MASK;
@@ -540,6 +666,7 @@ int cpu_exec(CPUArchState *env)
                            the program flow was changed */
                         next_tb = 0;
                     }
+                    cpu_exec_unlock_iothread();
                 }
                 if (unlikely(env->exit_request)) {
                     env->exit_request = 0;
@@ -565,8 +692,14 @@ int cpu_exec(CPUArchState *env)
 #endif
                 }
 #endif /* DEBUG_DISAS || CONFIG_DEBUG_EXEC */
-                spin_lock(&tb_lock);
                 tb = tb_find_fast(env);
+                if (unlikely(!tb)) {
+                    /* the code of this page keeps being rewritten */
+                    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+                    cpu_exec_nocache(env, 0, pc, cs_base, flags);
+                    next_tb = 0;
+                    continue;
+                }
                 /* Note: we do it here to avoid a gcc bug on Mac OS X when
                    doing it in tb_find_slow */
                 if (tb_invalidated_flag) {
@@ -585,9 +718,16 @@ int cpu_exec(CPUArchState *env)
                    spans two pages, we cannot safely do a direct
                    jump. */
                 if (next_tb != 0 && tb->page_addr[1] == -1) {
-                    tb_add_jump((TranslationBlock *)(next_tb & ~3), next_tb & 3, tb);
+                    if (parallel_cpus) {
+                        tb_add_jump_parallel((TranslationBlock *)(next_tb & ~3),
+                                             next_tb & 3, tb);
+                    } else {
+                        tb_lock_acquire();
+                        tb_add_jump((TranslationBlock *)(next_tb & ~3),
+                                    next_tb & 3, tb);
+                        tb_lock_release();
+                    }
                 }
-                spin_unlock(&tb_lock);
 
                 /* cpu_interrupt might be called while translating the
                    TB, but before it is linked into a potentially
@@ -599,6 +739,15 @@ int cpu_exec(CPUArchState *env)
                     tc_ptr = tb->tc_ptr;
                     /* execute the generated code */
                     next_tb = tcg_qemu_tb_exec(env, tc_ptr);
+                    if (next_tb == 0) {
+                        env->tb_exit_count[TB_EXIT_INDIRECT]++;
+                    } else if ((next_tb & 3) < 2) {
+                        env->tb_exit_count[TB_EXIT_UNLINKED]++;
+                    } else if ((next_tb & 3) == 2) {
+                        env->tb_exit_count[TB_EXIT_ICOUNT]++;
+                    } else {
+                        env->tb_exit_count[TB_EXIT_HOT]++;
+                    }
                     if ((next_tb & 3) == 2) {
                         /* Instruction counter expired.  */
                         int insns_left;
@@ -606,7 +755,11 @@ int cpu_exec(CPUArchState *env)
                         /* Restore PC.  */
                         cpu_pc_from_tb(env, tb);
                         insns_left = env->icount_decr.u32;
-                        if (env->icount_extra && insns_left >= 0) {
+                        if (!use_icount) {
+                            /* Exit requested by cpu_exit() with parallel
+                               vCPUs, handled at the top of the loop.  */
+                            next_tb = 0;
+                        } else if (env->icount_extra && insns_left >= 0) {
                             /* Refill decrementer and continue execution.  */
                             env->icount_extra += insns_left;
                             if (env->icount_extra > 0xffff) {
@@ -619,12 +772,21 @@ int cpu_exec(CPUArchState *env)
                         } else {
                             if (insns_left > 0) {
                                 /* Execute remaining instructions.  */
-                                cpu_exec_nocache(env, insns_left, tb);
+                                cpu_exec_nocache(env, insns_left, tb->pc,
+                                                 tb->cs_base, tb->flags);
                             }
                             env->exception_index = EXCP_INTERRUPT;
                             next_tb = 0;
                             cpu_loop_exit(env);
                         }
+                    } else if ((next_tb & 3) == 3) {
+                        /* The TB became hot before executing anything.  */
+                        tb = (TranslationBlock *)(next_tb & ~3);
+                        cpu_pc_from_tb(env, tb);
+                        tb_lock_acquire();
+                        tb_gen_superblock(env, tb);
+                        tb_lock_release();
+                        next_tb = 0;
                     }
                 }
                 env->current_tb = NULL;
@@ -635,6 +797,11 @@ int cpu_exec(CPUArchState *env)
             /* Reload env after longjmp - the compiler may have smashed all
              * local variables as longjmp is marked 'noreturn'. */
             env = cpu_single_env;
+            cpu_exec_reset_locks();
+            if (env->exception_index >= 0 &&
+                env->exception_index < EXCP_INTERRUPT) {
+                env->tb_exit_count[TB_EXIT_EXCEPTION]++;
+            }
         }
     } /* for(;;) */
 
@@ -33,6 +33,8 @@
 #include "qmp-commands.h"
 
 #include "qemu-thread.h"
+#include "qemu-tls.h"
+#include "qemu-barrier.h"
 #include "cpus.h"
 #include "qtest.h"
 #include "main-loop.h"
@@ -383,6 +385,34 @@ void configure_icount(const char *option)
                    qemu_get_clock_ns(vm_clock) + get_ticks_per_sec() / 10);
 }
 
+void configure_tcg_threads(const char *option)
+{
+    if (!option || !strcmp(option, "single")) {
+        return;
+    }
+    if (strcmp(option, "multi") != 0) {
+        fprintf(stderr, "Invalid -tcg-threads value '%s'\n", option);
+        exit(1);
+    }
+    if (!tcg_enabled()) {
+        fprintf(stderr, "-tcg-threads multi requires the TCG accelerator\n");
+        exit(1);
+    }
+    if (use_icount) {
+        fprintf(stderr, "-tcg-threads multi is not compatible with -icount\n");
+        exit(1);
+    }
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    !defined(CONFIG_TCG_INTERPRETER) && \
+    (defined(TARGET_I386) || defined(TARGET_ARM) || defined(TARGET_PPC))
+    parallel_cpus = true;
+#else
+    fprintf(stderr, "-tcg-threads multi is not supported for this host "
+            "and target combination\n");
+    exit(1);
+#endif
+}
+
 /***********************************************************/
 void hw_error(const char *fmt, ...)
 {
@@ -616,6 +646,14 @@ static void qemu_tcg_init_cpu_signals(void)
 QemuMutex qemu_global_mutex;
 static QemuCond qemu_io_proceeded_cond;
 static bool iothread_requesting_mutex;
+static DEFINE_TLS(bool, iothread_locked);
+
+/* With parallel_cpus, number of vCPU threads inside cpu_exec() and
+   whether a tb_flush() is waiting for that number to drop to zero.
+   tcg_running_cpus is protected by the BQL.  */
+static int tcg_running_cpus;
+static volatile bool tcg_flush_pending;
+static QemuCond qemu_tcg_flush_cond;
 
 static QemuThread io_thread;
 
@@ -635,6 +673,7 @@ void qemu_init_cpu_loop(void)
     qemu_cond_init(&qemu_pause_cond);
     qemu_cond_init(&qemu_work_cond);
     qemu_cond_init(&qemu_io_proceeded_cond);
+    qemu_cond_init(&qemu_tcg_flush_cond);
     qemu_mutex_init(&qemu_global_mutex);
 
     qemu_thread_get_self(&io_thread);
@@ -659,6 +698,7 @@ void run_on_cpu(CPUArchState *env, void (*func)(void *data), void *data)
     env->queued_work_last = &wi;
     wi.next = NULL;
     wi.done = false;
+    wi.free = false;
 
     qemu_cpu_kick(env);
     while (!wi.done) {
@@ -669,6 +709,31 @@ void run_on_cpu(CPUArchState *env, void (*func)(void *data), void *data)
     }
 }
 
+void async_run_on_cpu(CPUArchState *env, void (*func)(void *data), void *data)
+{
+    struct qemu_work_item *wi;
+
+    if (qemu_cpu_is_self(env)) {
+        func(data);
+        return;
+    }
+
+    wi = g_malloc0(sizeof(struct qemu_work_item));
+    wi->func = func;
+    wi->data = data;
+    wi->free = true;
+    if (!env->queued_work_first) {
+        env->queued_work_first = wi;
+    } else {
+        env->queued_work_last->next = wi;
+    }
+    env->queued_work_last = wi;
+    wi->next = NULL;
+    wi->done = false;
+
+    qemu_cpu_kick(env);
+}
+
 static void flush_queued_work(CPUArchState *env)
 {
     struct qemu_work_item *wi;
@@ -681,6 +746,9 @@ static void flush_queued_work(CPUArchState *env)
         env->queued_work_first = wi->next;
         wi->func(wi->data);
         wi->done = true;
+        if (wi->free) {
+            g_free(wi);
+        }
     }
     env->queued_work_last = NULL;
     qemu_cond_broadcast(&qemu_work_cond);
@@ -719,6 +787,15 @@ static void qemu_tcg_wait_io_event(void)
     }
 }
 
+static void qemu_tcg_mt_wait_io_event(CPUArchState *env)
+{
+    while (cpu_thread_is_idle(env)) {
+        qemu_cond_wait(env->halt_cond, &qemu_global_mutex);
+    }
+
+    qemu_wait_io_event_common(env);
+}
+
 static void qemu_kvm_wait_io_event(CPUArchState *env)
 {
     while (cpu_thread_is_idle(env)) {
@@ -736,6 +813,7 @@ static void *qemu_kvm_cpu_thread_fn(void *arg)
     int r;
 
     qemu_mutex_lock(&qemu_global_mutex);
+    tls_var(iothread_locked) = true;
     qemu_thread_get_self(cpu->thread);
     env->thread_id = qemu_get_thread_id();
     cpu_single_env = env;
@@ -809,6 +887,7 @@ static void *qemu_dummy_cpu_thread_fn(void *arg)
 }
 
 static void tcg_exec_all(void);
+static int tcg_cpu_exec(CPUArchState *env);
 
 static void *qemu_tcg_cpu_thread_fn(void *arg)
 {
@@ -820,6 +899,7 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
 
     /* signal CPU creation */
     qemu_mutex_lock(&qemu_global_mutex);
+    tls_var(iothread_locked) = true;
     for (env = first_cpu; env != NULL; env = env->next_cpu) {
         env->thread_id = qemu_get_thread_id();
         env->created = 1;
@@ -847,6 +927,76 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
     return NULL;
 }
 
+static void qemu_tcg_exec_begin(void)
+{
+    while (tcg_flush_pending) {
+        qemu_cond_wait(&qemu_tcg_flush_cond, &qemu_global_mutex);
+    }
+    tcg_running_cpus++;
+}
+
+static void qemu_tcg_exec_end(void)
+{
+    if (--tcg_running_cpus == 0 && tcg_flush_pending) {
+        tb_flush(first_cpu);
+        tcg_flush_pending = false;
+        qemu_cond_broadcast(&qemu_tcg_flush_cond);
+    }
+}
+
+bool qemu_tcg_cpus_running(void)
+{
+    return tcg_running_cpus != 0;
+}
+
+/* Ask for a tb_flush() once no vCPU thread is executing translated code.
+   Can be called without the BQL from a vCPU thread.  */
+void qemu_tcg_request_flush(void)
+{
+    CPUArchState *env;
+
+    tcg_flush_pending = true;
+    smp_mb();
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        cpu_exit(env);
+    }
+}
+
+/* With -tcg-threads multi each vCPU has a thread of its own, which only
+   takes the BQL to handle interrupts, I/O and queued work.  */
+static void *qemu_tcg_mt_cpu_thread_fn(void *arg)
+{
+    CPUArchState *env = arg;
+    CPUState *cpu = ENV_GET_CPU(env);
+    int r;
+
+    qemu_tcg_init_cpu_signals();
+
+    qemu_mutex_lock_iothread();
+    qemu_thread_get_self(cpu->thread);
+    env->thread_id = qemu_get_thread_id();
+
+    /* signal CPU creation */
+    env->created = 1;
+    qemu_cond_signal(&qemu_cpu_cond);
+
+    while (1) {
+        if (cpu_can_run(env)) {
+            qemu_tcg_exec_begin();
+            qemu_mutex_unlock_iothread();
+            r = tcg_cpu_exec(env);
+            qemu_mutex_lock_iothread();
+            qemu_tcg_exec_end();
+            if (r == EXCP_DEBUG) {
+                cpu_handle_guest_debug(env);
+            }
+        }
+        qemu_tcg_mt_wait_io_event(env);
+    }
+
+    return NULL;
+}
+
 static void qemu_cpu_kick_thread(CPUArchState *env)
 {
     CPUState *cpu = ENV_GET_CPU(env);
@@ -873,6 +1023,10 @@ void qemu_cpu_kick(void *_env)
     CPUState *cpu = ENV_GET_CPU(env);
 
     qemu_cond_broadcast(env->halt_cond);
+    if (parallel_cpus) {
+        cpu_exit(env);
+        return;
+    }
     if (!tcg_enabled() && !cpu->thread_kicked) {
         qemu_cpu_kick_thread(env);
         cpu->thread_kicked = true;
@@ -904,7 +1058,7 @@ int qemu_cpu_is_self(void *_env)
 
 void qemu_mutex_lock_iothread(void)
 {
-    if (!tcg_enabled()) {
+    if (!tcg_enabled() || parallel_cpus) {
         qemu_mutex_lock(&qemu_global_mutex);
     } else {
         iothread_requesting_mutex = true;
@@ -915,13 +1069,20 @@ void qemu_mutex_lock_iothread(void)
         iothread_requesting_mutex = false;
         qemu_cond_broadcast(&qemu_io_proceeded_cond);
     }
+    tls_var(iothread_locked) = true;
 }
 
 void qemu_mutex_unlock_iothread(void)
 {
+    tls_var(iothread_locked) = false;
     qemu_mutex_unlock(&qemu_global_mutex);
 }
 
+bool qemu_mutex_iothread_locked(void)
+{
+    return tls_var(iothread_locked);
+}
+
 static int all_vcpus_paused(void)
 {
     CPUArchState *penv = first_cpu;
@@ -949,7 +1110,7 @@ void pause_all_vcpus(void)
 
     if (!qemu_thread_is_self(&io_thread)) {
         cpu_stop_current();
-        if (!kvm_enabled()) {
+        if (!kvm_enabled() && !parallel_cpus) {
             while (penv) {
                 penv->stop = 0;
                 penv->stopped = 1;
@@ -987,6 +1148,18 @@ static void qemu_tcg_init_vcpu(void *_env)
     CPUArchState *env = _env;
     CPUState *cpu = ENV_GET_CPU(env);
 
+    if (parallel_cpus) {
+        cpu->thread = g_malloc0(sizeof(QemuThread));
+        env->halt_cond = g_malloc0(sizeof(QemuCond));
+        qemu_cond_init(env->halt_cond);
+        qemu_thread_create(cpu->thread, qemu_tcg_mt_cpu_thread_fn, env,
+                           QEMU_THREAD_JOINABLE);
+        while (env->created == 0) {
+            qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
+        }
+        return;
+    }
+
     /* share a single thread for all cpus with TCG */
     if (!tcg_cpu_thread) {
         cpu->thread = g_malloc0(sizeof(QemuThread));
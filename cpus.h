@@ -6,6 +6,8 @@ void qemu_init_cpu_loop(void);
 void resume_all_vcpus(void);
 void pause_all_vcpus(void);
 void cpu_stop_current(void);
+bool qemu_tcg_cpus_running(void);
+void qemu_tcg_request_flush(void);
 
 void cpu_synchronize_all_states(void);
 void cpu_synchronize_all_post_reset(void);
@@ -13,6 +15,11 @@ void cpu_synchronize_all_post_init(void);
 
 void qtest_clock_warp(int64_t dest);
 
+/* exec.c */
+struct MemoryRegion;
+bool cpu_io_lock(struct MemoryRegion *mr);
+void cpu_io_unlock(bool locked);
+
 /* vl.c */
 extern int smp_cores;
 extern int smp_threads;
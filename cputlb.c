@@ -21,6 +21,8 @@
 #include "cpu.h"
 #include "exec-all.h"
 #include "memory.h"
+#include "qemu-barrier.h"
+#include "qemu-timer.h"
 
 #include "cputlb.h"
 
@@ -32,6 +34,8 @@
 
 /* statistics */
 int tlb_flush_count;
+int tlb_flush_page_count;
+int tlb_flush_large_page_count;
 
 static const CPUTLBEntry s_cputlb_empty_entry = {
     .addr_read  = -1,
@@ -40,6 +44,78 @@ static const CPUTLBEntry s_cputlb_empty_entry = {
     .addend     = -1,
 };
 
+#ifdef CPU_TLB_DYN
+/* A TLB is shrunk only if it has been underused for this long, so that
+   the flushes of a briefly idle guest do not make it thrash.  */
+#define TLB_RESIZE_WINDOW_NS (100 * 1000 * 1000)
+
+static void tlb_mmu_alloc(CPUArchState *env, int mmu_idx, size_t n_entries)
+{
+    env->tlb_mask[mmu_idx] = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
+    env->tlb_table[mmu_idx] = g_malloc(n_entries * sizeof(CPUTLBEntry));
+    env->iotlb[mmu_idx] = g_malloc(n_entries * sizeof(target_phys_addr_t));
+}
+
+/* Called at flush time, before the TLB of 'mmu_idx' is cleared.  The
+   TLB grows as soon as more than 70% of it was in use at a flush, and
+   shrinks to fit when less than 30% was used at every flush over the
+   last TLB_RESIZE_WINDOW_NS.  */
+static void tlb_mmu_resize(CPUArchState *env, int mmu_idx, int64_t now)
+{
+    CPUTLBDesc *desc = &env->tlb_desc[mmu_idx];
+    size_t old_size = tlb_n_entries(env, mmu_idx);
+    size_t new_size = old_size;
+    size_t rate;
+    bool window_expired = now > desc->window_begin_ns + TLB_RESIZE_WINDOW_NS;
+
+    if (desc->n_used > desc->window_max_used) {
+        desc->window_max_used = desc->n_used;
+    }
+    rate = desc->window_max_used * 100 / old_size;
+
+    if (rate > 70) {
+        if (old_size < (1 << CPU_TLB_DYN_MAX_BITS)) {
+            new_size = old_size * 2;
+        }
+    } else if (rate < 30 && window_expired) {
+        /* the smallest size that would have been used at most 70% */
+        new_size = 1 << CPU_TLB_DYN_MIN_BITS;
+        while (new_size < old_size &&
+               desc->window_max_used * 100 / new_size > 70) {
+            new_size *= 2;
+        }
+    }
+
+    if (new_size != old_size) {
+        g_free(env->tlb_table[mmu_idx]);
+        g_free(env->iotlb[mmu_idx]);
+        tlb_mmu_alloc(env, mmu_idx, new_size);
+        env->tlb_resize_count++;
+    }
+    if (new_size != old_size || window_expired) {
+        desc->window_begin_ns = now;
+        desc->window_max_used = desc->n_used;
+    }
+    desc->n_used = 0;
+}
+#endif
+
+void tlb_init(CPUArchState *env)
+{
+#ifdef CPU_TLB_DYN
+    int64_t now = qemu_get_clock_ns(rt_clock);
+    int mmu_idx;
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        tlb_mmu_alloc(env, mmu_idx, CPU_TLB_SIZE);
+        env->tlb_desc[mmu_idx].n_used = 0;
+        env->tlb_desc[mmu_idx].window_max_used = 0;
+        env->tlb_desc[mmu_idx].window_begin_ns = now;
+    }
+#endif
+    tlb_flush(env, 1);
+}
+
 /* NOTE:
  * If flush_global is true (the usual case), flush all tlb entries.
  * If flush_global is false, flush (at least) all tlb entries not
@@ -52,9 +128,24 @@ static const CPUTLBEntry s_cputlb_empty_entry = {
  * entries from the TLB at any time, so flushing more entries than
  * required is only an efficiency issue, not a correctness issue.
  */
+static void tlb_flush_async_work(void *data)
+{
+    tlb_flush(data, 1);
+}
+
 void tlb_flush(CPUArchState *env, int flush_global)
 {
     int i;
+    int mmu_idx;
+#ifdef CPU_TLB_DYN
+    int64_t now = qemu_get_clock_ns(rt_clock);
+#endif
+
+    if (parallel_cpus && env->created && !qemu_cpu_is_self(env)) {
+        /* the TLB belongs to a vCPU running on another thread */
+        async_run_on_cpu(env, tlb_flush_async_work, env);
+        return;
+    }
 
 #if defined(DEBUG_TLB)
     printf("tlb_flush:\n");
@@ -63,37 +154,133 @@ void tlb_flush(CPUArchState *env, int flush_global)
        links while we are modifying them */
     env->current_tb = NULL;
 
-    for (i = 0; i < CPU_TLB_SIZE; i++) {
-        int mmu_idx;
+    /* cpu_tlb_reset_dirty_all may be walking the tables from another
+       thread */
+    phys_map_lock();
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        unsigned int n;
 
-        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+#ifdef CPU_TLB_DYN
+        tlb_mmu_resize(env, mmu_idx, now);
+#endif
+        n = tlb_n_entries(env, mmu_idx);
+        for (i = 0; i < n; i++) {
             env->tlb_table[mmu_idx][i] = s_cputlb_empty_entry;
         }
+        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+            env->tlb_v_table[mmu_idx][i] = s_cputlb_empty_entry;
+        }
     }
+    phys_map_unlock();
 
     memset(env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
 
+    env->tlb_nb_large_pages = 0;
     env->tlb_flush_addr = -1;
     env->tlb_flush_mask = 0;
     tlb_flush_count++;
 }
 
-static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
+/* Return true if the entry maps page 'addr' for any kind of access.  */
+static inline bool tlb_hit_page_anyprot(CPUTLBEntry *tlb_entry,
+                                        target_ulong addr)
+{
+    return addr == (tlb_entry->addr_read &
+                    (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
+           addr == (tlb_entry->addr_write &
+                    (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
+           addr == (tlb_entry->addr_code &
+                    (TARGET_PAGE_MASK | TLB_INVALID_MASK));
+}
+
+static inline bool tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
 {
-    if (addr == (tlb_entry->addr_read &
-                 (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
-        addr == (tlb_entry->addr_write &
-                 (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
-        addr == (tlb_entry->addr_code &
-                 (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
+    if (tlb_hit_page_anyprot(tlb_entry, addr)) {
         *tlb_entry = s_cputlb_empty_entry;
+        return true;
     }
+    return false;
+}
+
+/* Same as tlb_flush_entry, for all the pages of the large page at 'addr'
+   ('addr' & ~'mask' == 0).  */
+static inline bool tlb_flush_entry_mask(CPUTLBEntry *tlb_entry,
+                                        target_ulong addr, target_ulong mask)
+{
+    mask |= TLB_INVALID_MASK;
+    if (addr == (tlb_entry->addr_read & mask) ||
+        addr == (tlb_entry->addr_write & mask) ||
+        addr == (tlb_entry->addr_code & mask)) {
+        *tlb_entry = s_cputlb_empty_entry;
+        return true;
+    }
+    return false;
+}
+
+static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
+{
+    return te->addr_read == -1 && te->addr_write == -1 &&
+           te->addr_code == -1;
+}
+
+/* Flush the entries of all the pages of the large page at 'addr'.  */
+static void tlb_flush_large_page(CPUArchState *env, target_ulong addr,
+                                 target_ulong mask)
+{
+    target_ulong nb_pages = (~mask >> TARGET_PAGE_BITS) + 1;
+    target_ulong page;
+    int mmu_idx;
+    unsigned int i, n;
+
+#if defined(DEBUG_TLB)
+    printf("tlb_flush_large_page: " TARGET_FMT_lx "/" TARGET_FMT_lx "\n",
+           addr, mask);
+#endif
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        CPUTLBEntry *table = env->tlb_table[mmu_idx];
+        int flushed = 0;
+
+        n = tlb_n_entries(env, mmu_idx);
+        if (nb_pages >= n) {
+            /* the page covers every slot, scan them once */
+            for (i = 0; i < n; i++) {
+                flushed += tlb_flush_entry_mask(&table[i], addr, mask);
+            }
+        } else {
+            for (page = 0; page < nb_pages; page++) {
+                i = tlb_index(env, mmu_idx,
+                              addr + (page << TARGET_PAGE_BITS));
+                flushed += tlb_flush_entry_mask(&table[i], addr, mask);
+            }
+        }
+#ifdef CPU_TLB_DYN
+        env->tlb_desc[mmu_idx].n_used -= flushed;
+#endif
+        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+            tlb_flush_entry_mask(&env->tlb_v_table[mmu_idx][i], addr, mask);
+        }
+    }
+
+    if (nb_pages >= TB_JMP_CACHE_SIZE / TB_JMP_PAGE_SIZE) {
+        memset(env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
+    } else {
+        for (page = 0; page < nb_pages; page++) {
+            tb_flush_jmp_cache(env, addr + (page << TARGET_PAGE_BITS));
+        }
+    }
+    tlb_flush_large_page_count++;
 }
 
 void tlb_flush_page(CPUArchState *env, target_ulong addr)
 {
     int i;
     int mmu_idx;
+    bool large = false;
+
+    if (parallel_cpus && env->created && !qemu_cpu_is_self(env)) {
+        async_run_on_cpu(env, tlb_flush_async_work, env);
+        return;
+    }
 
 #if defined(DEBUG_TLB)
     printf("tlb_flush_page: " TARGET_FMT_lx "\n", addr);
@@ -111,11 +298,40 @@ void tlb_flush_page(CPUArchState *env, target_ulong addr)
     /* must reset current TB so that interrupts cannot modify the
        links while we are modifying them */
     env->current_tb = NULL;
+    tlb_flush_page_count++;
+
+    i = 0;
+    while (i < env->tlb_nb_large_pages) {
+        CPUTLBLargePage *lp = &env->tlb_large_pages[i];
+
+        if ((addr & lp->mask) == lp->addr) {
+            tlb_flush_large_page(env, lp->addr, lp->mask);
+            *lp = env->tlb_large_pages[--env->tlb_nb_large_pages];
+            large = true;
+        } else {
+            i++;
+        }
+    }
+    if (large) {
+        /* the page of addr was part of it */
+        return;
+    }
 
     addr &= TARGET_PAGE_MASK;
-    i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
+        i = tlb_index(env, mmu_idx, addr);
+        if (tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr)) {
+#ifdef CPU_TLB_DYN
+            env->tlb_desc[mmu_idx].n_used--;
+#endif
+        }
+    }
+
+    /* check whether there are entries that need to be flushed in the vtlb */
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+            tlb_flush_entry(&env->tlb_v_table[mmu_idx][i], addr);
+        }
     }
 
     tb_flush_jmp_cache(env, addr);
@@ -151,7 +367,13 @@ void tlb_reset_dirty_range(CPUTLBEntry *tlb_entry, uintptr_t start,
     if (tlb_is_dirty_ram(tlb_entry)) {
         addr = (tlb_entry->addr_write & TARGET_PAGE_MASK) + tlb_entry->addend;
         if ((addr - start) < length) {
-            tlb_entry->addr_write |= TLB_NOTDIRTY;
+            if (parallel_cpus) {
+                /* the entry may belong to a vCPU running on another
+                   thread, which only ever clears TLB_NOTDIRTY */
+                __sync_fetch_and_or(&tlb_entry->addr_write, TLB_NOTDIRTY);
+            } else {
+                tlb_entry->addr_write |= TLB_NOTDIRTY;
+            }
         }
     }
 }
@@ -175,18 +397,25 @@ void cpu_tlb_reset_dirty_all(ram_addr_t start1, ram_addr_t length)
 {
     CPUArchState *env;
 
+    /* keep the TLBs from being resized under our feet */
+    phys_map_lock();
     for (env = first_cpu; env != NULL; env = env->next_cpu) {
         int mmu_idx;
 
         for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-            unsigned int i;
+            unsigned int i, n = tlb_n_entries(env, mmu_idx);
 
-            for (i = 0; i < CPU_TLB_SIZE; i++) {
+            for (i = 0; i < n; i++) {
                 tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                       start1, length);
             }
+            for (i = 0; i < CPU_VTLB_SIZE; i++) {
+                tlb_reset_dirty_range(&env->tlb_v_table[mmu_idx][i],
+                                      start1, length);
+            }
         }
     }
+    phys_map_unlock();
 }
 
 static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
@@ -204,18 +433,43 @@ void tlb_set_dirty(CPUArchState *env, target_ulong vaddr)
     int mmu_idx;
 
     vaddr &= TARGET_PAGE_MASK;
-    i = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        i = tlb_index(env, mmu_idx, vaddr);
         tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
     }
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+            tlb_set_dirty1(&env->tlb_v_table[mmu_idx][i], vaddr);
+        }
+    }
 }
 
 /* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+   large pages and flush all of its entries if it is invalidated.  The
+   first CPU_TLB_LARGE_PAGES large pages are tracked one by one; the
+   others are merged into a single region that is flushed together with
+   the rest of the TLB.  */
 static void tlb_add_large_page(CPUArchState *env, target_ulong vaddr,
                                target_ulong size)
 {
     target_ulong mask = ~(size - 1);
+    CPUTLBLargePage *lp;
+    int i;
+
+    vaddr &= mask;
+    for (i = 0; i < env->tlb_nb_large_pages; i++) {
+        lp = &env->tlb_large_pages[i];
+        if (lp->addr == vaddr && lp->mask == mask) {
+            return;
+        }
+    }
+    if (env->tlb_nb_large_pages < CPU_TLB_LARGE_PAGES) {
+        lp = &env->tlb_large_pages[env->tlb_nb_large_pages++];
+        lp->addr = vaddr;
+        lp->mask = mask;
+        return;
+    }
 
     if (env->tlb_flush_addr == (target_ulong)-1) {
         env->tlb_flush_addr = vaddr & mask;
@@ -277,9 +531,24 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr,
     iotlb = memory_region_section_get_iotlb(env, section, vaddr, paddr, prot,
                                             &address);
 
-    index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-    env->iotlb[mmu_idx][index] = iotlb - vaddr;
+    index = tlb_index(env, mmu_idx, vaddr);
     te = &env->tlb_table[mmu_idx][index];
+
+    if (tlb_entry_is_empty(te)) {
+#ifdef CPU_TLB_DYN
+        env->tlb_desc[mmu_idx].n_used++;
+#endif
+    } else if (!tlb_hit_page_anyprot(te, vaddr & TARGET_PAGE_MASK)) {
+        /* do not discard the translation in te, evict it into a victim
+           tlb */
+        unsigned int vidx = env->vtlb_index++ % CPU_VTLB_SIZE;
+
+        env->tlb_v_table[mmu_idx][vidx] = *te;
+        env->iotlb_v[mmu_idx][vidx] = env->iotlb[mmu_idx][index];
+    }
+    env->tlb_fill_count++;
+
+    env->iotlb[mmu_idx][index] = iotlb - vaddr;
     te->addend = addend - vaddr;
     if (prot & PAGE_READ) {
         te->addr_read = address;
@@ -310,6 +579,110 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr,
     }
 }
 
+/* Look for the page of 'addr' in the victim TLB and, if it is there, swap
+   it with the entry of the direct mapped TLB that it conflicts with.
+   'is_write' is the access type as for tlb_fill.  Returns true on a hit,
+   in which case the caller can retry the TLB lookup without walking the
+   page tables.  */
+bool tlb_victim_fill(CPUArchState *env, target_ulong addr, int is_write,
+                     int mmu_idx)
+{
+    int index = tlb_index(env, mmu_idx, addr);
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    target_ulong cmp;
+    int vidx;
+
+    for (vidx = 0; vidx < CPU_VTLB_SIZE; vidx++) {
+        CPUTLBEntry *ve = &env->tlb_v_table[mmu_idx][vidx];
+
+        if (is_write == 0) {
+            cmp = ve->addr_read;
+        } else if (is_write == 1) {
+            cmp = ve->addr_write;
+        } else {
+            cmp = ve->addr_code;
+        }
+        if (page == (cmp & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
+            CPUTLBEntry *te = &env->tlb_table[mmu_idx][index];
+            CPUTLBEntry tmptlb = *te;
+            target_phys_addr_t tmpiotlb = env->iotlb[mmu_idx][index];
+
+#ifdef CPU_TLB_DYN
+            if (tlb_entry_is_empty(te)) {
+                env->tlb_desc[mmu_idx].n_used++;
+            }
+#endif
+            *te = *ve;
+            env->iotlb[mmu_idx][index] = env->iotlb_v[mmu_idx][vidx];
+            *ve = tmptlb;
+            env->iotlb_v[mmu_idx][vidx] = tmpiotlb;
+            if (parallel_cpus) {
+                /* tlb_reset_dirty_range may have run on another thread
+                   while the entry was being copied */
+                smp_mb();
+                tlb_update_dirty(te);
+            }
+            env->tlb_victim_hit_count++;
+            return true;
+        }
+    }
+    env->tlb_victim_miss_count++;
+    return false;
+}
+
+/* Return a host pointer through which the CPU can do an atomic
+   read-modify-write of 'size' bytes at guest address 'addr', filling the
+   TLB if needed.  Faults are raised as for a guest store from 'retaddr'.
+   Returns NULL if the access cannot be done directly on guest RAM (I/O,
+   ROM, watchpoints, or an access crossing a page boundary); the caller
+   then has to fall back to separate loads and stores.  */
+void *tlb_vaddr_to_host(CPUArchState *env, target_ulong addr, int size,
+                        int mmu_idx, uintptr_t retaddr)
+{
+    CPUTLBEntry *te;
+    int index;
+    uintptr_t haddr;
+
+    if (((addr & ~TARGET_PAGE_MASK) + size - 1) >= TARGET_PAGE_SIZE) {
+        return NULL;
+    }
+    index = tlb_index(env, mmu_idx, addr);
+    te = &env->tlb_table[mmu_idx][index];
+    if ((addr & TARGET_PAGE_MASK) !=
+        (te->addr_read & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
+        phys_map_lock();
+        if (!tlb_victim_fill(env, addr, 0, mmu_idx)) {
+            tlb_fill(env, addr, 0, mmu_idx, retaddr);
+        }
+        phys_map_unlock();
+        /* tlb_fill may have resized the TLB */
+        index = tlb_index(env, mmu_idx, addr);
+        te = &env->tlb_table[mmu_idx][index];
+    }
+    if ((addr & TARGET_PAGE_MASK) !=
+        (te->addr_write & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
+        phys_map_lock();
+        if (!tlb_victim_fill(env, addr, 1, mmu_idx)) {
+            tlb_fill(env, addr, 1, mmu_idx, retaddr);
+        }
+        phys_map_unlock();
+        index = tlb_index(env, mmu_idx, addr);
+        te = &env->tlb_table[mmu_idx][index];
+    }
+    if ((te->addr_read & ~TARGET_PAGE_MASK) ||
+        (te->addr_write & ~TARGET_PAGE_MASK & ~TLB_NOTDIRTY)) {
+        return NULL;
+    }
+    haddr = addr + te->addend;
+    if (te->addr_write & TLB_NOTDIRTY) {
+        env->mem_io_pc = retaddr;
+        env->mem_io_vaddr = addr;
+        tlb_notdirty_write(qemu_ram_addr_from_host_nofail((void *)haddr),
+                           size);
+    }
+    return (void *)haddr;
+}
+
 /* NOTE: this function can trigger an exception */
 /* NOTE2: the returned address is not exactly the physical address: it
  * is actually a ram_addr_t (in system mode; the user mode emulation
@@ -321,8 +694,8 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env1, target_ulong addr)
     void *p;
     MemoryRegion *mr;
 
-    page_index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     mmu_idx = cpu_mmu_index(env1);
+    page_index = tlb_index(env1, mmu_idx, addr);
     if (unlikely(env1->tlb_table[mmu_idx][page_index].addr_code !=
                  (addr & TARGET_PAGE_MASK))) {
 #ifdef CONFIG_TCG_PASS_AREG0
@@ -330,9 +703,12 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env1, target_ulong addr)
 #else
         ldub_code(addr);
 #endif
+        page_index = tlb_index(env1, mmu_idx, addr);
     }
     pd = env1->iotlb[mmu_idx][page_index] & ~TARGET_PAGE_MASK;
+    phys_map_lock();
     mr = iotlb_to_region(pd);
+    phys_map_unlock();
     if (memory_region_is_unassigned(mr)) {
 #if defined(TARGET_ALPHA) || defined(TARGET_MIPS) || defined(TARGET_SPARC)
         cpu_unassigned_access(env1, addr, 0, 1, 0, 4);
@@ -21,6 +21,7 @@
 
 #if !defined(CONFIG_USER_ONLY)
 /* cputlb.c */
+void tlb_init(CPUArchState *env);
 void tlb_protect_code(ram_addr_t ram_addr);
 void tlb_unprotect_code_phys(CPUArchState *env, ram_addr_t ram_addr,
                              target_ulong vaddr);
@@ -30,9 +31,12 @@ MemoryRegionSection *phys_page_find(target_phys_addr_t index);
 void cpu_tlb_reset_dirty_all(ram_addr_t start1, ram_addr_t length);
 void tlb_set_dirty(CPUArchState *env, target_ulong vaddr);
 extern int tlb_flush_count;
+extern int tlb_flush_page_count;
+extern int tlb_flush_large_page_count;
 
 /* exec.c */
 void tb_flush_jmp_cache(CPUArchState *env, target_ulong addr);
+void tlb_notdirty_write(ram_addr_t ram_addr, unsigned size);
 target_phys_addr_t memory_region_section_get_iotlb(CPUArchState *env,
                                                    MemoryRegionSection *section,
                                                    target_ulong vaddr,
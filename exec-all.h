@@ -98,6 +98,7 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
                                    int is_cpu_write_access);
 void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end,
                               int is_cpu_write_access);
+bool tb_page_nocache(tb_page_addr_t phys_pc);
 #if !defined(CONFIG_USER_ONLY)
 /* cputlb.c */
 void tlb_flush_page(CPUArchState *env, target_ulong addr);
@@ -118,9 +119,6 @@ static inline void tlb_flush(CPUArchState *env, int flush_global)
 
 #define CODE_GEN_ALIGN           16 /* must be >= of the size of a icache line */
 
-#define CODE_GEN_PHYS_HASH_BITS     15
-#define CODE_GEN_PHYS_HASH_SIZE     (1 << CODE_GEN_PHYS_HASH_BITS)
-
 #define MIN_CODE_GEN_BUFFER_SIZE     (1024 * 1024)
 
 /* estimated block size for TB allocation */
@@ -144,13 +142,13 @@ struct TranslationBlock {
     uint64_t flags; /* flags defining in which context the code was generated */
     uint16_t size;      /* size of target code for this block (1 <=
                            size <= TARGET_PAGE_SIZE) */
-    uint16_t cflags;    /* compile flags */
+    uint32_t cflags;    /* compile flags */
 #define CF_COUNT_MASK  0x7fff
 #define CF_LAST_IO     0x8000 /* Last insn may be an IO access.  */
+#define CF_SUPERBLOCK  0x10000 /* Retranslation of a hot TB.  */
+#define CF_PROFILE     0x20000 /* Count executions and helper calls.  */
 
     uint8_t *tc_ptr;    /* pointer to the translated code */
-    /* next matching tb for physical address. */
-    struct TranslationBlock *phys_hash_next;
     /* first and second physical page containing code. The lower bit
        of the pointer tells the index in page_next[] */
     struct TranslationBlock *page_next[2];
@@ -171,8 +169,16 @@ struct TranslationBlock {
     struct TranslationBlock *jmp_next[2];
     struct TranslationBlock *jmp_first;
     uint32_t icount;
+    /* executions so far, counted by the code of TBs with cflags == 0 */
+    uint32_t exec_count;
+    /* executions counted by the code of CF_PROFILE TBs */
+    uint64_t profile_count;
 };
 
+/* Number of executions after which a TB is retranslated as a superblock,
+   which follows direct unconditional jumps instead of ending there.  */
+#define TB_HOT_THRESHOLD 1000
+
 static inline unsigned int tb_jmp_cache_hash_page(target_ulong pc)
 {
     target_ulong tmp;
@@ -188,18 +194,83 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 	    | (tmp & TB_JMP_ADDR_MASK));
 }
 
-static inline unsigned int tb_phys_hash_func(tb_page_addr_t pc)
+/* xxHash32 primes */
+#define TB_HASH_PRIME32_1   2654435761U
+#define TB_HASH_PRIME32_2   2246822519U
+#define TB_HASH_PRIME32_3   3266489917U
+
+static inline uint32_t tb_hash_rol32(uint32_t v, int shift)
+{
+    return (v << shift) | (v >> (32 - shift));
+}
+
+static inline uint32_t tb_hash_round(uint32_t acc, uint32_t input)
 {
-    return (pc >> 2) & (CODE_GEN_PHYS_HASH_SIZE - 1);
+    acc += input * TB_HASH_PRIME32_2;
+    acc = tb_hash_rol32(acc, 13);
+    return acc * TB_HASH_PRIME32_1;
 }
 
+/* Hash of the lookup key of a TB, computed with the xxHash32 algorithm
+   over the four 64-bit inputs.  Every input bit affects every output
+   bit, so the bucket index can be taken from the low bits whatever the
+   table size.  */
+static inline uint32_t tb_hash_func(tb_page_addr_t phys_pc, target_ulong pc,
+                                    uint64_t flags, target_ulong cs_base)
+{
+    uint64_t ab = phys_pc, cd = pc, gh = cs_base;
+    uint32_t v1 = TB_HASH_PRIME32_1 + TB_HASH_PRIME32_2;
+    uint32_t v2 = TB_HASH_PRIME32_2;
+    uint32_t v3 = 0;
+    uint32_t v4 = -TB_HASH_PRIME32_1;
+    uint32_t h32;
+
+    v1 = tb_hash_round(v1, ab);
+    v2 = tb_hash_round(v2, ab >> 32);
+    v3 = tb_hash_round(v3, cd);
+    v4 = tb_hash_round(v4, cd >> 32);
+    v1 = tb_hash_round(v1, flags);
+    v2 = tb_hash_round(v2, flags >> 32);
+    v3 = tb_hash_round(v3, gh);
+    v4 = tb_hash_round(v4, gh >> 32);
+
+    h32 = tb_hash_rol32(v1, 1) + tb_hash_rol32(v2, 7) +
+          tb_hash_rol32(v3, 12) + tb_hash_rol32(v4, 18);
+    h32 += 32;
+
+    h32 ^= h32 >> 15;
+    h32 *= TB_HASH_PRIME32_2;
+    h32 ^= h32 >> 13;
+    h32 *= TB_HASH_PRIME32_3;
+    h32 ^= h32 >> 16;
+    return h32;
+}
+
+/* tb-hash.c */
+typedef bool tb_htable_cmp_func(TranslationBlock *tb, const void *opaque);
+
+void tb_htable_init(void);
+void tb_htable_reset(void);
+void tb_htable_insert(TranslationBlock *tb, tb_page_addr_t phys_pc);
+void tb_htable_remove(TranslationBlock *tb);
+bool tb_htable_contains(TranslationBlock *tb);
+TranslationBlock *tb_htable_lookup(uint32_t hash, tb_htable_cmp_func *cmp,
+                                   const void *opaque);
+void tb_htable_foreach(void (*func)(TranslationBlock *tb, void *opaque),
+                       void *opaque);
+void tb_htable_dump_info(FILE *f, fprintf_function cpu_fprintf);
+
+/* jit-perf.c */
+extern bool tcg_perf_enabled;
+void tcg_perf_report_tb(TranslationBlock *tb, int code_size);
+
 void tb_free(TranslationBlock *tb);
 void tb_flush(CPUArchState *env);
 void tb_link_page(TranslationBlock *tb,
                   tb_page_addr_t phys_pc, tb_page_addr_t phys_page2);
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
-
-extern TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
+void tb_gen_superblock(CPUArchState *env, TranslationBlock *tb);
+void *helper_lookup_tb_ptr(CPUArchState *env);
 
 #if defined(USE_DIRECT_JUMP)
 
@@ -214,12 +285,9 @@ static inline void tb_set_jmp_target1(uintptr_t jmp_addr, uintptr_t addr)
 void ppc_tb_set_jmp_target(unsigned long jmp_addr, unsigned long addr);
 #define tb_set_jmp_target1 ppc_tb_set_jmp_target
 #elif defined(__i386__) || defined(__x86_64__)
-static inline void tb_set_jmp_target1(uintptr_t jmp_addr, uintptr_t addr)
-{
-    /* patch the branch destination */
-    *(uint32_t *)jmp_addr = addr - (jmp_addr + 4);
-    /* no need to flush icache explicitly */
-}
+/* out of line to reach the writable mapping of a W^X code buffer */
+void i386_tb_set_jmp_target(uintptr_t jmp_addr, uintptr_t addr);
+#define tb_set_jmp_target1 i386_tb_set_jmp_target
 #elif defined(__arm__)
 static inline void tb_set_jmp_target1(uintptr_t jmp_addr, uintptr_t addr)
 {
@@ -284,10 +352,44 @@ TranslationBlock *tb_find_pc(uintptr_t pc_ptr);
 
 #include "qemu-lock.h"
 
-extern spinlock_t tb_lock;
-
 extern int tb_invalidated_flag;
 
+/* exec.c: locks used when vCPUs run in parallel (-tcg-threads multi, or
+   guest threads in user mode) */
+extern bool parallel_cpus;
+void tb_lock_acquire(void);
+void tb_lock_release(void);
+void cpu_atomic_lock(void);
+void cpu_atomic_unlock(void);
+void cpu_exec_reset_locks(void);
+#if !defined(CONFIG_USER_ONLY)
+void phys_map_lock(void);
+void phys_map_unlock(void);
+struct MemoryRegion *cpu_mmio_region(CPUArchState *env,
+                                     target_phys_addr_t index,
+                                     uintptr_t retaddr);
+#else
+/* With parallel_cpus, tb_flush only sets tb_flush_pending and the user
+   mode code calls tb_flush_exclusive once no other thread is running
+   translated code.  */
+extern bool tb_flush_pending;
+void tb_flush_exclusive(CPUArchState *env);
+#endif
+
+#if defined(CONFIG_LINUX_USER)
+/* linux-user/tb-cache.c: ops of the TBs saved across runs (-tb-cache) */
+extern bool tb_cache_enabled;
+bool tb_cache_lookup(CPUArchState *env, TranslationBlock *tb);
+void tb_cache_add(CPUArchState *env, TranslationBlock *tb);
+#else
+#define tb_cache_enabled false
+static inline bool tb_cache_lookup(CPUArchState *env, TranslationBlock *tb)
+{
+    return false;
+}
+static inline void tb_cache_add(CPUArchState *env, TranslationBlock *tb) { }
+#endif
+
 /* The return address may point to the start of the next instruction.
    Subtracting one gets us the call instruction itself.  */
 #if defined(CONFIG_TCG_INTERPRETER)
@@ -318,6 +420,10 @@ void io_mem_write(struct MemoryRegion *mr, target_phys_addr_t addr,
 
 void tlb_fill(CPUArchState *env1, target_ulong addr, int is_write, int mmu_idx,
               uintptr_t retaddr);
+void *tlb_vaddr_to_host(CPUArchState *env, target_ulong addr, int size,
+                        int mmu_idx, uintptr_t retaddr);
+bool tlb_victim_fill(CPUArchState *env, target_ulong addr, int is_write,
+                     int mmu_idx);
 
 #include "softmmu_defs.h"
 
@@ -350,6 +456,13 @@ static inline tb_page_addr_t get_page_addr_code(CPUArchState *env1, target_ulong
 {
     return addr;
 }
+
+/* exec.c: guest memory is directly mapped, so there is no TLB to fill.
+   'retaddr' is not evaluated: GETPC() is not defined for all user mode
+   helpers with TCI.  */
+void *page_vaddr_to_host(target_ulong addr, int size);
+#define tlb_vaddr_to_host(env, addr, size, mmu_idx, retaddr) \
+    page_vaddr_to_host(addr, size)
 #else
 /* cputlb.c */
 tb_page_addr_t get_page_addr_code(CPUArchState *env1, target_ulong addr);
@@ -55,6 +55,13 @@
 #else /* !CONFIG_USER_ONLY */
 #include "xen-mapcache.h"
 #include "trace.h"
+#include "qemu-thread.h"
+#include "qemu-barrier.h"
+#include "main-loop.h"
+#include "cpus.h"
+#include "disas.h"
+#include "qerror.h"
+#include "qmp-commands.h"
 #endif
 
 #include "cputlb.h"
@@ -78,13 +85,158 @@
 #endif
 
 #define SMC_BITMAP_USE_THRESHOLD 10
-
+/* A page on which guest writes invalidated SMC_NOCACHE_THRESHOLD TBs has
+   its code executed without caching the translation for the next
+   SMC_NOCACHE_EXECS blocks, after which caching is tried again.  */
+#define SMC_NOCACHE_THRESHOLD 32
+#define SMC_NOCACHE_EXECS 1024
+
+/* tbs[] is used as a ring: the nb_tbs live TBs start at tbs_first, in
+   the order they were generated.  */
 static TranslationBlock *tbs;
 static int code_gen_max_blocks;
-TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
+static int tbs_first;
 static int nb_tbs;
-/* any access to the tbs or the page table must use this lock */
-spinlock_t tb_lock = SPIN_LOCK_UNLOCKED;
+
+/* With -tcg-threads multi every vCPU runs on its own thread and no longer
+   holds the BQL while executing guest code.  The locks below then protect
+   the state that used to be implicitly serialized by the BQL: the TB
+   structures and TCG context (tb_mutex), the physical memory map as seen
+   by TLB refills (phys_map_mutex) and the fallback path of the guest
+   atomic instructions (atomic_mutex).  All three can be taken recursively
+   and are no-ops unless parallel_cpus is set.
+
+   In user mode the guest threads always run concurrently, so tb_mutex and
+   atomic_mutex are always taken; parallel_cpus is set when the first
+   thread is created and selects host atomics for the guest atomic
+   instructions.  tb_lock_acquire also takes mmap_lock there, which must
+   come first: the TB page lists and the page flags go together.  */
+bool parallel_cpus;
+static QemuMutex tb_mutex;
+#if !defined(CONFIG_USER_ONLY)
+static QemuMutex phys_map_mutex;
+#endif
+static QemuMutex atomic_mutex;
+static DEFINE_TLS(int, tb_lock_depth);
+#if !defined(CONFIG_USER_ONLY)
+static DEFINE_TLS(int, phys_map_lock_depth);
+#endif
+static DEFINE_TLS(int, atomic_lock_depth);
+
+#if defined(CONFIG_USER_ONLY)
+#define mt_locking() true
+#else
+#define mt_locking() parallel_cpus
+#endif
+
+static inline void mt_lock(QemuMutex *mutex, int *depth)
+{
+    if (mt_locking() && (*depth)++ == 0) {
+        qemu_mutex_lock(mutex);
+    }
+}
+
+static inline void mt_unlock(QemuMutex *mutex, int *depth)
+{
+    if (mt_locking() && --(*depth) == 0) {
+        qemu_mutex_unlock(mutex);
+    }
+}
+
+static inline void mt_lock_reset(QemuMutex *mutex, int *depth)
+{
+    if (*depth) {
+        *depth = 0;
+        qemu_mutex_unlock(mutex);
+    }
+}
+
+void tb_lock_acquire(void)
+{
+#if defined(CONFIG_USER_ONLY)
+    if (tls_var(tb_lock_depth) == 0) {
+        mmap_lock();
+    }
+#endif
+    mt_lock(&tb_mutex, &tls_var(tb_lock_depth));
+}
+
+void tb_lock_release(void)
+{
+    mt_unlock(&tb_mutex, &tls_var(tb_lock_depth));
+#if defined(CONFIG_USER_ONLY)
+    if (tls_var(tb_lock_depth) == 0) {
+        mmap_unlock();
+    }
+#endif
+}
+
+#if !defined(CONFIG_USER_ONLY)
+void phys_map_lock(void)
+{
+    mt_lock(&phys_map_mutex, &tls_var(phys_map_lock_depth));
+}
+
+void phys_map_unlock(void)
+{
+    mt_unlock(&phys_map_mutex, &tls_var(phys_map_lock_depth));
+}
+#endif
+
+void cpu_atomic_lock(void)
+{
+    mt_lock(&atomic_mutex, &tls_var(atomic_lock_depth));
+}
+
+void cpu_atomic_unlock(void)
+{
+    mt_unlock(&atomic_mutex, &tls_var(atomic_lock_depth));
+}
+
+/* An exception raised from a helper or from the softmmu slow path
+   longjmps back to cpu_exec() with whatever locks it held at the time.  */
+void cpu_exec_reset_locks(void)
+{
+    if (!mt_locking()) {
+        return;
+    }
+    mt_lock_reset(&atomic_mutex, &tls_var(atomic_lock_depth));
+#if defined(CONFIG_USER_ONLY)
+    mt_lock_reset(&tb_mutex, &tls_var(tb_lock_depth));
+    mmap_lock_reset();
+#else
+    mt_lock_reset(&phys_map_mutex, &tls_var(phys_map_lock_depth));
+    mt_lock_reset(&tb_mutex, &tls_var(tb_lock_depth));
+    if (qemu_mutex_iothread_locked()) {
+        qemu_mutex_unlock_iothread();
+    }
+#endif
+}
+
+#if !defined(CONFIG_USER_ONLY)
+/* Device emulation still relies on the BQL.  Take it around an access to
+   anything but RAM-like regions if the caller does not hold it yet.  A
+   NULL region stands for port I/O and other device state.  */
+bool cpu_io_lock(MemoryRegion *mr)
+{
+    if (!parallel_cpus || qemu_mutex_iothread_locked()) {
+        return false;
+    }
+    if (mr == &io_mem_ram || mr == &io_mem_rom ||
+        mr == &io_mem_unassigned || mr == &io_mem_notdirty) {
+        return false;
+    }
+    qemu_mutex_lock_iothread();
+    return true;
+}
+
+void cpu_io_unlock(bool locked)
+{
+    if (locked) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+#endif
 
 #if defined(__arm__) || defined(__sparc_v9__)
 /* The prologue must be reachable with a direct jump. ARM and Sparc64
@@ -101,13 +253,51 @@ spinlock_t tb_lock = SPIN_LOCK_UNLOCKED;
     __attribute__((aligned (32)))
 #endif
 
-uint8_t code_gen_prologue[1024] code_gen_section;
+#define CODE_GEN_PROLOGUE_SIZE 1024
+
+static uint8_t code_gen_prologue_buf[CODE_GEN_PROLOGUE_SIZE] code_gen_section;
+uint8_t *code_gen_prologue = code_gen_prologue_buf;
 static uint8_t *code_gen_buffer;
 static unsigned long code_gen_buffer_size;
-/* threshold to flush the translated code buffer */
-static unsigned long code_gen_buffer_max_size;
 static uint8_t *code_gen_ptr;
 
+/* Pages backing the code buffer (-tcg-buffer).  Huge pages give the
+   generated code a much larger iTLB reach.  */
+enum {
+    CODE_GEN_PAGES_SMALL,
+    CODE_GEN_PAGES_THP,
+    CODE_GEN_PAGES_HUGETLB,
+};
+
+#define CODE_GEN_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static int code_gen_pages = CODE_GEN_PAGES_THP;
+/* map the buffer twice instead of writable and executable */
+static bool code_gen_split_wx;
+uintptr_t code_gen_rw_offset;
+
+/* The code buffer is split in regions that are filled in turn.  When the
+   current one is full, translation goes on in the next one after
+   invalidating the TBs it holds, which are the oldest ones, instead of
+   flushing the whole buffer.  The TBs of a region are contiguous in
+   tbs[].  */
+#define CODE_GEN_MAX_REGIONS 8
+
+typedef struct CodeGenRegion {
+    uint8_t *start;
+    /* no TB starts past this point, so that it fits in the region */
+    uint8_t *end;
+    /* code_gen_ptr when translation last moved to the next region */
+    uint8_t *ptr;
+    int first_tb;
+    int nb_tbs;
+} CodeGenRegion;
+
+static CodeGenRegion code_gen_regions[CODE_GEN_MAX_REGIONS];
+static int code_gen_nb_regions;
+static int code_gen_cur_region;
+static unsigned long code_gen_region_size;
+
 #if !defined(CONFIG_USER_ONLY)
 int phys_ram_fd;
 static int in_migration;
@@ -138,6 +328,14 @@ typedef struct PageDesc {
        of lookups we do to a given page to use a bitmap */
     unsigned int code_write_count;
     uint8_t *code_bitmap;
+    /* number of TBs invalidated by writes to the page */
+    unsigned int smc_count;
+#if !defined(CONFIG_USER_ONLY)
+    /* the same since the page was last put in the uncached state, and
+       the number of blocks to execute before leaving it */
+    unsigned int smc_recent;
+    unsigned int smc_nocache;
+#endif
 #if defined(CONFIG_USER_ONLY)
     unsigned long flags;
 #endif
@@ -218,7 +416,15 @@ static MemoryRegion io_mem_watch;
 
 /* statistics */
 static int tb_flush_count;
+static int tb_superblock_count;
 static int tb_phys_invalidate_count;
+static int tb_evict_count;
+static int tb_evict_tb_count;
+static int tb_smc_invalidate_count;
+#if !defined(CONFIG_USER_ONLY)
+static int tb_smc_nocache_count;
+static int tb_smc_nocache_exec_count;
+#endif
 
 #ifdef _WIN32
 static void map_exec(void *addr, long size)
@@ -498,6 +704,34 @@ bool memory_region_is_unassigned(MemoryRegion *mr)
 #endif
 
 #define DEFAULT_CODE_GEN_BUFFER_SIZE (32 * 1024 * 1024)
+/* Minimum default size for system emulation on 64-bit hosts, where
+   address space is cheap; the pages are only touched when used.  */
+#define DEFAULT_CODE_GEN_BUFFER_SIZE_64 (256 * 1024 * 1024)
+
+/* The largest buffer the host can branch across, or map where needed */
+#if defined(__x86_64__) && (defined(__FreeBSD__) || \
+    defined(__FreeBSD_kernel__) || defined(__DragonFly__) || \
+    defined(__OpenBSD__) || defined(__NetBSD__))
+/* FreeBSD doesn't have MAP_32BIT, the buffer is mapped at 0x40000000 */
+#define MAX_CODE_GEN_BUFFER_SIZE (800ul * 1024 * 1024)
+#elif defined(__x86_64__)
+/* Below 2G, calls from the generated code to QEMU are direct.  Larger
+   buffers do not fit there and use indirect calls; they are still limited
+   by the 32-bit displacement of the direct jumps between TBs.  User mode
+   leaves the low 2G to the guest.  */
+#define MAX_CODE_GEN_BUFFER_SIZE (2047ul * 1024 * 1024)
+#elif defined(__sparc_v9__)
+/* Map the buffer below 2G, so we can use direct calls and branches */
+#define MAX_CODE_GEN_BUFFER_SIZE (512ul * 1024 * 1024)
+#elif defined(__arm__)
+/* Keep the buffer no bigger than 16MB to branch between blocks */
+#define MAX_CODE_GEN_BUFFER_SIZE (16ul * 1024 * 1024)
+#elif defined(__s390x__)
+/* We have a +- 4GB range on the branches; leave some slop.  */
+#define MAX_CODE_GEN_BUFFER_SIZE (3ul * 1024 * 1024 * 1024)
+#else
+#define MAX_CODE_GEN_BUFFER_SIZE ((unsigned long)-1)
+#endif
 
 #if defined(CONFIG_USER_ONLY)
 /* Currently it is not recommended to allocate big chunks of data in
@@ -510,13 +744,211 @@ static uint8_t static_code_gen_buffer[DEFAULT_CODE_GEN_BUFFER_SIZE]
                __attribute__((aligned (CODE_GEN_ALIGN)));
 #endif
 
-static void code_gen_alloc(unsigned long tb_size)
+void configure_tcg_buffer(const char *option)
 {
-#ifdef USE_STATIC_CODE_GEN_BUFFER
-    code_gen_buffer = static_code_gen_buffer;
-    code_gen_buffer_size = DEFAULT_CODE_GEN_BUFFER_SIZE;
-    map_exec(code_gen_buffer, code_gen_buffer_size);
+    char *opts, *p, *next;
+
+    if (!option) {
+        return;
+    }
+    opts = g_strdup(option);
+    for (p = opts; p; p = next) {
+        next = strchr(p, ',');
+        if (next) {
+            *next++ = '\0';
+        }
+        if (!strcmp(p, "small")) {
+            code_gen_pages = CODE_GEN_PAGES_SMALL;
+        } else if (!strcmp(p, "thp")) {
+            code_gen_pages = CODE_GEN_PAGES_THP;
+        } else if (!strcmp(p, "hugetlb")) {
+#if defined(__linux__)
+            code_gen_pages = CODE_GEN_PAGES_HUGETLB;
+#else
+            fprintf(stderr, "-tcg-buffer hugetlb is not supported "
+                    "on this host\n");
+            exit(1);
+#endif
+        } else if (!strcmp(p, "split-wx")) {
+#if defined(TCG_TARGET_SPLIT_WX) && defined(__linux__)
+            code_gen_split_wx = true;
 #else
+            fprintf(stderr, "-tcg-buffer split-wx is not supported "
+                    "on this host\n");
+            exit(1);
+#endif
+        } else {
+            fprintf(stderr, "Invalid -tcg-buffer value '%s'\n", p);
+            exit(1);
+        }
+    }
+    g_free(opts);
+}
+
+/* Ask for transparent huge pages on the huge page aligned part of
+   [addr, addr + size).  */
+static void code_gen_advise(void *addr, size_t size)
+{
+    uintptr_t start, end;
+
+    if (code_gen_pages != CODE_GEN_PAGES_THP) {
+        return;
+    }
+    start = ((uintptr_t)addr + CODE_GEN_HUGE_PAGE_SIZE - 1) &
+            ~(uintptr_t)(CODE_GEN_HUGE_PAGE_SIZE - 1);
+    end = ((uintptr_t)addr + size) & ~(uintptr_t)(CODE_GEN_HUGE_PAGE_SIZE - 1);
+    if (end > start) {
+        qemu_madvise((void *)start, end - start, QEMU_MADV_HUGEPAGE);
+    }
+}
+
+#if defined(__linux__)
+
+#include <sys/syscall.h>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 4
+#endif
+
+/* Reserve size bytes of address space for the buffer, aligned to a huge
+   page unless small pages were asked for.  'flags' carries the placement
+   constraints of the host.  */
+static uint8_t *code_gen_reserve(void *start, size_t size, int flags)
+{
+    size_t align = CODE_GEN_HUGE_PAGE_SIZE;
+    uint8_t *p, *q;
+
+    if (code_gen_pages == CODE_GEN_PAGES_SMALL || (flags & MAP_FIXED)) {
+        align = 0;
+    }
+    p = mmap(start, size + align, PROT_NONE,
+             flags | MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    if (align) {
+        q = (uint8_t *)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+        if (q != p) {
+            munmap(p, q - p);
+        }
+        if (q != p + align) {
+            munmap(q + size, p + align - q);
+        }
+        p = q;
+    }
+    return p;
+}
+
+/* Create the file shared by the two mappings of a W^X buffer.  */
+static int code_gen_memfd(size_t size, bool huge)
+{
+    int fd = -1;
+
+#ifdef __NR_memfd_create
+    fd = syscall(__NR_memfd_create, "qemu-code-gen-buffer",
+                 huge ? MFD_HUGETLB : 0);
+#endif
+    if (fd < 0 && !huge) {
+        char filename[] = "/dev/shm/qemu-code-gen-buffer.XXXXXX";
+
+        fd = mkstemp(filename);
+        if (fd >= 0) {
+            unlink(filename);
+        }
+    }
+    if (fd >= 0 && ftruncate(fd, size)) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* Map the buffer twice at 'rx', executable, and at a second reserved
+   range, writable.  */
+static bool code_gen_map_split(uint8_t *rx, size_t size, bool huge)
+{
+    uint8_t *rw;
+    int fd;
+
+    fd = code_gen_memfd(size, huge);
+    if (fd < 0) {
+        return false;
+    }
+    rw = code_gen_reserve(NULL, size, 0);
+    if (!rw) {
+        close(fd);
+        return false;
+    }
+    if (mmap(rx, size, PROT_READ | PROT_EXEC,
+             MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(rw, size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        /* a failed MAP_FIXED may leave a hole, keep the range reserved */
+        mmap(rx, size, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+        munmap(rw, size);
+        close(fd);
+        return false;
+    }
+    close(fd);
+    code_gen_rw_offset = rw - rx;
+    code_gen_advise(rw, size);
+    return true;
+}
+
+static void *code_gen_mmap(void *start, int flags)
+{
+    size_t size = code_gen_buffer_size;
+    bool huge = code_gen_pages == CODE_GEN_PAGES_HUGETLB;
+    uint8_t *buf;
+
+    /* huge page mappings must be made of whole huge pages; round down so
+       that the size limits of the host still hold */
+    if (code_gen_pages != CODE_GEN_PAGES_SMALL &&
+        size >= CODE_GEN_HUGE_PAGE_SIZE) {
+        size &= ~(size_t)(CODE_GEN_HUGE_PAGE_SIZE - 1);
+        code_gen_buffer_size = size;
+    }
+    buf = code_gen_reserve(start, size, flags);
+    if (!buf) {
+        return MAP_FAILED;
+    }
+    if (code_gen_split_wx) {
+        if (huge && !code_gen_map_split(buf, size, true)) {
+            fprintf(stderr, "qemu: no huge pages for the translation buffer, "
+                    "using transparent huge pages\n");
+            code_gen_pages = CODE_GEN_PAGES_THP;
+        }
+        if (!code_gen_rw_offset && !code_gen_map_split(buf, size, false)) {
+            fprintf(stderr, "qemu: cannot map the translation buffer "
+                    "twice: %s\n", strerror(errno));
+            exit(1);
+        }
+    } else {
+        if (huge && mmap(buf, size, PROT_WRITE | PROT_READ | PROT_EXEC,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB,
+                         -1, 0) == MAP_FAILED) {
+            fprintf(stderr, "qemu: no huge pages for the translation buffer, "
+                    "using transparent huge pages\n");
+            code_gen_pages = CODE_GEN_PAGES_THP;
+            huge = false;
+        }
+        if (!huge && mmap(buf, size, PROT_WRITE | PROT_READ | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+                          -1, 0) == MAP_FAILED) {
+            munmap(buf, size);
+            return MAP_FAILED;
+        }
+    }
+    return buf;
+}
+#endif
+
+static void code_gen_buffer_alloc(unsigned long tb_size)
+{
     code_gen_buffer_size = tb_size;
     if (code_gen_buffer_size == 0) {
 #if defined(CONFIG_USER_ONLY)
@@ -524,10 +956,18 @@ static void code_gen_alloc(unsigned long tb_size)
 #else
         /* XXX: needs adjustments */
         code_gen_buffer_size = (unsigned long)(ram_size / 4);
+#if HOST_LONG_BITS == 64
+        if (code_gen_buffer_size < DEFAULT_CODE_GEN_BUFFER_SIZE_64) {
+            code_gen_buffer_size = DEFAULT_CODE_GEN_BUFFER_SIZE_64;
+        }
+#endif
 #endif
     }
     if (code_gen_buffer_size < MIN_CODE_GEN_BUFFER_SIZE)
         code_gen_buffer_size = MIN_CODE_GEN_BUFFER_SIZE;
+    if (code_gen_buffer_size > MAX_CODE_GEN_BUFFER_SIZE) {
+        code_gen_buffer_size = MAX_CODE_GEN_BUFFER_SIZE;
+    }
     /* The code gen buffer location may have constraints depending on
        the host cpu and OS */
 #if defined(__linux__) 
@@ -535,33 +975,22 @@ static void code_gen_alloc(unsigned long tb_size)
         int flags;
         void *start = NULL;
 
-        flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        flags = 0;
 #if defined(__x86_64__)
-        flags |= MAP_32BIT;
-        /* Cannot map more than that */
-        if (code_gen_buffer_size > (800 * 1024 * 1024))
-            code_gen_buffer_size = (800 * 1024 * 1024);
+#if !defined(CONFIG_USER_ONLY)
+        if (code_gen_buffer_size <= (800 * 1024 * 1024)) {
+            flags |= MAP_32BIT;
+        }
+#endif
 #elif defined(__sparc_v9__)
         // Map the buffer below 2G, so we can use direct calls and branches
         flags |= MAP_FIXED;
         start = (void *) 0x60000000UL;
-        if (code_gen_buffer_size > (512 * 1024 * 1024))
-            code_gen_buffer_size = (512 * 1024 * 1024);
-#elif defined(__arm__)
-        /* Keep the buffer no bigger than 16MB to branch between blocks */
-        if (code_gen_buffer_size > 16 * 1024 * 1024)
-            code_gen_buffer_size = 16 * 1024 * 1024;
 #elif defined(__s390x__)
         /* Map the buffer so that we can use direct calls and branches.  */
-        /* We have a +- 4GB range on the branches; leave some slop.  */
-        if (code_gen_buffer_size > (3ul * 1024 * 1024 * 1024)) {
-            code_gen_buffer_size = 3ul * 1024 * 1024 * 1024;
-        }
         start = (void *)0x90000000UL;
 #endif
-        code_gen_buffer = mmap(start, code_gen_buffer_size,
-                               PROT_WRITE | PROT_READ | PROT_EXEC,
-                               flags, -1, 0);
+        code_gen_buffer = code_gen_mmap(start, flags);
         if (code_gen_buffer == MAP_FAILED) {
             fprintf(stderr, "Could not allocate dynamic translator buffer\n");
             exit(1);
@@ -579,16 +1008,10 @@ static void code_gen_alloc(unsigned long tb_size)
          * 0x40000000 is free */
         flags |= MAP_FIXED;
         addr = (void *)0x40000000;
-        /* Cannot map more than that */
-        if (code_gen_buffer_size > (800 * 1024 * 1024))
-            code_gen_buffer_size = (800 * 1024 * 1024);
 #elif defined(__sparc_v9__)
         // Map the buffer below 2G, so we can use direct calls and branches
         flags |= MAP_FIXED;
         addr = (void *) 0x60000000UL;
-        if (code_gen_buffer_size > (512 * 1024 * 1024)) {
-            code_gen_buffer_size = (512 * 1024 * 1024);
-        }
 #endif
         code_gen_buffer = mmap(addr, code_gen_buffer_size,
                                PROT_WRITE | PROT_READ | PROT_EXEC, 
@@ -602,24 +1025,115 @@ static void code_gen_alloc(unsigned long tb_size)
     code_gen_buffer = g_malloc(code_gen_buffer_size);
     map_exec(code_gen_buffer, code_gen_buffer_size);
 #endif
-#endif /* !USE_STATIC_CODE_GEN_BUFFER */
-    map_exec(code_gen_prologue, sizeof(code_gen_prologue));
-    code_gen_buffer_max_size = code_gen_buffer_size -
-        (TCG_MAX_OP_SIZE * OPC_BUF_SIZE);
+}
+
+static void code_gen_alloc(unsigned long tb_size)
+{
+#ifdef USE_STATIC_CODE_GEN_BUFFER
+    /* explicit huge pages and W^X need a mapping of their own */
+    if (code_gen_pages != CODE_GEN_PAGES_HUGETLB && !code_gen_split_wx) {
+        code_gen_buffer = static_code_gen_buffer;
+        code_gen_buffer_size = DEFAULT_CODE_GEN_BUFFER_SIZE;
+        map_exec(code_gen_buffer, code_gen_buffer_size);
+        if (code_gen_pages == CODE_GEN_PAGES_THP) {
+            /* code is generated from the start of the buffer, so that
+               is where a huge page helps most */
+            uint8_t *p = (uint8_t *)(((uintptr_t)code_gen_buffer +
+                                      CODE_GEN_HUGE_PAGE_SIZE - 1) &
+                                     ~(uintptr_t)(CODE_GEN_HUGE_PAGE_SIZE - 1));
+            code_gen_buffer_size -= p - code_gen_buffer;
+            code_gen_buffer = p;
+        }
+    } else {
+        code_gen_buffer_alloc(tb_size);
+    }
+#else
+    code_gen_buffer_alloc(tb_size);
+#endif
+    code_gen_advise(code_gen_buffer, code_gen_buffer_size);
+    if (code_gen_split_wx) {
+        /* no page may be both writable and executable, so the prologue
+           goes at the start of the buffer */
+        code_gen_prologue = code_gen_buffer;
+        code_gen_buffer += CODE_GEN_PROLOGUE_SIZE;
+        code_gen_buffer_size -= CODE_GEN_PROLOGUE_SIZE;
+    } else {
+        map_exec(code_gen_prologue, CODE_GEN_PROLOGUE_SIZE);
+    }
     code_gen_max_blocks = code_gen_buffer_size / CODE_GEN_AVG_BLOCK_SIZE;
     tbs = g_malloc(code_gen_max_blocks * sizeof(TranslationBlock));
 }
 
+static void code_gen_regions_init(void)
+{
+    unsigned long max_tb_size = TCG_MAX_OP_SIZE * OPC_BUF_SIZE;
+    CodeGenRegion *r;
+    int i;
+
+    /* evicting a region is only worth it if it holds a good number of
+       TBs even when they are as large as possible */
+    code_gen_nb_regions = code_gen_buffer_size / (4 * max_tb_size);
+    code_gen_nb_regions = MAX(1, MIN(code_gen_nb_regions,
+                                     CODE_GEN_MAX_REGIONS));
+    code_gen_region_size = (code_gen_buffer_size / code_gen_nb_regions) &
+                           ~(CODE_GEN_ALIGN - 1);
+    for (i = 0; i < code_gen_nb_regions; i++) {
+        r = &code_gen_regions[i];
+        r->start = code_gen_buffer + i * code_gen_region_size;
+        r->end = r->start + code_gen_region_size - max_tb_size;
+        r->ptr = r->start;
+    }
+    r->end = code_gen_buffer + code_gen_buffer_size - max_tb_size;
+}
+
+static inline TranslationBlock *tb_ring_at(int i)
+{
+    return &tbs[(tbs_first + i) % code_gen_max_blocks];
+}
+
+#if !defined(CONFIG_USER_ONLY)
+/* Return the number of bytes of generated code in the buffer.  */
+static unsigned long code_gen_used(void)
+{
+    unsigned long used = 0;
+    int i;
+
+    for (i = 0; i < code_gen_nb_regions; i++) {
+        CodeGenRegion *r = &code_gen_regions[i];
+
+        if (i == code_gen_cur_region) {
+            used += code_gen_ptr - r->start;
+        } else if (r->nb_tbs) {
+            used += r->ptr - r->start;
+        }
+    }
+    return used;
+}
+#endif
+
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
    (in bytes) allocated to the translation buffer. Zero means default
    size. */
+/* Largest size that can be passed to tcg_exec_init() on this host */
+unsigned long tcg_exec_max_size(void)
+{
+    return MAX_CODE_GEN_BUFFER_SIZE;
+}
+
 void tcg_exec_init(unsigned long tb_size)
 {
     cpu_gen_init();
     code_gen_alloc(tb_size);
+    code_gen_regions_init();
     code_gen_ptr = code_gen_buffer;
     tcg_register_jit(code_gen_buffer, code_gen_buffer_size);
     page_init();
+    tb_htable_init();
+    qemu_mutex_init(&tb_mutex);
+#if !defined(CONFIG_USER_ONLY)
+    qemu_mutex_init(&phys_map_mutex);
+#endif
+    qemu_mutex_init(&atomic_mutex);
 #if !defined(CONFIG_USER_ONLY) || !defined(CONFIG_USE_GUEST_BASE)
     /* There's no guest base to take into account, so go ahead and
        initialize the prologue now.  */
@@ -702,6 +1216,7 @@ void cpu_exec_init(CPUArchState *env)
     QTAILQ_INIT(&env->watchpoints);
 #ifndef CONFIG_USER_ONLY
     env->thread_id = qemu_get_thread_id();
+    tlb_init(env);
 #endif
     *penv = env;
 #if defined(CONFIG_USER_ONLY)
@@ -714,18 +1229,66 @@ void cpu_exec_init(CPUArchState *env)
 #endif
 }
 
-/* Allocate a new translation block. Flush the translation buffer if
-   too many translation blocks or too much generated code. */
+/* Move translation to the next region of the code buffer, invalidating
+   the TBs it holds.  Keep going if tbs[] is still full.  */
+static void code_gen_next_region(void)
+{
+    CodeGenRegion *r;
+    TranslationBlock *tb;
+    int i;
+
+    do {
+        code_gen_regions[code_gen_cur_region].ptr = code_gen_ptr;
+        code_gen_cur_region = (code_gen_cur_region + 1) % code_gen_nb_regions;
+        r = &code_gen_regions[code_gen_cur_region];
+        if (r->nb_tbs) {
+            /* the oldest TBs are at the start of the ring */
+            assert(r->first_tb == tbs_first);
+            for (i = 0; i < r->nb_tbs; i++) {
+                tb = tb_ring_at(i);
+                /* skip the TBs that were already invalidated */
+                if (tb_htable_contains(tb)) {
+                    tb_phys_invalidate(tb, -1);
+                }
+            }
+            tbs_first = (tbs_first + r->nb_tbs) % code_gen_max_blocks;
+            nb_tbs -= r->nb_tbs;
+            tb_evict_tb_count += r->nb_tbs;
+            tb_evict_count++;
+            r->nb_tbs = 0;
+        }
+        code_gen_ptr = r->start;
+    } while (nb_tbs >= code_gen_max_blocks);
+}
+
+/* Allocate a new translation block.  When the current region of the code
+   buffer is full, evict the next one.  Return NULL if the whole buffer
+   has to be flushed instead.  */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
+    CodeGenRegion *r = &code_gen_regions[code_gen_cur_region];
     TranslationBlock *tb;
+    int i;
 
-    if (nb_tbs >= code_gen_max_blocks ||
-        (code_gen_ptr - code_gen_buffer) >= code_gen_buffer_max_size)
-        return NULL;
-    tb = &tbs[nb_tbs++];
+    if (nb_tbs >= code_gen_max_blocks || code_gen_ptr >= r->end) {
+        /* With parallel vCPUs, other threads may be running the code
+           of the region to evict.  */
+        if (parallel_cpus || code_gen_nb_regions == 1) {
+            return NULL;
+        }
+        code_gen_next_region();
+        r = &code_gen_regions[code_gen_cur_region];
+    }
+    i = (tbs_first + nb_tbs) % code_gen_max_blocks;
+    if (r->nb_tbs++ == 0) {
+        r->first_tb = i;
+    }
+    nb_tbs++;
+    tb = &tbs[i];
     tb->pc = pc;
     tb->cflags = 0;
+    tb->exec_count = 0;
+    tb->profile_count = 0;
     return tb;
 }
 
@@ -733,9 +1296,15 @@ void tb_free(TranslationBlock *tb)
 {
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
-       be the last one generated.  */
-    if (nb_tbs > 0 && tb == &tbs[nb_tbs - 1]) {
+       be the last one generated.  With parallel_cpus another thread may
+       have found the TB in the hash table and still be running its code,
+       so the space is only reclaimed by tb_flush.  */
+    if (parallel_cpus) {
+        return;
+    }
+    if (nb_tbs > 0 && tb == tb_ring_at(nb_tbs - 1)) {
         code_gen_ptr = tb->tc_ptr;
+        code_gen_regions[code_gen_cur_region].nb_tbs--;
         nb_tbs--;
     }
 }
@@ -763,6 +1332,10 @@ static void page_flush_tb_1 (int level, void **lp)
         for (i = 0; i < L2_SIZE; ++i) {
             pd[i].first_tb = NULL;
             invalidate_page_bitmap(pd + i);
+#if !defined(CONFIG_USER_ONLY)
+            pd[i].smc_recent = 0;
+            pd[i].smc_nocache = 0;
+#endif
         }
     } else {
         void **pp = *lp;
@@ -780,11 +1353,50 @@ static void page_flush_tb(void)
     }
 }
 
+static void tb_flush_now(CPUArchState *env1);
+
+#if defined(CONFIG_USER_ONLY)
+bool tb_flush_pending;
+
+/* Do the flush requested with parallel_cpus.  The caller has stopped all
+   the other threads (start_exclusive in linux-user).  */
+void tb_flush_exclusive(CPUArchState *env)
+{
+    tb_lock_acquire();
+    if (tb_flush_pending) {
+        tb_flush_pending = false;
+        tb_flush_now(env);
+    }
+    tb_lock_release();
+}
+#endif
+
 /* flush all the translation blocks */
-/* XXX: tb_flush is currently not thread safe */
 void tb_flush(CPUArchState *env1)
+{
+#if !defined(CONFIG_USER_ONLY)
+    if (parallel_cpus && qemu_tcg_cpus_running()) {
+        /* other threads may be executing translated code: the last vCPU
+           to leave cpu_exec() does the flush */
+        qemu_tcg_request_flush();
+        return;
+    }
+#else
+    if (parallel_cpus) {
+        /* other threads may be executing translated code: user mode
+           stops them and calls tb_flush_exclusive */
+        tb_flush_pending = true;
+        return;
+    }
+#endif
+    tb_flush_now(env1);
+}
+
+static void tb_flush_now(CPUArchState *env1)
 {
     CPUArchState *env;
+    int i;
+
 #if defined(DEBUG_FLUSH)
     printf("qemu: flush code_size=%ld nb_tbs=%d avg_tb_size=%ld\n",
            (unsigned long)(code_gen_ptr - code_gen_buffer),
@@ -794,13 +1406,19 @@ void tb_flush(CPUArchState *env1)
     if ((unsigned long)(code_gen_ptr - code_gen_buffer) > code_gen_buffer_size)
         cpu_abort(env1, "Internal error: code buffer overflow\n");
 
+    tbs_first = 0;
     nb_tbs = 0;
+    for (i = 0; i < code_gen_nb_regions; i++) {
+        code_gen_regions[i].nb_tbs = 0;
+        code_gen_regions[i].ptr = code_gen_regions[i].start;
+    }
+    code_gen_cur_region = 0;
 
     for(env = first_cpu; env != NULL; env = env->next_cpu) {
         memset (env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
     }
 
-    memset (tb_phys_hash, 0, CODE_GEN_PHYS_HASH_SIZE * sizeof (void *));
+    tb_htable_reset();
     page_flush_tb();
 
     code_gen_ptr = code_gen_buffer;
@@ -811,58 +1429,44 @@ void tb_flush(CPUArchState *env1)
 
 #ifdef DEBUG_TB_CHECK
 
+static void tb_invalidate_check_tb(TranslationBlock *tb, void *opaque)
+{
+    target_ulong address = *(target_ulong *)opaque;
+
+    if (!(address + TARGET_PAGE_SIZE <= tb->pc ||
+          address >= tb->pc + tb->size)) {
+        printf("ERROR invalidate: address=" TARGET_FMT_lx
+               " PC=%08lx size=%04x\n",
+               address, (long)tb->pc, tb->size);
+    }
+}
+
 static void tb_invalidate_check(target_ulong address)
 {
-    TranslationBlock *tb;
-    int i;
     address &= TARGET_PAGE_MASK;
-    for(i = 0;i < CODE_GEN_PHYS_HASH_SIZE; i++) {
-        for(tb = tb_phys_hash[i]; tb != NULL; tb = tb->phys_hash_next) {
-            if (!(address + TARGET_PAGE_SIZE <= tb->pc ||
-                  address >= tb->pc + tb->size)) {
-                printf("ERROR invalidate: address=" TARGET_FMT_lx
-                       " PC=%08lx size=%04x\n",
-                       address, (long)tb->pc, tb->size);
-            }
-        }
+    tb_htable_foreach(tb_invalidate_check_tb, &address);
+}
+
+static void tb_page_check_tb(TranslationBlock *tb, void *opaque)
+{
+    int flags1, flags2;
+
+    flags1 = page_get_flags(tb->pc);
+    flags2 = page_get_flags(tb->pc + tb->size - 1);
+    if ((flags1 & PAGE_WRITE) || (flags2 & PAGE_WRITE)) {
+        printf("ERROR page flags: PC=%08lx size=%04x f1=%x f2=%x\n",
+               (long)tb->pc, tb->size, flags1, flags2);
     }
 }
 
 /* verify that all the pages have correct rights for code */
 static void tb_page_check(void)
 {
-    TranslationBlock *tb;
-    int i, flags1, flags2;
-
-    for(i = 0;i < CODE_GEN_PHYS_HASH_SIZE; i++) {
-        for(tb = tb_phys_hash[i]; tb != NULL; tb = tb->phys_hash_next) {
-            flags1 = page_get_flags(tb->pc);
-            flags2 = page_get_flags(tb->pc + tb->size - 1);
-            if ((flags1 & PAGE_WRITE) || (flags2 & PAGE_WRITE)) {
-                printf("ERROR page flags: PC=%08lx size=%04x f1=%x f2=%x\n",
-                       (long)tb->pc, tb->size, flags1, flags2);
-            }
-        }
-    }
+    tb_htable_foreach(tb_page_check_tb, NULL);
 }
 
 #endif
 
-/* invalidate one TB */
-static inline void tb_remove(TranslationBlock **ptb, TranslationBlock *tb,
-                             int next_offset)
-{
-    TranslationBlock *tb1;
-    for(;;) {
-        tb1 = *ptb;
-        if (tb1 == tb) {
-            *ptb = *(TranslationBlock **)((char *)tb1 + next_offset);
-            break;
-        }
-        ptb = (TranslationBlock **)((char *)tb1 + next_offset);
-    }
-}
-
 static inline void tb_page_remove(TranslationBlock **ptb, TranslationBlock *tb)
 {
     TranslationBlock *tb1;
@@ -920,25 +1524,19 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     CPUArchState *env;
     PageDesc *p;
     unsigned int h, n1;
-    tb_page_addr_t phys_pc;
     TranslationBlock *tb1, *tb2;
 
-    /* remove the TB from the hash list */
-    phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
-    h = tb_phys_hash_func(phys_pc);
-    tb_remove(&tb_phys_hash[h], tb,
-              offsetof(TranslationBlock, phys_hash_next));
+    /* remove the TB from the hash table */
+    tb_htable_remove(tb);
 
     /* remove the TB from the page list */
     if (tb->page_addr[0] != page_addr) {
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
         tb_page_remove(&p->first_tb, tb);
-        invalidate_page_bitmap(p);
     }
     if (tb->page_addr[1] != -1 && tb->page_addr[1] != page_addr) {
         p = page_find(tb->page_addr[1] >> TARGET_PAGE_BITS);
         tb_page_remove(&p->first_tb, tb);
-        invalidate_page_bitmap(p);
     }
 
     tb_invalidated_flag = 1;
@@ -998,30 +1596,42 @@ static inline void set_bits(uint8_t *tab, int start, int len)
     }
 }
 
+/* mark the bytes of page 'n' of 'tb' in the code bitmap of the page */
+static void tb_set_page_bits(PageDesc *p, TranslationBlock *tb, int n)
+{
+    int tb_start, tb_end;
+
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        tb_start = tb->pc & ~TARGET_PAGE_MASK;
+        tb_end = tb_start + tb->size;
+        if (tb_end > TARGET_PAGE_SIZE)
+            tb_end = TARGET_PAGE_SIZE;
+    } else {
+        tb_start = 0;
+        tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+    }
+    set_bits(p->code_bitmap, tb_start, tb_end - tb_start);
+}
+
+/* The bitmap is kept up to date as TBs are added to the page.  Bits of
+   invalidated TBs stay set until a write to them finds no code and the
+   bitmap is rebuilt.  */
 static void build_page_bitmap(PageDesc *p)
 {
-    int n, tb_start, tb_end;
+    int n;
     TranslationBlock *tb;
 
-    p->code_bitmap = g_malloc0(TARGET_PAGE_SIZE / 8);
+    if (!p->code_bitmap) {
+        p->code_bitmap = g_malloc(TARGET_PAGE_SIZE / 8);
+    }
+    memset(p->code_bitmap, 0, TARGET_PAGE_SIZE / 8);
 
     tb = p->first_tb;
     while (tb != NULL) {
         n = (uintptr_t)tb & 3;
         tb = (TranslationBlock *)((uintptr_t)tb & ~3);
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE)
-                tb_end = TARGET_PAGE_SIZE;
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
-        set_bits(p->code_bitmap, tb_start, tb_end - tb_start);
+        tb_set_page_bits(p, tb, n);
         tb = tb->page_next[n];
     }
 }
@@ -1039,6 +1649,13 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     phys_pc = get_page_addr_code(env, pc);
     tb = tb_alloc(pc);
     if (!tb) {
+        if (parallel_cpus) {
+            /* the flush is deferred until all vCPUs are out of
+               cpu_exec(), so this one has to get out too */
+            tb_flush(env);
+            env->exception_index = EXCP_INTERRUPT;
+            cpu_loop_exit(env);
+        }
         /* flush must be done */
         tb_flush(env);
         /* cannot fail at this point */
@@ -1046,12 +1663,18 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
         /* Don't forget to invalidate previous TB info.  */
         tb_invalidated_flag = 1;
     }
+    if (tcg_ctx.profile) {
+        cflags |= CF_PROFILE;
+    }
     tc_ptr = code_gen_ptr;
     tb->tc_ptr = tc_ptr;
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
     cpu_gen_code(env, tb, &code_gen_size);
+    if (unlikely(tcg_perf_enabled)) {
+        tcg_perf_report_tb(tb, code_gen_size);
+    }
     code_gen_ptr = (void *)(((uintptr_t)code_gen_ptr + code_gen_size +
                              CODE_GEN_ALIGN - 1) & ~(CODE_GEN_ALIGN - 1));
 
@@ -1065,6 +1688,60 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     return tb;
 }
 
+/* Called with tb_lock held when the code of 'tb' found it hot: replace it
+   with a superblock for the same CPU state.  TBs that jumped to it are
+   unchained and will chain to the superblock on their next exit.  */
+void tb_gen_superblock(CPUArchState *env, TranslationBlock *tb)
+{
+    target_ulong pc, cs_base;
+    uint64_t flags;
+
+    /* another vCPU may have got there first */
+    if (!tb_htable_contains(tb)) {
+        return;
+    }
+    pc = tb->pc;
+    cs_base = tb->cs_base;
+    flags = tb->flags;
+    tb_phys_invalidate(tb, -1);
+    tb_gen_code(env, pc, cs_base, flags, CF_SUPERBLOCK);
+    tb_superblock_count++;
+}
+
+/* Account for 'n' TBs of page 'p' invalidated by a guest write.  */
+static void page_smc_invalidated(PageDesc *p, int n)
+{
+    p->smc_count += n;
+    tb_smc_invalidate_count += n;
+#if !defined(CONFIG_USER_ONLY)
+    p->smc_recent += n;
+    if (p->smc_recent >= SMC_NOCACHE_THRESHOLD) {
+        p->smc_recent = 0;
+        p->smc_nocache = SMC_NOCACHE_EXECS;
+        tb_smc_nocache_count++;
+    }
+#endif
+}
+
+/* Called with tb_lock held when no TB is found for the code at 'phys_pc'.
+   Return true if the code of its page is rewritten so often that it is
+   better executed once with cpu_exec_nocache() than translated for the
+   TB cache.  In user mode the page protection makes this pointless.  */
+bool tb_page_nocache(tb_page_addr_t phys_pc)
+{
+#if !defined(CONFIG_USER_ONLY)
+    PageDesc *p;
+
+    p = page_find(phys_pc >> TARGET_PAGE_BITS);
+    if (p && p->smc_nocache) {
+        p->smc_nocache--;
+        tb_smc_nocache_exec_count++;
+        return true;
+    }
+#endif
+    return false;
+}
+
 /*
  * Invalidate all TBs which intersect with the target physical address range
  * [start;end[. NOTE: start and end may refer to *different* physical pages.
@@ -1082,6 +1759,10 @@ void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end,
     }
 }
 
+static void tb_invalidate_phys_page_range_locked(tb_page_addr_t start,
+                                                 tb_page_addr_t end,
+                                                 int is_cpu_write_access);
+
 /*
  * Invalidate all TBs which intersect with the target physical address range
  * [start;end[. NOTE: start and end must refer to the *same* physical page.
@@ -1091,12 +1772,21 @@ void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end,
  */
 void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
                                    int is_cpu_write_access)
+{
+    tb_lock_acquire();
+    tb_invalidate_phys_page_range_locked(start, end, is_cpu_write_access);
+    tb_lock_release();
+}
+
+static void tb_invalidate_phys_page_range_locked(tb_page_addr_t start,
+                                                 tb_page_addr_t end,
+                                                 int is_cpu_write_access)
 {
     TranslationBlock *tb, *tb_next, *saved_tb;
     CPUArchState *env = cpu_single_env;
     tb_page_addr_t tb_start, tb_end;
     PageDesc *p;
-    int n;
+    int n, invalidated = 0;
 #ifdef TARGET_HAS_PRECISE_SMC
     int current_tb_not_found = is_cpu_write_access;
     TranslationBlock *current_tb = NULL;
@@ -1165,6 +1855,7 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
                 env->current_tb = NULL;
             }
             tb_phys_invalidate(tb, -1);
+            invalidated++;
             if (env) {
                 env->current_tb = saved_tb;
                 if (env->interrupt_request && env->current_tb)
@@ -1173,6 +1864,16 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
         }
         tb = tb_next;
     }
+    if (is_cpu_write_access) {
+        if (invalidated) {
+            page_smc_invalidated(p, invalidated);
+        } else if (p->first_tb) {
+            /* The page mixes code and data, or the bitmap has bits of
+               TBs which are gone: only check writes against the bytes
+               of the TBs left from now on.  */
+            build_page_bitmap(p);
+        }
+    }
 #if !defined(CONFIG_USER_ONLY)
     /* if no code remaining, no need to continue to use slow writes */
     if (!p->first_tb) {
@@ -1208,9 +1909,12 @@ static inline void tb_invalidate_phys_page_fast(tb_page_addr_t start, int len)
                   (intptr_t)cpu_single_env->segs[R_CS].base);
     }
 #endif
+    tb_lock_acquire();
     p = page_find(start >> TARGET_PAGE_BITS);
-    if (!p)
+    if (!p) {
+        tb_lock_release();
         return;
+    }
     if (p->code_bitmap) {
         offset = start & ~TARGET_PAGE_MASK;
         b = p->code_bitmap[offset >> 3] >> (offset & 7);
@@ -1220,15 +1924,18 @@ static inline void tb_invalidate_phys_page_fast(tb_page_addr_t start, int len)
     do_invalidate:
         tb_invalidate_phys_page_range(start, start + len, 1);
     }
+    tb_lock_release();
 }
 
 #if !defined(CONFIG_SOFTMMU)
-static void tb_invalidate_phys_page(tb_page_addr_t addr,
-                                    uintptr_t pc, void *puc)
+/* Return true if the TB being executed at host address 'pc' was modified:
+   a TB with only the instruction doing the write has been generated, and
+   the caller must resume execution with it once it released its locks.  */
+static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
 {
     TranslationBlock *tb;
     PageDesc *p;
-    int n;
+    int n, invalidated = 0;
 #ifdef TARGET_HAS_PRECISE_SMC
     TranslationBlock *current_tb = NULL;
     CPUArchState *env = cpu_single_env;
@@ -1239,9 +1946,12 @@ static void tb_invalidate_phys_page(tb_page_addr_t addr,
 #endif
 
     addr &= TARGET_PAGE_MASK;
+    tb_lock_acquire();
     p = page_find(addr >> TARGET_PAGE_BITS);
-    if (!p)
-        return;
+    if (!p) {
+        tb_lock_release();
+        return false;
+    }
     tb = p->first_tb;
 #ifdef TARGET_HAS_PRECISE_SMC
     if (tb && pc != 0) {
@@ -1267,9 +1977,11 @@ static void tb_invalidate_phys_page(tb_page_addr_t addr,
         }
 #endif /* TARGET_HAS_PRECISE_SMC */
         tb_phys_invalidate(tb, addr);
+        invalidated++;
         tb = tb->page_next[n];
     }
     p->first_tb = NULL;
+    page_smc_invalidated(p, invalidated);
 #ifdef TARGET_HAS_PRECISE_SMC
     if (current_tb_modified) {
         /* we generate a block containing just the instruction
@@ -1277,9 +1989,12 @@ static void tb_invalidate_phys_page(tb_page_addr_t addr,
            itself */
         env->current_tb = NULL;
         tb_gen_code(env, current_pc, current_cs_base, current_flags, 1);
-        cpu_resume_from_signal(env, puc);
+        tb_lock_release();
+        return true;
     }
 #endif
+    tb_lock_release();
+    return false;
 }
 #endif
 
@@ -1299,7 +2014,9 @@ static inline void tb_alloc_page(TranslationBlock *tb,
     page_already_protected = p->first_tb != NULL;
 #endif
     p->first_tb = (TranslationBlock *)((uintptr_t)tb | n);
-    invalidate_page_bitmap(p);
+    if (p->code_bitmap) {
+        tb_set_page_bits(p, tb, n);
+    }
 
 #if defined(TARGET_HAS_SMC) || 1
 
@@ -1346,17 +2063,11 @@ static inline void tb_alloc_page(TranslationBlock *tb,
 void tb_link_page(TranslationBlock *tb,
                   tb_page_addr_t phys_pc, tb_page_addr_t phys_page2)
 {
-    unsigned int h;
-    TranslationBlock **ptb;
-
     /* Grab the mmap lock to stop another thread invalidating this TB
        before we are done.  */
     mmap_lock();
     /* add in the physical hash table */
-    h = tb_phys_hash_func(phys_pc);
-    ptb = &tb_phys_hash[h];
-    tb->phys_hash_next = *ptb;
-    *ptb = tb;
+    tb_htable_insert(tb, phys_pc);
 
     /* add in the page list */
     tb_alloc_page(tb, 0, phys_pc & TARGET_PAGE_MASK);
@@ -1385,33 +2096,78 @@ void tb_link_page(TranslationBlock *tb,
    tb[1].tc_ptr. Return NULL if not found */
 TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
 {
-    int m_min, m_max, m;
+    int m_min, m_max, m, n;
     uintptr_t v;
     TranslationBlock *tb;
+    CodeGenRegion *r;
 
     if (nb_tbs <= 0)
         return NULL;
     if (tc_ptr < (uintptr_t)code_gen_buffer ||
-        tc_ptr >= (uintptr_t)code_gen_ptr) {
+        tc_ptr >= (uintptr_t)code_gen_buffer + code_gen_buffer_size) {
+        return NULL;
+    }
+    tb_lock_acquire();
+    n = (tc_ptr - (uintptr_t)code_gen_buffer) / code_gen_region_size;
+    if (n >= code_gen_nb_regions) {
+        n = code_gen_nb_regions - 1;
+    }
+    r = &code_gen_regions[n];
+    if (r->nb_tbs == 0 || tc_ptr < (uintptr_t)r->start ||
+        (n == code_gen_cur_region && tc_ptr >= (uintptr_t)code_gen_ptr)) {
+        tb_lock_release();
         return NULL;
     }
     /* binary search (cf Knuth) */
     m_min = 0;
-    m_max = nb_tbs - 1;
+    m_max = r->nb_tbs - 1;
+    tb = NULL;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tbs[m];
-        v = (uintptr_t)tb->tc_ptr;
-        if (v == tc_ptr)
-            return tb;
-        else if (tc_ptr < v) {
+        v = (uintptr_t)tbs[(r->first_tb + m) % code_gen_max_blocks].tc_ptr;
+        if (v == tc_ptr) {
+            m_max = m;
+            break;
+        } else if (tc_ptr < v) {
             m_max = m - 1;
         } else {
             m_min = m + 1;
         }
     }
-    return &tbs[m_max];
+    if (m_max >= 0) {
+        tb = &tbs[(r->first_tb + m_max) % code_gen_max_blocks];
+    }
+    tb_lock_release();
+    return tb;
+}
+
+#if !defined(CONFIG_USER_ONLY)
+/* Return the memory region of the I/O TLB entry 'index', for an access
+   made by generated code at 'retaddr'.  With parallel vCPUs the memory
+   map may have been rebuilt since the entry was filled.  The TLB flush
+   that follows a rebuild is queued to all vCPUs before the new map is
+   published, so pending work means the entry may be stale: restart the
+   instruction once the work has been processed.  */
+MemoryRegion *cpu_mmio_region(CPUArchState *env, target_phys_addr_t index,
+                              uintptr_t retaddr)
+{
+    MemoryRegion *mr;
+    TranslationBlock *tb;
+
+    if (!parallel_cpus) {
+        return iotlb_to_region(index);
+    }
+    phys_map_lock();
+    mr = iotlb_to_region(index);
+    phys_map_unlock();
+    if (env->queued_work_first && (tb = tb_find_pc(retaddr)) != NULL) {
+        cpu_restore_state(tb, env, retaddr);
+        env->exception_index = EXCP_INTERRUPT;
+        cpu_loop_exit(env);
+    }
+    return mr;
 }
+#endif
 
 static void tb_reset_jump_recursive(TranslationBlock *tb);
 
@@ -1683,12 +2439,32 @@ static void cpu_unlink_tb(CPUArchState *env)
     spin_unlock(&interrupt_lock);
 }
 
+/* With parallel vCPUs the TB chain of another thread cannot be unlinked
+   safely.  Instead every TB starts by checking icount_decr.u32 (see
+   gen_icount_start), so setting the high half makes the vCPU leave the
+   generated code at the next TB boundary.  */
+static void cpu_exit_tb_parallel(CPUArchState *env)
+{
+    smp_wmb();
+    env->icount_decr.u16.high = 0xffff;
+}
+
 #ifndef CONFIG_USER_ONLY
+
 /* mask must never be zero, except for A20 change call */
 static void tcg_handle_interrupt(CPUArchState *env, int mask)
 {
     int old_mask;
 
+    if (parallel_cpus) {
+        __sync_fetch_and_or(&env->interrupt_request, mask);
+        cpu_exit_tb_parallel(env);
+        if (!qemu_cpu_is_self(env)) {
+            qemu_cpu_kick(env);
+        }
+        return;
+    }
+
     old_mask = env->interrupt_request;
     env->interrupt_request |= mask;
 
@@ -1719,18 +2495,32 @@ CPUInterruptHandler cpu_interrupt_handler = tcg_handle_interrupt;
 void cpu_interrupt(CPUArchState *env, int mask)
 {
     env->interrupt_request |= mask;
+    if (parallel_cpus) {
+        cpu_exit_tb_parallel(env);
+        return;
+    }
     cpu_unlink_tb(env);
 }
 #endif /* CONFIG_USER_ONLY */
 
 void cpu_reset_interrupt(CPUArchState *env, int mask)
 {
+#ifndef CONFIG_USER_ONLY
+    if (parallel_cpus) {
+        __sync_fetch_and_and(&env->interrupt_request, ~mask);
+        return;
+    }
+#endif
     env->interrupt_request &= ~mask;
 }
 
 void cpu_exit(CPUArchState *env)
 {
     env->exit_request = 1;
+    if (parallel_cpus) {
+        cpu_exit_tb_parallel(env);
+        return;
+    }
     cpu_unlink_tb(env);
 }
 
@@ -2068,7 +2858,7 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
         if (!(p->flags & PAGE_WRITE) &&
             (flags & PAGE_WRITE) &&
             p->first_tb) {
-            tb_invalidate_phys_page(addr, 0, NULL);
+            tb_invalidate_phys_page(addr, 0);
         }
         p->flags = flags;
     }
@@ -2124,6 +2914,28 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
     return 0;
 }
 
+/* Return a host pointer through which the CPU can do an atomic
+   read-modify-write of 'size' bytes at guest address 'addr', or NULL if
+   the access crosses a page or is not to readable and writable memory;
+   the caller then falls back to separate loads and stores, which raise
+   the fault.  Pages holding translated code are unprotected, as a store
+   would do.  */
+void *page_vaddr_to_host(target_ulong addr, int size)
+{
+    if (((addr & ~TARGET_PAGE_MASK) + size - 1) >= TARGET_PAGE_SIZE) {
+        return NULL;
+    }
+#if TARGET_ABI_BITS > L1_MAP_ADDR_SPACE_BITS
+    if (addr >= ((abi_ulong)1 << L1_MAP_ADDR_SPACE_BITS)) {
+        return NULL;
+    }
+#endif
+    if (page_check_range(addr, size, PAGE_READ | PAGE_WRITE) < 0) {
+        return NULL;
+    }
+    return g2h(addr);
+}
+
 /* called from signal handler: invalidate the code and unprotect the
    page. Return TRUE if the fault was successfully handled. */
 int page_unprotect(target_ulong address, uintptr_t pc, void *puc)
@@ -2131,6 +2943,7 @@ int page_unprotect(target_ulong address, uintptr_t pc, void *puc)
     unsigned int prot;
     PageDesc *p;
     target_ulong host_start, host_end, addr;
+    bool current_tb_modified = false;
 
     /* Technically this isn't safe inside a signal handler.  However we
        know this only ever happens in a synchronous SEGV handler, so in
@@ -2143,6 +2956,13 @@ int page_unprotect(target_ulong address, uintptr_t pc, void *puc)
         return 0;
     }
 
+    /* another guest thread may have faulted on the same page and
+       unprotected it first */
+    if ((p->flags & PAGE_WRITE_ORG) && (p->flags & PAGE_WRITE)) {
+        mmap_unlock();
+        return 1;
+    }
+
     /* if the page was really writable, then we change its
        protection back to writable */
     if ((p->flags & PAGE_WRITE_ORG) && !(p->flags & PAGE_WRITE)) {
@@ -2157,7 +2977,7 @@ int page_unprotect(target_ulong address, uintptr_t pc, void *puc)
 
             /* and since the content will be modified, we must invalidate
                the corresponding translated code. */
-            tb_invalidate_phys_page(addr, pc, puc);
+            current_tb_modified |= tb_invalidate_phys_page(addr, pc);
 #ifdef DEBUG_TB_CHECK
             tb_invalidate_check(addr);
 #endif
@@ -2166,6 +2986,9 @@ int page_unprotect(target_ulong address, uintptr_t pc, void *puc)
                  prot & PAGE_BITS);
 
         mmap_unlock();
+        if (current_tb_modified) {
+            cpu_resume_from_signal(cpu_single_env, puc);
+        }
         return 1;
     }
     mmap_unlock();
@@ -2890,17 +3713,52 @@ static const MemoryRegionOps rom_mem_ops = {
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
-static void notdirty_mem_write(void *opaque, target_phys_addr_t ram_addr,
-                               uint64_t val, unsigned size)
+/* Throw away the translated code that a CPU write to a page that is not
+   dirty is going to overwrite.  Returns the dirty flags of the page.  */
+static int notdirty_invalidate(ram_addr_t ram_addr, unsigned size)
 {
     int dirty_flags;
     dirty_flags = cpu_physical_memory_get_dirty_flags(ram_addr);
     if (!(dirty_flags & CODE_DIRTY_FLAG)) {
 #if !defined(CONFIG_USER_ONLY)
-        tb_invalidate_phys_page_fast(ram_addr, size);
+        if (size & (size - 1) || ram_addr & (size - 1)) {
+            tb_invalidate_phys_page_range(ram_addr, ram_addr + size, 1);
+        } else {
+            tb_invalidate_phys_page_fast(ram_addr, size);
+        }
         dirty_flags = cpu_physical_memory_get_dirty_flags(ram_addr);
 #endif
     }
+    return dirty_flags;
+}
+
+static void notdirty_set_dirty(ram_addr_t ram_addr, int dirty_flags,
+                               target_ulong vaddr)
+{
+    dirty_flags |= (0xff & ~CODE_DIRTY_FLAG);
+    cpu_physical_memory_set_dirty_flags(ram_addr, dirty_flags);
+    /* we remove the notdirty callback only if the code has been
+       flushed */
+    if (dirty_flags == 0xff)
+        tlb_set_dirty(cpu_single_env, vaddr);
+}
+
+/* Bookkeeping for a write that the CPU does directly through a host
+   pointer (an atomic read-modify-write) to a page whose TLB entry has
+   TLB_NOTDIRTY set.  mem_io_pc and mem_io_vaddr must already be set up
+   as for a write through notdirty_mem_write.  */
+void tlb_notdirty_write(ram_addr_t ram_addr, unsigned size)
+{
+    int dirty_flags = notdirty_invalidate(ram_addr, size);
+    notdirty_set_dirty(ram_addr, dirty_flags, cpu_single_env->mem_io_vaddr);
+}
+
+static void notdirty_mem_write(void *opaque, target_phys_addr_t ram_addr,
+                               uint64_t val, unsigned size)
+{
+    int dirty_flags;
+
+    dirty_flags = notdirty_invalidate(ram_addr, size);
     switch (size) {
     case 1:
         stb_p(qemu_get_ram_ptr(ram_addr), val);
@@ -2914,12 +3772,7 @@ static void notdirty_mem_write(void *opaque, target_phys_addr_t ram_addr,
     default:
         abort();
     }
-    dirty_flags |= (0xff & ~CODE_DIRTY_FLAG);
-    cpu_physical_memory_set_dirty_flags(ram_addr, dirty_flags);
-    /* we remove the notdirty callback only if the code has been
-       flushed */
-    if (dirty_flags == 0xff)
-        tlb_set_dirty(cpu_single_env, cpu_single_env->mem_io_vaddr);
+    notdirty_set_dirty(ram_addr, dirty_flags, cpu_single_env->mem_io_vaddr);
 }
 
 static const MemoryRegionOps notdirty_mem_ops = {
@@ -3165,6 +4018,8 @@ static void io_mem_init(void)
 
 static void core_begin(MemoryListener *listener)
 {
+    /* keep vCPU threads from refilling their TLB from a half-built map */
+    phys_map_lock();
     destroy_all_mappings();
     phys_sections_clear();
     phys_map.ptr = PHYS_MAP_NODE_NIL;
@@ -3184,6 +4039,9 @@ static void core_commit(MemoryListener *listener)
     for(env = first_cpu; env != NULL; env = env->next_cpu) {
         tlb_flush(env, 1);
     }
+    /* with parallel vCPUs the flushes above are only queued; this must
+       happen before the new map is published, see cpu_mmio_region() */
+    phys_map_unlock();
 }
 
 static void core_region_add(MemoryListener *listener,
@@ -4150,7 +5008,8 @@ void cpu_io_recompile(CPUArchState *env, uintptr_t retaddr)
     if (n > CF_COUNT_MASK)
         cpu_abort(env, "TB too big during recompile");
 
-    cflags = n | CF_LAST_IO;
+    /* a superblock must follow the same jumps to reach the I/O insn */
+    cflags = n | CF_LAST_IO | (tb->cflags & CF_SUPERBLOCK);
     pc = tb->pc;
     cs_base = tb->cs_base;
     flags = tb->flags;
@@ -4168,20 +5027,261 @@ void cpu_io_recompile(CPUArchState *env, uintptr_t retaddr)
 
 #if !defined(CONFIG_USER_ONLY)
 
+typedef struct TBSMCPage {
+    tb_page_addr_t addr;
+    unsigned int count;
+    bool nocache;
+} TBSMCPage;
+
+/* Insert the pages under 'lp' with SMC invalidations in top[], which
+   has room for 'max' pages and holds *pn of them, most first.  */
+static void page_smc_top_1(int level, void **lp, tb_page_addr_t index,
+                           TBSMCPage *top, int max, int *pn)
+{
+    int i, j;
+
+    if (*lp == NULL) {
+        return;
+    }
+    if (level == 0) {
+        PageDesc *pd = *lp;
+        for (i = 0; i < L2_SIZE; ++i) {
+            if (pd[i].smc_count == 0) {
+                continue;
+            }
+            for (j = *pn; j > 0 && top[j - 1].count < pd[i].smc_count; j--) {
+                if (j < max) {
+                    top[j] = top[j - 1];
+                }
+            }
+            if (j < max) {
+                top[j].addr = (index + i) << TARGET_PAGE_BITS;
+                top[j].count = pd[i].smc_count;
+                top[j].nocache = pd[i].smc_nocache != 0;
+                if (*pn < max) {
+                    (*pn)++;
+                }
+            }
+        }
+    } else {
+        void **pp = *lp;
+        for (i = 0; i < L2_SIZE; ++i) {
+            page_smc_top_1(level - 1, pp + i,
+                           index + ((tb_page_addr_t)i << (level * L2_BITS)),
+                           top, max, pn);
+        }
+    }
+}
+
+/* Fill top[] with the 'max' pages whose code was invalidated most often
+   by guest writes.  Return the number of pages found.  */
+static int page_smc_top(TBSMCPage *top, int max)
+{
+    int i, n = 0;
+
+    for (i = 0; i < V_L1_SIZE; i++) {
+        page_smc_top_1(V_L1_SHIFT / L2_BITS - 1, l1_map + i,
+                       (tb_page_addr_t)i << V_L1_SHIFT, top, max, &n);
+    }
+    return n;
+}
+
+typedef struct TBProfile {
+    target_ulong pc;
+    int size;
+    uint64_t count;
+} TBProfile;
+
+static int tb_profile_cmp_pc(const void *a, const void *b)
+{
+    const TBProfile *p1 = a, *p2 = b;
+
+    return p1->pc < p2->pc ? -1 : p1->pc > p2->pc;
+}
+
+static int tb_profile_cmp_count(const void *a, const void *b)
+{
+    const TBProfile *p1 = a, *p2 = b;
+
+    return p1->count > p2->count ? -1 : p1->count < p2->count;
+}
+
+/* Return the executions counted since profiling was enabled, summed by
+   guest pc so that retranslations of a block count together, most
+   executed first.  Sets *pn to the number of entries.  */
+static TBProfile *tb_profile_collect(int *pn)
+{
+    TBProfile *prof = g_new(TBProfile, nb_tbs + 1);
+    TranslationBlock *tb;
+    int i, m, n = 0;
+
+    for (i = 0; i < nb_tbs; i++) {
+        tb = tb_ring_at(i);
+        if (tb->profile_count == 0) {
+            continue;
+        }
+        prof[n].pc = tb->pc;
+        prof[n].size = tb->size;
+        prof[n].count = tb->profile_count;
+        n++;
+    }
+    qsort(prof, n, sizeof(*prof), tb_profile_cmp_pc);
+    for (i = 1, m = n ? 1 : 0; i < n; i++) {
+        if (prof[i].pc == prof[m - 1].pc) {
+            prof[m - 1].size = MAX(prof[m - 1].size, prof[i].size);
+            prof[m - 1].count += prof[i].count;
+        } else {
+            prof[m++] = prof[i];
+        }
+    }
+    qsort(prof, m, sizeof(*prof), tb_profile_cmp_count);
+    *pn = m;
+    return prof;
+}
+
+/* Profiling instruments the translated code, so switching it flushes
+   the translation buffer.  Turning it on resets the statistics.  */
+void qmp_jit_profile(bool enable, Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_set(errp, QERR_UNSUPPORTED);
+        return;
+    }
+    tb_lock_acquire();
+    if (enable && !tcg_ctx.profile) {
+        tcg_profile_reset(&tcg_ctx);
+    }
+    tcg_ctx.profile = enable;
+    tb_lock_release();
+    tb_flush(first_cpu);
+}
+
+JitInfo *qmp_query_jit(bool has_top, int64_t top, Error **errp)
+{
+    JitInfo *info;
+    JitCpuInfoList *cpu, **cpu_tail;
+    JitBlockInfoList *block, **block_tail;
+    JitHelperInfoList *helper, **helper_tail;
+    JitSmcPageInfoList *smc, **smc_tail;
+    TBSMCPage *smc_top;
+    TBProfile *prof;
+    TCGHelperInfo **top_helpers;
+    CPUArchState *env;
+    const char *sym;
+    int i, n;
+
+    if (!tcg_enabled()) {
+        error_set(errp, QERR_UNSUPPORTED);
+        return NULL;
+    }
+    if (!has_top) {
+        top = 10;
+    }
+    top = MAX(0, MIN(top, 1000));
+    info = g_malloc0(sizeof(*info));
+    cpu_tail = &info->cpus;
+    block_tail = &info->blocks;
+    helper_tail = &info->helpers;
+    smc_tail = &info->smc_pages;
+
+    tb_lock_acquire();
+    info->profiling = tcg_ctx.profile;
+    info->code_size = code_gen_used();
+    info->code_buffer_size = code_gen_buffer_size;
+    info->tbs = nb_tbs;
+    info->max_tbs = code_gen_max_blocks;
+    info->flushes = tb_flush_count;
+    info->translations = tcg_ctx.tb_count;
+    info->translation_cycles = tcg_ctx.interm_time + tcg_ctx.code_time;
+    info->smc_invalidations = tb_smc_invalidate_count;
+    info->smc_uncached = tb_smc_nocache_exec_count;
+
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        cpu = g_malloc0(sizeof(*cpu));
+        cpu->value = g_malloc0(sizeof(*cpu->value));
+        cpu->value->CPU = env->cpu_index;
+        cpu->value->tlb_fills = env->tlb_fill_count;
+        cpu->value->exits_indirect = env->tb_exit_count[TB_EXIT_INDIRECT];
+        cpu->value->exits_unlinked = env->tb_exit_count[TB_EXIT_UNLINKED];
+        cpu->value->exits_icount = env->tb_exit_count[TB_EXIT_ICOUNT];
+        cpu->value->exits_hot = env->tb_exit_count[TB_EXIT_HOT];
+        cpu->value->exits_exception = env->tb_exit_count[TB_EXIT_EXCEPTION];
+        cpu->value->exits_interrupt = env->tb_exit_count[TB_EXIT_INTERRUPT];
+        cpu->value->exits_request = env->tb_exit_count[TB_EXIT_REQUEST];
+        *cpu_tail = cpu;
+        cpu_tail = &cpu->next;
+    }
+
+    prof = tb_profile_collect(&n);
+    for (i = 0; i < n && i < top; i++) {
+        block = g_malloc0(sizeof(*block));
+        block->value = g_malloc0(sizeof(*block->value));
+        block->value->pc = prof[i].pc;
+        block->value->size = prof[i].size;
+        block->value->executions = prof[i].count;
+        sym = lookup_symbol(prof[i].pc);
+        if (*sym) {
+            block->value->has_symbol = true;
+            block->value->symbol = g_strdup(sym);
+        }
+        *block_tail = block;
+        block_tail = &block->next;
+    }
+    g_free(prof);
+
+    top_helpers = g_new(TCGHelperInfo *, top);
+    n = tcg_profile_top_helpers(&tcg_ctx, top_helpers, top);
+    for (i = 0; i < n; i++) {
+        helper = g_malloc0(sizeof(*helper));
+        helper->value = g_malloc0(sizeof(*helper->value));
+        helper->value->name = g_strdup(top_helpers[i]->name);
+        helper->value->calls = top_helpers[i]->count;
+        *helper_tail = helper;
+        helper_tail = &helper->next;
+    }
+    g_free(top_helpers);
+
+    smc_top = g_new(TBSMCPage, top);
+    n = page_smc_top(smc_top, top);
+    for (i = 0; i < n; i++) {
+        smc = g_malloc0(sizeof(*smc));
+        smc->value = g_malloc0(sizeof(*smc->value));
+        smc->value->addr = smc_top[i].addr;
+        smc->value->invalidations = smc_top[i].count;
+        smc->value->uncached = smc_top[i].nocache;
+        *smc_tail = smc;
+        smc_tail = &smc->next;
+    }
+    g_free(smc_top);
+    tb_lock_release();
+
+    return info;
+}
+
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    int i, target_code_size, max_target_code_size;
-    int direct_jmp_count, direct_jmp2_count, cross_page;
+    TBSMCPage smc_top[5];
+    TBProfile *prof;
+    int i, n, target_code_size, max_target_code_size;
+    int direct_jmp_count, direct_jmp2_count, cross_page, superblocks;
+    unsigned long code_size;
     TranslationBlock *tb;
+#if !defined(CONFIG_USER_ONLY)
+    CPUArchState *env;
+#endif
 
     target_code_size = 0;
     max_target_code_size = 0;
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
+    superblocks = 0;
     for(i = 0; i < nb_tbs; i++) {
-        tb = &tbs[i];
+        tb = tb_ring_at(i);
         target_code_size += tb->size;
+        if (tb->cflags & CF_SUPERBLOCK) {
+            superblocks++;
+        }
         if (tb->size > max_target_code_size)
             max_target_code_size = tb->size;
         if (tb->page_addr[1] != -1)
@@ -4195,16 +5295,21 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     }
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
-    cpu_fprintf(f, "gen code size       %td/%ld\n",
-                code_gen_ptr - code_gen_buffer, code_gen_buffer_max_size);
+    code_size = code_gen_used();
+    cpu_fprintf(f, "gen code size       %lu/%lu (%d regions)\n",
+                code_size, code_gen_buffer_size, code_gen_nb_regions);
+    cpu_fprintf(f, "gen code pages      %s%s\n",
+                code_gen_pages == CODE_GEN_PAGES_HUGETLB ? "hugetlb" :
+                code_gen_pages == CODE_GEN_PAGES_THP ? "thp" : "small",
+                code_gen_split_wx ? ", split W^X" : "");
     cpu_fprintf(f, "TB count            %d/%d\n", 
                 nb_tbs, code_gen_max_blocks);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
                 nb_tbs ? target_code_size / nb_tbs : 0,
                 max_target_code_size);
-    cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-                nb_tbs ? (code_gen_ptr - code_gen_buffer) / nb_tbs : 0,
-                target_code_size ? (double) (code_gen_ptr - code_gen_buffer) / target_code_size : 0);
+    cpu_fprintf(f, "TB avg host size    %lu bytes (expansion ratio: %0.1f)\n",
+                nb_tbs ? code_size / nb_tbs : 0,
+                target_code_size ? (double) code_size / target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n",
             cross_page,
             nb_tbs ? (cross_page * 100) / nb_tbs : 0);
@@ -4213,11 +5318,74 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
                 nb_tbs ? (direct_jmp_count * 100) / nb_tbs : 0,
                 direct_jmp2_count,
                 nb_tbs ? (direct_jmp2_count * 100) / nb_tbs : 0);
+    tb_lock_acquire();
+    tb_htable_dump_info(f, cpu_fprintf);
+    tb_lock_release();
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %d\n", tb_flush_count);
+    cpu_fprintf(f, "TB region evictions %d (%d TBs)\n",
+                tb_evict_count, tb_evict_tb_count);
     cpu_fprintf(f, "TB invalidate count %d\n", tb_phys_invalidate_count);
+    cpu_fprintf(f, "TB superblocks      %d (%d in buffer)\n",
+                tb_superblock_count, superblocks);
+    cpu_fprintf(f, "SMC invalidations   %d (%d uncached pages, "
+                "%d uncached blocks)\n", tb_smc_invalidate_count,
+                tb_smc_nocache_count, tb_smc_nocache_exec_count);
+    tb_lock_acquire();
+    n = page_smc_top(smc_top, ARRAY_SIZE(smc_top));
+    tb_lock_release();
+    for (i = 0; i < n; i++) {
+        cpu_fprintf(f, "  page 0x%08" PRIx64 " %u%s\n",
+                    (uint64_t)smc_top[i].addr, smc_top[i].count,
+                    smc_top[i].nocache ? " (uncached)" : "");
+    }
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
+    cpu_fprintf(f, "TLB page flushes    %d (%d of large pages)\n",
+                tlb_flush_page_count, tlb_flush_large_page_count);
+#if !defined(CONFIG_USER_ONLY)
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        cpu_fprintf(f, "CPU #%d TLB fills   %" PRIu64
+                    " (victim TLB hits %" PRIu64 " misses %" PRIu64 ")\n",
+                    env->cpu_index, env->tlb_fill_count,
+                    env->tlb_victim_hit_count, env->tlb_victim_miss_count);
+#ifdef CPU_TLB_DYN
+        {
+            int mmu_idx;
+
+            cpu_fprintf(f, "CPU #%d TLB size   ", env->cpu_index);
+            for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+                cpu_fprintf(f, " %zu", tlb_n_entries(env, mmu_idx));
+            }
+            cpu_fprintf(f, " (%u resizes)\n", env->tlb_resize_count);
+        }
+#endif
+        cpu_fprintf(f, "CPU #%d TB exits    indirect %" PRIu64
+                    " unlinked %" PRIu64 " icount %" PRIu64
+                    " hot %" PRIu64 "\n", env->cpu_index,
+                    env->tb_exit_count[TB_EXIT_INDIRECT],
+                    env->tb_exit_count[TB_EXIT_UNLINKED],
+                    env->tb_exit_count[TB_EXIT_ICOUNT],
+                    env->tb_exit_count[TB_EXIT_HOT]);
+        cpu_fprintf(f, "CPU #%d loop exits  exception %" PRIu64
+                    " interrupt %" PRIu64 " main loop %" PRIu64 "\n",
+                    env->cpu_index,
+                    env->tb_exit_count[TB_EXIT_EXCEPTION],
+                    env->tb_exit_count[TB_EXIT_INTERRUPT],
+                    env->tb_exit_count[TB_EXIT_REQUEST]);
+    }
+#endif
     tcg_dump_info(f, cpu_fprintf);
+
+    tb_lock_acquire();
+    prof = tb_profile_collect(&n);
+    for (i = 0; i < n && i < 10; i++) {
+        cpu_fprintf(f, "%s" TARGET_FMT_lx " %-24s %5d bytes %" PRIu64
+                    " executions\n", i == 0 ? "top blocks:\n  " : "  ",
+                    prof[i].pc, lookup_symbol(prof[i].pc), prof[i].size,
+                    prof[i].count);
+    }
+    g_free(prof);
+    tb_lock_release();
 }
 
 /*
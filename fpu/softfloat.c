@@ -40,6 +40,9 @@ these four paragraphs for those parts of this code that are retained.
  */
 #include "config.h"
 
+#include <float.h>
+#include <math.h>
+
 #include "softfloat.h"
 
 /*----------------------------------------------------------------------------
@@ -1843,6 +1846,102 @@ static float32 subFloat32Sigs( float32 a, float32 b, flag zSign STATUS_PARAM)
 
 }
 
+/*----------------------------------------------------------------------------
+| Host FPU fast path for the basic operations.  When the rounding mode is
+| round-to-nearest-even and the inexact flag is already raised, an operation
+| on zero or normal operands whose result is neither tiny nor infinite gives
+| the same result as the host's IEEE operation, and can only raise the
+| inexact flag.  Overflow is recognized from the infinite result.  Anything
+| else (denormals, infinities, NaNs, results that may be tiny) goes through
+| the soft-float code, which knows about the target's tininess detection,
+| flush-to-zero and NaN rules.  The host must evaluate float and double
+| expressions in their own precision, which excludes x87 code.
+*----------------------------------------------------------------------------*/
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define USE_HOST_FPU 1
+#else
+#define USE_HOST_FPU 0
+#endif
+
+enum {
+    host_fpu_add,
+    host_fpu_sub,
+    host_fpu_mul,
+    host_fpu_div
+};
+
+typedef union {
+    float32 s;
+    float h;
+} float32_host;
+
+typedef union {
+    float64 s;
+    double h;
+} float64_host;
+
+INLINE flag host_fpu_usable(float_status *status)
+{
+    return USE_HOST_FPU &&
+           STATUS(float_rounding_mode) == float_round_nearest_even &&
+           (STATUS(float_exception_flags) & float_flag_inexact);
+}
+
+INLINE flag float32_is_zero_or_normal(float32 a)
+{
+    int_fast16_t aExp = extractFloat32Exp(a);
+
+    return aExp != 0xFF && (aExp != 0 || float32_is_zero(a));
+}
+
+/*----------------------------------------------------------------------------
+| Computes `a' OP `b' with the host FPU and stores the result in `r'.  Returns
+| 0 if the soft-float code has to do it instead.
+*----------------------------------------------------------------------------*/
+
+INLINE flag float32_host_op(int op, float32 a, float32 b, float32 *r
+                            STATUS_PARAM)
+{
+    float32_host ha, hb, hr;
+    flag zero_ok;
+
+    if (!host_fpu_usable(status) ||
+        !float32_is_zero_or_normal(a) || !float32_is_zero_or_normal(b)) {
+        return 0;
+    }
+    ha.s = a;
+    hb.s = b;
+    switch (op) {
+    case host_fpu_add:
+        hr.h = ha.h + hb.h;
+        zero_ok = float32_is_zero(a) && float32_is_zero(b);
+        break;
+    case host_fpu_sub:
+        hr.h = ha.h - hb.h;
+        zero_ok = float32_is_zero(a) && float32_is_zero(b);
+        break;
+    case host_fpu_mul:
+        hr.h = ha.h * hb.h;
+        zero_ok = float32_is_zero(a) || float32_is_zero(b);
+        break;
+    default:
+        if (float32_is_zero(b)) {
+            return 0;
+        }
+        hr.h = ha.h / hb.h;
+        zero_ok = float32_is_zero(a);
+        break;
+    }
+    /* zero_ok is set when the result is an exact zero */
+    if (isinf(hr.h)) {
+        float_raise(float_flag_overflow | float_flag_inexact STATUS_VAR);
+    } else if (!zero_ok && !(fabsf(hr.h) > FLT_MIN)) {
+        return 0;
+    }
+    *r = hr.s;
+    return 1;
+}
+
 /*----------------------------------------------------------------------------
 | Returns the result of adding the single-precision floating-point values `a'
 | and `b'.  The operation is performed according to the IEC/IEEE Standard for
@@ -1852,6 +1951,12 @@ static float32 subFloat32Sigs( float32 a, float32 b, flag zSign STATUS_PARAM)
 float32 float32_add( float32 a, float32 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    float32 r;
+
+    if (float32_host_op(host_fpu_add, a, b, &r STATUS_VAR)) {
+        return r;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1875,6 +1980,12 @@ float32 float32_add( float32 a, float32 b STATUS_PARAM )
 float32 float32_sub( float32 a, float32 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    float32 r;
+
+    if (float32_host_op(host_fpu_sub, a, b, &r STATUS_VAR)) {
+        return r;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1902,6 +2013,11 @@ float32 float32_mul( float32 a, float32 b STATUS_PARAM )
     uint32_t aSig, bSig;
     uint64_t zSig64;
     uint32_t zSig;
+    float32 r;
+
+    if (float32_host_op(host_fpu_mul, a, b, &r STATUS_VAR)) {
+        return r;
+    }
 
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
@@ -1963,6 +2079,12 @@ float32 float32_div( float32 a, float32 b STATUS_PARAM )
     flag aSign, bSign, zSign;
     int_fast16_t aExp, bExp, zExp;
     uint32_t aSig, bSig, zSig;
+    float32 r;
+
+    if (float32_host_op(host_fpu_div, a, b, &r STATUS_VAR)) {
+        return r;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -2336,6 +2458,16 @@ float32 float32_sqrt( float32 a STATUS_PARAM )
     int_fast16_t aExp, zExp;
     uint32_t aSig, zSig;
     uint64_t rem, term;
+
+    if (host_fpu_usable(status) && float32_is_zero_or_normal(a) &&
+        (!float32_is_neg(a) || float32_is_zero(a))) {
+        float32_host h;
+
+        h.s = a;
+        h.h = sqrtf(h.h);
+        return h.s;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
 
     aSig = extractFloat32Frac( a );
@@ -3406,6 +3538,60 @@ static float64 subFloat64Sigs( float64 a, float64 b, flag zSign STATUS_PARAM )
 
 }
 
+INLINE flag float64_is_zero_or_normal(float64 a)
+{
+    int_fast16_t aExp = extractFloat64Exp(a);
+
+    return aExp != 0x7FF && (aExp != 0 || float64_is_zero(a));
+}
+
+/*----------------------------------------------------------------------------
+| Computes `a' OP `b' with the host FPU and stores the result in `r'.  Returns
+| 0 if the soft-float code has to do it instead.
+*----------------------------------------------------------------------------*/
+
+INLINE flag float64_host_op(int op, float64 a, float64 b, float64 *r
+                            STATUS_PARAM)
+{
+    float64_host ha, hb, hr;
+    flag zero_ok;
+
+    if (!host_fpu_usable(status) ||
+        !float64_is_zero_or_normal(a) || !float64_is_zero_or_normal(b)) {
+        return 0;
+    }
+    ha.s = a;
+    hb.s = b;
+    switch (op) {
+    case host_fpu_add:
+        hr.h = ha.h + hb.h;
+        zero_ok = float64_is_zero(a) && float64_is_zero(b);
+        break;
+    case host_fpu_sub:
+        hr.h = ha.h - hb.h;
+        zero_ok = float64_is_zero(a) && float64_is_zero(b);
+        break;
+    case host_fpu_mul:
+        hr.h = ha.h * hb.h;
+        zero_ok = float64_is_zero(a) || float64_is_zero(b);
+        break;
+    default:
+        if (float64_is_zero(b)) {
+            return 0;
+        }
+        hr.h = ha.h / hb.h;
+        zero_ok = float64_is_zero(a);
+        break;
+    }
+    if (isinf(hr.h)) {
+        float_raise(float_flag_overflow | float_flag_inexact STATUS_VAR);
+    } else if (!zero_ok && !(fabs(hr.h) > DBL_MIN)) {
+        return 0;
+    }
+    *r = hr.s;
+    return 1;
+}
+
 /*----------------------------------------------------------------------------
 | Returns the result of adding the double-precision floating-point values `a'
 | and `b'.  The operation is performed according to the IEC/IEEE Standard for
@@ -3415,6 +3601,12 @@ static float64 subFloat64Sigs( float64 a, float64 b, flag zSign STATUS_PARAM )
 float64 float64_add( float64 a, float64 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    float64 r;
+
+    if (float64_host_op(host_fpu_add, a, b, &r STATUS_VAR)) {
+        return r;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3438,6 +3630,12 @@ float64 float64_add( float64 a, float64 b STATUS_PARAM )
 float64 float64_sub( float64 a, float64 b STATUS_PARAM )
 {
     flag aSign, bSign;
+    float64 r;
+
+    if (float64_host_op(host_fpu_sub, a, b, &r STATUS_VAR)) {
+        return r;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3463,6 +3661,11 @@ float64 float64_mul( float64 a, float64 b STATUS_PARAM )
     flag aSign, bSign, zSign;
     int_fast16_t aExp, bExp, zExp;
     uint64_t aSig, bSig, zSig0, zSig1;
+    float64 r;
+
+    if (float64_host_op(host_fpu_mul, a, b, &r STATUS_VAR)) {
+        return r;
+    }
 
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
@@ -3526,6 +3729,12 @@ float64 float64_div( float64 a, float64 b STATUS_PARAM )
     uint64_t aSig, bSig, zSig;
     uint64_t rem0, rem1;
     uint64_t term0, term1;
+    float64 r;
+
+    if (float64_host_op(host_fpu_div, a, b, &r STATUS_VAR)) {
+        return r;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3903,6 +4112,16 @@ float64 float64_sqrt( float64 a STATUS_PARAM )
     int_fast16_t aExp, zExp;
     uint64_t aSig, zSig, doubleZSig;
     uint64_t rem0, rem1, term0, term1;
+
+    if (host_fpu_usable(status) && float64_is_zero_or_normal(a) &&
+        (!float64_is_neg(a) || float64_is_zero(a))) {
+        float64_host h;
+
+        h.s = a;
+        h.h = sqrt(h.h);
+        return h.s;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
 
     aSig = extractFloat64Frac( a );
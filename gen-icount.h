@@ -9,8 +9,19 @@ static inline void gen_icount_start(void)
 {
     TCGv_i32 count;
 
-    if (!use_icount)
+    if (!use_icount) {
+        if (parallel_cpus) {
+            /* no instruction counting, but cpu_exit() on another thread
+               sets icount_decr.u16.high to make us leave the TB */
+            icount_label = gen_new_label();
+            count = tcg_temp_new_i32();
+            tcg_gen_ld_i32(count, cpu_env,
+                           offsetof(CPUArchState, icount_decr.u32));
+            tcg_gen_brcondi_i32(TCG_COND_LT, count, 0, icount_label);
+            tcg_temp_free_i32(count);
+        }
         return;
+    }
 
     icount_label = gen_new_label();
     count = tcg_temp_local_new_i32();
@@ -28,11 +39,63 @@ static void gen_icount_end(TranslationBlock *tb, int num_insns)
 {
     if (use_icount) {
         *icount_arg = num_insns;
+    }
+    if (use_icount || parallel_cpus) {
         gen_set_label(icount_label);
         tcg_gen_exit_tb((tcg_target_long)tb + 2);
     }
 }
 
+/* Count the executions of a TB and leave it with exit code 3 when it
+   becomes hot, so that cpu_exec() retranslates it as a superblock.  Must
+   come before any other code of the TB.  Only emitted by targets whose
+   translator follows jumps in superblocks.  */
+static inline void gen_tb_exec_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr;
+    TCGv_i32 count;
+    int l1;
+
+    if ((tb->cflags & ~CF_PROFILE) != 0) {
+        return;
+    }
+    l1 = gen_new_label();
+    ptr = tcg_const_ptr(&tb->exec_count);
+    count = tcg_temp_new_i32();
+    tcg_gen_ld_i32(count, ptr, 0);
+    tcg_gen_addi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, 0);
+    tcg_gen_brcondi_i32(TCG_COND_NE, count, TB_HOT_THRESHOLD, l1);
+    tcg_temp_free_i32(count);
+    tcg_temp_free_ptr(ptr);
+    tcg_gen_exit_tb((tcg_target_long)tb + 3);
+    gen_set_label(l1);
+}
+
+/* End the TB after an indirect branch by jumping straight to the TB of
+   the new CPU state, which must already be stored in env.  Hosts without
+   goto_ptr return to cpu_exec() instead.  */
+static inline void gen_lookup_and_goto_ptr(TCGv_ptr env)
+{
+    TCGv_ptr ptr;
+    TCGArg args[1];
+    int sizemask;
+
+    if (!TCG_TARGET_HAS_goto_ptr) {
+        tcg_gen_exit_tb(0);
+        return;
+    }
+    sizemask = tcg_gen_sizemask(0, TCG_TARGET_REG_BITS == 64, 0)
+               | tcg_gen_sizemask(1, TCG_TARGET_REG_BITS == 64, 0);
+    ptr = tcg_temp_new_ptr();
+    args[0] = GET_TCGV_PTR(env);
+    /* reads the pc from env, and sets env->current_tb */
+    tcg_gen_helperN(helper_lookup_tb_ptr, TCG_CALL_NO_WRITE_GLOBALS,
+                    sizemask, GET_TCGV_PTR(ptr), 1, args);
+    tcg_gen_goto_ptr(ptr);
+    tcg_temp_free_ptr(ptr);
+}
+
 static inline void gen_io_start(void)
 {
     TCGv_i32 tmp = tcg_const_i32(1);
@@ -321,6 +321,24 @@ STEXI
 @findex singlestep
 Run the emulation in single step mode.
 If called with option off, the emulation returns to normal mode.
+ETEXI
+
+    {
+        .name       = "jit_profile",
+        .args_type  = "enable:b",
+        .params     = "on|off",
+        .help       = "enable or disable profiling of translated code",
+        .mhandler.cmd = hmp_jit_profile,
+    },
+
+STEXI
+@item jit_profile on|off
+@findex jit_profile
+Enable or disable profiling of translated code.  While profiling, the
+translated code counts how often each block is executed and each helper is
+called, and @code{info jit} also shows the translation time and the most
+executed blocks and helpers.  Turning profiling on resets these statistics;
+turning it on or off flushes the translated code.
 ETEXI
 
     {
@@ -0,0 +1,239 @@
+/*
+ * Describe translated code to the Linux perf tool
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Two formats are supported:
+ *
+ * - "map" writes /tmp/perf-<pid>.map, one "start size name" line per TB.
+ *   perf report picks it up by itself, but only knows the last block that
+ *   was placed at a given address, so samples taken before the translation
+ *   buffer is reused may be attributed to the wrong guest code.
+ *
+ * - "jitdump" writes /tmp/jit-<pid>.dump in the format described in
+ *   tools/perf/Documentation/jitdump-specification.txt.  Every record has
+ *   a timestamp and a copy of the host code, so reuse of the buffer is
+ *   handled, and the host instructions can be annotated.  Record with
+ *   "perf record -k 1" and run "perf inject --jit" before "perf report".
+ *
+ * Blocks are named after the guest symbol that contains them when one is
+ * known (ELF binaries loaded by linux-user, or -kernel for system
+ * emulation) and after their guest pc otherwise.
+ *
+ * Callers of tcg_perf_report_tb must hold tb_lock.
+ */
+
+#include <sys/mman.h>
+#include <time.h>
+
+#include "config.h"
+#include "cpu.h"
+#include "exec-all.h"
+#include "disas.h"
+#include "elf.h"
+
+#if defined(__x86_64__)
+#define PERF_ELF_MACHINE EM_X86_64
+#elif defined(__i386__)
+#define PERF_ELF_MACHINE EM_386
+#elif defined(__arm__)
+#define PERF_ELF_MACHINE EM_ARM
+#elif defined(__powerpc64__)
+#define PERF_ELF_MACHINE EM_PPC64
+#elif defined(__powerpc__)
+#define PERF_ELF_MACHINE EM_PPC
+#elif defined(__mips__)
+#define PERF_ELF_MACHINE EM_MIPS
+#elif defined(__s390__)
+#define PERF_ELF_MACHINE EM_S390
+#elif defined(__sparc__)
+#define PERF_ELF_MACHINE EM_SPARCV9
+#elif defined(__ia64__)
+#define PERF_ELF_MACHINE EM_IA_64
+#else
+#define PERF_ELF_MACHINE EM_NONE
+#endif
+
+#define JITDUMP_MAGIC           0x4A695444
+#define JITDUMP_VERSION         1
+
+enum {
+    JIT_CODE_LOAD = 0,
+    JIT_CODE_CLOSE = 3,
+};
+
+typedef struct JitHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+} JitHeader;
+
+typedef struct JitRecordPrefix {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+} JitRecordPrefix;
+
+/* followed by the NUL terminated name and the code */
+typedef struct JitCodeLoad {
+    JitRecordPrefix p;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+} JitCodeLoad;
+
+bool tcg_perf_enabled;
+
+static FILE *perf_map;
+static FILE *jitdump;
+static void *jitdump_marker;
+static uint64_t jitdump_index;
+
+static uint64_t perf_timestamp(void)
+{
+    struct timespec ts;
+
+    /* must match the clock of "perf record -k 1" */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static FILE *perf_open(const char *format, const char *mode)
+{
+    char path[64];
+    FILE *f;
+
+    snprintf(path, sizeof(path), format, (int)getpid());
+    f = fopen(path, mode);
+    if (!f) {
+        fprintf(stderr, "qemu: cannot open %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    return f;
+}
+
+static void perf_map_init(void)
+{
+    perf_map = perf_open("/tmp/perf-%d.map", "w");
+}
+
+static void jitdump_init(void)
+{
+    JitHeader header;
+    long page_size = getpagesize();
+
+    jitdump = perf_open("/tmp/jit-%d.dump", "w+");
+
+    /* perf finds the dump through an executable mapping of the file */
+    jitdump_marker = mmap(NULL, page_size, PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                          fileno(jitdump), 0);
+    if (jitdump_marker == MAP_FAILED) {
+        fprintf(stderr, "qemu: cannot map the jitdump file: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = JITDUMP_MAGIC;
+    header.version = JITDUMP_VERSION;
+    header.total_size = sizeof(header);
+    header.elf_mach = PERF_ELF_MACHINE;
+    header.pid = getpid();
+    header.timestamp = perf_timestamp();
+    fwrite(&header, sizeof(header), 1, jitdump);
+}
+
+void configure_tcg_perf(const char *option)
+{
+    if (!option) {
+        return;
+    }
+    if (!strcmp(option, "map")) {
+        if (!perf_map) {
+            perf_map_init();
+        }
+    } else if (!strcmp(option, "jitdump")) {
+        if (!jitdump) {
+            jitdump_init();
+        }
+    } else {
+        fprintf(stderr, "Invalid -tcg-perf value '%s'\n", option);
+        exit(1);
+    }
+    if (!tcg_perf_enabled) {
+        tcg_perf_enabled = true;
+        atexit(tcg_perf_exit);
+    }
+}
+
+static void perf_tb_name(TranslationBlock *tb, char *buf, size_t size)
+{
+    const char *sym = lookup_symbol(tb->pc);
+
+    if (*sym) {
+        snprintf(buf, size, "guest:%s@0x" TARGET_FMT_lx, sym, tb->pc);
+    } else {
+        snprintf(buf, size, "guest:0x" TARGET_FMT_lx, tb->pc);
+    }
+}
+
+void tcg_perf_report_tb(TranslationBlock *tb, int code_size)
+{
+    char name[256];
+
+    perf_tb_name(tb, name, sizeof(name));
+    if (perf_map) {
+        fprintf(perf_map, "%" PRIxPTR " %x %s\n",
+                (uintptr_t)tb->tc_ptr, code_size, name);
+    }
+    if (jitdump) {
+        JitCodeLoad rec;
+        size_t name_len = strlen(name) + 1;
+
+        rec.p.id = JIT_CODE_LOAD;
+        rec.p.total_size = sizeof(rec) + name_len + code_size;
+        rec.p.timestamp = perf_timestamp();
+        rec.pid = getpid();
+        rec.tid = qemu_get_thread_id();
+        rec.vma = (uintptr_t)tb->tc_ptr;
+        rec.code_addr = (uintptr_t)tb->tc_ptr;
+        rec.code_size = code_size;
+        rec.code_index = jitdump_index++;
+        fwrite(&rec, sizeof(rec), 1, jitdump);
+        fwrite(name, name_len, 1, jitdump);
+        fwrite(tb->tc_ptr, code_size, 1, jitdump);
+    }
+}
+
+/* Also called on the exit paths of linux-user that bypass atexit().  */
+void tcg_perf_exit(void)
+{
+    /* vCPUs that are still running must not write to the files anymore */
+    tb_lock_acquire();
+    tcg_perf_enabled = false;
+    if (perf_map) {
+        fclose(perf_map);
+        perf_map = NULL;
+    }
+    if (jitdump) {
+        JitRecordPrefix rec;
+
+        rec.id = JIT_CODE_CLOSE;
+        rec.total_size = sizeof(rec);
+        rec.timestamp = perf_timestamp();
+        fwrite(&rec, sizeof(rec), 1, jitdump);
+        munmap(jitdump_marker, getpagesize());
+        fclose(jitdump);
+        jitdump = NULL;
+    }
+    tb_lock_release();
+}
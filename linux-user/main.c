@@ -67,6 +67,7 @@ static void usage(void);
 
 static const char *interp_prefix = CONFIG_QEMU_INTERP_PREFIX;
 const char *qemu_uname_release = CONFIG_UNAME_RELEASE;
+static const char *tb_cache_dir;
 
 /* XXX: on x86 MAP_GROWSDOWN only works if ESP <= address + 32, so
    we allocate a bigger stack. Need a better solution, for example
@@ -119,13 +120,14 @@ static int pending_cpus;
 /* Make sure everything is in a consistent state for calling fork().  */
 void fork_start(void)
 {
-    pthread_mutex_lock(&tb_lock);
     pthread_mutex_lock(&exclusive_lock);
     mmap_fork_start();
+    tb_lock_acquire();
 }
 
 void fork_end(int child)
 {
+    tb_lock_release();
     mmap_fork_end(child);
     if (child) {
         /* Child processes created by fork() only have a single thread.
@@ -137,11 +139,9 @@ void fork_end(int child)
         pthread_mutex_init(&cpu_list_mutex, NULL);
         pthread_cond_init(&exclusive_cond, NULL);
         pthread_cond_init(&exclusive_resume, NULL);
-        pthread_mutex_init(&tb_lock, NULL);
         gdbserver_fork(thread_env);
     } else {
         pthread_mutex_unlock(&exclusive_lock);
-        pthread_mutex_unlock(&tb_lock);
     }
 }
 
@@ -183,9 +183,21 @@ static inline void end_exclusive(void)
     pthread_mutex_unlock(&exclusive_lock);
 }
 
+/* With parallel_cpus, tb_flush waits for the other threads to leave the
+   translated code.  */
+static inline void cpu_exec_flush(CPUArchState *env)
+{
+    if (unlikely(tb_flush_pending)) {
+        start_exclusive();
+        tb_flush_exclusive(env);
+        end_exclusive();
+    }
+}
+
 /* Wait for exclusive ops to finish, and begin cpu execution.  */
 static inline void cpu_exec_start(CPUArchState *env)
 {
+    cpu_exec_flush(env);
     pthread_mutex_lock(&exclusive_lock);
     exclusive_idle();
     env->running = 1;
@@ -205,6 +217,7 @@ static inline void cpu_exec_end(CPUArchState *env)
     }
     exclusive_idle();
     pthread_mutex_unlock(&exclusive_lock);
+    cpu_exec_flush(env);
 }
 
 void cpu_list_lock(void)
@@ -3201,6 +3214,21 @@ static void handle_arg_singlestep(const char *arg)
     singlestep = 1;
 }
 
+static void handle_arg_tcg_perf(const char *arg)
+{
+    configure_tcg_perf(arg);
+}
+
+static void handle_arg_tcg_buffer(const char *arg)
+{
+    configure_tcg_buffer(arg);
+}
+
+static void handle_arg_tb_cache(const char *arg)
+{
+    tb_cache_dir = arg;
+}
+
 static void handle_arg_strace(const char *arg)
 {
     do_strace = 1;
@@ -3255,6 +3283,12 @@ static const struct qemu_argument arg_table[] = {
      "pagesize",   "set the host page size to 'pagesize'"},
     {"singlestep", "QEMU_SINGLESTEP",  false, handle_arg_singlestep,
      "",           "run in singlestep mode"},
+    {"tcg-perf",   "QEMU_TCG_PERF",    true,  handle_arg_tcg_perf,
+     "map|jitdump", "describe translated code to perf in /tmp"},
+    {"tcg-buffer", "QEMU_TCG_BUFFER",  true,  handle_arg_tcg_buffer,
+     "pages[,split-wx]", "back translated code with small|thp|hugetlb pages"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "dir",        "keep translated code in 'dir' for later runs"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"version",    "QEMU_VERSION",     false, handle_arg_version,
@@ -3594,6 +3628,10 @@ int main(int argc, char **argv, char **envp)
 
     free(target_environ);
 
+    if (tb_cache_dir) {
+        tb_cache_init(tb_cache_dir, filename, info->load_addr, cpu_model);
+    }
+
     if (qemu_log_enabled()) {
 #if defined(CONFIG_USE_GUEST_BASE)
         qemu_log("guest_base  0x%lx\n", guest_base);
@@ -51,20 +51,33 @@ void mmap_unlock(void)
     }
 }
 
-/* Grab lock to make sure things are in a consistent state after fork().  */
+/* Drop the lock, however deeply it is held, when an exception in
+   translated code longjmps back to cpu_exec().  */
+void mmap_lock_reset(void)
+{
+    if (mmap_lock_count) {
+        mmap_lock_count = 0;
+        pthread_mutex_unlock(&mmap_mutex);
+    }
+}
+
+/* Grab lock to make sure things are in a consistent state after fork().
+   The translator takes it with tb_lock, see fork_start().  */
 void mmap_fork_start(void)
 {
     if (mmap_lock_count)
         abort();
-    pthread_mutex_lock(&mmap_mutex);
+    mmap_lock();
 }
 
 void mmap_fork_end(int child)
 {
-    if (child)
+    if (child) {
+        mmap_lock_count = 0;
         pthread_mutex_init(&mmap_mutex, NULL);
-    else
-        pthread_mutex_unlock(&mmap_mutex);
+    } else {
+        mmap_unlock();
+    }
 }
 #else
 /* We aren't threadsafe to start with, so no need to worry about locking.  */
@@ -75,6 +88,10 @@ void mmap_lock(void)
 void mmap_unlock(void)
 {
 }
+
+void mmap_lock_reset(void)
+{
+}
 #endif
 
 /* NOTE: all the constants are the HOST ones, but addresses are target. */
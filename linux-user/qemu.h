@@ -262,6 +262,7 @@ extern unsigned long last_brk;
 extern abi_ulong mmap_next_start;
 void mmap_lock(void);
 void mmap_unlock(void);
+void mmap_lock_reset(void);
 abi_ulong mmap_find_vma(abi_ulong, abi_ulong);
 void cpu_list_lock(void);
 void cpu_list_unlock(void);
@@ -273,6 +274,12 @@ void mmap_fork_end(int child);
 /* main.c */
 extern unsigned long guest_stack_size;
 
+/* tb-cache.c */
+void tb_cache_init(const char *dir, const char *exe, abi_ulong load_addr,
+                   const char *cpu_model);
+void tb_cache_save(void);
+void tb_cache_fork_child(void);
+
 /* user access */
 
 #define VERIFY_READ 0
@@ -4310,6 +4310,19 @@ static int do_fork(CPUArchState *env, unsigned int flags, abi_ulong newsp,
 #if defined(CONFIG_USE_NPTL)
         new_thread_info info;
         pthread_attr_t attr;
+#endif
+#if defined(CONFIG_USE_NPTL) && \
+    (defined(__i386__) || defined(__x86_64__)) && \
+    !defined(CONFIG_TCG_INTERPRETER) && \
+    (defined(TARGET_I386) || defined(TARGET_ARM) || defined(TARGET_PPC))
+        if (!parallel_cpus) {
+            /* From now on the threads run translated code concurrently and
+               the guest atomic instructions use host atomics.  The code
+               translated so far does neither, nor does it check for
+               cpu_exit() from another thread.  */
+            tb_flush(env);
+            parallel_cpus = true;
+        }
 #endif
         ts = g_malloc0(sizeof(TaskState));
         init_task_state(ts);
@@ -4394,6 +4407,7 @@ static int do_fork(CPUArchState *env, unsigned int flags, abi_ulong newsp,
             /* Child Process.  */
             cpu_clone_regs(env, newsp);
             fork_end(1);
+            tb_cache_fork_child();
 #if defined(CONFIG_USE_NPTL)
             /* There is a race condition here.  The parent process could
                theoretically read the TID in the child process before the child
@@ -5149,6 +5163,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         _mcleanup();
 #endif
         gdb_exit(cpu_env, arg1);
+        tcg_perf_exit();
+        tb_cache_save();
         _exit(arg1);
         ret = 0; /* avoid warning */
         break;
@@ -5339,6 +5355,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             }
             if (!(p = lock_user_string(arg1)))
                 goto execve_efault;
+            tb_cache_save();
             ret = get_errno(execve(p, argp, envp));
             unlock_user(p, arg1, 0);
 
@@ -6903,6 +6920,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         _mcleanup();
 #endif
         gdb_exit(cpu_env, arg1);
+        tcg_perf_exit();
+        tb_cache_save();
         ret = get_errno(exit_group(arg1));
         break;
 #endif
@@ -0,0 +1,700 @@
+/*
+ * Translation cache kept across runs of a program
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * With "-tb-cache dir", the TCG ops of each TB are saved to a file in dir
+ * after the optimizer and the liveness analysis, and later runs of the same
+ * program take them from there instead of decoding the guest code again.
+ * Only the register allocator and the backend run for those TBs.  This
+ * mostly helps short lived processes, like the compilers and tools started
+ * by a build, which spend a good part of their time translating code that
+ * runs only a few times.
+ *
+ * The file is named after a hash of the contents of the guest executable,
+ * its load address, the CPU model and the QEMU executable.  Entries are
+ * looked up by pc, cs_base, flags and cflags, and are only used if the
+ * guest code they were translated from is still the same, so that shared
+ * libraries which were updated or loaded elsewhere are simply translated
+ * again.
+ *
+ * Host pointers in the ops (helpers, TB addresses) are saved relative to
+ * the QEMU executable or to the TB, using the ops recorded in
+ * tcg_ctx.ptr_ops.  TBs which use any other host pointer, or where the
+ * optimizer copied a pointer to another op, are not saved.
+ *
+ * New entries are appended to the file when the process exits or calls
+ * execve, with a single write so that several processes can share the
+ * file.  Each record has a length and a checksum, and later records
+ * replace earlier ones with the same key.  The file is rewritten when
+ * most of its records have been replaced or when it is damaged.
+ *
+ * Callers of tb_cache_lookup and tb_cache_add must hold tb_lock.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <link.h>
+
+#include "qemu.h"
+#include "qemu-common.h"
+#include "tcg.h"
+
+#define TB_CACHE_MAGIC      "QEMUTBC1"
+
+/* host pointer relocations, in the low bits of a relocation entry */
+#define TB_CACHE_RELOC_TB   0   /* relative to the TranslationBlock */
+#define TB_CACHE_RELOC_EXE  1   /* relative to the QEMU executable */
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint64_t key;
+} TBCacheHeader;
+
+/* Every record starts with its length, a multiple of 8, and a checksum of
+   the entry that follows.  The checksum is only verified when the entry
+   is used, most entries of a big file never are.  */
+typedef struct TBCacheRecord {
+    uint32_t len;
+    uint32_t check;
+} TBCacheRecord;
+
+/* An entry is followed by nb_params TCGArg, nb_relocs uint32_t (parameter
+   index << 2 | relocation), nb_ops uint16_t opcodes, as many op_dead_args,
+   nb_temps bytes (base type, type and temp_local of each temp) and the size
+   bytes of guest code.  */
+typedef struct TBCacheEntry {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint64_t flags;
+    uint32_t cflags;
+    uint32_t size;
+    uint32_t icount;
+    uint32_t nb_temps;
+    uint32_t nb_labels;
+    uint32_t nb_ops;
+    uint32_t nb_params;
+    uint32_t nb_relocs;
+} TBCacheEntry;
+
+bool tb_cache_enabled;
+
+static char *tb_cache_path;
+static uint64_t tb_cache_key;
+static GHashTable *tb_cache_table;
+static GPtrArray *tb_cache_pending;
+static int tb_cache_live;
+static int tb_cache_stale;
+static bool tb_cache_damaged;
+
+/* where the QEMU executable is loaded */
+static uintptr_t tb_cache_exe_start, tb_cache_exe_end;
+
+static uint64_t tb_cache_hash(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint64_t w;
+
+    while (len >= 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0x100000001b3ULL;
+        h ^= h >> 29;
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        h = (h ^ *p++) * 0x100000001b3ULL;
+    }
+    return h ^ (h >> 32);
+}
+
+static size_t tb_cache_entry_size(const TBCacheEntry *e)
+{
+    return sizeof(*e) + e->nb_params * sizeof(TCGArg)
+        + e->nb_relocs * sizeof(uint32_t) + e->nb_ops * 2 * sizeof(uint16_t)
+        + e->nb_temps + e->size;
+}
+
+static TBCacheRecord *tb_cache_record(TBCacheEntry *e)
+{
+    return (TBCacheRecord *)e - 1;
+}
+
+static TCGArg *tb_cache_params(TBCacheEntry *e)
+{
+    return (TCGArg *)(e + 1);
+}
+
+static uint32_t *tb_cache_relocs(TBCacheEntry *e)
+{
+    return (uint32_t *)(tb_cache_params(e) + e->nb_params);
+}
+
+static uint16_t *tb_cache_ops(TBCacheEntry *e)
+{
+    return (uint16_t *)(tb_cache_relocs(e) + e->nb_relocs);
+}
+
+static uint16_t *tb_cache_dead_args(TBCacheEntry *e)
+{
+    return tb_cache_ops(e) + e->nb_ops;
+}
+
+static uint8_t *tb_cache_temps(TBCacheEntry *e)
+{
+    return (uint8_t *)(tb_cache_dead_args(e) + e->nb_ops);
+}
+
+static uint8_t *tb_cache_code(TBCacheEntry *e)
+{
+    return tb_cache_temps(e) + e->nb_temps;
+}
+
+static guint tb_cache_entry_hash(gconstpointer p)
+{
+    const TBCacheEntry *e = p;
+
+    return tb_cache_hash(e->cflags, &e->pc, 3 * sizeof(uint64_t));
+}
+
+static gboolean tb_cache_entry_equal(gconstpointer p1, gconstpointer p2)
+{
+    const TBCacheEntry *e1 = p1, *e2 = p2;
+
+    return e1->pc == e2->pc && e1->cs_base == e2->cs_base &&
+        e1->flags == e2->flags && e1->cflags == e2->cflags;
+}
+
+static bool tb_cache_entry_valid(TBCacheEntry *e)
+{
+    TCGContext *s = &tcg_ctx;
+    TBCacheRecord *rec = tb_cache_record(e);
+    uint32_t *relocs;
+    uint16_t *ops;
+    uint8_t *temps;
+    int i;
+
+    if ((uint32_t)tb_cache_hash(0, e, tb_cache_entry_size(e)) != rec->check ||
+        e->nb_ops > OPC_BUF_SIZE || e->nb_params > OPPARAM_BUF_SIZE ||
+        e->nb_relocs > e->nb_params || e->nb_ops == 0 ||
+        e->nb_temps > TCG_MAX_TEMPS - s->nb_globals ||
+        e->nb_labels > TCG_MAX_LABELS || e->size == 0 ||
+        e->size > 2 * TARGET_PAGE_SIZE) {
+        return false;
+    }
+    relocs = tb_cache_relocs(e);
+    for (i = 0; i < e->nb_relocs; i++) {
+        if ((relocs[i] >> 2) >= e->nb_params ||
+            (relocs[i] & 3) > TB_CACHE_RELOC_EXE) {
+            return false;
+        }
+    }
+    ops = tb_cache_ops(e);
+    for (i = 0; i < e->nb_ops; i++) {
+        if (ops[i] >= NB_OPS) {
+            return false;
+        }
+    }
+    if (ops[e->nb_ops - 1] != INDEX_op_end) {
+        return false;
+    }
+    temps = tb_cache_temps(e);
+    for (i = 0; i < e->nb_temps; i++) {
+        if (temps[i] & ~7) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void tb_cache_insert(TBCacheEntry *e)
+{
+    if (g_hash_table_lookup(tb_cache_table, e)) {
+        tb_cache_stale++;
+    } else {
+        tb_cache_live++;
+    }
+    g_hash_table_replace(tb_cache_table, e, e);
+}
+
+static void *tb_cache_map(const char *path, size_t *len)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    *len = st.st_size;
+    return p;
+}
+
+static void tb_cache_load(void)
+{
+    TBCacheHeader *hdr;
+    uint8_t *data;
+    size_t len, pos;
+
+    /* the entries point into the mapping, which is never unmapped */
+    data = tb_cache_map(tb_cache_path, &len);
+    if (!data) {
+        return;
+    }
+    hdr = (TBCacheHeader *)data;
+    if (len < sizeof(*hdr) || memcmp(hdr->magic, TB_CACHE_MAGIC, 8) ||
+        hdr->key != tb_cache_key) {
+        tb_cache_damaged = true;
+        munmap(data, len);
+        return;
+    }
+    for (pos = sizeof(*hdr); pos < len; ) {
+        TBCacheRecord *rec = (TBCacheRecord *)(data + pos);
+        TBCacheEntry *e = (TBCacheEntry *)(rec + 1);
+
+        if (len - pos < sizeof(*rec) + sizeof(*e) || rec->len % 8 ||
+            rec->len > len - pos ||
+            sizeof(*rec) + tb_cache_entry_size(e) > rec->len) {
+            tb_cache_damaged = true;
+            break;
+        }
+        tb_cache_insert(e);
+        pos += rec->len;
+    }
+}
+
+static int tb_cache_find_exe(struct dl_phdr_info *info, size_t size,
+                             void *opaque)
+{
+    int i;
+
+    /* the executable comes first */
+    tb_cache_exe_start = UINTPTR_MAX;
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+
+        if (ph->p_type == PT_LOAD) {
+            uintptr_t start = info->dlpi_addr + ph->p_vaddr;
+
+            tb_cache_exe_start = MIN(tb_cache_exe_start, start);
+            tb_cache_exe_end = MAX(tb_cache_exe_end, start + ph->p_memsz);
+        }
+    }
+    return 1;
+}
+
+void tb_cache_init(const char *dir, const char *exe, abi_ulong load_addr,
+                   const char *cpu_model)
+{
+    TCGContext *s = &tcg_ctx;
+    void *contents;
+    size_t len;
+    struct stat st;
+    uint64_t h;
+
+    contents = tb_cache_map(exe, &len);
+    if (!contents) {
+        return;
+    }
+    h = tb_cache_hash(0xcbf29ce484222325ULL, contents, len);
+    munmap(contents, len);
+    h = tb_cache_hash(h, &load_addr, sizeof(load_addr));
+    h = tb_cache_hash(h, cpu_model, strlen(cpu_model));
+    h = tb_cache_hash(h, &s->nb_globals, sizeof(s->nb_globals));
+    h = tb_cache_hash(h, &singlestep, sizeof(singlestep));
+    /* the ops depend on the translator, and the relocated pointers on
+       the layout of QEMU itself */
+    h = tb_cache_hash(h, QEMU_VERSION, strlen(QEMU_VERSION));
+    if (stat("/proc/self/exe", &st) == 0) {
+        h = tb_cache_hash(h, &st.st_size, sizeof(st.st_size));
+        h = tb_cache_hash(h, &st.st_mtime, sizeof(st.st_mtime));
+        h = tb_cache_hash(h, &st.st_ino, sizeof(st.st_ino));
+    }
+
+    dl_iterate_phdr(tb_cache_find_exe, NULL);
+    if (tb_cache_exe_start >= tb_cache_exe_end) {
+        return;
+    }
+
+    tb_cache_key = h;
+    tb_cache_path = g_strdup_printf("%s/%016" PRIx64 ".tbc", dir, h);
+    tb_cache_table = g_hash_table_new(tb_cache_entry_hash,
+                                      tb_cache_entry_equal);
+    tb_cache_pending = g_ptr_array_new();
+    tb_cache_load();
+    tb_cache_enabled = true;
+    atexit(tb_cache_save);
+}
+
+/* The ops of a TB also depend on parallel_cpus (exit check at the start
+   of the TB, host atomic operations), which is part of the key as an
+   extra cflags bit.  */
+#define TB_CACHE_CF_PARALLEL    0x80000000
+
+static uint32_t tb_cache_cflags(TranslationBlock *tb)
+{
+    return tb->cflags | (parallel_cpus ? TB_CACHE_CF_PARALLEL : 0);
+}
+
+/* Debugging the guest, or looking at the code generated by the target
+   translator, needs the real thing.  */
+static bool tb_cache_usable(CPUArchState *env, TranslationBlock *tb)
+{
+    return !(tb->cflags & CF_PROFILE) && !env->singlestep_enabled &&
+        QTAILQ_EMPTY(&env->breakpoints) &&
+        !qemu_loglevel_mask(CPU_LOG_TB_IN_ASM | CPU_LOG_TB_OP |
+                            CPU_LOG_TB_OP_OPT);
+}
+
+bool tb_cache_lookup(CPUArchState *env, TranslationBlock *tb)
+{
+    TCGContext *s = &tcg_ctx;
+    TBCacheEntry key, *e;
+    TCGArg *params;
+    uint32_t *relocs;
+    uint8_t *temps;
+    int i;
+
+    if (!tb_cache_usable(env, tb)) {
+        return false;
+    }
+    key.pc = tb->pc;
+    key.cs_base = tb->cs_base;
+    key.flags = tb->flags;
+    key.cflags = tb_cache_cflags(tb);
+    e = g_hash_table_lookup(tb_cache_table, &key);
+    if (!e) {
+        return false;
+    }
+    if (!tb_cache_entry_valid(e)) {
+        /* drop it from the file as well */
+        g_hash_table_remove(tb_cache_table, e);
+        tb_cache_damaged = true;
+        return false;
+    }
+    if (page_check_range(tb->pc, e->size, PAGE_READ) < 0 ||
+        memcmp(g2h(tb->pc), tb_cache_code(e), e->size)) {
+        return false;
+    }
+
+    /* as left by tcg_analyze_ops: gen_opc_ptr is after the end op */
+    memcpy(gen_opc_buf, tb_cache_ops(e), e->nb_ops * sizeof(uint16_t));
+    gen_opc_ptr = gen_opc_buf + e->nb_ops;
+    s->op_dead_args = tcg_malloc(e->nb_ops * sizeof(uint16_t));
+    memcpy(s->op_dead_args, tb_cache_dead_args(e),
+           e->nb_ops * sizeof(uint16_t));
+    params = tb_cache_params(e);
+    memcpy(gen_opparam_buf, params, e->nb_params * sizeof(TCGArg));
+    gen_opparam_ptr = gen_opparam_buf + e->nb_params;
+    relocs = tb_cache_relocs(e);
+    for (i = 0; i < e->nb_relocs; i++) {
+        TCGArg *p = &gen_opparam_buf[relocs[i] >> 2];
+
+        if ((relocs[i] & 3) == TB_CACHE_RELOC_TB) {
+            *p += (TCGArg)tb;
+        } else {
+            *p += tb_cache_exe_start;
+        }
+    }
+
+    temps = tb_cache_temps(e);
+    for (i = 0; i < e->nb_temps; i++) {
+        TCGTemp *ts = &s->temps[s->nb_globals + i];
+
+        ts->base_type = temps[i] & 1;
+        ts->type = (temps[i] >> 1) & 1;
+        ts->temp_local = (temps[i] >> 2) & 1;
+        ts->temp_allocated = 0;
+        ts->fixed_reg = 0;
+        ts->name = NULL;
+    }
+    s->nb_temps = s->nb_globals + e->nb_temps;
+    for (i = 0; i < e->nb_labels; i++) {
+        s->labels[i].has_value = 0;
+        s->labels[i].u.first_reloc = NULL;
+    }
+    s->nb_labels = e->nb_labels;
+    s->ops_analyzed = 1;
+
+    tb->size = e->size;
+    tb->icount = e->icount;
+    return true;
+}
+
+static int tb_cache_reloc(TranslationBlock *tb, TCGArg val)
+{
+    if (val - (TCGArg)tb < sizeof(*tb)) {
+        return TB_CACHE_RELOC_TB;
+    } else if (val >= tb_cache_exe_start && val < tb_cache_exe_end) {
+        return TB_CACHE_RELOC_EXE;
+    }
+    return -1;
+}
+
+static int tb_cache_op_nb_args(TCGOpcode opc, const TCGArg *args)
+{
+    switch (opc) {
+    case INDEX_op_call:
+        return (args[0] >> 16) + (args[0] & 0xffff) + 3;
+    case INDEX_op_nopn:
+        return args[0];
+    default:
+        return tcg_op_defs[opc].nb_args;
+    }
+}
+
+void tb_cache_add(CPUArchState *env, TranslationBlock *tb)
+{
+    TCGContext *s = &tcg_ctx;
+    uint32_t relocs[TCG_MAX_PTR_OPS];
+    TBCacheRecord *rec;
+    TBCacheEntry hdr, *e;
+    TCGArg *args, *params;
+    uint8_t *temps;
+    int i, k, op_index, nb_relocs;
+
+    if (!tb_cache_usable(env, tb) || s->nb_ptr_ops > TCG_MAX_PTR_OPS ||
+        page_check_range(tb->pc, tb->size, PAGE_READ) < 0) {
+        return;
+    }
+    /* e.g. pointers to data allocated at run time */
+    for (i = 0; i < s->nb_ptr_ops; i++) {
+        if (tb_cache_reloc(tb, s->ptr_vals[i]) < 0) {
+            return;
+        }
+    }
+
+    /* find the pointers which are left after the optimizer */
+    hdr.nb_ops = gen_opc_ptr - gen_opc_buf;
+    args = gen_opparam_buf;
+    nb_relocs = 0;
+    k = 0;
+    for (op_index = 0; op_index < hdr.nb_ops; op_index++) {
+        TCGOpcode opc = gen_opc_buf[op_index];
+        int nb_args = tb_cache_op_nb_args(opc, args);
+        bool tracked = false;
+
+        while (k < s->nb_ptr_ops && s->ptr_ops[k] <= op_index) {
+            tracked = s->ptr_ops[k++] == op_index;
+        }
+        switch (opc) {
+        case INDEX_op_movi_i32:
+#if TCG_TARGET_REG_BITS == 64
+        case INDEX_op_movi_i64:
+#endif
+        case INDEX_op_exit_tb:
+            i = tb_cache_reloc(tb, args[nb_args - 1]);
+            if (tracked) {
+                int idx = args + nb_args - 1 - gen_opparam_buf;
+
+                relocs[nb_relocs++] = idx << 2 | i;
+            } else if (i >= 0) {
+                /* a copy, or a guest constant which looks like a pointer */
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+        args += nb_args;
+    }
+
+    hdr.pc = tb->pc;
+    hdr.cs_base = tb->cs_base;
+    hdr.flags = tb->flags;
+    hdr.cflags = tb_cache_cflags(tb);
+    hdr.size = tb->size;
+    hdr.icount = tb->icount;
+    hdr.nb_temps = s->nb_temps - s->nb_globals;
+    hdr.nb_labels = s->nb_labels;
+    hdr.nb_params = gen_opparam_ptr - gen_opparam_buf;
+    hdr.nb_relocs = nb_relocs;
+    rec = g_malloc0(QEMU_ALIGN_UP(sizeof(*rec) +
+                                  tb_cache_entry_size(&hdr), 8));
+    rec->len = QEMU_ALIGN_UP(sizeof(*rec) + tb_cache_entry_size(&hdr), 8);
+    e = (TBCacheEntry *)(rec + 1);
+    *e = hdr;
+
+    params = tb_cache_params(e);
+    memcpy(params, gen_opparam_buf, hdr.nb_params * sizeof(TCGArg));
+    for (i = 0; i < nb_relocs; i++) {
+        TCGArg *p = &params[relocs[i] >> 2];
+
+        if ((relocs[i] & 3) == TB_CACHE_RELOC_TB) {
+            *p -= (TCGArg)tb;
+        } else {
+            *p -= tb_cache_exe_start;
+        }
+    }
+    memcpy(tb_cache_relocs(e), relocs, nb_relocs * sizeof(uint32_t));
+    memcpy(tb_cache_ops(e), gen_opc_buf, hdr.nb_ops * sizeof(uint16_t));
+    memcpy(tb_cache_dead_args(e), s->op_dead_args,
+           hdr.nb_ops * sizeof(uint16_t));
+    temps = tb_cache_temps(e);
+    for (i = 0; i < hdr.nb_temps; i++) {
+        TCGTemp *ts = &s->temps[s->nb_globals + i];
+
+        temps[i] = ts->base_type | ts->type << 1 | ts->temp_local << 2;
+    }
+    memcpy(tb_cache_code(e), g2h(tb->pc), tb->size);
+    rec->check = tb_cache_hash(0, e, tb_cache_entry_size(e));
+
+    tb_cache_insert(e);
+    g_ptr_array_add(tb_cache_pending, e);
+}
+
+/* Copy the records of entries to buf, which must be large enough.  */
+static void tb_cache_records(uint8_t *buf, TBCacheEntry **entries, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        TBCacheRecord *rec = tb_cache_record(entries[i]);
+
+        memcpy(buf, rec, rec->len);
+        buf += rec->len;
+    }
+}
+
+static size_t tb_cache_records_size(TBCacheEntry **entries, int n)
+{
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        len += tb_cache_record(entries[i])->len;
+    }
+    return len;
+}
+
+static bool tb_cache_write_all(int fd, const uint8_t *buf, size_t len)
+{
+    while (len) {
+        ssize_t ret = write(fd, buf, len);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+/* Create a new file with the given entries under a temporary name, then
+   either rename it to the cache file or, if replace is false, only link
+   it there if there is no cache file yet.  */
+static bool tb_cache_create(TBCacheEntry **entries, int n, bool replace)
+{
+    TBCacheHeader *hdr;
+    uint8_t *buf;
+    size_t len;
+    char *tmp;
+    bool ok;
+    int fd;
+
+    len = sizeof(*hdr) + tb_cache_records_size(entries, n);
+    buf = g_malloc(len);
+    hdr = (TBCacheHeader *)buf;
+    memcpy(hdr->magic, TB_CACHE_MAGIC, 8);
+    hdr->key = tb_cache_key;
+    tb_cache_records(buf + sizeof(*hdr), entries, n);
+
+    tmp = g_strdup_printf("%s.%d", tb_cache_path, (int)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ok = fd >= 0 && tb_cache_write_all(fd, buf, len);
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (ok) {
+        ok = replace ? rename(tmp, tb_cache_path) == 0
+                     : link(tmp, tb_cache_path) == 0;
+    }
+    unlink(tmp);
+    g_free(tmp);
+    g_free(buf);
+    return ok;
+}
+
+static void tb_cache_append(TBCacheEntry **entries, int n)
+{
+    uint8_t *buf;
+    size_t len;
+    int fd;
+
+    fd = open(tb_cache_path, O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        if (errno != ENOENT || tb_cache_create(entries, n, false)) {
+            return;
+        }
+        /* somebody else created it in the meantime */
+        fd = open(tb_cache_path, O_WRONLY | O_APPEND);
+        if (fd < 0) {
+            return;
+        }
+    }
+    len = tb_cache_records_size(entries, n);
+    buf = g_malloc(len);
+    tb_cache_records(buf, entries, n);
+    /* a single write, so that records from different processes do not
+       get mixed */
+    tb_cache_write_all(fd, buf, len);
+    close(fd);
+    g_free(buf);
+}
+
+static void tb_cache_collect(gpointer key, gpointer value, gpointer opaque)
+{
+    g_ptr_array_add(opaque, value);
+}
+
+void tb_cache_save(void)
+{
+    if (!tb_cache_enabled) {
+        return;
+    }
+    tb_lock_acquire();
+    if (tb_cache_damaged || tb_cache_stale > tb_cache_live) {
+        GPtrArray *all = g_ptr_array_new();
+
+        g_hash_table_foreach(tb_cache_table, tb_cache_collect, all);
+        if (tb_cache_create((TBCacheEntry **)all->pdata, all->len, true)) {
+            tb_cache_damaged = false;
+            tb_cache_stale = 0;
+        }
+        g_ptr_array_free(all, TRUE);
+    } else if (tb_cache_pending->len) {
+        tb_cache_append((TBCacheEntry **)tb_cache_pending->pdata,
+                        tb_cache_pending->len);
+    }
+    g_ptr_array_set_size(tb_cache_pending, 0);
+    tb_lock_release();
+}
+
+/* The entries translated before fork are saved by the parent.  */
+void tb_cache_fork_child(void)
+{
+    if (tb_cache_enabled) {
+        g_ptr_array_set_size(tb_cache_pending, 0);
+    }
+}
@@ -353,6 +353,15 @@ void qemu_mutex_lock_iothread(void);
  */
 void qemu_mutex_unlock_iothread(void);
 
+/**
+ * qemu_mutex_iothread_locked: Return whether the calling thread holds the
+ * main loop mutex.
+ *
+ * vCPU threads of the multi-threaded TCG run guest code without the main
+ * loop mutex and use this to take it only around device accesses.
+ */
+bool qemu_mutex_iothread_locked(void);
+
 /* internal interfaces */
 
 void qemu_fd_register(int fd);
@@ -18,6 +18,7 @@
 #include "ioport.h"
 #include "bitops.h"
 #include "kvm.h"
+#include "cpus.h"
 #include <assert.h>
 
 #define WANT_EXEC_OBSOLETE
@@ -1505,13 +1506,21 @@ void set_system_io_map(MemoryRegion *mr)
 
 uint64_t io_mem_read(MemoryRegion *mr, target_phys_addr_t addr, unsigned size)
 {
-    return memory_region_dispatch_read(mr, addr, size);
+    bool locked = cpu_io_lock(mr);
+    uint64_t ret;
+
+    ret = memory_region_dispatch_read(mr, addr, size);
+    cpu_io_unlock(locked);
+    return ret;
 }
 
 void io_mem_write(MemoryRegion *mr, target_phys_addr_t addr,
                   uint64_t val, unsigned size)
 {
+    bool locked = cpu_io_lock(mr);
+
     memory_region_dispatch_write(mr, addr, val, size);
+    cpu_io_unlock(locked);
 }
 
 typedef struct MemoryRegionList MemoryRegionList;
@@ -117,6 +117,16 @@ static inline char *realpath(const char *path, char *resolved_path)
 void configure_icount(const char *option);
 extern int use_icount;
 
+/* multi-threaded TCG */
+void configure_tcg_threads(const char *option);
+
+/* perf profiling of translated code */
+void configure_tcg_perf(const char *option);
+void tcg_perf_exit(void);
+
+/* pages and mapping of the translation buffer */
+void configure_tcg_buffer(const char *option);
+
 /* FIXME: Remove NEED_CPU_H.  */
 #ifndef NEED_CPU_H
 
@@ -302,6 +312,7 @@ typedef struct PCIHostDeviceAddress {
 } PCIHostDeviceAddress;
 
 void tcg_exec_init(unsigned long tb_size);
+unsigned long tcg_exec_max_size(void);
 bool tcg_enabled(void);
 
 void cpu_exec_init_all(void);
@@ -321,6 +332,7 @@ struct qemu_work_item {
     void (*func)(void *data);
     void *data;
     int done;
+    bool free;
 };
 
 #ifdef CONFIG_USER_ONLY
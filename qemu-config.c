@@ -114,6 +114,14 @@ static QemuOptsList qemu_drive_opts = {
             .name = "copy-on-read",
             .type = QEMU_OPT_BOOL,
             .help = "copy read data from backing file into image file",
+        },{
+            .name = "copy-on-read-prefetch",
+            .type = QEMU_OPT_SIZE,
+            .help = "copy this much data ahead of sequential reads",
+        },{
+            .name = "copy-on-read-prefetch-bps",
+            .type = QEMU_OPT_NUMBER,
+            .help = "limit copy-on-read prefetching bytes per second",
         },
         { /* end of list */ }
     },
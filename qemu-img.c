@@ -28,6 +28,7 @@
 #include "sysemu.h"
 #include "block_int.h"
 #include <stdio.h>
+#include <getopt.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -91,6 +92,14 @@ static void help(void)
            "       kinds of errors, with a higher risk of choosing the wrong fix or\n"
            "       hiding corruption that has already occured.\n"
            "\n"
+           "Parameters to compare subcommand:\n"
+           "  '-f' first image format\n"
+           "  '-F' second image format\n"
+           "  '-s' run in Strict mode - fail on different image size or sector allocation\n"
+           "\n"
+           "Parameters to map subcommand:\n"
+           "  '--output' takes the format in which the output must be done (human or json)\n"
+           "\n"
            "Parameters to snapshot subcommand:\n"
            "  'snapshot' is the name of the snapshot to create, apply or delete\n"
            "  '-a' applies a snapshot (revert disk to saved state)\n"
@@ -652,9 +661,326 @@ static int compare_sectors(const uint8_t *buf1, const uint8_t *buf2, int n,
 
 #define IO_BUF_SIZE (2 * 1024 * 1024)
 
+/*
+ * qemu-img compare keeps several chunks of both images in flight at once, so
+ * that reading one image overlaps with reading the other and with comparing
+ * the chunks that have already arrived.  Chunks are checked in order, which
+ * means the first mismatch reported is always the one at the lowest offset.
+ */
+#define COMPARE_SLOTS 8
+
+typedef struct CompareSlot {
+    int64_t sector_num;
+    int nb_sectors;
+    int pending;
+    int ret;
+    uint8_t *buf[2];
+    struct iovec iov[2];
+    QEMUIOVector qiov[2];
+} CompareSlot;
+
+typedef struct CompareState {
+    BlockDriverState *bs[2];
+    int nb_images;
+    int64_t total_sectors;
+    CompareSlot slots[COMPARE_SLOTS];
+    int head;
+    int count;
+} CompareState;
+
+static void compare_read_cb(void *opaque, int ret)
+{
+    CompareSlot *slot = opaque;
+
+    if (ret < 0) {
+        slot->ret = ret;
+    }
+    slot->pending--;
+}
+
+static void compare_submit(CompareState *s, int64_t sector_num, int nb_sectors)
+{
+    CompareSlot *slot = &s->slots[(s->head + s->count) % COMPARE_SLOTS];
+    int i;
+
+    slot->sector_num = sector_num;
+    slot->nb_sectors = nb_sectors;
+    slot->pending = s->nb_images;
+    slot->ret = 0;
+    s->count++;
+
+    for (i = 0; i < s->nb_images; i++) {
+        slot->iov[i].iov_base = slot->buf[i];
+        slot->iov[i].iov_len = nb_sectors * BDRV_SECTOR_SIZE;
+        qemu_iovec_init_external(&slot->qiov[i], &slot->iov[i], 1);
+        if (!bdrv_aio_readv(s->bs[i], sector_num, &slot->qiov[i], nb_sectors,
+                            compare_read_cb, slot)) {
+            slot->ret = -EIO;
+            slot->pending--;
+        }
+    }
+}
+
+/*
+ * Check the oldest chunk in flight.  Returns 0 if it is the same in both
+ * images (or all zeroes when checking the tail of the larger image), 1 and
+ * the first differing sector in *mismatch otherwise, or a negative errno.
+ */
+static int compare_complete(CompareState *s, int64_t *mismatch)
+{
+    CompareSlot *slot = &s->slots[s->head];
+    int ret = 0;
+    int i, pnum;
+
+    while (slot->pending) {
+        qemu_aio_wait();
+    }
+    s->head = (s->head + 1) % COMPARE_SLOTS;
+    s->count--;
+
+    if (slot->ret < 0) {
+        return slot->ret;
+    }
+
+    if (s->nb_images == 2) {
+        if (memcmp(slot->buf[0], slot->buf[1],
+                   slot->nb_sectors * BDRV_SECTOR_SIZE)) {
+            for (i = 0; i < slot->nb_sectors; i += pnum) {
+                if (compare_sectors(slot->buf[0] + i * BDRV_SECTOR_SIZE,
+                                    slot->buf[1] + i * BDRV_SECTOR_SIZE,
+                                    slot->nb_sectors - i, &pnum)) {
+                    break;
+                }
+            }
+            *mismatch = slot->sector_num + i;
+            ret = 1;
+        }
+    } else if (!buffer_is_zero(slot->buf[0],
+                               slot->nb_sectors * BDRV_SECTOR_SIZE)) {
+        for (i = 0; i < slot->nb_sectors; i++) {
+            if (!buffer_is_zero(slot->buf[0] + i * BDRV_SECTOR_SIZE,
+                                BDRV_SECTOR_SIZE)) {
+                break;
+            }
+        }
+        *mismatch = slot->sector_num + i;
+        ret = 1;
+    }
+
+    qemu_progress_print((float)slot->nb_sectors * 100 / s->total_sectors,
+                        100);
+    return ret;
+}
+
+/*
+ * Compare sectors [sector_num, end) of s->bs[0] and s->bs[1], or check that
+ * they are zero in s->bs[0] if only one image is given.  Ranges that are
+ * unallocated in the whole backing chain of every image read as zeroes and
+ * are skipped without reading them.
+ *
+ * Returns 0 if the range is identical, 1 if it differs (the first differing
+ * sector is stored in *mismatch), 2 if an allocation mismatch was found in
+ * strict mode (also stored in *mismatch), -ENOTSUP if the allocation status
+ * could not be determined, or the negative errno of a failed read.
+ */
+static int compare_range(CompareState *s, int64_t sector_num, int64_t end,
+                         bool strict, int64_t *mismatch)
+{
+    int64_t alloc_mismatch = -1, ignored;
+    int ret = 0, err = 0;
+    int i, n, pnum, allocated[2];
+
+    while (sector_num < end || s->count > 0) {
+        while (s->count < COMPARE_SLOTS && sector_num < end &&
+               alloc_mismatch < 0 && err == 0) {
+            n = MIN(end - sector_num, IO_BUF_SIZE / BDRV_SECTOR_SIZE);
+            for (i = 0; i < s->nb_images; i++) {
+                allocated[i] = bdrv_is_allocated_above(s->bs[i], NULL,
+                                                       sector_num, n, &pnum);
+                if (allocated[i] < 0) {
+                    err = -ENOTSUP;
+                    break;
+                }
+                n = pnum;
+            }
+            if (err) {
+                break;
+            }
+
+            if (strict && s->nb_images == 2 && allocated[0] != allocated[1]) {
+                alloc_mismatch = sector_num;
+                break;
+            }
+            if (allocated[0] || (s->nb_images == 2 && allocated[1])) {
+                compare_submit(s, sector_num, n);
+            } else {
+                qemu_progress_print((float)n * 100 / s->total_sectors, 100);
+            }
+            sector_num += n;
+        }
+
+        if (s->count == 0) {
+            break;
+        }
+        ret = compare_complete(s, mismatch);
+        if (ret != 0) {
+            break;
+        }
+    }
+
+    /* The buffers of the remaining slots are still in use */
+    while (s->count > 0) {
+        compare_complete(s, &ignored);
+    }
+
+    if (ret != 0) {
+        return ret;
+    } else if (err) {
+        return err;
+    } else if (alloc_mismatch >= 0) {
+        *mismatch = alloc_mismatch;
+        return 2;
+    }
+    return 0;
+}
+
+static int img_compare(int argc, char **argv)
+{
+    const char *fmt1 = NULL, *fmt2 = NULL, *filename1, *filename2;
+    BlockDriverState *bs1 = NULL, *bs2 = NULL;
+    CompareState s;
+    int64_t total_sectors1, total_sectors2, min_sectors, mismatch;
+    int c, i, ret = 0, progress = 0, strict = 0;
+
+    for (;;) {
+        c = getopt(argc, argv, "hpf:F:s");
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case '?':
+        case 'h':
+            help();
+            break;
+        case 'f':
+            fmt1 = optarg;
+            break;
+        case 'F':
+            fmt2 = optarg;
+            break;
+        case 'p':
+            progress = 1;
+            break;
+        case 's':
+            strict = 1;
+            break;
+        }
+    }
+
+    if (optind > argc - 2) {
+        help();
+    }
+    filename1 = argv[optind++];
+    filename2 = argv[optind++];
+
+    /* Initialize before goto out */
+    memset(&s, 0, sizeof(s));
+    qemu_progress_init(progress, 2.0);
+
+    bs1 = bdrv_new_open(filename1, fmt1, BDRV_O_FLAGS);
+    if (!bs1) {
+        error_report("Can't open file %s", filename1);
+        ret = 2;
+        goto out;
+    }
+    bs2 = bdrv_new_open(filename2, fmt2, BDRV_O_FLAGS);
+    if (!bs2) {
+        error_report("Can't open file %s", filename2);
+        ret = 2;
+        goto out;
+    }
+
+    for (i = 0; i < COMPARE_SLOTS; i++) {
+        s.slots[i].buf[0] = qemu_blockalign(bs1, IO_BUF_SIZE);
+        s.slots[i].buf[1] = qemu_blockalign(bs2, IO_BUF_SIZE);
+    }
+
+    total_sectors1 = bdrv_getlength(bs1) >> BDRV_SECTOR_BITS;
+    total_sectors2 = bdrv_getlength(bs2) >> BDRV_SECTOR_BITS;
+    if (total_sectors1 < 0 || total_sectors2 < 0) {
+        error_report("Can't get size of %s",
+                     total_sectors1 < 0 ? filename1 : filename2);
+        ret = 4;
+        goto out;
+    }
+    min_sectors = MIN(total_sectors1, total_sectors2);
+    s.total_sectors = MAX(MAX(total_sectors1, total_sectors2), 1);
+
+    if (strict && total_sectors1 != total_sectors2) {
+        printf("Strict mode: Image size mismatch!\n");
+        ret = 1;
+        goto out;
+    }
+
+    qemu_progress_print(0, 100);
+
+    s.bs[0] = bs1;
+    s.bs[1] = bs2;
+    s.nb_images = 2;
+    ret = compare_range(&s, 0, min_sectors, strict, &mismatch);
+
+    if (ret == 0 && total_sectors1 != total_sectors2) {
+        /* The part that only exists in the larger image must read as zero */
+        s.bs[0] = total_sectors1 > total_sectors2 ? bs1 : bs2;
+        s.nb_images = 1;
+        printf("Warning: Image size mismatch!\n");
+        ret = compare_range(&s, min_sectors,
+                            MAX(total_sectors1, total_sectors2), false,
+                            &mismatch);
+    }
+
+    switch (ret) {
+    case 0:
+        printf("Images are identical.\n");
+        break;
+    case 1:
+        printf("Content mismatch at offset %" PRId64 "!\n",
+               mismatch << BDRV_SECTOR_BITS);
+        break;
+    case 2:
+        printf("Strict mode: Offset %" PRId64 " allocation mismatch!\n",
+               mismatch << BDRV_SECTOR_BITS);
+        ret = 1;
+        break;
+    case -ENOTSUP:
+        error_report("Sector allocation test failed");
+        ret = 3;
+        break;
+    default:
+        error_report("Error while reading image data: %s", strerror(-ret));
+        ret = 4;
+        break;
+    }
+
+out:
+    for (i = 0; i < COMPARE_SLOTS; i++) {
+        qemu_vfree(s.slots[i].buf[0]);
+        qemu_vfree(s.slots[i].buf[1]);
+    }
+    if (bs2) {
+        bdrv_delete(bs2);
+    }
+    if (bs1) {
+        bdrv_delete(bs1);
+    }
+    qemu_progress_end();
+    return ret;
+}
+
 static int img_convert(int argc, char **argv)
 {
     int c, ret = 0, n, n1, bs_n, bs_i, compress, cluster_size, cluster_sectors;
+    int batch_sectors;
     int progress = 0, flags;
     const char *fmt, *out_fmt, *cache, *out_baseimg, *out_filename;
     BlockDriver *drv, *proto_drv;
@@ -905,22 +1231,25 @@ static int img_convert(int argc, char **argv)
             goto out;
         }
         cluster_sectors = cluster_size >> 9;
+        /* Hand as many clusters as fit into the buffer to the driver at
+         * once, so that it can compress them in parallel */
+        batch_sectors = (IO_BUF_SIZE / cluster_size) * cluster_sectors;
         sector_num = 0;
 
         nb_sectors = total_sectors;
         local_progress = (float)100 /
-            (nb_sectors / MIN(nb_sectors, cluster_sectors));
+            (nb_sectors / MIN(nb_sectors, batch_sectors));
 
         for(;;) {
             int64_t bs_num;
-            int remainder;
+            int remainder, padded, i, run;
             uint8_t *buf2;
 
             nb_sectors = total_sectors - sector_num;
             if (nb_sectors <= 0)
                 break;
-            if (nb_sectors >= cluster_sectors)
-                n = cluster_sectors;
+            if (nb_sectors >= batch_sectors)
+                n = batch_sectors;
             else
                 n = nb_sectors;
 
@@ -958,15 +1287,31 @@ static int img_convert(int argc, char **argv)
             }
             assert (remainder == 0);
 
-            if (n < cluster_sectors) {
-                memset(buf + n * 512, 0, cluster_size - n * 512);
+            padded = DIV_ROUND_UP(n, cluster_sectors) * cluster_sectors;
+            if (n < padded) {
+                memset(buf + n * 512, 0, (padded - n) * 512);
             }
-            if (!buffer_is_zero(buf, cluster_size)) {
-                ret = bdrv_write_compressed(out_bs, sector_num, buf,
-                                            cluster_sectors);
+
+            /* Write each run of non-zero clusters with a single request */
+            for (i = 0; i < padded; i += run) {
+                int64_t run_sector = sector_num + i;
+                bool zero = buffer_is_zero(buf + i * 512, cluster_size);
+
+                run = cluster_sectors;
+                while (i + run < padded &&
+                       buffer_is_zero(buf + (i + run) * 512,
+                                      cluster_size) == zero) {
+                    run += cluster_sectors;
+                }
+                if (zero) {
+                    continue;
+                }
+
+                ret = bdrv_write_compressed(out_bs, run_sector, buf + i * 512,
+                                            run);
                 if (ret != 0) {
                     error_report("error while compressing sector %" PRId64
-                                 ": %s", sector_num, strerror(-ret));
+                                 ": %s", run_sector, strerror(-ret));
                     goto out;
                 }
             }
@@ -1181,6 +1526,202 @@ static int img_info(int argc, char **argv)
     return 0;
 }
 
+enum {
+    OPTION_OUTPUT = 256,
+};
+
+typedef enum OutputFormat {
+    OFORMAT_JSON,
+    OFORMAT_HUMAN,
+} OutputFormat;
+
+typedef struct MapEntry {
+    int flags;
+    int depth;
+    int64_t start;
+    int64_t length;
+    int64_t offset;
+    BlockDriverState *bs;
+} MapEntry;
+
+static int dump_map_entry(OutputFormat output_format, MapEntry *e,
+                          MapEntry *next)
+{
+    switch (output_format) {
+    case OFORMAT_HUMAN:
+        if ((e->flags & BDRV_BLOCK_DATA) &&
+            !(e->flags & BDRV_BLOCK_OFFSET_VALID)) {
+            error_report("File contains external, encrypted or compressed "
+                         "clusters.");
+            return -1;
+        }
+        if ((e->flags & (BDRV_BLOCK_DATA | BDRV_BLOCK_ZERO)) ==
+            BDRV_BLOCK_DATA) {
+            printf("%#-16" PRIx64 "%#-16" PRIx64 "%#-16" PRIx64 "%s\n",
+                   e->start, e->length, e->offset, e->bs->filename);
+        }
+        break;
+    case OFORMAT_JSON:
+        printf("%s{ \"start\": %" PRId64 ", \"length\": %" PRId64 ", "
+               "\"depth\": %d, \"zero\": %s, \"data\": %s",
+               (e->start == 0 ? "[" : ",\n"),
+               e->start, e->length, e->depth,
+               (e->flags & BDRV_BLOCK_ZERO) ? "true" : "false",
+               (e->flags & BDRV_BLOCK_DATA) ? "true" : "false");
+        if (e->flags & BDRV_BLOCK_OFFSET_VALID) {
+            printf(", \"offset\": %" PRId64, e->offset);
+        }
+        putchar('}');
+        if (!next) {
+            printf("]\n");
+        }
+        break;
+    }
+    return 0;
+}
+
+/*
+ * Find the allocation status of the sectors starting at sector_num by walking
+ * down the backing chain until a layer that has data or reads as zero.
+ */
+static int get_block_status(BlockDriverState *bs, int64_t sector_num,
+                            int nb_sectors, MapEntry *e)
+{
+    int64_t ret;
+    int depth;
+
+    depth = 0;
+    for (;;) {
+        ret = bdrv_get_block_status(bs, sector_num, nb_sectors, &nb_sectors);
+        if (ret < 0) {
+            return ret;
+        }
+        assert(nb_sectors);
+        if (ret & (BDRV_BLOCK_ZERO | BDRV_BLOCK_DATA)) {
+            break;
+        }
+        if (!bs->backing_hd) {
+            break;
+        }
+        bs = bs->backing_hd;
+        depth++;
+    }
+
+    e->start = sector_num * BDRV_SECTOR_SIZE;
+    e->length = nb_sectors * BDRV_SECTOR_SIZE;
+    e->flags = ret & ~BDRV_BLOCK_OFFSET_MASK;
+    e->offset = ret & BDRV_BLOCK_OFFSET_MASK;
+    e->depth = depth;
+    e->bs = bs;
+    return 0;
+}
+
+static int img_map(int argc, char **argv)
+{
+    int c;
+    OutputFormat output_format = OFORMAT_HUMAN;
+    BlockDriverState *bs;
+    const char *filename, *fmt, *output;
+    int64_t length;
+    MapEntry curr = { .length = 0 }, next;
+    int ret = 0;
+
+    fmt = NULL;
+    output = NULL;
+    for (;;) {
+        int option_index = 0;
+        static const struct option long_options[] = {
+            {"help", no_argument, 0, 'h'},
+            {"format", required_argument, 0, 'f'},
+            {"output", required_argument, 0, OPTION_OUTPUT},
+            {0, 0, 0, 0}
+        };
+        c = getopt_long(argc, argv, "f:h", long_options, &option_index);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case '?':
+        case 'h':
+            help();
+            break;
+        case 'f':
+            fmt = optarg;
+            break;
+        case OPTION_OUTPUT:
+            output = optarg;
+            break;
+        }
+    }
+    if (optind >= argc) {
+        help();
+    }
+    filename = argv[optind++];
+
+    if (output && !strcmp(output, "json")) {
+        output_format = OFORMAT_JSON;
+    } else if (output && !strcmp(output, "human")) {
+        output_format = OFORMAT_HUMAN;
+    } else if (output) {
+        error_report("--output must be used with human or json as argument.");
+        return 1;
+    }
+
+    bs = bdrv_new_open(filename, fmt, BDRV_O_FLAGS);
+    if (!bs) {
+        return 1;
+    }
+
+    if (output_format == OFORMAT_HUMAN) {
+        printf("%-16s%-16s%-16s%s\n", "Offset", "Length", "Mapped to", "File");
+    }
+
+    length = bdrv_getlength(bs);
+    while (curr.start + curr.length < length) {
+        int64_t nsectors_left;
+        int64_t sector_num;
+        int n;
+
+        sector_num = (curr.start + curr.length) >> BDRV_SECTOR_BITS;
+
+        /* Probe up to 1 GiB at a time.  */
+        nsectors_left = DIV_ROUND_UP(length, BDRV_SECTOR_SIZE) - sector_num;
+        n = MIN(1 << (30 - BDRV_SECTOR_BITS), nsectors_left);
+        ret = get_block_status(bs, sector_num, n, &next);
+
+        if (ret < 0) {
+            error_report("Could not read file metadata: %s", strerror(-ret));
+            goto out;
+        }
+
+        if (curr.length != 0 && curr.flags == next.flags &&
+            curr.depth == next.depth &&
+            ((curr.flags & BDRV_BLOCK_OFFSET_VALID) == 0 ||
+             curr.offset + curr.length == next.offset)) {
+            curr.length += next.length;
+            continue;
+        }
+
+        if (curr.length > 0) {
+            ret = dump_map_entry(output_format, &curr, &next);
+            if (ret < 0) {
+                goto out;
+            }
+        }
+        curr = next;
+    }
+
+    if (curr.length > 0) {
+        ret = dump_map_entry(output_format, &curr, NULL);
+    } else if (output_format == OFORMAT_JSON) {
+        printf("[]\n");
+    }
+
+out:
+    bdrv_delete(bs);
+    return ret < 0;
+}
+
 #define SNAPSHOT_LIST   1
 #define SNAPSHOT_CREATE 2
 #define SNAPSHOT_APPLY  3
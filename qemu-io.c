@@ -17,6 +17,7 @@
 #include "qemu-common.h"
 #include "main-loop.h"
 #include "block_int.h"
+#include "host-utils.h"
 #include "cmd.h"
 #include "trace/control.h"
 
@@ -1616,6 +1617,29 @@ static const cmdinfo_t alloc_cmd = {
     .oneline    = "checks if a sector is present in the file",
 };
 
+static void map_help(void)
+{
+    printf(
+"\n"
+" prints the allocated areas of a file\n"
+"\n"
+" -c, -- look the areas up through the allocation cache of the backing chain\n"
+"        instead of asking the image format directly\n"
+"\n");
+}
+
+static int map_f(int argc, char **argv);
+
+static const cmdinfo_t map_cmd = {
+       .name           = "map",
+       .argmin         = 0,
+       .argmax         = 1,
+       .cfunc          = map_f,
+       .args           = "[-c]",
+       .oneline        = "prints the allocated areas of a file",
+       .help           = map_help,
+};
+
 static int map_f(int argc, char **argv)
 {
     int64_t offset;
@@ -1623,14 +1647,34 @@ static int map_f(int argc, char **argv)
     char s1[64];
     int num, num_checked;
     int ret;
+    int c, cflag = 0;
     const char *retstr;
 
+    while ((c = getopt(argc, argv, "c")) != EOF) {
+        switch (c) {
+        case 'c':
+            cflag = 1;
+            break;
+        default:
+            return command_usage(&map_cmd);
+        }
+    }
+
+    if (optind != argc) {
+        return command_usage(&map_cmd);
+    }
+
     offset = 0;
     nb_sectors = bs->total_sectors;
 
     do {
         num_checked = MIN(nb_sectors, INT_MAX);
-        ret = bdrv_is_allocated(bs, offset, num_checked, &num);
+        if (cflag) {
+            ret = bdrv_is_allocated_above(bs, bs->backing_hd, offset,
+                                          num_checked, &num);
+        } else {
+            ret = bdrv_is_allocated(bs, offset, num_checked, &num);
+        }
         retstr = ret ? "    allocated" : "not allocated";
         cvtstr(offset << 9ULL, s1, sizeof(s1));
         printf("[% 24" PRId64 "] % 8d/% 8d sectors %s at offset %s (%d)\n",
@@ -1643,15 +1687,490 @@ static int map_f(int argc, char **argv)
     return 0;
 }
 
-static const cmdinfo_t map_cmd = {
-       .name           = "map",
-       .argmin         = 0,
-       .argmax         = 0,
-       .cfunc          = map_f,
-       .args           = "",
-       .oneline        = "prints the allocated areas of a file",
+static void snapshot_help(void)
+{
+    printf(
+"\n"
+" creates, applies or deletes an internal snapshot\n"
+"\n"
+" Example:\n"
+" 'snapshot -c foo' - saves the current contents of the image as 'foo'\n"
+"\n"
+" Unlike 'qemu-img snapshot', this keeps the image open, so that it can be\n"
+" used to check what the block layer does after loadvm.\n"
+" -a, -- apply the snapshot (revert the image to it)\n"
+" -c, -- create the snapshot\n"
+" -d, -- delete the snapshot\n"
+"\n");
+}
+
+static int snapshot_f(int argc, char **argv);
+
+static const cmdinfo_t snapshot_cmd = {
+    .name       = "snapshot",
+    .cfunc      = snapshot_f,
+    .argmin     = 2,
+    .argmax     = 2,
+    .args       = "-a|-c|-d tag",
+    .oneline    = "creates, applies or deletes an internal snapshot",
+    .help       = snapshot_help,
+};
+
+static int snapshot_f(int argc, char **argv)
+{
+    QEMUSnapshotInfo sn;
+    qemu_timeval tv;
+    const char *name = NULL;
+    int action = 0;
+    int c, ret;
+
+    while ((c = getopt(argc, argv, "a:c:d:")) != EOF) {
+        switch (c) {
+        case 'a':
+        case 'c':
+        case 'd':
+            action = c;
+            name = optarg;
+            break;
+        default:
+            return command_usage(&snapshot_cmd);
+        }
+    }
+
+    if (optind != argc || !name) {
+        return command_usage(&snapshot_cmd);
+    }
+
+    switch (action) {
+    case 'c':
+        memset(&sn, 0, sizeof(sn));
+        pstrcpy(sn.name, sizeof(sn.name), name);
+        qemu_gettimeofday(&tv);
+        sn.date_sec = tv.tv_sec;
+        sn.date_nsec = tv.tv_usec * 1000;
+        ret = bdrv_snapshot_create(bs, &sn);
+        break;
+    case 'a':
+        ret = bdrv_snapshot_goto(bs, name);
+        break;
+    default:
+        ret = bdrv_snapshot_delete(bs, name);
+        break;
+    }
+
+    if (ret < 0) {
+        printf("snapshot failed: %s\n", strerror(-ret));
+    }
+    return 0;
+}
+
+static void prefetch_help(void)
+{
+    printf(
+"\n"
+" configures copy-on-read prefetching\n"
+"\n"
+" Example:\n"
+" 'prefetch -b 1M 4M' - copy up to 4 megabytes ahead of sequential reads,\n"
+" but no more than 1 megabyte per second\n"
+"\n"
+" Prefetching only happens while copy-on-read is enabled, see -C.\n"
+" A window of 0 disables prefetching.\n"
+" -b, -- limit prefetching to the given number of bytes per second\n"
+"\n");
+}
+
+static int prefetch_f(int argc, char **argv);
+
+static const cmdinfo_t prefetch_cmd = {
+    .name       = "prefetch",
+    .cfunc      = prefetch_f,
+    .argmin     = 1,
+    .argmax     = 3,
+    .args       = "[-b bps] window",
+    .oneline    = "configures copy-on-read prefetching",
+    .help       = prefetch_help,
+};
+
+static int prefetch_f(int argc, char **argv)
+{
+    int64_t window, bps = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:")) != EOF) {
+        switch (c) {
+        case 'b':
+            bps = cvtnum(optarg);
+            if (bps < 0) {
+                printf("non-numeric rate argument -- %s\n", optarg);
+                return 0;
+            }
+            break;
+        default:
+            return command_usage(&prefetch_cmd);
+        }
+    }
+
+    if (optind != argc - 1) {
+        return command_usage(&prefetch_cmd);
+    }
+
+    window = cvtnum(argv[optind]);
+    if (window < 0) {
+        printf("non-numeric window argument -- %s\n", argv[optind]);
+        return 0;
+    }
+
+    bdrv_set_cor_prefetch(bs, window, bps);
+    return 0;
+}
+
+/*
+ * Latency histogram for the bench command.  Each power of two is split into
+ * BENCH_HIST_SUB linear sub-buckets, which bounds the relative error of the
+ * reported percentiles to 1/BENCH_HIST_SUB without storing every sample.
+ */
+#define BENCH_HIST_SUB_BITS 4
+#define BENCH_HIST_SUB      (1 << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_BUCKETS  (64 * BENCH_HIST_SUB)
+
+struct bench_ctx;
+
+struct bench_req {
+    struct bench_ctx *ctx;
+    QEMUIOVector qiov;
+    void *buf;
+    int64_t offset;
+    int64_t start;
+};
+
+struct bench_ctx {
+    int64_t offset;
+    int64_t len;
+    int64_t seq_offset;
+    int reqsize;
+    int wflag;
+    int rflag;
+    int64_t deadline;
+    int64_t max_reqs;
+
+    int64_t issued;
+    int64_t completed;
+    int in_flight;
+    int error;
+
+    int64_t lat_min;
+    int64_t lat_max;
+    int64_t lat_sum;
+    uint64_t hist[BENCH_HIST_BUCKETS];
 };
 
+static int bench_hist_index(int64_t ns)
+{
+    int shift;
+
+    if (ns < BENCH_HIST_SUB) {
+        return ns < 0 ? 0 : ns;
+    }
+    shift = 63 - clz64(ns) - BENCH_HIST_SUB_BITS;
+    return ((shift + 1) << BENCH_HIST_SUB_BITS) +
+           ((ns >> shift) & (BENCH_HIST_SUB - 1));
+}
+
+static int64_t bench_hist_value(int index)
+{
+    int shift = (index >> BENCH_HIST_SUB_BITS) - 1;
+
+    if (shift < 0) {
+        return index;
+    }
+    /* Upper bound of the bucket */
+    return (((int64_t)(index & (BENCH_HIST_SUB - 1)) + BENCH_HIST_SUB + 1)
+            << shift) - 1;
+}
+
+static int64_t bench_percentile(struct bench_ctx *ctx, double pct)
+{
+    uint64_t target = ctx->completed * pct / 100.0;
+    uint64_t sum = 0;
+    int i;
+
+    for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+        sum += ctx->hist[i];
+        if (sum > target) {
+            return MIN(bench_hist_value(i), ctx->lat_max);
+        }
+    }
+    return ctx->lat_max;
+}
+
+static void bench_submit(struct bench_req *req);
+
+static void bench_done(void *opaque, int ret)
+{
+    struct bench_req *req = opaque;
+    struct bench_ctx *ctx = req->ctx;
+    int64_t lat = get_clock() - req->start;
+
+    ctx->in_flight--;
+    if (ret < 0) {
+        if (!ctx->error) {
+            ctx->error = ret;
+        }
+        return;
+    }
+
+    ctx->completed++;
+    ctx->lat_sum += lat;
+    ctx->lat_min = MIN(ctx->lat_min, lat);
+    ctx->lat_max = MAX(ctx->lat_max, lat);
+    ctx->hist[bench_hist_index(lat)]++;
+
+    bench_submit(req);
+}
+
+static void bench_submit(struct bench_req *req)
+{
+    struct bench_ctx *ctx = req->ctx;
+    int64_t nb_slots = ctx->len / ctx->reqsize;
+
+    if (ctx->error || (ctx->max_reqs && ctx->issued >= ctx->max_reqs) ||
+        (ctx->deadline && get_clock() >= ctx->deadline)) {
+        return;
+    }
+
+    if (ctx->rflag) {
+        uint64_t r = ((uint64_t)g_random_int() << 32) | g_random_int();
+        req->offset = ctx->offset + (r % nb_slots) * ctx->reqsize;
+    } else {
+        req->offset = ctx->seq_offset;
+        ctx->seq_offset += ctx->reqsize;
+        if (ctx->seq_offset + ctx->reqsize > ctx->offset + ctx->len) {
+            ctx->seq_offset = ctx->offset;
+        }
+    }
+
+    ctx->issued++;
+    ctx->in_flight++;
+    req->start = get_clock();
+    if (ctx->wflag) {
+        bdrv_aio_writev(bs, req->offset >> 9, &req->qiov,
+                        ctx->reqsize >> 9, bench_done, req);
+    } else {
+        bdrv_aio_readv(bs, req->offset >> 9, &req->qiov,
+                       ctx->reqsize >> 9, bench_done, req);
+    }
+}
+
+static void bench_help(void)
+{
+    printf(
+"\n"
+" measures the performance of the block layer with parallel requests\n"
+"\n"
+" Example:\n"
+" 'bench -d 32 -s 4k -r -t 10 0 1G' - issues random 4 kilobyte reads from\n"
+" the first gigabyte of the file, 32 at a time, for 10 seconds\n"
+"\n"
+" Keeps a number of requests in flight over a range of the currently open\n"
+" file and reports IOPS, bandwidth and completion latency percentiles.\n"
+" The null-co:// and null-aio:// protocols can be used to measure the\n"
+" overhead of the block layer without any storage involved.\n"
+" -C, -- report statistics in a machine parsable format\n"
+" -d, -- number of requests in flight (queue depth, default 1)\n"
+" -n, -- stop after the given number of requests\n"
+" -r, -- use random instead of sequential offsets\n"
+" -s, -- size of each request (default 4k)\n"
+" -t, -- stop after the given number of seconds (default 1 unless -n is used)\n"
+" -w, -- write instead of read\n"
+"\n");
+}
+
+static int bench_f(int argc, char **argv);
+
+static const cmdinfo_t bench_cmd = {
+    .name       = "bench",
+    .cfunc      = bench_f,
+    .argmin     = 2,
+    .argmax     = -1,
+    .args       = "[-Crw] [-d depth] [-n count] [-s size] [-t secs] off len",
+    .oneline    = "measures IOPS, bandwidth and latency of parallel requests",
+    .help       = bench_help,
+};
+
+static int bench_f(int argc, char **argv)
+{
+    struct bench_ctx *ctx;
+    struct bench_req *reqs;
+    int64_t t1, t2, secs = 0, total, val;
+    int Cflag = 0, depth = 1;
+    int c, i;
+    double elapsed;
+    char s1[64], s2[64];
+
+    ctx = g_new0(struct bench_ctx, 1);
+    ctx->reqsize = 4096;
+    ctx->lat_min = INT64_MAX;
+
+    while ((c = getopt(argc, argv, "Cd:n:rs:t:w")) != EOF) {
+        switch (c) {
+        case 'C':
+            Cflag = 1;
+            break;
+        case 'd':
+            val = cvtnum(optarg);
+            if (val <= 0 || val > INT_MAX) {
+                printf("invalid queue depth -- %s\n", optarg);
+                goto out;
+            }
+            depth = val;
+            break;
+        case 'n':
+            ctx->max_reqs = cvtnum(optarg);
+            if (ctx->max_reqs <= 0) {
+                printf("invalid request count -- %s\n", optarg);
+                goto out;
+            }
+            break;
+        case 'r':
+            ctx->rflag = 1;
+            break;
+        case 's':
+            val = cvtnum(optarg);
+            if (val <= 0) {
+                printf("non-numeric length argument -- %s\n", optarg);
+                goto out;
+            }
+            if (val > INT_MAX) {
+                printf("request size %" PRId64 " is too large\n", val);
+                goto out;
+            }
+            if (val & (BDRV_SECTOR_SIZE - 1)) {
+                printf("request size %" PRId64 " is not sector aligned\n",
+                       val);
+                goto out;
+            }
+            ctx->reqsize = val;
+            break;
+        case 't':
+            secs = cvtnum(optarg);
+            if (secs <= 0) {
+                printf("invalid duration -- %s\n", optarg);
+                goto out;
+            }
+            break;
+        case 'w':
+            ctx->wflag = 1;
+            break;
+        default:
+            g_free(ctx);
+            return command_usage(&bench_cmd);
+        }
+    }
+
+    if (optind != argc - 2) {
+        g_free(ctx);
+        return command_usage(&bench_cmd);
+    }
+
+    ctx->offset = cvtnum(argv[optind]);
+    if (ctx->offset < 0) {
+        printf("non-numeric length argument -- %s\n", argv[optind]);
+        goto out;
+    }
+    optind++;
+    ctx->len = cvtnum(argv[optind]);
+    if (ctx->len < 0) {
+        printf("non-numeric length argument -- %s\n", argv[optind]);
+        goto out;
+    }
+
+    if (ctx->offset & 0x1ff) {
+        printf("offset %" PRId64 " is not sector aligned\n", ctx->offset);
+        goto out;
+    }
+    if (ctx->len < ctx->reqsize) {
+        printf("range is smaller than the request size\n");
+        goto out;
+    }
+
+    if (!secs && !ctx->max_reqs) {
+        secs = 1;
+    }
+
+    reqs = g_new0(struct bench_req, depth);
+    for (i = 0; i < depth; i++) {
+        reqs[i].ctx = ctx;
+        reqs[i].buf = qemu_io_alloc(ctx->reqsize, 0xcd);
+        qemu_iovec_init(&reqs[i].qiov, 1);
+        qemu_iovec_add(&reqs[i].qiov, reqs[i].buf, ctx->reqsize);
+    }
+
+    ctx->seq_offset = ctx->offset;
+    t1 = get_clock();
+    if (secs) {
+        ctx->deadline = t1 + secs * get_ticks_per_sec();
+    }
+    for (i = 0; i < depth; i++) {
+        bench_submit(&reqs[i]);
+    }
+    while (ctx->in_flight) {
+        main_loop_wait(false);
+    }
+    t2 = get_clock();
+
+    for (i = 0; i < depth; i++) {
+        qemu_iovec_destroy(&reqs[i].qiov);
+        qemu_io_free(reqs[i].buf);
+    }
+    g_free(reqs);
+
+    if (ctx->error) {
+        printf("bench failed: %s\n", strerror(-ctx->error));
+        goto out;
+    }
+    if (!ctx->completed) {
+        printf("no requests completed\n");
+        goto out;
+    }
+
+    elapsed = (double)(t2 - t1) / get_ticks_per_sec();
+    total = ctx->completed * ctx->reqsize;
+
+    if (!Cflag) {
+        cvtstr((double)total, s1, sizeof(s1));
+        cvtstr(total / elapsed, s2, sizeof(s2));
+        printf("%s %" PRId64 " requests of %d bytes, %s in %.4f sec "
+               "(%s/sec and %.4f ops/sec)\n",
+               ctx->wflag ? "wrote" : "read", ctx->completed, ctx->reqsize,
+               s1, elapsed, s2, ctx->completed / elapsed);
+        printf("latency (usec): min %.3f avg %.3f max %.3f\n",
+               ctx->lat_min / 1000.0,
+               (double)ctx->lat_sum / ctx->completed / 1000.0,
+               ctx->lat_max / 1000.0);
+        printf("percentiles (usec): 50th %.3f 90th %.3f 99th %.3f "
+               "99.9th %.3f\n",
+               bench_percentile(ctx, 50) / 1000.0,
+               bench_percentile(ctx, 90) / 1000.0,
+               bench_percentile(ctx, 99) / 1000.0,
+               bench_percentile(ctx, 99.9) / 1000.0);
+    } else {
+        /* ops,bytes,time,bytes/sec,ops/sec,min,avg,max,p50,p90,p99,p99.9 */
+        printf("%" PRId64 ",%" PRId64 ",%.6f,%.3f,%.3f,%" PRId64 ",%" PRId64
+               ",%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64
+               "\n",
+               ctx->completed, total, elapsed, total / elapsed,
+               ctx->completed / elapsed, ctx->lat_min,
+               ctx->lat_sum / ctx->completed, ctx->lat_max,
+               bench_percentile(ctx, 50), bench_percentile(ctx, 90),
+               bench_percentile(ctx, 99), bench_percentile(ctx, 99.9));
+    }
+
+out:
+    g_free(ctx);
+    return 0;
+}
+
 static int abort_f(int argc, char **argv)
 {
     abort();
@@ -1714,6 +2233,7 @@ static void open_help(void)
 " 'open -Cn /tmp/data' - creates/opens data file read-write and uncached\n"
 "\n"
 " Opens a file for subsequent use by all of the other qemu-io commands.\n"
+" -C, -- use copy-on-read\n"
 " -r, -- open file read-only\n"
 " -s, -- use snapshot file\n"
 " -n, -- disable host cache\n"
@@ -1742,8 +2262,11 @@ static int open_f(int argc, char **argv)
     int growable = 0;
     int c;
 
-    while ((c = getopt(argc, argv, "snrg")) != EOF) {
+    while ((c = getopt(argc, argv, "Csnrg")) != EOF) {
         switch (c) {
+        case 'C':
+            flags |= BDRV_O_COPY_ON_READ;
+            break;
         case 's':
             flags |= BDRV_O_SNAPSHOT;
             break;
@@ -1796,10 +2319,11 @@ static int init_check_command(const cmdinfo_t *ct)
 static void usage(const char *name)
 {
     printf(
-"Usage: %s [-h] [-V] [-rsnm] [-c cmd] ... [file]\n"
+"Usage: %s [-h] [-V] [-Crsnm] [-c cmd] ... [file]\n"
 "QEMU Disk exerciser\n"
 "\n"
 "  -c, --cmd            command to execute\n"
+"  -C, --copy-on-read   enable copy-on-read\n"
 "  -r, --read-only      export read-only\n"
 "  -s, --snapshot       use snapshot file\n"
 "  -n, --nocache        disable host cache\n"
@@ -1819,12 +2343,13 @@ int main(int argc, char **argv)
 {
     int readonly = 0;
     int growable = 0;
-    const char *sopt = "hVc:rsnmgkt:T:";
+    const char *sopt = "hVc:Crsnmgkt:T:";
     const struct option lopt[] = {
         { "help", 0, NULL, 'h' },
         { "version", 0, NULL, 'V' },
         { "offset", 1, NULL, 'o' },
         { "cmd", 1, NULL, 'c' },
+        { "copy-on-read", 0, NULL, 'C' },
         { "read-only", 0, NULL, 'r' },
         { "snapshot", 0, NULL, 's' },
         { "nocache", 0, NULL, 'n' },
@@ -1852,6 +2377,9 @@ int main(int argc, char **argv)
         case 'c':
             add_user_command(optarg);
             break;
+        case 'C':
+            flags |= BDRV_O_COPY_ON_READ;
+            break;
         case 'r':
             readonly = 1;
             break;
@@ -1916,6 +2444,9 @@ int main(int argc, char **argv)
     add_command(&discard_cmd);
     add_command(&alloc_cmd);
     add_command(&map_cmd);
+    add_command(&snapshot_cmd);
+    add_command(&prefetch_cmd);
+    add_command(&bench_cmd);
     add_command(&abort_cmd);
 
     add_args_command(init_args_command);
@@ -149,6 +149,7 @@ DEF("drive", HAS_ARG, QEMU_OPTION_drive,
     "       [,cache=writethrough|writeback|none|directsync|unsafe][,format=f]\n"
     "       [,serial=s][,addr=A][,id=name][,aio=threads|native]\n"
     "       [,readonly=on|off][,copy-on-read=on|off]\n"
+    "       [,copy-on-read-prefetch=size][,copy-on-read-prefetch-bps=b]\n"
     "       [[,bps=b]|[[,bps_rd=r][,bps_wr=w]]][[,iops=i]|[[,iops_rd=r][,iops_wr=w]]\n"
     "                use 'file' as a drive image\n", QEMU_ARCH_ALL)
 STEXI
@@ -203,6 +204,13 @@ Open drive @option{file} as read-only. Guest write attempts will fail.
 @item copy-on-read=@var{copy-on-read}
 @var{copy-on-read} is "on" or "off" and enables whether to copy read backing
 file sectors into the image file.
+@item copy-on-read-prefetch=@var{size}
+When copy-on-read is enabled, detect sequential reads and copy up to @var{size}
+bytes ahead of them from the backing file in the background.  The default is 0,
+which disables prefetching.
+@item copy-on-read-prefetch-bps=@var{b}
+Limit the bandwidth used for copy-on-read prefetching to @var{b} bytes per
+second.  The default is 0, which means no limit.
 @end table
 
 By default, writethrough caching is used for all block device.  This means that
@@ -2554,6 +2562,77 @@ order cores with complex cache hierarchies.  The number of instructions
 executed often has little or no correlation with actual performance.
 ETEXI
 
+DEF("tcg-threads", HAS_ARG, QEMU_OPTION_tcg_threads, \
+    "-tcg-threads single|multi\n" \
+    "                run all TCG vCPUs in one thread (default) or each vCPU\n" \
+    "                in its own thread (experimental)\n", QEMU_ARCH_ALL)
+STEXI
+@item -tcg-threads single|multi
+@findex -tcg-threads
+Select how the TCG accelerator runs the virtual CPUs of a SMP guest.
+With @code{single}, the default, all virtual CPUs are executed in turn by
+one thread.  With @code{multi} each virtual CPU gets its own thread and
+runs guest code without holding the global lock, so that the guest can
+use several host CPUs.
+
+@code{multi} is experimental.  It is only available on x86 hosts for
+x86, ARM and PowerPC guests, and cannot be combined with @option{-icount}.
+Atomic guest instructions are emulated with host atomic operations where
+the guest memory is RAM; guest page tables are expected to live in RAM.
+ETEXI
+
+DEF("tcg-perf", HAS_ARG, QEMU_OPTION_tcg_perf, \
+    "-tcg-perf map|jitdump\n" \
+    "                describe translated code to the Linux perf tool\n", \
+    QEMU_ARCH_ALL)
+STEXI
+@item -tcg-perf map|jitdump
+@findex -tcg-perf
+Tell the Linux @command{perf} tool which guest code every translated block
+comes from, so that @command{perf report} shows guest functions instead of
+anonymous memory.  Blocks are named after the guest symbol that contains
+them if QEMU loaded one (@option{-kernel} with an ELF image), after their
+guest address otherwise.  The option can be given twice to get both files.
+
+With @code{map}, QEMU writes @file{/tmp/perf-@var{pid}.map}, which
+@command{perf report} reads by itself.  The map has no notion of time, so
+samples taken before the translation buffer was flushed may be attributed
+to the blocks that replaced them.
+
+With @code{jitdump}, QEMU writes @file{/tmp/jit-@var{pid}.dump} with a
+timestamped copy of every block.  Record with @code{perf record -k 1}, then
+run @code{perf inject --jit} on the recording to get per-block symbols and
+annotated host code.
+ETEXI
+
+DEF("tcg-buffer", HAS_ARG, QEMU_OPTION_tcg_buffer, \
+    "-tcg-buffer small|thp|hugetlb[,split-wx]\n" \
+    "                back the translation buffer with small, transparent\n" \
+    "                huge (default) or hugetlbfs pages; with split-wx, map\n" \
+    "                it twice instead of writable and executable\n", \
+    QEMU_ARCH_ALL)
+STEXI
+@item -tcg-buffer small|thp|hugetlb[,split-wx]
+@findex -tcg-buffer
+Choose how the buffer that holds the translated code is mapped.  Large
+guests translate tens of megabytes of code, which the host walks with its
+instruction TLB; huge pages let a few TLB entries cover all of it.
+
+With @code{thp}, the default on Linux hosts, the buffer is aligned to 2MB
+and the kernel is asked to back it with transparent huge pages, provided
+@file{/sys/kernel/mm/transparent_hugepage/enabled} is not @code{never}.
+@code{hugetlb} takes pages from the hugetlbfs pool, which must have been
+filled beforehand (@file{/proc/sys/vm/nr_hugepages}); QEMU falls back to
+@code{thp} when the pool is empty.  @code{small} uses normal pages.
+
+By default the buffer is both writable and executable, which hardened
+hosts refuse.  @code{split-wx} maps the same memory twice instead, once
+executable for running the code and once writable for generating and
+patching it, so that no page is ever writable and executable.  It is only
+available on x86 Linux hosts.  Transparent huge pages for a split buffer
+further depend on @file{/sys/kernel/mm/transparent_hugepage/shmem_enabled}.
+ETEXI
+
 DEF("watchdog", HAS_ARG, QEMU_OPTION_watchdog, \
     "-watchdog i6300esb|ib700\n" \
     "                enable virtual hardware watchdog [default=none]\n",
@@ -2648,11 +2727,16 @@ Show cursor.
 ETEXI
 
 DEF("tb-size", HAS_ARG, QEMU_OPTION_tb_size, \
-    "-tb-size n      set TB size\n", QEMU_ARCH_ALL)
+    "-tb-size n      set the translated code buffer size to n MB\n",
+    QEMU_ARCH_ALL)
 STEXI
 @item -tb-size @var{n}
 @findex -tb-size
-Set TB size.
+Set the size of the buffer holding the translated code to @var{n} MB.
+The default is a quarter of the guest RAM, and at least 256 MB on 64-bit
+hosts.  When the buffer is full, the oldest eighth of the translations is
+discarded to make room.  Sizes the host cannot branch across, such as
+more than 2047 MB on x86_64, are refused.
 ETEXI
 
 DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
@@ -294,12 +294,12 @@ static inline int64_t cpu_get_real_ticks (void)
 }
 #endif
 
-#ifdef CONFIG_PROFILER
 static inline int64_t profile_getclock(void)
 {
     return cpu_get_real_ticks();
 }
 
+#ifdef CONFIG_PROFILER
 extern int64_t qemu_time, qemu_time_start;
 extern int64_t tlb_flush_time;
 extern int64_t dev_time;
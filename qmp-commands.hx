@@ -910,6 +910,31 @@ Example:
 -> { "execute": "set_link", "arguments": { "name": "e1000.0", "up": false } }
 <- { "return": {} }
 
+EQMP
+
+    {
+        .name       = "jit-profile",
+        .args_type  = "enable:b",
+        .mhandler.cmd_new = qmp_marshal_input_jit_profile,
+    },
+
+SQMP
+jit-profile
+-----------
+
+Enable or disable profiling of translated code.  Enabling it resets the
+statistics returned by query-jit.  Both enabling and disabling profiling
+flush the translated code.
+
+Arguments:
+
+- "enable": true to enable profiling, false to disable it (json-bool)
+
+Example:
+
+-> { "execute": "jit-profile", "arguments": { "enable": true } }
+<- { "return": {} }
+
 EQMP
 
     {
@@ -1954,6 +1979,79 @@ EQMP
         .mhandler.cmd_new = qmp_marshal_input_query_kvm,
     },
 
+SQMP
+query-jit
+---------
+
+Show statistics of the dynamic translator.
+
+Arguments:
+
+- "top": how many blocks, helpers and pages to return, default 10
+         (json-int, optional)
+
+Return a json-object with the following information:
+
+- "profiling": true if profiling is enabled (json-bool)
+- "code-size": bytes of the translation buffer in use (json-int)
+- "code-buffer-size": size of the translation buffer (json-int)
+- "tbs": number of translated blocks (json-int)
+- "max-tbs": maximum number of translated blocks (json-int)
+- "flushes": number of translation buffer flushes (json-int)
+- "translations": blocks translated while profiling (json-int)
+- "translation-cycles": host cycles spent translating while profiling
+                        (json-int)
+- "smc-invalidations": blocks invalidated by writes to guest code (json-int)
+- "smc-uncached": blocks executed without caching their translation, as
+                  their page is rewritten too often (json-int)
+- "cpus": a json-array of json-objects, one per virtual CPU, with:
+    - "CPU": CPU index (json-int)
+    - "tlb-fills": softmmu TLB misses (json-int)
+    - "exits-indirect", "exits-unlinked", "exits-icount", "exits-hot":
+      exits from translated code back to the execution loop, by reason
+      (json-int)
+    - "exits-exception", "exits-interrupt": guest exceptions and
+      interrupt checks (json-int)
+    - "exits-request": returns to the main loop (json-int)
+- "blocks": a json-array of the blocks executed most often while
+  profiling, each a json-object with "pc", "size", "executions" and
+  optionally "symbol"
+- "helpers": a json-array of the helpers called most often while
+  profiling, each a json-object with "name" and "calls"
+- "smc-pages": a json-array of the pages with the most blocks invalidated
+  by writes, each a json-object with "addr", "invalidations" and
+  "uncached"
+
+Example:
+
+-> { "execute": "query-jit", "arguments": { "top": 1 } }
+<- { "return": { "profiling": true, "code-size": 1441792,
+                 "code-buffer-size": 33554432, "tbs": 7342,
+                 "max-tbs": 262144, "flushes": 1, "translations": 7342,
+                 "translation-cycles": 493177052,
+                 "smc-invalidations": 2210, "smc-uncached": 0,
+                 "cpus": [ { "CPU": 0, "tlb-fills": 40214,
+                             "exits-indirect": 81203,
+                             "exits-unlinked": 10231, "exits-icount": 0,
+                             "exits-hot": 412, "exits-exception": 12,
+                             "exits-interrupt": 3012,
+                             "exits-request": 2920 } ],
+                 "blocks": [ { "pc": 1048672, "size": 14,
+                               "executions": 902671,
+                               "symbol": "memcpy" } ],
+                 "helpers": [ { "name": "helper_cc_compute_all",
+                                "calls": 61022 } ],
+                 "smc-pages": [ { "addr": 651264, "invalidations": 1893,
+                                  "uncached": false } ] } }
+
+EQMP
+
+    {
+        .name       = "query-jit",
+        .args_type  = "top:i?",
+        .mhandler.cmd_new = qmp_marshal_input_query_jit,
+    },
+
 SQMP
 query-status
 ------------
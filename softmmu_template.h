@@ -76,7 +76,7 @@ static inline DATA_TYPE glue(io_read, SUFFIX)(ENV_PARAM
                                               uintptr_t retaddr)
 {
     DATA_TYPE res;
-    MemoryRegion *mr = iotlb_to_region(physaddr);
+    MemoryRegion *mr = cpu_mmio_region(env, physaddr, retaddr);
 
     physaddr = (physaddr & TARGET_PAGE_MASK) + addr;
     env->mem_io_pc = retaddr;
@@ -116,8 +116,9 @@ glue(glue(glue(HELPER_PREFIX, ld), SUFFIX), MMUSUFFIX)(ENV_PARAM
 
     /* test if there is match for unaligned or IO access */
     /* XXX: could done more in memory macro in a non portable way */
-    index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
  redo:
+    /* tlb_fill may have resized the TLB */
+    index = tlb_index(env, mmu_idx, addr);
     tlb_addr = env->tlb_table[mmu_idx][index].ADDR_READ;
     if ((addr & TARGET_PAGE_MASK) == (tlb_addr & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
         if (tlb_addr & ~TARGET_PAGE_MASK) {
@@ -156,7 +157,11 @@ glue(glue(glue(HELPER_PREFIX, ld), SUFFIX), MMUSUFFIX)(ENV_PARAM
         if ((addr & (DATA_SIZE - 1)) != 0)
             do_unaligned_access(ENV_VAR addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
 #endif
-        tlb_fill(env, addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
+        phys_map_lock();
+        if (!tlb_victim_fill(env, addr, READ_ACCESS_TYPE, mmu_idx)) {
+            tlb_fill(env, addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
+        }
+        phys_map_unlock();
         goto redo;
     }
     return res;
@@ -174,8 +179,8 @@ glue(glue(slow_ld, SUFFIX), MMUSUFFIX)(ENV_PARAM
     target_phys_addr_t ioaddr;
     target_ulong tlb_addr, addr1, addr2;
 
-    index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
  redo:
+    index = tlb_index(env, mmu_idx, addr);
     tlb_addr = env->tlb_table[mmu_idx][index].ADDR_READ;
     if ((addr & TARGET_PAGE_MASK) == (tlb_addr & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
         if (tlb_addr & ~TARGET_PAGE_MASK) {
@@ -208,7 +213,11 @@ glue(glue(slow_ld, SUFFIX), MMUSUFFIX)(ENV_PARAM
         }
     } else {
         /* the page is not in the TLB : fill it */
-        tlb_fill(env, addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
+        phys_map_lock();
+        if (!tlb_victim_fill(env, addr, READ_ACCESS_TYPE, mmu_idx)) {
+            tlb_fill(env, addr, READ_ACCESS_TYPE, mmu_idx, retaddr);
+        }
+        phys_map_unlock();
         goto redo;
     }
     return res;
@@ -228,7 +237,7 @@ static inline void glue(io_write, SUFFIX)(ENV_PARAM
                                           target_ulong addr,
                                           uintptr_t retaddr)
 {
-    MemoryRegion *mr = iotlb_to_region(physaddr);
+    MemoryRegion *mr = cpu_mmio_region(env, physaddr, retaddr);
 
     physaddr = (physaddr & TARGET_PAGE_MASK) + addr;
     if (mr != &io_mem_ram && mr != &io_mem_rom
@@ -263,8 +272,8 @@ void glue(glue(glue(HELPER_PREFIX, st), SUFFIX), MMUSUFFIX)(ENV_PARAM
     uintptr_t retaddr;
     int index;
 
-    index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
  redo:
+    index = tlb_index(env, mmu_idx, addr);
     tlb_addr = env->tlb_table[mmu_idx][index].addr_write;
     if ((addr & TARGET_PAGE_MASK) == (tlb_addr & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
         if (tlb_addr & ~TARGET_PAGE_MASK) {
@@ -302,7 +311,11 @@ void glue(glue(glue(HELPER_PREFIX, st), SUFFIX), MMUSUFFIX)(ENV_PARAM
         if ((addr & (DATA_SIZE - 1)) != 0)
             do_unaligned_access(ENV_VAR addr, 1, mmu_idx, retaddr);
 #endif
-        tlb_fill(env, addr, 1, mmu_idx, retaddr);
+        phys_map_lock();
+        if (!tlb_victim_fill(env, addr, 1, mmu_idx)) {
+            tlb_fill(env, addr, 1, mmu_idx, retaddr);
+        }
+        phys_map_unlock();
         goto redo;
     }
 }
@@ -318,8 +331,8 @@ static void glue(glue(slow_st, SUFFIX), MMUSUFFIX)(ENV_PARAM
     target_ulong tlb_addr;
     int index, i;
 
-    index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
  redo:
+    index = tlb_index(env, mmu_idx, addr);
     tlb_addr = env->tlb_table[mmu_idx][index].addr_write;
     if ((addr & TARGET_PAGE_MASK) == (tlb_addr & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
         if (tlb_addr & ~TARGET_PAGE_MASK) {
@@ -352,7 +365,11 @@ static void glue(glue(slow_st, SUFFIX), MMUSUFFIX)(ENV_PARAM
         }
     } else {
         /* the page is not in the TLB : fill it */
-        tlb_fill(env, addr, 1, mmu_idx, retaddr);
+        phys_map_lock();
+        if (!tlb_victim_fill(env, addr, 1, mmu_idx)) {
+            tlb_fill(env, addr, 1, mmu_idx, retaddr);
+        }
+        phys_map_unlock();
         goto redo;
     }
 }
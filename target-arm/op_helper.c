@@ -99,6 +99,87 @@ void tlb_fill(CPUARMState *env1, target_ulong addr, int is_write, int mmu_idx,
 }
 #endif
 
+/* Store exclusive with parallel_cpus (-tcg-threads multi, or several
+   threads in user mode): compare and swap the value seen by the load
+   exclusive with the new one, in a single host atomic operation.
+   'info' is size | (rt << 8) | (rt2 << 12).  Returns 0 on success, 1 on
+   failure, as STREX does.  */
+uint32_t HELPER(strex_parallel)(uint32_t addr, uint32_t info)
+{
+    int size = info & 3;
+    int rt = (info >> 8) & 0xf;
+    int rt2 = (info >> 12) & 0xf;
+    uint64_t cmpv, newv, oldv;
+    void *p;
+
+    if (addr != env->exclusive_addr) {
+        return 1;
+    }
+    cmpv = env->exclusive_val;
+    newv = env->regs[rt];
+    if (size == 3) {
+        cmpv |= (uint64_t)env->exclusive_high << 32;
+        newv |= (uint64_t)env->regs[rt2] << 32;
+    }
+
+    p = tlb_vaddr_to_host(env, addr, size == 3 ? 8 : 1 << size,
+                          cpu_mmu_index(env), GETPC());
+    if (p) {
+        switch (size) {
+        case 0:
+            oldv = __sync_val_compare_and_swap((uint8_t *)p, cmpv, newv);
+            break;
+        case 1:
+            oldv = __sync_val_compare_and_swap((uint16_t *)p, cmpv, newv);
+            break;
+        case 2:
+            oldv = __sync_val_compare_and_swap((uint32_t *)p, cmpv, newv);
+            break;
+        default:
+            oldv = __sync_val_compare_and_swap((uint64_t *)p, cmpv, newv);
+            break;
+        }
+        return oldv != cmpv;
+    }
+
+    /* I/O, page crossing or read-only access */
+    cpu_atomic_lock();
+    switch (size) {
+    case 0:
+        oldv = ldub(addr);
+        break;
+    case 1:
+        oldv = lduw(addr);
+        break;
+    case 2:
+        oldv = (uint32_t)ldl(addr);
+        break;
+    default:
+        oldv = (uint32_t)ldl(addr);
+        oldv |= (uint64_t)(uint32_t)ldl(addr + 4) << 32;
+        break;
+    }
+    if (oldv == cmpv) {
+        switch (size) {
+        case 0:
+            stb(addr, newv);
+            break;
+        case 1:
+            stw(addr, newv);
+            break;
+        case 2:
+            stl(addr, newv);
+            break;
+        default:
+            stl(addr, newv);
+            stl(addr + 4, newv >> 32);
+            break;
+        }
+    }
+    cpu_atomic_unlock();
+    return oldv != cmpv;
+}
+
 /* FIXME: Pass an explicit pointer to QF to CPUARMState, and move saturating
    instructions into helper.c  */
 uint32_t HELPER(add_setq)(uint32_t a, uint32_t b)
@@ -735,7 +735,7 @@ static inline void gen_bx_im(DisasContext *s, uint32_t addr)
 /* Set PC and Thumb state from var.  var is marked as dead.  */
 static inline void gen_bx(DisasContext *s, TCGv var)
 {
-    s->is_jmp = DISAS_UPDATE;
+    s->is_jmp = DISAS_JUMP;
     tcg_gen_andi_i32(cpu_R[15], var, ~1);
     tcg_gen_andi_i32(var, var, 1);
     store_cpu_field(var, thumb);
@@ -3353,6 +3353,19 @@ static inline void gen_jmp (DisasContext *s, uint32_t dest)
     }
 }
 
+/* Unconditional direct branch: a superblock goes on translating at the
+   destination when it is further ahead on the same page.  */
+static inline void gen_jmp_direct(DisasContext *s, uint32_t dest)
+{
+    if ((s->tb->cflags & CF_SUPERBLOCK) && !s->singlestep_enabled &&
+        !s->condjmp && !s->condexec_mask && dest >= s->pc &&
+        (dest & TARGET_PAGE_MASK) == (s->tb->pc & TARGET_PAGE_MASK)) {
+        s->pc = dest;
+        return;
+    }
+    gen_jmp(s, dest);
+}
+
 static inline void gen_mulxy(TCGv t0, TCGv t1, int x, int y)
 {
     if (x)
@@ -3438,7 +3451,7 @@ static void gen_exception_return(DisasContext *s, TCGv pc)
     tmp = load_cpu_field(spsr);
     gen_set_cpsr(tmp, 0xffffffff);
     tcg_temp_free_i32(tmp);
-    s->is_jmp = DISAS_UPDATE;
+    s->is_jmp = DISAS_JUMP;
 }
 
 /* Generate a v6 exception return.  Marks both values as dead.  */
@@ -3447,7 +3460,7 @@ static void gen_rfe(DisasContext *s, TCGv pc, TCGv cpsr)
     gen_set_cpsr(cpsr, 0xffffffff);
     tcg_temp_free_i32(cpsr);
     store_reg(s, 15, pc);
-    s->is_jmp = DISAS_UPDATE;
+    s->is_jmp = DISAS_JUMP;
 }
 
 static inline void
@@ -4403,6 +4416,53 @@ static const uint8_t neon_2rm_sizes[] = {
    We process data in a mixture of 32-bit and 64-bit chunks.
    Mostly we use 32-bit chunks so we can use normal scalar instructions.  */
 
+/* Translate the integer add/sub, bitwise logic and compare-equal insns of
+   the three registers of the same length group into TCG vector ops, which
+   work on whole D or Q registers.  Return nonzero if the insn was
+   translated.  */
+static int gen_neon_3r_vec(int op, int u, int size, int q,
+                           int rd, int rn, int rm)
+{
+    int oprsz = q ? 16 : 8;
+    long dofs = vfp_reg_offset(1, rd);
+    long aofs = vfp_reg_offset(1, rn);
+    long bofs = vfp_reg_offset(1, rm);
+
+    switch (op) {
+    case NEON_3R_VADD_VSUB:
+        if (u) {
+            tcg_gen_vec_sub(oprsz, size, cpu_env, dofs, aofs, bofs);
+        } else {
+            tcg_gen_vec_add(oprsz, size, cpu_env, dofs, aofs, bofs);
+        }
+        return 1;
+    case NEON_3R_LOGIC:
+        switch ((u << 2) | size) {
+        case 0: /* VAND */
+            tcg_gen_vec_and(oprsz, cpu_env, dofs, aofs, bofs);
+            return 1;
+        case 1: /* BIC */
+            tcg_gen_vec_andc(oprsz, cpu_env, dofs, aofs, bofs);
+            return 1;
+        case 2: /* VORR */
+            tcg_gen_vec_or(oprsz, cpu_env, dofs, aofs, bofs);
+            return 1;
+        case 4: /* VEOR */
+            tcg_gen_vec_xor(oprsz, cpu_env, dofs, aofs, bofs);
+            return 1;
+        }
+        return 0;
+    case NEON_3R_VTST_VCEQ:
+        if (u) { /* VCEQ */
+            tcg_gen_vec_cmpeq(oprsz, size, cpu_env, dofs, aofs, bofs);
+            return 1;
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
 static int disas_neon_data_insn(CPUARMState * env, DisasContext *s, uint32_t insn)
 {
     int op;
@@ -4439,6 +4499,9 @@ static int disas_neon_data_insn(CPUARMState * env, DisasContext *s, uint32_t ins
         if (q && ((rd | rn | rm) & 1)) {
             return 1;
         }
+        if (gen_neon_3r_vec(op, u, size, q, rd, rn, rm)) {
+            return 0;
+        }
         if (size == 3 && op != NEON_3R_LOGIC) {
             /* 64-bit element instructions. */
             for (pass = 0; pass < (q ? 2 : 1); pass++) {
@@ -6407,8 +6470,11 @@ static void gen_logicq_cc(TCGv_i64 val)
    regular stores.
 
    In system emulation mode only one CPU will be running at once, so
-   this sequence is effectively atomic.  In user emulation mode we
-   throw an exception and handle the atomic operation elsewhere.  */
+   this sequence is effectively atomic, unless the CPUs run in parallel
+   threads; then the store is a host compare and swap done by a helper.
+   In user emulation mode we throw an exception and handle the atomic
+   operation elsewhere, or use the same helper once the guest has
+   started a second thread.  */
 static void gen_load_exclusive(DisasContext *s, int rt, int rt2,
                                TCGv addr, int size)
 {
@@ -6446,10 +6512,29 @@ static void gen_clrex(DisasContext *s)
     tcg_gen_movi_i32(cpu_exclusive_addr, -1);
 }
 
+/* other CPUs run concurrently, let the helper do an atomic compare and
+   swap instead */
+static void gen_store_exclusive_parallel(DisasContext *s, int rd, int rt,
+                                         int rt2, TCGv addr, int size)
+{
+    TCGv tmp;
+
+    tmp = tcg_const_i32(size | (rt << 8) | (rt2 << 12));
+    gen_set_condexec(s);
+    gen_set_pc_im(s->pc - 4);
+    gen_helper_strex_parallel(cpu_R[rd], addr, tmp);
+    tcg_temp_free_i32(tmp);
+    tcg_gen_movi_i32(cpu_exclusive_addr, -1);
+}
+
 #ifdef CONFIG_USER_ONLY
 static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
                                 TCGv addr, int size)
 {
+    if (parallel_cpus) {
+        gen_store_exclusive_parallel(s, rd, rt, rt2, addr, size);
+        return;
+    }
     tcg_gen_mov_i32(cpu_exclusive_test, addr);
     tcg_gen_movi_i32(cpu_exclusive_info,
                      size | (rd << 4) | (rt << 8) | (rt2 << 12));
@@ -6463,6 +6548,11 @@ static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
     int done_label;
     int fail_label;
 
+    if (parallel_cpus) {
+        gen_store_exclusive_parallel(s, rd, rt, rt2, addr, size);
+        return;
+    }
+
     /* if (env->exclusive_addr == addr && env->exclusive_val == [addr]) {
          [addr] = {Rt};
          {Rd} = 0;
@@ -7800,7 +7890,7 @@ static void disas_arm_insn(CPUARMState * env, DisasContext *s)
                 }
                 offset = (((int32_t)insn << 8) >> 8);
                 val += (offset << 2) + 4;
-                gen_jmp(s, val);
+                gen_jmp_direct(s, val);
             }
             break;
         case 0xc:
@@ -8528,7 +8618,7 @@ static int disas_thumb2_insn(CPUARMState *env, DisasContext *s, uint16_t insn_hw
                 offset += s->pc;
                 if (insn & (1 << 12)) {
                     /* b/bl */
-                    gen_jmp(s, offset);
+                    gen_jmp_direct(s, offset);
                 } else {
                     /* blx */
                     offset &= ~(uint32_t)2;
@@ -9656,7 +9746,7 @@ static void disas_thumb_insn(CPUARMState *env, DisasContext *s)
         val = (uint32_t)s->pc;
         offset = ((int32_t)insn << 21) >> 21;
         val += (offset << 1) + 2;
-        gen_jmp(s, val);
+        gen_jmp_direct(s, val);
         break;
 
     case 15:
@@ -9725,6 +9815,7 @@ static inline void gen_intermediate_code_internal(CPUARMState *env,
     if (max_insns == 0)
         max_insns = CF_COUNT_MASK;
 
+    gen_tb_exec_count(tb);
     gen_icount_start();
 
     tcg_clear_temp_count();
@@ -9903,8 +9994,11 @@ static inline void gen_intermediate_code_internal(CPUARMState *env,
         case DISAS_NEXT:
             gen_goto_tb(dc, 1, dc->pc);
             break;
-        default:
         case DISAS_JUMP:
+            /* indirect branch: look up the next TB from translated code */
+            gen_lookup_and_goto_ptr(cpu_env);
+            break;
+        default:
         case DISAS_UPDATE:
             /* indicate that the hash table must be used to find the next TB */
             tcg_gen_exit_tb(0);
@@ -545,6 +545,20 @@ enum {
     CC_OP_NB,
 };
 
+/* Operations of helper_atomic_op(), used for LOCK-prefixed instructions
+   when vCPUs run in parallel.  The operation is shifted left by 3 and
+   ored with the operand size; the helper returns the new memory value,
+   or the old one if X86_ATOMIC_FETCH is set.  */
+enum {
+    X86_ATOMIC_ADD,
+    X86_ATOMIC_AND,
+    X86_ATOMIC_OR,
+    X86_ATOMIC_XOR,
+    X86_ATOMIC_XCHG,
+};
+
+#define X86_ATOMIC_FETCH 4
+
 typedef struct SegmentCache {
     uint32_t selector;
     target_ulong base;
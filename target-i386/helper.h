@@ -1,7 +1,7 @@
 #include "def-helper.h"
 
-DEF_HELPER_FLAGS_2(cc_compute_all, TCG_CALL_PURE, i32, env, int)
-DEF_HELPER_FLAGS_2(cc_compute_c, TCG_CALL_PURE, i32, env, int)
+DEF_HELPER_FLAGS_2(cc_compute_all, TCG_CALL_NO_WG_SE, i32, env, int)
+DEF_HELPER_FLAGS_2(cc_compute_c, TCG_CALL_NO_WG_SE, i32, env, int)
 
 DEF_HELPER_0(lock, void)
 DEF_HELPER_0(unlock, void)
@@ -74,6 +74,8 @@ DEF_HELPER_3(boundl, void, env, tl, int)
 DEF_HELPER_1(rsm, void, env)
 DEF_HELPER_2(into, void, env, int)
 DEF_HELPER_2(cmpxchg8b, void, env, tl)
+DEF_HELPER_4(atomic_op, tl, env, tl, tl, i32)
+DEF_HELPER_5(atomic_cmpxchg, tl, env, tl, tl, tl, i32)
 #ifdef TARGET_X86_64
 DEF_HELPER_2(cmpxchg16b, void, env, tl)
 #endif
@@ -109,82 +111,82 @@ DEF_HELPER_2(invlpga, void, env, int)
 
 /* x86 FPU */
 
-DEF_HELPER_2(flds_FT0, void, env, i32)
-DEF_HELPER_2(fldl_FT0, void, env, i64)
-DEF_HELPER_2(fildl_FT0, void, env, s32)
-DEF_HELPER_2(flds_ST0, void, env, i32)
-DEF_HELPER_2(fldl_ST0, void, env, i64)
-DEF_HELPER_2(fildl_ST0, void, env, s32)
-DEF_HELPER_2(fildll_ST0, void, env, s64)
-DEF_HELPER_1(fsts_ST0, i32, env)
-DEF_HELPER_1(fstl_ST0, i64, env)
-DEF_HELPER_1(fist_ST0, s32, env)
-DEF_HELPER_1(fistl_ST0, s32, env)
-DEF_HELPER_1(fistll_ST0, s64, env)
-DEF_HELPER_1(fistt_ST0, s32, env)
-DEF_HELPER_1(fisttl_ST0, s32, env)
-DEF_HELPER_1(fisttll_ST0, s64, env)
+DEF_HELPER_FLAGS_2(flds_FT0, TCG_CALL_NO_RWG, void, env, i32)
+DEF_HELPER_FLAGS_2(fldl_FT0, TCG_CALL_NO_RWG, void, env, i64)
+DEF_HELPER_FLAGS_2(fildl_FT0, TCG_CALL_NO_RWG, void, env, s32)
+DEF_HELPER_FLAGS_2(flds_ST0, TCG_CALL_NO_RWG, void, env, i32)
+DEF_HELPER_FLAGS_2(fldl_ST0, TCG_CALL_NO_RWG, void, env, i64)
+DEF_HELPER_FLAGS_2(fildl_ST0, TCG_CALL_NO_RWG, void, env, s32)
+DEF_HELPER_FLAGS_2(fildll_ST0, TCG_CALL_NO_RWG, void, env, s64)
+DEF_HELPER_FLAGS_1(fsts_ST0, TCG_CALL_NO_RWG, i32, env)
+DEF_HELPER_FLAGS_1(fstl_ST0, TCG_CALL_NO_RWG, i64, env)
+DEF_HELPER_FLAGS_1(fist_ST0, TCG_CALL_NO_RWG, s32, env)
+DEF_HELPER_FLAGS_1(fistl_ST0, TCG_CALL_NO_RWG, s32, env)
+DEF_HELPER_FLAGS_1(fistll_ST0, TCG_CALL_NO_RWG, s64, env)
+DEF_HELPER_FLAGS_1(fistt_ST0, TCG_CALL_NO_RWG, s32, env)
+DEF_HELPER_FLAGS_1(fisttl_ST0, TCG_CALL_NO_RWG, s32, env)
+DEF_HELPER_FLAGS_1(fisttll_ST0, TCG_CALL_NO_RWG, s64, env)
 DEF_HELPER_2(fldt_ST0, void, env, tl)
 DEF_HELPER_2(fstt_ST0, void, env, tl)
-DEF_HELPER_1(fpush, void, env)
-DEF_HELPER_1(fpop, void, env)
-DEF_HELPER_1(fdecstp, void, env)
-DEF_HELPER_1(fincstp, void, env)
-DEF_HELPER_2(ffree_STN, void, env, int)
-DEF_HELPER_1(fmov_ST0_FT0, void, env)
-DEF_HELPER_2(fmov_FT0_STN, void, env, int)
-DEF_HELPER_2(fmov_ST0_STN, void, env, int)
-DEF_HELPER_2(fmov_STN_ST0, void, env, int)
-DEF_HELPER_2(fxchg_ST0_STN, void, env, int)
-DEF_HELPER_1(fcom_ST0_FT0, void, env)
-DEF_HELPER_1(fucom_ST0_FT0, void, env)
+DEF_HELPER_FLAGS_1(fpush, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fpop, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fdecstp, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fincstp, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_2(ffree_STN, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_1(fmov_ST0_FT0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_2(fmov_FT0_STN, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_2(fmov_ST0_STN, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_2(fmov_STN_ST0, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_2(fxchg_ST0_STN, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_1(fcom_ST0_FT0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fucom_ST0_FT0, TCG_CALL_NO_RWG, void, env)
 DEF_HELPER_1(fcomi_ST0_FT0, void, env)
 DEF_HELPER_1(fucomi_ST0_FT0, void, env)
-DEF_HELPER_1(fadd_ST0_FT0, void, env)
-DEF_HELPER_1(fmul_ST0_FT0, void, env)
-DEF_HELPER_1(fsub_ST0_FT0, void, env)
-DEF_HELPER_1(fsubr_ST0_FT0, void, env)
-DEF_HELPER_1(fdiv_ST0_FT0, void, env)
-DEF_HELPER_1(fdivr_ST0_FT0, void, env)
-DEF_HELPER_2(fadd_STN_ST0, void, env, int)
-DEF_HELPER_2(fmul_STN_ST0, void, env, int)
-DEF_HELPER_2(fsub_STN_ST0, void, env, int)
-DEF_HELPER_2(fsubr_STN_ST0, void, env, int)
-DEF_HELPER_2(fdiv_STN_ST0, void, env, int)
-DEF_HELPER_2(fdivr_STN_ST0, void, env, int)
-DEF_HELPER_1(fchs_ST0, void, env)
-DEF_HELPER_1(fabs_ST0, void, env)
-DEF_HELPER_1(fxam_ST0, void, env)
-DEF_HELPER_1(fld1_ST0, void, env)
-DEF_HELPER_1(fldl2t_ST0, void, env)
-DEF_HELPER_1(fldl2e_ST0, void, env)
-DEF_HELPER_1(fldpi_ST0, void, env)
-DEF_HELPER_1(fldlg2_ST0, void, env)
-DEF_HELPER_1(fldln2_ST0, void, env)
-DEF_HELPER_1(fldz_ST0, void, env)
-DEF_HELPER_1(fldz_FT0, void, env)
-DEF_HELPER_1(fnstsw, i32, env)
-DEF_HELPER_1(fnstcw, i32, env)
-DEF_HELPER_2(fldcw, void, env, i32)
-DEF_HELPER_1(fclex, void, env)
+DEF_HELPER_FLAGS_1(fadd_ST0_FT0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fmul_ST0_FT0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fsub_ST0_FT0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fsubr_ST0_FT0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fdiv_ST0_FT0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fdivr_ST0_FT0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_2(fadd_STN_ST0, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_2(fmul_STN_ST0, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_2(fsub_STN_ST0, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_2(fsubr_STN_ST0, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_2(fdiv_STN_ST0, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_2(fdivr_STN_ST0, TCG_CALL_NO_RWG, void, env, int)
+DEF_HELPER_FLAGS_1(fchs_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fabs_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fxam_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fld1_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fldl2t_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fldl2e_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fldpi_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fldlg2_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fldln2_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fldz_ST0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fldz_FT0, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fnstsw, TCG_CALL_NO_RWG, i32, env)
+DEF_HELPER_FLAGS_1(fnstcw, TCG_CALL_NO_RWG, i32, env)
+DEF_HELPER_FLAGS_2(fldcw, TCG_CALL_NO_RWG, void, env, i32)
+DEF_HELPER_FLAGS_1(fclex, TCG_CALL_NO_RWG, void, env)
 DEF_HELPER_1(fwait, void, env)
-DEF_HELPER_1(fninit, void, env)
+DEF_HELPER_FLAGS_1(fninit, TCG_CALL_NO_RWG, void, env)
 DEF_HELPER_2(fbld_ST0, void, env, tl)
 DEF_HELPER_2(fbst_ST0, void, env, tl)
-DEF_HELPER_1(f2xm1, void, env)
-DEF_HELPER_1(fyl2x, void, env)
-DEF_HELPER_1(fptan, void, env)
-DEF_HELPER_1(fpatan, void, env)
-DEF_HELPER_1(fxtract, void, env)
-DEF_HELPER_1(fprem1, void, env)
-DEF_HELPER_1(fprem, void, env)
-DEF_HELPER_1(fyl2xp1, void, env)
-DEF_HELPER_1(fsqrt, void, env)
-DEF_HELPER_1(fsincos, void, env)
-DEF_HELPER_1(frndint, void, env)
-DEF_HELPER_1(fscale, void, env)
-DEF_HELPER_1(fsin, void, env)
-DEF_HELPER_1(fcos, void, env)
+DEF_HELPER_FLAGS_1(f2xm1, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fyl2x, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fptan, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fpatan, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fxtract, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fprem1, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fprem, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fyl2xp1, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fsqrt, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fsincos, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(frndint, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fscale, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fsin, TCG_CALL_NO_RWG, void, env)
+DEF_HELPER_FLAGS_1(fcos, TCG_CALL_NO_RWG, void, env)
 DEF_HELPER_3(fstenv, void, env, tl, int)
 DEF_HELPER_3(fldenv, void, env, tl, int)
 DEF_HELPER_3(fsave, void, env, tl, int)
@@ -30,20 +30,227 @@ static spinlock_t global_cpu_lock = SPIN_LOCK_UNLOCKED;
 
 void helper_lock(void)
 {
+    if (parallel_cpus) {
+        cpu_atomic_lock();
+        return;
+    }
     spin_lock(&global_cpu_lock);
 }
 
 void helper_unlock(void)
 {
+    if (parallel_cpus) {
+        cpu_atomic_unlock();
+        return;
+    }
     spin_unlock(&global_cpu_lock);
 }
 
+/* Host pointer for an atomic access to guest memory, or NULL if the
+   access has to go through the slow path.  */
+static void *atomic_host_addr(CPUX86State *env, target_ulong a0, int size,
+                              uintptr_t retaddr)
+{
+    return tlb_vaddr_to_host(env, a0, size, cpu_mmu_index(env), retaddr);
+}
+
+/* GETPC() is not available to user mode helpers with TCI, and the
+   return address is only needed to restore state after a TLB fill.  */
+#if !defined(CONFIG_USER_ONLY)
+#define ATOMIC_RETADDR() GETPC()
+#else
+#define ATOMIC_RETADDR() 0
+#endif
+
+/* 'ot' is the log2 of the operand size, as in the translator */
+static target_ulong atomic_ld(CPUX86State *env, target_ulong a0, int ot)
+{
+    switch (ot) {
+    case 0:
+        return cpu_ldub_data(env, a0);
+    case 1:
+        return cpu_lduw_data(env, a0);
+    case 2:
+        return (uint32_t)cpu_ldl_data(env, a0);
+    default:
+        return cpu_ldq_data(env, a0);
+    }
+}
+
+static void atomic_st(CPUX86State *env, target_ulong a0, target_ulong val,
+                      int ot)
+{
+    switch (ot) {
+    case 0:
+        cpu_stb_data(env, a0, val);
+        break;
+    case 1:
+        cpu_stw_data(env, a0, val);
+        break;
+    case 2:
+        cpu_stl_data(env, a0, val);
+        break;
+    default:
+        cpu_stq_data(env, a0, val);
+        break;
+    }
+}
+
+static inline target_ulong atomic_mask(target_ulong val, int ot)
+{
+    switch (ot) {
+    case 0:
+        return (uint8_t)val;
+    case 1:
+        return (uint16_t)val;
+    case 2:
+        return (uint32_t)val;
+    default:
+        return val;
+    }
+}
+
+#define ATOMIC_OP(type, p, aop, fetch, val, ret)                         \
+    do {                                                                \
+        type *ptr_ = (type *)(p);                                       \
+        type val_ = (val);                                              \
+                                                                        \
+        switch (aop) {                                                  \
+        case X86_ATOMIC_ADD:                                            \
+            ret = fetch ? __sync_fetch_and_add(ptr_, val_)              \
+                        : __sync_add_and_fetch(ptr_, val_);             \
+            break;                                                      \
+        case X86_ATOMIC_AND:                                            \
+            ret = fetch ? __sync_fetch_and_and(ptr_, val_)              \
+                        : __sync_and_and_fetch(ptr_, val_);             \
+            break;                                                      \
+        case X86_ATOMIC_OR:                                             \
+            ret = fetch ? __sync_fetch_and_or(ptr_, val_)               \
+                        : __sync_or_and_fetch(ptr_, val_);              \
+            break;                                                      \
+        case X86_ATOMIC_XOR:                                            \
+            ret = fetch ? __sync_fetch_and_xor(ptr_, val_)              \
+                        : __sync_xor_and_fetch(ptr_, val_);             \
+            break;                                                      \
+        default:                                                        \
+            /* a full barrier on x86 hosts, like xchg itself */          \
+            ret = __sync_lock_test_and_set(ptr_, val_);                 \
+            break;                                                      \
+        }                                                               \
+    } while (0)
+
+target_ulong helper_atomic_op(CPUX86State *env, target_ulong a0,
+                              target_ulong val, uint32_t op)
+{
+    int ot = op & 3;
+    int aop = op >> 3;
+    int fetch = (op & X86_ATOMIC_FETCH) != 0;
+    target_ulong old, ret;
+    void *p;
+
+    p = atomic_host_addr(env, a0, 1 << ot, ATOMIC_RETADDR());
+    if (p) {
+        switch (ot) {
+        case 0:
+            ATOMIC_OP(uint8_t, p, aop, fetch, val, ret);
+            break;
+        case 1:
+            ATOMIC_OP(uint16_t, p, aop, fetch, val, ret);
+            break;
+        case 2:
+            ATOMIC_OP(uint32_t, p, aop, fetch, val, ret);
+            break;
+        default:
+            ATOMIC_OP(uint64_t, p, aop, fetch, val, ret);
+            break;
+        }
+        return ret;
+    }
+
+    /* I/O or page crossing access: this only serializes against the
+       other LOCK-prefixed instructions */
+    helper_lock();
+    old = atomic_ld(env, a0, ot);
+    switch (aop) {
+    case X86_ATOMIC_ADD:
+        ret = old + val;
+        break;
+    case X86_ATOMIC_AND:
+        ret = old & val;
+        break;
+    case X86_ATOMIC_OR:
+        ret = old | val;
+        break;
+    case X86_ATOMIC_XOR:
+        ret = old ^ val;
+        break;
+    default:
+        ret = val;
+        break;
+    }
+    atomic_st(env, a0, ret, ot);
+    helper_unlock();
+    if (fetch || aop == X86_ATOMIC_XCHG) {
+        return old;
+    }
+    return atomic_mask(ret, ot);
+}
+
+target_ulong helper_atomic_cmpxchg(CPUX86State *env, target_ulong a0,
+                                   target_ulong cmpv, target_ulong newv,
+                                   uint32_t ot)
+{
+    target_ulong old;
+    void *p;
+
+    p = atomic_host_addr(env, a0, 1 << ot, ATOMIC_RETADDR());
+    if (p) {
+        switch (ot) {
+        case 0:
+            return __sync_val_compare_and_swap((uint8_t *)p, cmpv, newv);
+        case 1:
+            return __sync_val_compare_and_swap((uint16_t *)p, cmpv, newv);
+        case 2:
+            return __sync_val_compare_and_swap((uint32_t *)p, cmpv, newv);
+        default:
+            return __sync_val_compare_and_swap((uint64_t *)p, cmpv, newv);
+        }
+    }
+
+    helper_lock();
+    old = atomic_ld(env, a0, ot);
+    /* always do the store */
+    atomic_st(env, a0, old == atomic_mask(cmpv, ot) ? newv : old, ot);
+    helper_unlock();
+    return old;
+}
+
 void helper_cmpxchg8b(CPUX86State *env, target_ulong a0)
 {
     uint64_t d;
     int eflags;
+    void *p;
 
     eflags = cpu_cc_compute_all(env, CC_OP);
+    if (parallel_cpus &&
+        (p = atomic_host_addr(env, a0, 8, ATOMIC_RETADDR()))) {
+        uint64_t cmpv = ((uint64_t)EDX << 32) | (uint32_t)EAX;
+
+        d = __sync_val_compare_and_swap((uint64_t *)p, cmpv,
+                                        ((uint64_t)ECX << 32) | (uint32_t)EBX);
+        if (d == cmpv) {
+            eflags |= CC_Z;
+        } else {
+            EDX = (uint32_t)(d >> 32);
+            EAX = (uint32_t)d;
+            eflags &= ~CC_Z;
+        }
+        CC_SRC = eflags;
+        return;
+    }
+    if (parallel_cpus) {
+        helper_lock();
+    }
     d = cpu_ldq_data(env, a0);
     if (d == (((uint64_t)EDX << 32) | (uint32_t)EAX)) {
         cpu_stq_data(env, a0, ((uint64_t)ECX << 32) | (uint32_t)EBX);
@@ -55,6 +262,9 @@ void helper_cmpxchg8b(CPUX86State *env, target_ulong a0)
         EAX = (uint32_t)d;
         eflags &= ~CC_Z;
     }
+    if (parallel_cpus) {
+        helper_unlock();
+    }
     CC_SRC = eflags;
 }
 
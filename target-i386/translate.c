@@ -107,6 +107,9 @@ typedef struct DisasContext {
     int cpuid_ext_features;
     int cpuid_ext2_features;
     int cpuid_ext3_features;
+    int atomic; /* LOCK prefix implemented with host atomic operations */
+    int lookahead; /* number of following insns sure to be in the TB */
+    target_ulong pc_start;
 } DisasContext;
 
 static void gen_eob(DisasContext *s);
@@ -815,11 +818,356 @@ static void gen_op_update_neg_cc(void)
     tcg_gen_mov_tl(cpu_cc_dst, cpu_T[0]);
 }
 
-/* compute eflags.C to reg */
-static void gen_compute_eflags_c(TCGv reg)
+#define CC_ALL (CC_O | CC_S | CC_Z | CC_A | CC_P | CC_C)
+
+/* flags read by each condition code */
+static const uint16_t jcc_flags[8] = {
+    [JCC_O] = CC_O,
+    [JCC_B] = CC_C,
+    [JCC_Z] = CC_Z,
+    [JCC_BE] = CC_C | CC_Z,
+    [JCC_S] = CC_S,
+    [JCC_P] = CC_P,
+    [JCC_L] = CC_S | CC_O,
+    [JCC_LE] = CC_S | CC_O | CC_Z,
+};
+
+/* Flags liveness.  Most instructions overwrite the flags computed by the
+   previous one without reading them ("inc; cmp", "adc; sub"...).  When
+   the flags are expensive to compute, live_flags() is used to look at
+   the instructions that follow the current one in the TB and find which
+   flags may still be read.  Only the instructions that can neither fault
+   nor end the TB are followed, so the flags cannot be observed in between
+   by an exception or an interrupt. */
+
+#define LOOKAHEAD_INSNS 4
+
+static int lookahead_ldub(DisasContext *s, target_ulong pc)
 {
-    gen_helper_cc_compute_c(cpu_tmp2_i32, cpu_env, cpu_cc_op);
-    tcg_gen_extu_i32_tl(reg, cpu_tmp2_i32);
+    /* only read from the page of the current instruction, which has
+       already been fetched */
+    if ((pc & TARGET_PAGE_MASK) != ((s->pc - 1) & TARGET_PAGE_MASK)) {
+        return -1;
+    }
+    return cpu_ldub_code(cpu_single_env, pc);
+}
+
+/* Decode the instruction at pc: return its length and the flags it reads
+   and writes, or -1 if it is not one of the simple register-only
+   instructions that are followed */
+static int lookahead_insn(DisasContext *s, target_ulong pc,
+                          int *use, int *def)
+{
+    target_ulong p = pc;
+    int b, modrm, mod, rm, op, count, imm_size, rex_w = 0;
+
+    *use = 0;
+    *def = 0;
+    imm_size = 4;
+    b = lookahead_ldub(s, p++);
+    if (b == 0x66) {
+        imm_size = 2;
+        b = lookahead_ldub(s, p++);
+    }
+    if (CODE64(s) && b >= 0x40 && b <= 0x4f) {
+        rex_w = b & 8;
+        if (rex_w) {
+            imm_size = 4;
+        }
+        b = lookahead_ldub(s, p++);
+    }
+    if (b == 0x0f) {
+        b = lookahead_ldub(s, p++);
+        if (b < 0) {
+            return -1;
+        }
+        b |= 0x100;
+    }
+    if (b < 0) {
+        return -1;
+    }
+
+    /* register operands only, except for lea */
+    modrm = 0;
+    switch(b) {
+    case 0x00 ... 0x03: case 0x08 ... 0x0b: case 0x10 ... 0x13:
+    case 0x18 ... 0x1b: case 0x20 ... 0x23: case 0x28 ... 0x2b:
+    case 0x30 ... 0x33: case 0x38 ... 0x3b:
+    case 0x69: case 0x6b: case 0x80 ... 0x8b:
+    case 0xc0: case 0xc1: case 0xd0: case 0xd1:
+    case 0xf6: case 0xf7: case 0xfe: case 0xff:
+    case 0x140 ... 0x14f: case 0x190 ... 0x19f: case 0x1af:
+    case 0x1b6: case 0x1b7: case 0x1be: case 0x1bf:
+        modrm = lookahead_ldub(s, p++);
+        if (modrm < 0 || (modrm >> 6) != 3) {
+            return -1;
+        }
+        break;
+    case 0x63:
+        if (!CODE64(s)) {
+            return -1;
+        }
+        modrm = lookahead_ldub(s, p++);
+        if (modrm < 0 || (modrm >> 6) != 3) {
+            return -1;
+        }
+        break;
+    case 0x8d:
+        /* lea does not access memory */
+        modrm = lookahead_ldub(s, p++);
+        if (modrm < 0) {
+            return -1;
+        }
+        mod = modrm >> 6;
+        rm = modrm & 7;
+        if (mod == 3) {
+            return -1;
+        }
+        if (rm == 4) {
+            rm = lookahead_ldub(s, p++) & 7;
+        }
+        if (mod == 1) {
+            p += 1;
+        } else if (mod == 2 || (mod == 0 && rm == 5)) {
+            p += 4;
+        }
+        break;
+    }
+    op = (modrm >> 3) & 7;
+
+    switch(b) {
+    case 0x00 ... 0x05: case 0x08 ... 0x0d: case 0x10 ... 0x15:
+    case 0x18 ... 0x1d: case 0x20 ... 0x25: case 0x28 ... 0x2d:
+    case 0x30 ... 0x35: case 0x38 ... 0x3d:
+        /* arith */
+        op = b >> 3;
+        if (op == OP_ADCL || op == OP_SBBL) {
+            *use = CC_C;
+        }
+        *def = CC_ALL;
+        if ((b & 7) == 4) {
+            p += 1;
+        } else if ((b & 7) == 5) {
+            p += imm_size;
+        }
+        break;
+    case 0x40 ... 0x4f:
+        /* inc, dec */
+        if (CODE64(s)) {
+            return -1;
+        }
+        *def = CC_ALL & ~CC_C;
+        break;
+    case 0x80 ... 0x83:
+        if (b == 0x82 && CODE64(s)) {
+            return -1;
+        }
+        if (op == OP_ADCL || op == OP_SBBL) {
+            *use = CC_C;
+        }
+        *def = CC_ALL;
+        p += (b == 0x81) ? imm_size : 1;
+        break;
+    case 0x84: case 0x85:
+        *def = CC_ALL;
+        break;
+    case 0xa8:
+        *def = CC_ALL;
+        p += 1;
+        break;
+    case 0xa9:
+        *def = CC_ALL;
+        p += imm_size;
+        break;
+    case 0x69:
+    case 0x1af:
+        *def = CC_ALL;
+        p += (b == 0x69) ? imm_size : 0;
+        break;
+    case 0x6b:
+        *def = CC_ALL;
+        p += 1;
+        break;
+    case 0xc0: case 0xc1: case 0xd0: case 0xd1:
+        /* shifts and rotates by a constant, which do not change the
+           flags if the count is zero */
+        if (b == 0xc0 || b == 0xc1) {
+            count = lookahead_ldub(s, p++);
+            if (count < 0) {
+                return -1;
+            }
+        } else {
+            count = 1;
+        }
+        if ((count & ((rex_w && (b & 1)) ? 0x3f : 0x1f)) == 0) {
+            break;
+        }
+        switch(op) {
+        case OP_ROL:
+        case OP_ROR:
+            *def = CC_O | CC_C;
+            break;
+        case OP_SHL:
+        case OP_SHR:
+        case OP_SAR:
+            *def = CC_ALL;
+            break;
+        default:
+            return -1;
+        }
+        break;
+    case 0xf6: case 0xf7:
+        switch(op) {
+        case 0: /* test */
+            *def = CC_ALL;
+            p += (b == 0xf6) ? 1 : imm_size;
+            break;
+        case 2: /* not */
+            break;
+        case 3: /* neg */
+            *def = CC_ALL;
+            break;
+        default:
+            return -1;
+        }
+        break;
+    case 0xfe: case 0xff:
+        if (op > 1) {
+            return -1;
+        }
+        *def = CC_ALL & ~CC_C;
+        break;
+    case 0x140 ... 0x14f: /* cmov */
+    case 0x190 ... 0x19f: /* setcc */
+        *use = jcc_flags[(b >> 1) & 7];
+        break;
+    case 0x63: /* movsxd */
+    case 0x88 ... 0x8b: /* mov */
+    case 0x8d: /* lea */
+    case 0x90: /* nop */
+    case 0x1b6: case 0x1b7: case 0x1be: case 0x1bf: /* movzx, movsx */
+        break;
+    case 0xb0 ... 0xb7:
+        p += 1;
+        break;
+    case 0xb8 ... 0xbf:
+        p += rex_w ? 8 : imm_size;
+        break;
+    default:
+        return -1;
+    }
+    return p - pc;
+}
+
+/* return the flags that may be read after the current instruction,
+   which must have been decoded completely */
+static int live_flags(DisasContext *s)
+{
+    target_ulong pc;
+    int i, len, use, def, live, dead;
+
+    pc = s->pc;
+    live = 0;
+    dead = 0;
+    for(i = 0; i < s->lookahead && i < LOOKAHEAD_INSNS; i++) {
+        /* same test as in gen_intermediate_code_internal */
+        if (pc - s->tb->pc >= TARGET_PAGE_SIZE - 32) {
+            break;
+        }
+        len = lookahead_insn(s, pc, &use, &def);
+        if (len < 0 || lookahead_ldub(s, pc + len - 1) < 0) {
+            break;
+        }
+        live |= use & ~dead;
+        dead |= def;
+        if ((live | dead) == CC_ALL) {
+            return live;
+        }
+        pc += len;
+    }
+    return live | (CC_ALL & ~dead);
+}
+
+/* compute eflags.C to reg.  When cc_op is known, this is done inline
+   like in the compute_c_xxx functions of cc_helper_template.h; otherwise
+   cpu_cc_op must be up to date. */
+static void gen_compute_eflags_c(int cc_op, TCGv reg)
+{
+    TCGv t0, t1;
+    int size;
+
+    size = (cc_op - CC_OP_ADDB) & 3;
+    switch(cc_op) {
+    case CC_OP_EFLAGS:
+        tcg_gen_andi_tl(reg, cpu_cc_src, CC_C);
+        break;
+    case CC_OP_MULB ... CC_OP_MULQ:
+        tcg_gen_setcondi_tl(TCG_COND_NE, reg, cpu_cc_src, 0);
+        break;
+    case CC_OP_ADDB ... CC_OP_SBBQ:
+        t0 = tcg_temp_new();
+        t1 = tcg_temp_new();
+        if (cc_op >= CC_OP_SUBB) {
+            /* src1 = dst + src2 */
+            tcg_gen_add_tl(t0, cpu_cc_dst, cpu_cc_src);
+            if (cc_op >= CC_OP_SBBB) {
+                tcg_gen_addi_tl(t0, t0, 1);
+            }
+        } else {
+            tcg_gen_mov_tl(t0, cpu_cc_dst);
+        }
+        tcg_gen_mov_tl(t1, cpu_cc_src);
+        gen_extu(size, t0);
+        gen_extu(size, t1);
+        if ((cc_op >= CC_OP_ADCB && cc_op <= CC_OP_ADCQ) ||
+            cc_op >= CC_OP_SBBB) {
+            /* the carry in was set */
+            tcg_gen_setcond_tl(TCG_COND_LEU, reg, t0, t1);
+        } else {
+            tcg_gen_setcond_tl(TCG_COND_LTU, reg, t0, t1);
+        }
+        tcg_temp_free(t0);
+        tcg_temp_free(t1);
+        break;
+    case CC_OP_LOGICB ... CC_OP_LOGICQ:
+        tcg_gen_movi_tl(reg, 0);
+        break;
+    case CC_OP_INCB ... CC_OP_DECQ:
+        tcg_gen_mov_tl(reg, cpu_cc_src);
+        break;
+    case CC_OP_SHLB ... CC_OP_SHLQ:
+        tcg_gen_shri_tl(reg, cpu_cc_src, (8 << size) - 1);
+        tcg_gen_andi_tl(reg, reg, CC_C);
+        break;
+    case CC_OP_SARB ... CC_OP_SARQ:
+        tcg_gen_andi_tl(reg, cpu_cc_src, CC_C);
+        break;
+    default:
+        gen_helper_cc_compute_c(cpu_tmp2_i32, cpu_env, cpu_cc_op);
+        tcg_gen_extu_i32_tl(reg, cpu_tmp2_i32);
+        break;
+    }
+}
+
+/* reg = (x < y || (cin && x == y)) on the low 8 << ot bits of x and y,
+   which is the carry of an adc whose result is x and second operand y,
+   or the borrow of an sbb whose operands are x and y */
+static void gen_compute_carry_cin(int ot, TCGv reg, TCGv x, TCGv y, TCGv cin)
+{
+    TCGv t0, t1;
+
+    t0 = tcg_temp_new();
+    t1 = tcg_temp_new();
+    tcg_gen_mov_tl(t0, x);
+    tcg_gen_mov_tl(t1, y);
+    gen_extu(ot, t0);
+    gen_extu(ot, t1);
+    tcg_gen_setcond_tl(TCG_COND_EQ, reg, t0, t1);
+    tcg_gen_and_tl(reg, reg, cin);
+    tcg_gen_setcond_tl(TCG_COND_LTU, t0, t0, t1);
+    tcg_gen_or_tl(reg, reg, t0);
+    tcg_temp_free(t0);
+    tcg_temp_free(t1);
 }
 
 /* compute all eflags to cc_src */
@@ -829,10 +1177,10 @@ static void gen_compute_eflags(TCGv reg)
     tcg_gen_extu_i32_tl(reg, cpu_tmp2_i32);
 }
 
-static inline void gen_setcc_slow_T0(DisasContext *s, int jcc_op)
+static inline void gen_setcc_slow_T0(DisasContext *s, int cc_op, int jcc_op)
 {
-    if (s->cc_op != CC_OP_DYNAMIC)
-        gen_op_set_cc_op(s->cc_op);
+    if (cc_op != CC_OP_DYNAMIC)
+        gen_op_set_cc_op(cc_op);
     switch(jcc_op) {
     case JCC_O:
         gen_compute_eflags(cpu_T[0]);
@@ -840,7 +1188,7 @@ static inline void gen_setcc_slow_T0(DisasContext *s, int jcc_op)
         tcg_gen_andi_tl(cpu_T[0], cpu_T[0], 1);
         break;
     case JCC_B:
-        gen_compute_eflags_c(cpu_T[0]);
+        gen_compute_eflags_c(cc_op, cpu_T[0]);
         break;
     case JCC_Z:
         gen_compute_eflags(cpu_T[0]);
@@ -899,17 +1247,24 @@ static int is_fast_jcc_case(DisasContext *s, int b)
             goto slow_jcc;
         break;
 
+        /* and the test/jcc case */
+    case CC_OP_LOGICB:
+    case CC_OP_LOGICW:
+    case CC_OP_LOGICL:
+    case CC_OP_LOGICQ:
+        if (jcc_op == JCC_P)
+            goto slow_jcc;
+        break;
+
+    case CC_OP_EFLAGS:
+        break;
+
         /* some jumps are easy to compute */
     case CC_OP_ADDB:
     case CC_OP_ADDW:
     case CC_OP_ADDL:
     case CC_OP_ADDQ:
 
-    case CC_OP_LOGICB:
-    case CC_OP_LOGICW:
-    case CC_OP_LOGICL:
-    case CC_OP_LOGICQ:
-
     case CC_OP_INCB:
     case CC_OP_INCW:
     case CC_OP_INCL:
@@ -1071,7 +1426,74 @@ static inline void gen_jcc1(DisasContext *s, int cc_op, int b, int l1)
             goto slow_jcc;
         }
         break;
-        
+
+        /* O and C are clear after a logical operation */
+    case CC_OP_LOGICB:
+    case CC_OP_LOGICW:
+    case CC_OP_LOGICL:
+    case CC_OP_LOGICQ:
+        size = cc_op - CC_OP_LOGICB;
+        switch(jcc_op) {
+        case JCC_Z:
+        case JCC_BE:
+            goto fast_jcc_z;
+        case JCC_S:
+        case JCC_L:
+            goto fast_jcc_s;
+        case JCC_LE:
+            switch(size) {
+            case 0:
+                tcg_gen_ext8s_tl(cpu_tmp0, cpu_cc_dst);
+                t0 = cpu_tmp0;
+                break;
+            case 1:
+                tcg_gen_ext16s_tl(cpu_tmp0, cpu_cc_dst);
+                t0 = cpu_tmp0;
+                break;
+#ifdef TARGET_X86_64
+            case 2:
+                tcg_gen_ext32s_tl(cpu_tmp0, cpu_cc_dst);
+                t0 = cpu_tmp0;
+                break;
+#endif
+            default:
+                t0 = cpu_cc_dst;
+                break;
+            }
+            tcg_gen_brcondi_tl(inv ? TCG_COND_GT : TCG_COND_LE, t0, 0, l1);
+            break;
+        case JCC_O:
+        case JCC_B:
+            if (inv) {
+                tcg_gen_br(l1);
+            }
+            break;
+        default:
+            goto slow_jcc;
+        }
+        break;
+
+        /* the flags are in cc_src */
+    case CC_OP_EFLAGS:
+        switch(jcc_op) {
+        case JCC_L:
+        case JCC_LE:
+            /* S != O, at the position of CC_S */
+            tcg_gen_shri_tl(cpu_tmp0, cpu_cc_src, 4);
+            tcg_gen_xor_tl(cpu_tmp0, cpu_tmp0, cpu_cc_src);
+            tcg_gen_andi_tl(cpu_tmp0, cpu_tmp0, CC_S);
+            if (jcc_op == JCC_LE) {
+                tcg_gen_andi_tl(cpu_tmp4, cpu_cc_src, CC_Z);
+                tcg_gen_or_tl(cpu_tmp0, cpu_tmp0, cpu_tmp4);
+            }
+            break;
+        default:
+            tcg_gen_andi_tl(cpu_tmp0, cpu_cc_src, jcc_flags[jcc_op]);
+            break;
+        }
+        tcg_gen_brcondi_tl(inv ? TCG_COND_EQ : TCG_COND_NE, cpu_tmp0, 0, l1);
+        break;
+
         /* some jumps are easy to compute */
     case CC_OP_ADDB:
     case CC_OP_ADDW:
@@ -1088,11 +1510,6 @@ static inline void gen_jcc1(DisasContext *s, int cc_op, int b, int l1)
     case CC_OP_SBBL:
     case CC_OP_SBBQ:
         
-    case CC_OP_LOGICB:
-    case CC_OP_LOGICW:
-    case CC_OP_LOGICL:
-    case CC_OP_LOGICQ:
-        
     case CC_OP_INCB:
     case CC_OP_INCW:
     case CC_OP_INCL:
@@ -1125,7 +1542,7 @@ static inline void gen_jcc1(DisasContext *s, int cc_op, int b, int l1)
         break;
     default:
     slow_jcc:
-        gen_setcc_slow_T0(s, jcc_op);
+        gen_setcc_slow_T0(s, cc_op, jcc_op);
         tcg_gen_brcondi_tl(inv ? TCG_COND_EQ : TCG_COND_NE, 
                            cpu_T[0], 0, l1);
         break;
@@ -1326,91 +1743,165 @@ static void gen_helper_fp_arith_STN_ST0(int op, int opreg)
     }
 }
 
+/* T0 = atomic 'aop' of 'val' on the memory operand at A0 (see
+   helper_atomic_op) */
+static void gen_atomic_op(DisasContext *s, int aop, int ot, TCGv val)
+{
+    TCGv eip;
+    TCGv_i32 op;
+
+    /* the slow path of the helper cannot restore the CPU state */
+    if (s->cc_op != CC_OP_DYNAMIC) {
+        gen_op_set_cc_op(s->cc_op);
+    }
+    eip = tcg_const_tl(s->pc_start - s->cs_base);
+    tcg_gen_st_tl(eip, cpu_env, offsetof(CPUX86State, eip));
+    tcg_temp_free(eip);
+    op = tcg_const_i32(aop | ot);
+    gen_helper_atomic_op(cpu_T[0], cpu_env, cpu_A0, val, op);
+    tcg_temp_free_i32(op);
+}
+
 /* if d == OR_TMP0, it means memory operand (address in A0) */
 static void gen_op(DisasContext *s1, int op, int ot, int d)
 {
+    int atomic = d == OR_TMP0 && s1->atomic;
+    int live;
+
     if (d != OR_TMP0) {
         gen_op_mov_TN_reg(ot, 0, d);
-    } else {
+    } else if (!atomic) {
         gen_op_ld_T0_A0(ot + s1->mem_index);
     }
     switch(op) {
     case OP_ADCL:
         if (s1->cc_op != CC_OP_DYNAMIC)
             gen_op_set_cc_op(s1->cc_op);
-        gen_compute_eflags_c(cpu_tmp4);
-        tcg_gen_add_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
-        tcg_gen_add_tl(cpu_T[0], cpu_T[0], cpu_tmp4);
+        gen_compute_eflags_c(s1->cc_op, cpu_tmp4);
+        if (atomic) {
+            tcg_gen_add_tl(cpu_tmp5, cpu_T[1], cpu_tmp4);
+            gen_atomic_op(s1, X86_ATOMIC_ADD << 3, ot, cpu_tmp5);
+        } else {
+            tcg_gen_add_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+            tcg_gen_add_tl(cpu_T[0], cpu_T[0], cpu_tmp4);
+        }
         if (d != OR_TMP0)
             gen_op_mov_reg_T0(ot, d);
-        else
+        else if (!atomic)
             gen_op_st_T0_A0(ot + s1->mem_index);
-        tcg_gen_mov_tl(cpu_cc_src, cpu_T[1]);
-        tcg_gen_mov_tl(cpu_cc_dst, cpu_T[0]);
-        tcg_gen_trunc_tl_i32(cpu_tmp2_i32, cpu_tmp4);
-        tcg_gen_shli_i32(cpu_tmp2_i32, cpu_tmp2_i32, 2);
-        tcg_gen_addi_i32(cpu_cc_op, cpu_tmp2_i32, CC_OP_ADDB + ot);
-        s1->cc_op = CC_OP_DYNAMIC;
+        live = live_flags(s1);
+        if (live & ~CC_C) {
+            tcg_gen_mov_tl(cpu_cc_src, cpu_T[1]);
+            tcg_gen_mov_tl(cpu_cc_dst, cpu_T[0]);
+            tcg_gen_trunc_tl_i32(cpu_tmp2_i32, cpu_tmp4);
+            tcg_gen_shli_i32(cpu_tmp2_i32, cpu_tmp2_i32, 2);
+            tcg_gen_addi_i32(cpu_cc_op, cpu_tmp2_i32, CC_OP_ADDB + ot);
+            s1->cc_op = CC_OP_DYNAMIC;
+        } else if (live) {
+            /* only the carry is used, typically by the next adc */
+            gen_compute_carry_cin(ot, cpu_cc_src, cpu_T[0], cpu_T[1],
+                                  cpu_tmp4);
+            tcg_gen_discard_tl(cpu_cc_dst);
+            s1->cc_op = CC_OP_EFLAGS;
+        }
         break;
     case OP_SBBL:
         if (s1->cc_op != CC_OP_DYNAMIC)
             gen_op_set_cc_op(s1->cc_op);
-        gen_compute_eflags_c(cpu_tmp4);
-        tcg_gen_sub_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
-        tcg_gen_sub_tl(cpu_T[0], cpu_T[0], cpu_tmp4);
+        gen_compute_eflags_c(s1->cc_op, cpu_tmp4);
+        if (atomic) {
+            tcg_gen_add_tl(cpu_tmp5, cpu_T[1], cpu_tmp4);
+            tcg_gen_neg_tl(cpu_tmp5, cpu_tmp5);
+            gen_atomic_op(s1, X86_ATOMIC_ADD << 3, ot, cpu_tmp5);
+        } else {
+            tcg_gen_sub_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+            tcg_gen_sub_tl(cpu_T[0], cpu_T[0], cpu_tmp4);
+        }
         if (d != OR_TMP0)
             gen_op_mov_reg_T0(ot, d);
-        else
+        else if (!atomic)
             gen_op_st_T0_A0(ot + s1->mem_index);
-        tcg_gen_mov_tl(cpu_cc_src, cpu_T[1]);
-        tcg_gen_mov_tl(cpu_cc_dst, cpu_T[0]);
-        tcg_gen_trunc_tl_i32(cpu_tmp2_i32, cpu_tmp4);
-        tcg_gen_shli_i32(cpu_tmp2_i32, cpu_tmp2_i32, 2);
-        tcg_gen_addi_i32(cpu_cc_op, cpu_tmp2_i32, CC_OP_SUBB + ot);
-        s1->cc_op = CC_OP_DYNAMIC;
+        live = live_flags(s1);
+        if (live & ~CC_C) {
+            tcg_gen_mov_tl(cpu_cc_src, cpu_T[1]);
+            tcg_gen_mov_tl(cpu_cc_dst, cpu_T[0]);
+            tcg_gen_trunc_tl_i32(cpu_tmp2_i32, cpu_tmp4);
+            tcg_gen_shli_i32(cpu_tmp2_i32, cpu_tmp2_i32, 2);
+            tcg_gen_addi_i32(cpu_cc_op, cpu_tmp2_i32, CC_OP_SUBB + ot);
+            s1->cc_op = CC_OP_DYNAMIC;
+        } else if (live) {
+            /* the first operand is res + src + cin */
+            tcg_gen_add_tl(cpu_tmp0, cpu_T[0], cpu_T[1]);
+            tcg_gen_add_tl(cpu_tmp0, cpu_tmp0, cpu_tmp4);
+            gen_compute_carry_cin(ot, cpu_cc_src, cpu_tmp0, cpu_T[1],
+                                  cpu_tmp4);
+            tcg_gen_discard_tl(cpu_cc_dst);
+            s1->cc_op = CC_OP_EFLAGS;
+        }
         break;
     case OP_ADDL:
-        gen_op_addl_T0_T1();
+        if (atomic) {
+            gen_atomic_op(s1, X86_ATOMIC_ADD << 3, ot, cpu_T[1]);
+        } else {
+            gen_op_addl_T0_T1();
+        }
         if (d != OR_TMP0)
             gen_op_mov_reg_T0(ot, d);
-        else
+        else if (!atomic)
             gen_op_st_T0_A0(ot + s1->mem_index);
         gen_op_update2_cc();
         s1->cc_op = CC_OP_ADDB + ot;
         break;
     case OP_SUBL:
-        tcg_gen_sub_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+        if (atomic) {
+            tcg_gen_neg_tl(cpu_tmp5, cpu_T[1]);
+            gen_atomic_op(s1, X86_ATOMIC_ADD << 3, ot, cpu_tmp5);
+        } else {
+            tcg_gen_sub_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+        }
         if (d != OR_TMP0)
             gen_op_mov_reg_T0(ot, d);
-        else
+        else if (!atomic)
             gen_op_st_T0_A0(ot + s1->mem_index);
         gen_op_update2_cc();
         s1->cc_op = CC_OP_SUBB + ot;
         break;
     default:
     case OP_ANDL:
-        tcg_gen_and_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+        if (atomic) {
+            gen_atomic_op(s1, X86_ATOMIC_AND << 3, ot, cpu_T[1]);
+        } else {
+            tcg_gen_and_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+        }
         if (d != OR_TMP0)
             gen_op_mov_reg_T0(ot, d);
-        else
+        else if (!atomic)
             gen_op_st_T0_A0(ot + s1->mem_index);
         gen_op_update1_cc();
         s1->cc_op = CC_OP_LOGICB + ot;
         break;
     case OP_ORL:
-        tcg_gen_or_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+        if (atomic) {
+            gen_atomic_op(s1, X86_ATOMIC_OR << 3, ot, cpu_T[1]);
+        } else {
+            tcg_gen_or_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+        }
         if (d != OR_TMP0)
             gen_op_mov_reg_T0(ot, d);
-        else
+        else if (!atomic)
             gen_op_st_T0_A0(ot + s1->mem_index);
         gen_op_update1_cc();
         s1->cc_op = CC_OP_LOGICB + ot;
         break;
     case OP_XORL:
-        tcg_gen_xor_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+        if (atomic) {
+            gen_atomic_op(s1, X86_ATOMIC_XOR << 3, ot, cpu_T[1]);
+        } else {
+            tcg_gen_xor_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+        }
         if (d != OR_TMP0)
             gen_op_mov_reg_T0(ot, d);
-        else
+        else if (!atomic)
             gen_op_st_T0_A0(ot + s1->mem_index);
         gen_op_update1_cc();
         s1->cc_op = CC_OP_LOGICB + ot;
@@ -1425,13 +1916,20 @@ static void gen_op(DisasContext *s1, int op, int ot, int d)
 /* if d == OR_TMP0, it means memory operand (address in A0) */
 static void gen_inc(DisasContext *s1, int ot, int d, int c)
 {
+    int atomic = d == OR_TMP0 && s1->atomic;
+    int cc_op = s1->cc_op;
+
     if (d != OR_TMP0)
         gen_op_mov_TN_reg(ot, 0, d);
-    else
+    else if (!atomic)
         gen_op_ld_T0_A0(ot + s1->mem_index);
     if (s1->cc_op != CC_OP_DYNAMIC)
         gen_op_set_cc_op(s1->cc_op);
-    if (c > 0) {
+    if (atomic) {
+        tcg_gen_movi_tl(cpu_tmp5, c > 0 ? 1 : -1);
+        gen_atomic_op(s1, X86_ATOMIC_ADD << 3, ot, cpu_tmp5);
+        s1->cc_op = c > 0 ? CC_OP_INCB + ot : CC_OP_DECB + ot;
+    } else if (c > 0) {
         tcg_gen_addi_tl(cpu_T[0], cpu_T[0], 1);
         s1->cc_op = CC_OP_INCB + ot;
     } else {
@@ -1440,9 +1938,14 @@ static void gen_inc(DisasContext *s1, int ot, int d, int c)
     }
     if (d != OR_TMP0)
         gen_op_mov_reg_T0(ot, d);
-    else
+    else if (!atomic)
         gen_op_st_T0_A0(ot + s1->mem_index);
-    gen_compute_eflags_c(cpu_cc_src);
+    /* the carry is preserved, but it is often overwritten right away */
+    if (live_flags(s1) & CC_C) {
+        gen_compute_eflags_c(cc_op, cpu_cc_src);
+    } else {
+        tcg_gen_movi_tl(cpu_cc_src, 0);
+    }
     tcg_gen_mov_tl(cpu_cc_dst, cpu_T[0]);
 }
 
@@ -1662,8 +2165,12 @@ static void gen_rot_rm_T1(DisasContext *s, int ot, int op1,
     label2 = gen_new_label();
     tcg_gen_brcondi_tl(TCG_COND_EQ, t1, 0, label2);
 
-    gen_compute_eflags(cpu_cc_src);
-    tcg_gen_andi_tl(cpu_cc_src, cpu_cc_src, ~(CC_O | CC_C));
+    if (live_flags(s) & ~(CC_O | CC_C)) {
+        gen_compute_eflags(cpu_cc_src);
+        tcg_gen_andi_tl(cpu_cc_src, cpu_cc_src, ~(CC_O | CC_C));
+    } else {
+        tcg_gen_movi_tl(cpu_cc_src, 0);
+    }
     tcg_gen_xor_tl(cpu_tmp0, t2, t0);
     tcg_gen_lshift(cpu_tmp0, cpu_tmp0, 11 - (data_bits - 1));
     tcg_gen_andi_tl(cpu_tmp0, cpu_tmp0, CC_O);
@@ -1737,12 +2244,16 @@ static void gen_rot_rm_im(DisasContext *s, int ot, int op1, int op2,
     }
 
     if (op2 != 0) {
-        /* update eflags */
-        if (s->cc_op != CC_OP_DYNAMIC)
-            gen_op_set_cc_op(s->cc_op);
-
-        gen_compute_eflags(cpu_cc_src);
-        tcg_gen_andi_tl(cpu_cc_src, cpu_cc_src, ~(CC_O | CC_C));
+        /* update eflags.  The other flags are often dead, as in
+           "rol; dec" */
+        if (live_flags(s) & ~(CC_O | CC_C)) {
+            if (s->cc_op != CC_OP_DYNAMIC)
+                gen_op_set_cc_op(s->cc_op);
+            gen_compute_eflags(cpu_cc_src);
+            tcg_gen_andi_tl(cpu_cc_src, cpu_cc_src, ~(CC_O | CC_C));
+        } else {
+            tcg_gen_movi_tl(cpu_cc_src, 0);
+        }
         tcg_gen_xor_tl(cpu_tmp0, t1, t0);
         tcg_gen_lshift(cpu_tmp0, cpu_tmp0, 11 - (data_bits - 1));
         tcg_gen_andi_tl(cpu_tmp0, cpu_tmp0, CC_O);
@@ -2410,7 +2921,7 @@ static void gen_setcc(DisasContext *s, int b)
            worth to */
         inv = b & 1;
         jcc_op = (b >> 1) & 7;
-        gen_setcc_slow_T0(s, jcc_op);
+        gen_setcc_slow_T0(s, s->cc_op, jcc_op);
         if (inv) {
             tcg_gen_xori_tl(cpu_T[0], cpu_T[0], 1);
         }
@@ -2748,7 +3259,9 @@ static void gen_debug(DisasContext *s, target_ulong cur_eip)
 
 /* generate a generic end of block. Trace exception is also generated
    if needed */
-static void gen_eob(DisasContext *s)
+/* end of block.  If jr, the next TB is looked up from translated code
+   instead of returning to cpu_exec() */
+static void gen_eob_worker(DisasContext *s, bool jr)
 {
     if (s->cc_op != CC_OP_DYNAMIC)
         gen_op_set_cc_op(s->cc_op);
@@ -2762,12 +3275,25 @@ static void gen_eob(DisasContext *s)
         gen_helper_debug(cpu_env);
     } else if (s->tf) {
         gen_helper_single_step(cpu_env);
+    } else if (jr) {
+        gen_lookup_and_goto_ptr(cpu_env);
     } else {
         tcg_gen_exit_tb(0);
     }
     s->is_jmp = DISAS_TB_JUMP;
 }
 
+static void gen_eob(DisasContext *s)
+{
+    gen_eob_worker(s, false);
+}
+
+/* indirect jump to the eip stored by gen_op_jmp_T0() */
+static void gen_jr(DisasContext *s)
+{
+    gen_eob_worker(s, true);
+}
+
 /* generate a jump to eip. No segment change must happen before as a
    direct call to the next block may occur */
 static void gen_jmp_tb(DisasContext *s, target_ulong eip, int tb_num)
@@ -2787,6 +3313,20 @@ static void gen_jmp(DisasContext *s, target_ulong eip)
     gen_jmp_tb(s, eip, 0);
 }
 
+/* direct jmp or call: a superblock goes on translating at the target
+   when it is further ahead on the same page */
+static void gen_jmp_direct(DisasContext *s, target_ulong eip)
+{
+    target_ulong pc = s->cs_base + eip;
+
+    if ((s->tb->cflags & CF_SUPERBLOCK) && s->jmp_opt && pc >= s->pc &&
+        (pc & TARGET_PAGE_MASK) == (s->tb->pc & TARGET_PAGE_MASK)) {
+        s->pc = pc;
+        return;
+    }
+    gen_jmp(s, eip);
+}
+
 static inline void gen_ldq_env_A0(int idx, int offset)
 {
     int mem_index = (idx >> 2) - 1;
@@ -3166,6 +3706,45 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
     [0x63] = SSE42_OP(pcmpistri),
 };
 
+/* MMX/SSE2 integer ops that map onto TCG vector ops.  Return nonzero if
+   'b' was translated.  */
+static int gen_sse_vec(int b, int oprsz, int op1_offset, int op2_offset)
+{
+    switch (b) {
+    case 0xfc ... 0xfe: /* padd[bwd] */
+        tcg_gen_vec_add(oprsz, b - 0xfc, cpu_env, op1_offset, op1_offset,
+                        op2_offset);
+        break;
+    case 0xd4: /* paddq */
+        tcg_gen_vec_add(oprsz, 3, cpu_env, op1_offset, op1_offset,
+                        op2_offset);
+        break;
+    case 0xf8 ... 0xfb: /* psub[bwdq] */
+        tcg_gen_vec_sub(oprsz, b - 0xf8, cpu_env, op1_offset, op1_offset,
+                        op2_offset);
+        break;
+    case 0xdb: /* pand */
+        tcg_gen_vec_and(oprsz, cpu_env, op1_offset, op1_offset, op2_offset);
+        break;
+    case 0xdf: /* pandn */
+        tcg_gen_vec_andc(oprsz, cpu_env, op1_offset, op2_offset, op1_offset);
+        break;
+    case 0xeb: /* por */
+        tcg_gen_vec_or(oprsz, cpu_env, op1_offset, op1_offset, op2_offset);
+        break;
+    case 0xef: /* pxor */
+        tcg_gen_vec_xor(oprsz, cpu_env, op1_offset, op1_offset, op2_offset);
+        break;
+    case 0x74 ... 0x76: /* pcmpeq[bwd] */
+        tcg_gen_vec_cmpeq(oprsz, b - 0x74, cpu_env, op1_offset, op1_offset,
+                          op2_offset);
+        break;
+    default:
+        return 0;
+    }
+    return 1;
+}
+
 static void gen_sse(DisasContext *s, int b, target_ulong pc_start, int rex_r)
 {
     int b1, op1_offset, op2_offset, is_xmm, val, ot;
@@ -4141,6 +4720,16 @@ static void gen_sse(DisasContext *s, int b, target_ulong pc_start, int rex_r)
         case 0x70: /* pshufx insn */
         case 0xc6: /* pshufx insn */
             val = cpu_ldub_code(cpu_single_env, s->pc++);
+            if (b == 0x70 && b1 == 1) {
+                /* pshufd */
+#ifdef HOST_WORDS_BIGENDIAN
+                /* XMM_L(n) is at index 3 - n in memory */
+                val = ((3 - (val >> 6)) | (3 - ((val >> 4) & 3)) << 2 |
+                       (3 - ((val >> 2) & 3)) << 4 | (3 - (val & 3)) << 6);
+#endif
+                tcg_gen_vec_shufd(cpu_env, op1_offset, op2_offset, val);
+                break;
+            }
             tcg_gen_addi_ptr(cpu_ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(cpu_ptr1, cpu_env, op2_offset);
             /* XXX: introduce a new table? */
@@ -4181,6 +4770,9 @@ static void gen_sse(DisasContext *s, int b, target_ulong pc_start, int rex_r)
             sse_fn_eppt(cpu_env, cpu_ptr0, cpu_ptr1, cpu_A0);
             break;
         default:
+            if (gen_sse_vec(b, is_xmm ? 16 : 8, op1_offset, op2_offset)) {
+                break;
+            }
             tcg_gen_addi_ptr(cpu_ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(cpu_ptr1, cpu_env, op2_offset);
             sse_fn_epp(cpu_env, cpu_ptr0, cpu_ptr1);
@@ -4192,6 +4784,53 @@ static void gen_sse(DisasContext *s, int b, target_ulong pc_start, int rex_r)
     }
 }
 
+/* With parallel vCPUs, tell whether the LOCK-prefixed instruction starting
+   with opcode byte 'b' (modrm byte or second opcode byte at s->pc) is
+   implemented with host atomic operations.  The others still take the
+   global lock in helper_lock().  */
+static int lock_is_atomic(DisasContext *s, int b, int dflag)
+{
+    int modrm;
+
+    if (!parallel_cpus) {
+        return 0;
+    }
+    if (b == 0x0f) {
+        b = cpu_ldub_code(cpu_single_env, s->pc) | 0x100;
+        modrm = cpu_ldub_code(cpu_single_env, s->pc + 1);
+    } else {
+        modrm = cpu_ldub_code(cpu_single_env, s->pc);
+    }
+    if (((modrm >> 6) & 3) == 3) {
+        return 0;
+    }
+    switch (b) {
+    case 0x00 ... 0x31: /* add/or/adc/sbb/and/sub/xor Ev, Gv */
+        return (b & 7) < 2;
+    case 0x80 ... 0x83: /* GRP1, except cmp */
+        return ((modrm >> 3) & 7) != 7;
+    case 0x86: /* xchg */
+    case 0x87:
+    case 0x1b0: /* cmpxchg */
+    case 0x1b1:
+    case 0x1c0: /* xadd */
+    case 0x1c1:
+    case 0x1ab: /* bts */
+    case 0x1b3: /* btr */
+    case 0x1bb: /* btc */
+        return 1;
+    case 0xfe: /* inc/dec */
+    case 0xff:
+        return ((modrm >> 3) & 7) < 2;
+    case 0x1ba: /* bts/btr/btc Ev, Ib */
+        return ((modrm >> 3) & 7) >= 5;
+    case 0x1c7: /* cmpxchg8b, but not cmpxchg16b */
+        return ((modrm >> 3) & 7) == 1 && dflag != 2;
+    default:
+        return 0;
+    }
+}
+
 /* convert one instruction. s->is_jmp is set if the translation must
    be stopped. Return the next pc value */
 static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
@@ -4322,9 +4961,11 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
     s->prefix = prefixes;
     s->aflag = aflag;
     s->dflag = dflag;
+    s->pc_start = pc_start;
+    s->atomic = (prefixes & PREFIX_LOCK) && lock_is_atomic(s, b, dflag);
 
     /* lock generation */
-    if (prefixes & PREFIX_LOCK)
+    if ((prefixes & PREFIX_LOCK) && !s->atomic)
         gen_helper_lock();
 
     /* now check op code */
@@ -4747,7 +5388,7 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
             gen_movtl_T1_im(next_eip);
             gen_push_T1(s);
             gen_op_jmp_T0();
-            gen_eob(s);
+            gen_jr(s);
             break;
         case 3: /* lcall Ev */
             gen_op_ld_T1_A0(ot + s->mem_index);
@@ -4774,7 +5415,7 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
             if (s->dflag == 0)
                 gen_op_andl_T0_ffff();
             gen_op_jmp_T0();
-            gen_eob(s);
+            gen_jr(s);
             break;
         case 5: /* ljmp Ev */
             gen_op_ld_T1_A0(ot + s->mem_index);
@@ -4949,6 +5590,15 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
             gen_op_addl_T0_T1();
             gen_op_mov_reg_T1(ot, reg);
             gen_op_mov_reg_T0(ot, rm);
+        } else if (s->atomic) {
+            gen_lea_modrm(s, modrm, &reg_addr, &offset_addr);
+            gen_op_mov_TN_reg(ot, 1, reg);
+            gen_atomic_op(s, X86_ATOMIC_ADD << 3 | X86_ATOMIC_FETCH, ot,
+                          cpu_T[1]);
+            /* T0 = old value, T1 = addend: swap them for the flags */
+            gen_op_mov_reg_T0(ot, reg);
+            tcg_gen_add_tl(cpu_T[0], cpu_T[0], cpu_T[1]);
+            tcg_gen_sub_tl(cpu_T[1], cpu_T[0], cpu_T[1]);
         } else {
             gen_lea_modrm(s, modrm, &reg_addr, &offset_addr);
             gen_op_mov_TN_reg(ot, 0, reg);
@@ -4984,7 +5634,19 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
             } else {
                 gen_lea_modrm(s, modrm, &reg_addr, &offset_addr);
                 tcg_gen_mov_tl(a0, cpu_A0);
-                gen_op_ld_v(ot + s->mem_index, t0, a0);
+                if (s->atomic) {
+                    TCGv_i32 tot = tcg_const_i32(ot);
+
+                    if (s->cc_op != CC_OP_DYNAMIC) {
+                        gen_op_set_cc_op(s->cc_op);
+                    }
+                    gen_jmp_im(pc_start - s->cs_base);
+                    gen_helper_atomic_cmpxchg(t0, cpu_env, a0,
+                                              cpu_regs[R_EAX], t1, tot);
+                    tcg_temp_free_i32(tot);
+                } else {
+                    gen_op_ld_v(ot + s->mem_index, t0, a0);
+                }
                 rm = 0; /* avoid warning */
             }
             label1 = gen_new_label();
@@ -4997,6 +5659,10 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
                 tcg_gen_br(label2);
                 gen_set_label(label1);
                 gen_op_mov_reg_v(ot, rm, t1);
+            } else if (s->atomic) {
+                /* the helper did the store */
+                gen_op_mov_reg_v(ot, R_EAX, t0);
+                gen_set_label(label1);
             } else {
                 /* perform no-op store cycle like physical cpu; must be
                    before changing accumulator to ensure idempotency if
@@ -5435,6 +6101,11 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
         } else {
             gen_lea_modrm(s, modrm, &reg_addr, &offset_addr);
             gen_op_mov_TN_reg(ot, 0, reg);
+            if (parallel_cpus) {
+                gen_atomic_op(s, X86_ATOMIC_XCHG << 3, ot, cpu_T[0]);
+                gen_op_mov_reg_T0(ot, reg);
+                break;
+            }
             /* for xchg, lock is implicit */
             if (!(prefixes & PREFIX_LOCK))
                 gen_helper_lock();
@@ -6302,7 +6973,7 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
         if (s->dflag == 0)
             gen_op_andl_T0_ffff();
         gen_op_jmp_T0();
-        gen_eob(s);
+        gen_jr(s);
         break;
     case 0xc3: /* ret */
         gen_pop_T0(s);
@@ -6310,7 +6981,7 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
         if (s->dflag == 0)
             gen_op_andl_T0_ffff();
         gen_op_jmp_T0();
-        gen_eob(s);
+        gen_jr(s);
         break;
     case 0xca: /* lret im */
         val = cpu_ldsw_code(cpu_single_env, s->pc);
@@ -6380,7 +7051,7 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
                 tval &= 0xffffffff;
             gen_movtl_T0_im(next_eip);
             gen_push_T0(s);
-            gen_jmp(s, tval);
+            gen_jmp_direct(s, tval);
         }
         break;
     case 0x9a: /* lcall im */
@@ -6407,7 +7078,7 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
             tval &= 0xffff;
         else if(!CODE64(s))
             tval &= 0xffffffff;
-        gen_jmp(s, tval);
+        gen_jmp_direct(s, tval);
         break;
     case 0xea: /* ljmp im */
         {
@@ -6428,7 +7099,7 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
         tval += s->pc - s->cs_base;
         if (s->dflag == 0)
             tval &= 0xffff;
-        gen_jmp(s, tval);
+        gen_jmp_direct(s, tval);
         break;
     case 0x70 ... 0x7f: /* jcc Jb */
         tval = (int8_t)insn_get(s, OT_BYTE);
@@ -6623,7 +7294,9 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
         if (mod != 3) {
             s->rip_offset = 1;
             gen_lea_modrm(s, modrm, &reg_addr, &offset_addr);
-            gen_op_ld_T0_A0(ot + s->mem_index);
+            if (!s->atomic) {
+                gen_op_ld_T0_A0(ot + s->mem_index);
+            }
         } else {
             gen_op_mov_TN_reg(ot, 0, rm);
         }
@@ -6659,12 +7332,31 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
             tcg_gen_sari_tl(cpu_tmp0, cpu_T[1], 3 + ot);
             tcg_gen_shli_tl(cpu_tmp0, cpu_tmp0, ot);
             tcg_gen_add_tl(cpu_A0, cpu_A0, cpu_tmp0);
-            gen_op_ld_T0_A0(ot + s->mem_index);
+            if (!s->atomic) {
+                gen_op_ld_T0_A0(ot + s->mem_index);
+            }
         } else {
             gen_op_mov_TN_reg(ot, 0, rm);
         }
     bt_op:
         tcg_gen_andi_tl(cpu_T[1], cpu_T[1], (1 << (3 + ot)) - 1);
+        if (s->atomic && mod != 3) {
+            static const int bt_atomic_op[4] = {
+                0, X86_ATOMIC_OR, X86_ATOMIC_AND, X86_ATOMIC_XOR
+            };
+
+            tcg_gen_movi_tl(cpu_tmp5, 1);
+            tcg_gen_shl_tl(cpu_tmp5, cpu_tmp5, cpu_T[1]);
+            if (op == 2) {
+                tcg_gen_not_tl(cpu_tmp5, cpu_tmp5);
+            }
+            gen_atomic_op(s, bt_atomic_op[op] << 3 | X86_ATOMIC_FETCH, ot,
+                          cpu_tmp5);
+            tcg_gen_shr_tl(cpu_cc_src, cpu_T[0], cpu_T[1]);
+            tcg_gen_movi_tl(cpu_cc_dst, 0);
+            s->cc_op = CC_OP_SARB + ot;
+            break;
+        }
         switch(op) {
         case 0:
             tcg_gen_shr_tl(cpu_cc_src, cpu_T[0], cpu_T[1]);
@@ -6931,7 +7623,7 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
             goto illegal_op;
         if (s->cc_op != CC_OP_DYNAMIC)
             gen_op_set_cc_op(s->cc_op);
-        gen_compute_eflags_c(cpu_T[0]);
+        gen_compute_eflags_c(s->cc_op, cpu_T[0]);
         tcg_gen_neg_tl(cpu_T[0], cpu_T[0]);
         gen_op_mov_reg_T0(OT_BYTE, R_EAX);
         break;
@@ -7780,11 +8472,11 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
         goto illegal_op;
     }
     /* lock generation */
-    if (s->prefix & PREFIX_LOCK)
+    if ((s->prefix & PREFIX_LOCK) && !s->atomic)
         gen_helper_unlock();
     return s->pc;
  illegal_op:
-    if (s->prefix & PREFIX_LOCK)
+    if ((s->prefix & PREFIX_LOCK) && !s->atomic)
         gen_helper_unlock();
     /* XXX: ensure that no lock was generated */
     gen_exception(s, EXCP06_ILLOP, pc_start - s->cs_base);
@@ -7877,6 +8569,7 @@ static inline void gen_intermediate_code_internal(CPUX86State *env,
     target_ulong cs_base;
     int num_insns;
     int max_insns;
+    int lookahead_ok;
 
     /* generate intermediate code */
     pc_start = tb->pc;
@@ -7920,6 +8613,12 @@ static inline void gen_intermediate_code_internal(CPUX86State *env,
                     || (flags & HF_SOFTMMU_MASK)
 #endif
                     );
+    /* a single insn is translated, or the flags may be observed
+       between two insns */
+    lookahead_ok = dc->code32 && !(dc->tf || env->singlestep_enabled ||
+                                   singlestep ||
+                                   (flags & HF_INHIBIT_IRQ_MASK) ||
+                                   !QTAILQ_EMPTY(&env->breakpoints));
 #if 0
     /* check addseg logic */
     if (!dc->addseg && (dc->vm86 || !dc->pe || !dc->code32))
@@ -7950,6 +8649,7 @@ static inline void gen_intermediate_code_internal(CPUX86State *env,
     if (max_insns == 0)
         max_insns = CF_COUNT_MASK;
 
+    gen_tb_exec_count(tb);
     gen_icount_start();
     for(;;) {
         if (unlikely(!QTAILQ_EMPTY(&env->breakpoints))) {
@@ -7976,6 +8676,15 @@ static inline void gen_intermediate_code_internal(CPUX86State *env,
         if (num_insns + 1 == max_insns && (tb->cflags & CF_LAST_IO))
             gen_io_start();
 
+        /* number of following insns that will be translated in this TB
+           even if each one generates MAX_OP_PER_INSTR ops */
+        if (lookahead_ok) {
+            dc->lookahead = MIN(max_insns - num_insns - 1,
+                                (gen_opc_end - gen_opc_ptr - 1) /
+                                MAX_OP_PER_INSTR);
+        } else {
+            dc->lookahead = 0;
+        }
         pc_ptr = disas_insn(dc, pc_ptr);
         num_insns++;
         /* stop translation if indicated */
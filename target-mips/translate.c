@@ -8216,7 +8216,7 @@ static void handle_delay_slot (CPUMIPSState *env, DisasContext *ctx,
                 save_cpu_state(ctx, 0);
                 gen_helper_0i(raise_exception, EXCP_DEBUG);
             }
-            tcg_gen_exit_tb(0);
+            gen_lookup_and_goto_ptr(cpu_env);
             break;
         default:
             MIPS_DEBUG("unknown branch");
@@ -293,3 +293,60 @@ void tlb_fill(CPUPPCState *env, target_ulong addr, int is_write, int mmu_idx,
     }
 }
 #endif /* !CONFIG_USER_ONLY */
+
+/* stwcx. and stdcx. with parallel_cpus (-tcg-threads multi, or several
+   threads in user mode): compare and swap the value seen by the
+   reservation with the new one, in a single host atomic operation.  Returns 1 if the store was performed.  */
+uint32_t helper_stcx_parallel(CPUPPCState *env, target_ulong addr,
+                              target_ulong val, uint32_t size)
+{
+    uint64_t cmpv, newv, oldv;
+    void *p;
+
+    if (addr != env->reserve_addr) {
+        return 0;
+    }
+    cmpv = env->reserve_val;
+    newv = val;
+    if (size == 4) {
+        cmpv = (uint32_t)cmpv;
+        newv = (uint32_t)newv;
+    }
+
+    /* cmpv and newv are in the byte order of the load/store instructions,
+       convert them to the byte order of guest memory */
+    if (msr_le) {
+        cmpv = size == 4 ? bswap32(cmpv) : bswap64(cmpv);
+        newv = size == 4 ? bswap32(newv) : bswap64(newv);
+    }
+
+    p = tlb_vaddr_to_host(env, addr, size, cpu_mmu_index(env), GETPC());
+    if (p) {
+        if (size == 4) {
+            oldv = tswap32(__sync_val_compare_and_swap((uint32_t *)p,
+                                                       tswap32(cmpv),
+                                                       tswap32(newv)));
+        } else {
+            oldv = tswap64(__sync_val_compare_and_swap((uint64_t *)p,
+                                                       tswap64(cmpv),
+                                                       tswap64(newv)));
+        }
+        return oldv == cmpv;
+    }
+
+    /* I/O, page crossing or read-only access */
+    cpu_atomic_lock();
+    if (size == 4) {
+        oldv = (uint32_t)cpu_ldl_data(env, addr);
+        if (oldv == cmpv) {
+            cpu_stl_data(env, addr, newv);
+        }
+    } else {
+        oldv = cpu_ldq_data(env, addr);
+        if (oldv == cmpv) {
+            cpu_stq_data(env, addr, newv);
+        }
+    }
+    cpu_atomic_unlock();
+    return oldv == cmpv;
+}
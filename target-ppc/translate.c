@@ -3155,6 +3155,27 @@ static void gen_conditional_store (DisasContext *ctx, TCGv EA,
 }
 #endif
 
+/* With parallel_cpus (-tcg-threads multi, or several threads in user
+   mode) other CPUs run concurrently, so the conditional store is done by
+   a helper with a host compare and swap */
+static void gen_conditional_store_parallel(DisasContext *ctx, TCGv EA,
+                                           int reg, int size)
+{
+    TCGv_i32 t0 = tcg_const_i32(size);
+    TCGv_i32 t1 = tcg_temp_new_i32();
+
+    gen_update_nip(ctx, ctx->nip - 4);
+    gen_helper_stcx_parallel(t1, cpu_env, EA, cpu_gpr[reg], t0);
+    tcg_gen_trunc_tl_i32(cpu_crf[0], cpu_xer);
+    tcg_gen_shri_i32(cpu_crf[0], cpu_crf[0], XER_SO);
+    tcg_gen_andi_i32(cpu_crf[0], cpu_crf[0], 1);
+    tcg_gen_shli_i32(t1, t1, CRF_EQ);
+    tcg_gen_or_i32(cpu_crf[0], cpu_crf[0], t1);
+    tcg_gen_movi_tl(cpu_reserve, -1);
+    tcg_temp_free_i32(t1);
+    tcg_temp_free_i32(t0);
+}
+
 /* stwcx. */
 static void gen_stwcx_(DisasContext *ctx)
 {
@@ -3164,9 +3185,15 @@ static void gen_stwcx_(DisasContext *ctx)
     gen_addr_reg_index(ctx, t0);
     gen_check_align(ctx, t0, 0x03);
 #if defined(CONFIG_USER_ONLY)
-    gen_conditional_store(ctx, t0, rS(ctx->opcode), 4);
+    if (parallel_cpus) {
+        gen_conditional_store_parallel(ctx, t0, rS(ctx->opcode), 4);
+    } else {
+        gen_conditional_store(ctx, t0, rS(ctx->opcode), 4);
+    }
 #else
-    {
+    if (parallel_cpus) {
+        gen_conditional_store_parallel(ctx, t0, rS(ctx->opcode), 4);
+    } else {
         int l1;
 
         tcg_gen_trunc_tl_i32(cpu_crf[0], cpu_xer);
@@ -3208,9 +3235,15 @@ static void gen_stdcx_(DisasContext *ctx)
     gen_addr_reg_index(ctx, t0);
     gen_check_align(ctx, t0, 0x07);
 #if defined(CONFIG_USER_ONLY)
-    gen_conditional_store(ctx, t0, rS(ctx->opcode), 8);
+    if (parallel_cpus) {
+        gen_conditional_store_parallel(ctx, t0, rS(ctx->opcode), 8);
+    } else {
+        gen_conditional_store(ctx, t0, rS(ctx->opcode), 8);
+    }
 #else
-    {
+    if (parallel_cpus) {
+        gen_conditional_store_parallel(ctx, t0, rS(ctx->opcode), 8);
+    } else {
         int l1;
         tcg_gen_trunc_tl_i32(cpu_crf[0], cpu_xer);
         tcg_gen_shri_i32(cpu_crf[0], cpu_crf[0], XER_SO);
@@ -3589,7 +3622,11 @@ static inline void gen_bcond(DisasContext *ctx, int type)
         else
 #endif
             tcg_gen_andi_tl(cpu_nip, target, ~3);
-        tcg_gen_exit_tb(0);
+        if (likely(!ctx->singlestep_enabled)) {
+            gen_lookup_and_goto_ptr(cpu_env);
+        } else {
+            tcg_gen_exit_tb(0);
+        }
         gen_set_label(l1);
 #if defined(TARGET_PPC64)
         if (!(ctx->sf_mode))
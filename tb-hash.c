@@ -0,0 +1,361 @@
+/*
+ * Translation block lookup hash table
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * TBs are looked up by (phys_pc, pc, flags, cs_base).  The table is an
+ * array of cache line sized buckets, each holding a few TB pointers
+ * together with the full 32-bit hash of their key, so that a lookup
+ * usually touches a single cache line and only dereferences TBs whose
+ * hash matches.  Buckets that overflow are chained.  The number of
+ * buckets doubles when the table gets too full and halves when it gets
+ * too empty, and goes back to the minimum size on tb_flush.
+ *
+ * Changes to the table need tb_lock, lookups do not.  A lookup that
+ * races with a change may miss a TB which is in the table, in which
+ * case the caller looks again with tb_lock held, but never sees a
+ * partially written entry: the hash of an entry is written before its
+ * TB, and an entry is only cleared after it has been copied.  A resize
+ * bumps a sequence count, and a lookup which saw it change returns NULL.
+ * With parallel_cpus, overflow buckets and old arrays that a lookup may
+ * still be walking are only freed on tb_flush, when no other thread runs
+ * translated code.
+ */
+
+#include "config.h"
+#include "cpu.h"
+#include "exec-all.h"
+#include "qemu-barrier.h"
+
+#define TB_HASH_BUCKET_SIZE     64
+#define TB_HASH_BUCKET_ENTRIES \
+    ((TB_HASH_BUCKET_SIZE - sizeof(void *)) / \
+     (sizeof(uint32_t) + sizeof(void *)))
+
+/* 4096 buckets hold 16k TBs on a 64-bit host before chaining.  */
+#define TB_HASH_MIN_BUCKETS     (1 << 12)
+
+typedef struct TBHashBucket TBHashBucket;
+
+/* Used slots are packed at the start of a chain: a NULL tb ends it.  */
+struct TBHashBucket {
+    uint32_t hashes[TB_HASH_BUCKET_ENTRIES];
+    TranslationBlock *tbs[TB_HASH_BUCKET_ENTRIES];
+    TBHashBucket *next;
+} __attribute__((aligned(TB_HASH_BUCKET_SIZE)));
+
+static struct {
+    TBHashBucket *buckets;
+    size_t nb_buckets;
+    size_t nb_entries;
+    size_t nb_overflow;
+    unsigned int resize_count;
+    unsigned int seq;
+    void **retired;
+    size_t nb_retired;
+} tb_htable;
+
+static TBHashBucket *tb_htable_alloc(size_t nb_buckets)
+{
+    size_t size = nb_buckets * sizeof(TBHashBucket);
+    TBHashBucket *buckets = qemu_memalign(TB_HASH_BUCKET_SIZE, size);
+
+    memset(buckets, 0, size);
+    return buckets;
+}
+
+static TBHashBucket *tb_htable_alloc_overflow(void)
+{
+    tb_htable.nb_overflow++;
+    return tb_htable_alloc(1);
+}
+
+/* Free memory that lookups without tb_lock may still be reading, or keep
+   it until the next tb_flush.  */
+static void tb_htable_retire(void *p)
+{
+    if (!parallel_cpus) {
+        qemu_vfree(p);
+        return;
+    }
+    tb_htable.retired = g_renew(void *, tb_htable.retired,
+                                tb_htable.nb_retired + 1);
+    tb_htable.retired[tb_htable.nb_retired++] = p;
+}
+
+static void tb_htable_free_overflow(TBHashBucket *b)
+{
+    tb_htable.nb_overflow--;
+    tb_htable_retire(b);
+}
+
+static inline TBHashBucket *tb_htable_head(uint32_t hash)
+{
+    return &tb_htable.buckets[hash & (tb_htable.nb_buckets - 1)];
+}
+
+static void tb_htable_do_insert(TranslationBlock *tb, uint32_t hash)
+{
+    TBHashBucket *b = tb_htable_head(hash);
+    int i;
+
+    for (;;) {
+        for (i = 0; i < TB_HASH_BUCKET_ENTRIES; i++) {
+            if (!b->tbs[i]) {
+                b->hashes[i] = hash;
+                smp_wmb();
+                b->tbs[i] = tb;
+                return;
+            }
+        }
+        if (!b->next) {
+            TBHashBucket *next = tb_htable_alloc_overflow();
+
+            smp_wmb();
+            b->next = next;
+        }
+        b = b->next;
+    }
+}
+
+/* Free all overflow buckets of the table.  */
+static void tb_htable_free_chains(TBHashBucket *buckets, size_t nb_buckets)
+{
+    TBHashBucket *b, *next;
+    size_t i;
+
+    for (i = 0; i < nb_buckets; i++) {
+        for (b = buckets[i].next; b != NULL; b = next) {
+            next = b->next;
+            tb_htable_free_overflow(b);
+        }
+    }
+}
+
+static void tb_htable_resize(size_t nb_buckets)
+{
+    TBHashBucket *old_buckets = tb_htable.buckets;
+    size_t old_nb_buckets = tb_htable.nb_buckets;
+    TBHashBucket *b;
+    size_t i;
+    int j;
+
+    tb_htable.seq++;
+    smp_wmb();
+    tb_htable.buckets = tb_htable_alloc(nb_buckets);
+    tb_htable.nb_buckets = nb_buckets;
+    tb_htable.resize_count++;
+
+    /* the hashes are stored in the table, no need to recompute them */
+    for (i = 0; i < old_nb_buckets; i++) {
+        for (b = &old_buckets[i]; b != NULL; b = b->next) {
+            for (j = 0; j < TB_HASH_BUCKET_ENTRIES && b->tbs[j]; j++) {
+                tb_htable_do_insert(b->tbs[j], b->hashes[j]);
+            }
+        }
+    }
+    smp_wmb();
+    tb_htable.seq++;
+    tb_htable_free_chains(old_buckets, old_nb_buckets);
+    tb_htable_retire(old_buckets);
+}
+
+void tb_htable_init(void)
+{
+    tb_htable.buckets = tb_htable_alloc(TB_HASH_MIN_BUCKETS);
+    tb_htable.nb_buckets = TB_HASH_MIN_BUCKETS;
+}
+
+void tb_htable_reset(void)
+{
+    size_t i;
+
+    tb_htable_free_chains(tb_htable.buckets, tb_htable.nb_buckets);
+    for (i = 0; i < tb_htable.nb_retired; i++) {
+        qemu_vfree(tb_htable.retired[i]);
+    }
+    g_free(tb_htable.retired);
+    tb_htable.retired = NULL;
+    tb_htable.nb_retired = 0;
+    if (tb_htable.nb_buckets != TB_HASH_MIN_BUCKETS) {
+        qemu_vfree(tb_htable.buckets);
+        tb_htable_init();
+    } else {
+        memset(tb_htable.buckets, 0,
+               tb_htable.nb_buckets * sizeof(TBHashBucket));
+    }
+    tb_htable.nb_entries = 0;
+}
+
+static inline uint32_t tb_htable_hash(TranslationBlock *tb)
+{
+    tb_page_addr_t phys_pc;
+
+    phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
+    return tb_hash_func(phys_pc, tb->pc, tb->flags, tb->cs_base);
+}
+
+void tb_htable_insert(TranslationBlock *tb, tb_page_addr_t phys_pc)
+{
+    tb_htable_do_insert(tb, tb_hash_func(phys_pc, tb->pc, tb->flags,
+                                         tb->cs_base));
+    /* grow when there are two entries per bucket on average, which keeps
+       chains short even with four entries per bucket */
+    if (++tb_htable.nb_entries >
+        tb_htable.nb_buckets * TB_HASH_BUCKET_ENTRIES / 2) {
+        tb_htable_resize(tb_htable.nb_buckets * 2);
+    }
+}
+
+void tb_htable_remove(TranslationBlock *tb)
+{
+    uint32_t hash = tb_htable_hash(tb);
+    TBHashBucket *head = tb_htable_head(hash);
+    TBHashBucket *b, *last, *prev;
+    int i, n;
+
+    for (b = head; b != NULL; b = b->next) {
+        for (i = 0; i < TB_HASH_BUCKET_ENTRIES && b->tbs[i]; i++) {
+            if (b->tbs[i] == tb) {
+                goto found;
+            }
+        }
+    }
+    return;
+
+ found:
+    /* move the last entry of the chain into the hole */
+    prev = NULL;
+    for (last = b; last->next; last = last->next) {
+        prev = last;
+    }
+    for (n = TB_HASH_BUCKET_ENTRIES - 1; !last->tbs[n]; n--) {
+        continue;
+    }
+    b->hashes[i] = last->hashes[n];
+    smp_wmb();
+    b->tbs[i] = last->tbs[n];
+    smp_wmb();
+    last->tbs[n] = NULL;
+    last->hashes[n] = 0;
+    if (n == 0 && last != head) {
+        if (!prev) {
+            for (prev = head; prev->next != last; prev = prev->next) {
+                continue;
+            }
+        }
+        prev->next = last->next;
+        tb_htable_free_overflow(last);
+    }
+
+    if (--tb_htable.nb_entries <
+        tb_htable.nb_buckets * TB_HASH_BUCKET_ENTRIES / 8 &&
+        tb_htable.nb_buckets > TB_HASH_MIN_BUCKETS) {
+        tb_htable_resize(tb_htable.nb_buckets / 2);
+    }
+}
+
+TranslationBlock *tb_htable_lookup(uint32_t hash, tb_htable_cmp_func *cmp,
+                                   const void *opaque)
+{
+    TBHashBucket *b;
+    TranslationBlock *tb;
+    unsigned int seq;
+    int i;
+
+    seq = tb_htable.seq;
+    smp_rmb();
+    if (seq & 1) {
+        return NULL;
+    }
+    b = tb_htable_head(hash);
+    smp_rmb();
+    if (tb_htable.seq != seq) {
+        return NULL;
+    }
+
+    do {
+        for (i = 0; i < TB_HASH_BUCKET_ENTRIES; i++) {
+            tb = b->tbs[i];
+            if (!tb) {
+                return NULL;
+            }
+            smp_rmb();
+            if (b->hashes[i] == hash && cmp(tb, opaque)) {
+                return tb;
+            }
+        }
+        b = b->next;
+        smp_rmb();
+    } while (b);
+    return NULL;
+}
+
+static bool tb_htable_cmp_ptr(TranslationBlock *tb, const void *opaque)
+{
+    return tb == opaque;
+}
+
+bool tb_htable_contains(TranslationBlock *tb)
+{
+    return tb_htable_lookup(tb_htable_hash(tb), tb_htable_cmp_ptr, tb) != NULL;
+}
+
+void tb_htable_foreach(void (*func)(TranslationBlock *tb, void *opaque),
+                       void *opaque)
+{
+    TBHashBucket *b;
+    size_t i;
+    int j;
+
+    for (i = 0; i < tb_htable.nb_buckets; i++) {
+        for (b = &tb_htable.buckets[i]; b != NULL; b = b->next) {
+            for (j = 0; j < TB_HASH_BUCKET_ENTRIES && b->tbs[j]; j++) {
+                func(b->tbs[j], opaque);
+            }
+        }
+    }
+}
+
+void tb_htable_dump_info(FILE *f, fprintf_function cpu_fprintf)
+{
+    size_t used_buckets = 0, head_entries = 0, chain_total = 0;
+    size_t chain_max = 0;
+    size_t i;
+    TBHashBucket *b;
+    size_t len;
+    int j;
+
+    for (i = 0; i < tb_htable.nb_buckets; i++) {
+        b = &tb_htable.buckets[i];
+        if (!b->tbs[0]) {
+            continue;
+        }
+        used_buckets++;
+        for (j = 0; j < TB_HASH_BUCKET_ENTRIES && b->tbs[j]; j++) {
+            head_entries++;
+        }
+        for (len = 0; b != NULL; b = b->next) {
+            len++;
+        }
+        chain_total += len;
+        if (len > chain_max) {
+            chain_max = len;
+        }
+    }
+
+    cpu_fprintf(f, "TB hash buckets     %zu/%zu (%zu overflow, "
+                "%u resizes)\n",
+                used_buckets, tb_htable.nb_buckets, tb_htable.nb_overflow,
+                tb_htable.resize_count);
+    cpu_fprintf(f, "TB hash occupancy   %0.1f%% head bucket slots, "
+                "%zu entries\n",
+                tb_htable.nb_buckets ?
+                (double)head_entries * 100 /
+                (tb_htable.nb_buckets * TB_HASH_BUCKET_ENTRIES) : 0,
+                tb_htable.nb_entries);
+    cpu_fprintf(f, "TB hash chain len   avg %0.2f max %zu buckets\n",
+                used_buckets ? (double)chain_total / used_buckets : 0,
+                chain_max);
+}
@@ -100,20 +100,27 @@ static void patch_reloc(uint8_t *code_ptr, int type,
         if (value != (int32_t)value) {
             tcg_abort();
         }
-        *(uint32_t *)code_ptr = value;
+        *(uint32_t *)tcg_code_rw(code_ptr) = value;
         break;
     case R_386_PC8:
         value -= (uintptr_t)code_ptr;
         if (value != (int8_t)value) {
             tcg_abort();
         }
-        *(uint8_t *)code_ptr = value;
+        *tcg_code_rw(code_ptr) = value;
         break;
     default:
         tcg_abort();
     }
 }
 
+void i386_tb_set_jmp_target(uintptr_t jmp_addr, uintptr_t addr)
+{
+    /* patch the branch destination */
+    *(uint32_t *)tcg_code_rw((uint8_t *)jmp_addr) = addr - (jmp_addr + 4);
+    /* no need to flush icache explicitly */
+}
+
 /* maximum number of register used for input function arguments */
 static inline int tcg_target_get_call_iarg_regs_count(int flags)
 {
@@ -238,11 +245,13 @@ static inline int tcg_target_const_match(tcg_target_long val,
 # define P_REXW		0x800		/* Set REX.W = 1 */
 # define P_REXB_R	0x1000		/* REG field as byte register */
 # define P_REXB_RM	0x2000		/* R/M field as byte register */
+# define P_SIMDF3	0x4000		/* 0xf3 opcode prefix */
 #else
 # define P_ADDR32	0
 # define P_REXW		0
 # define P_REXB_R	0
 # define P_REXB_RM	0
+# define P_SIMDF3	0
 #endif
 
 #define OPC_ARITH_EvIz	(0x81)
@@ -287,6 +296,28 @@ static inline int tcg_target_const_match(tcg_target_long val,
 #define OPC_GRP3_Ev	(0xf7)
 #define OPC_GRP5	(0xff)
 
+/* SSE2, used by the vector ops on 64-bit hosts */
+#define OPC_MOVDQU_VxWx	(0x6f | P_EXT | P_SIMDF3)
+#define OPC_MOVDQU_WxVx	(0x7f | P_EXT | P_SIMDF3)
+#define OPC_MOVQ_VqWq	(0x7e | P_EXT | P_SIMDF3)
+#define OPC_MOVQ_WqVq	(0xd6 | P_EXT | P_DATA16)
+#define OPC_PADDB	(0xfc | P_EXT | P_DATA16)
+#define OPC_PADDW	(0xfd | P_EXT | P_DATA16)
+#define OPC_PADDD	(0xfe | P_EXT | P_DATA16)
+#define OPC_PADDQ	(0xd4 | P_EXT | P_DATA16)
+#define OPC_PSUBB	(0xf8 | P_EXT | P_DATA16)
+#define OPC_PSUBW	(0xf9 | P_EXT | P_DATA16)
+#define OPC_PSUBD	(0xfa | P_EXT | P_DATA16)
+#define OPC_PSUBQ	(0xfb | P_EXT | P_DATA16)
+#define OPC_PAND	(0xdb | P_EXT | P_DATA16)
+#define OPC_PANDN	(0xdf | P_EXT | P_DATA16)
+#define OPC_POR		(0xeb | P_EXT | P_DATA16)
+#define OPC_PXOR	(0xef | P_EXT | P_DATA16)
+#define OPC_PCMPEQB	(0x74 | P_EXT | P_DATA16)
+#define OPC_PCMPEQW	(0x75 | P_EXT | P_DATA16)
+#define OPC_PCMPEQD	(0x76 | P_EXT | P_DATA16)
+#define OPC_PSHUFD	(0x70 | P_EXT | P_DATA16)
+
 /* Group 1 opcode extensions for 0x80-0x83.
    These are also used as modifiers for OPC_ARITH.  */
 #define ARITH_ADD 0
@@ -361,6 +392,9 @@ static void tcg_out_opc(TCGContext *s, int opc, int r, int rm, int x)
         assert((opc & P_REXW) == 0);
         tcg_out8(s, 0x66);
     }
+    if (opc & P_SIMDF3) {
+        tcg_out8(s, 0xf3);
+    }
     if (opc & P_ADDR32) {
         tcg_out8(s, 0x67);
     }
@@ -1049,15 +1083,19 @@ static inline void tcg_out_tlb_load(TCGContext *s, int addrlo_idx,
 
     tgen_arithi(s, ARITH_AND + rexw, r0,
                 TARGET_PAGE_MASK | ((1 << s_bits) - 1), 0);
-    tgen_arithi(s, ARITH_AND + rexw, r1,
-                (CPU_TLB_SIZE - 1) << CPU_TLB_ENTRY_BITS, 0);
 
-    tcg_out_modrm_sib_offset(s, OPC_LEA + P_REXW, r1, TCG_AREG0, r1, 0,
-                             offsetof(CPUArchState, tlb_table[mem_index][0])
-                             + which);
+    /* The TLB is resized at flush time, so its size and location are
+       loaded from the CPU state rather than encoded here.
+       and tlb_mask[mem_index](env), r1 */
+    tcg_out_modrm_offset(s, OPC_ARITH_GvEv + (ARITH_AND << 3) + rexw, r1,
+                         TCG_AREG0,
+                         offsetof(CPUArchState, tlb_mask[mem_index]));
+    /* add tlb_table[mem_index](env), r1 */
+    tcg_out_modrm_offset(s, OPC_ADD_GvEv + P_REXW, r1, TCG_AREG0,
+                         offsetof(CPUArchState, tlb_table[mem_index]));
 
-    /* cmp 0(r1), r0 */
-    tcg_out_modrm_offset(s, OPC_CMP_GvEv + rexw, r0, r1, 0);
+    /* cmp which(r1), r0 */
+    tcg_out_modrm_offset(s, OPC_CMP_GvEv + rexw, r0, r1, which);
 
     tcg_out_mov(s, type, r0, addrlo);
 
@@ -1067,8 +1105,9 @@ static inline void tcg_out_tlb_load(TCGContext *s, int addrlo_idx,
     s->code_ptr++;
 
     if (TARGET_LONG_BITS > TCG_TARGET_REG_BITS) {
-        /* cmp 4(r1), addrhi */
-        tcg_out_modrm_offset(s, OPC_CMP_GvEv, args[addrlo_idx+1], r1, 4);
+        /* cmp which+4(r1), addrhi */
+        tcg_out_modrm_offset(s, OPC_CMP_GvEv, args[addrlo_idx+1], r1,
+                             which + 4);
 
         /* jne label1 */
         tcg_out8(s, OPC_JCC_short + JCC_JNE);
@@ -1080,7 +1119,7 @@ static inline void tcg_out_tlb_load(TCGContext *s, int addrlo_idx,
 
     /* add addend(r1), r0 */
     tcg_out_modrm_offset(s, OPC_ADD_GvEv + P_REXW, r0, r1,
-                         offsetof(CPUTLBEntry, addend) - which);
+                         offsetof(CPUTLBEntry, addend));
 }
 #endif
 
@@ -1205,9 +1244,9 @@ static void tcg_out_qemu_ld(TCGContext *s, const TCGArg *args,
     /* TLB Miss.  */
 
     /* label1: */
-    *label_ptr[0] = s->code_ptr - label_ptr[0] - 1;
+    *tcg_code_rw(label_ptr[0]) = s->code_ptr - label_ptr[0] - 1;
     if (TARGET_LONG_BITS > TCG_TARGET_REG_BITS) {
-        *label_ptr[1] = s->code_ptr - label_ptr[1] - 1;
+        *tcg_code_rw(label_ptr[1]) = s->code_ptr - label_ptr[1] - 1;
     }
 
     /* XXX: move that code at the end of the TB */
@@ -1291,7 +1330,7 @@ static void tcg_out_qemu_ld(TCGContext *s, const TCGArg *args,
     }
 
     /* label2: */
-    *label_ptr[2] = s->code_ptr - label_ptr[2] - 1;
+    *tcg_code_rw(label_ptr[2]) = s->code_ptr - label_ptr[2] - 1;
 #else
     {
         int32_t offset = GUEST_BASE;
@@ -1415,9 +1454,9 @@ static void tcg_out_qemu_st(TCGContext *s, const TCGArg *args,
     /* TLB Miss.  */
 
     /* label1: */
-    *label_ptr[0] = s->code_ptr - label_ptr[0] - 1;
+    *tcg_code_rw(label_ptr[0]) = s->code_ptr - label_ptr[0] - 1;
     if (TARGET_LONG_BITS > TCG_TARGET_REG_BITS) {
-        *label_ptr[1] = s->code_ptr - label_ptr[1] - 1;
+        *tcg_code_rw(label_ptr[1]) = s->code_ptr - label_ptr[1] - 1;
     }
 
     /* XXX: move that code at the end of the TB */
@@ -1468,7 +1507,7 @@ static void tcg_out_qemu_st(TCGContext *s, const TCGArg *args,
     }
 
     /* label2: */
-    *label_ptr[2] = s->code_ptr - label_ptr[2] - 1;
+    *tcg_code_rw(label_ptr[2]) = s->code_ptr - label_ptr[2] - 1;
 #else
     {
         int32_t offset = GUEST_BASE;
@@ -1496,6 +1535,69 @@ static void tcg_out_qemu_st(TCGContext *s, const TCGArg *args,
 #endif
 }
 
+#if TCG_TARGET_HAS_vec
+/* TCG does not allocate the SSE registers, so xmm0 and xmm1 are free
+   as scratch.  The operands are loaded with unaligned moves because
+   env fields are only 8-byte aligned.  */
+static void tcg_out_vec_op(TCGContext *s, TCGOpcode opc, const TCGArg *args)
+{
+    static const int add_insn[4] = {
+        OPC_PADDB, OPC_PADDW, OPC_PADDD, OPC_PADDQ
+    };
+    static const int sub_insn[4] = {
+        OPC_PSUBB, OPC_PSUBW, OPC_PSUBD, OPC_PSUBQ
+    };
+    static const int cmpeq_insn[3] = {
+        OPC_PCMPEQB, OPC_PCMPEQW, OPC_PCMPEQD
+    };
+    int base = args[0], oprsz = args[4], vece = args[5];
+    tcg_target_long dofs = args[1], aofs = args[2], bofs = args[3];
+    int ld = oprsz == 16 ? OPC_MOVDQU_VxWx : OPC_MOVQ_VqWq;
+    int st = oprsz == 16 ? OPC_MOVDQU_WxVx : OPC_MOVQ_WqVq;
+    int insn;
+
+    switch (opc) {
+    case INDEX_op_add_vec:
+        insn = add_insn[vece];
+        break;
+    case INDEX_op_sub_vec:
+        insn = sub_insn[vece];
+        break;
+    case INDEX_op_and_vec:
+        insn = OPC_PAND;
+        break;
+    case INDEX_op_or_vec:
+        insn = OPC_POR;
+        break;
+    case INDEX_op_xor_vec:
+        insn = OPC_PXOR;
+        break;
+    case INDEX_op_andc_vec:
+        /* pandn computes ~dest & src */
+        tcg_out_modrm_offset(s, ld, 0, base, bofs);
+        tcg_out_modrm_offset(s, ld, 1, base, aofs);
+        tcg_out_modrm(s, OPC_PANDN, 0, 1);
+        tcg_out_modrm_offset(s, st, 0, base, dofs);
+        return;
+    case INDEX_op_cmpeq_vec:
+        insn = cmpeq_insn[vece];
+        break;
+    case INDEX_op_shufd_vec:
+        tcg_out_modrm_offset(s, ld, 1, base, aofs);
+        tcg_out_modrm(s, OPC_PSHUFD, 0, 1);
+        tcg_out8(s, bofs);
+        tcg_out_modrm_offset(s, st, 0, base, dofs);
+        return;
+    default:
+        tcg_abort();
+    }
+    tcg_out_modrm_offset(s, ld, 0, base, aofs);
+    tcg_out_modrm_offset(s, ld, 1, base, bofs);
+    tcg_out_modrm(s, insn, 0, 1);
+    tcg_out_modrm_offset(s, st, 0, base, dofs);
+}
+#endif
+
 static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
                               const TCGArg *args, const int *const_args)
 {
@@ -1519,6 +1621,14 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
     case INDEX_op_goto_tb:
         if (s->tb_jmp_offset) {
             /* direct jump method */
+            if (parallel_cpus) {
+                /* other vCPU threads may execute the jump while it is
+                   patched, so keep the displacement naturally aligned
+                   for tb_set_jmp_target() */
+                while (((tcg_target_long)s->code_ptr + 1) & 3) {
+                    tcg_out8(s, 0x90); /* nop */
+                }
+            }
             tcg_out8(s, OPC_JMP_long); /* jmp im */
             s->tb_jmp_offset[args[0]] = s->code_ptr - s->code_buf;
             tcg_out32(s, 0);
@@ -1529,6 +1639,10 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
         }
         s->tb_next_offset[args[0]] = s->code_ptr - s->code_buf;
         break;
+    case INDEX_op_goto_ptr:
+        /* jmp *reg */
+        tcg_out_modrm(s, OPC_GRP5, EXT5_JMPN_Ev, args[0]);
+        break;
     case INDEX_op_call:
         if (const_args[0]) {
             tcg_out_calli(s, args[0]);
@@ -1830,6 +1944,19 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
         }
         break;
 
+#if TCG_TARGET_HAS_vec
+    case INDEX_op_add_vec:
+    case INDEX_op_sub_vec:
+    case INDEX_op_and_vec:
+    case INDEX_op_or_vec:
+    case INDEX_op_xor_vec:
+    case INDEX_op_andc_vec:
+    case INDEX_op_cmpeq_vec:
+    case INDEX_op_shufd_vec:
+        tcg_out_vec_op(s, opc, args);
+        break;
+#endif
+
     default:
         tcg_abort();
     }
@@ -1840,6 +1967,7 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
 static const TCGTargetOpDef x86_op_defs[] = {
     { INDEX_op_exit_tb, { } },
     { INDEX_op_goto_tb, { } },
+    { INDEX_op_goto_ptr, { "r" } },
     { INDEX_op_call, { "ri" } },
     { INDEX_op_jmp, { "ri" } },
     { INDEX_op_br, { } },
@@ -1942,6 +2070,17 @@ static const TCGTargetOpDef x86_op_defs[] = {
     { INDEX_op_deposit_i64, { "Q", "0", "Q" } },
 #endif
 
+#if TCG_TARGET_HAS_vec
+    { INDEX_op_add_vec, { "r" } },
+    { INDEX_op_sub_vec, { "r" } },
+    { INDEX_op_and_vec, { "r" } },
+    { INDEX_op_or_vec, { "r" } },
+    { INDEX_op_xor_vec, { "r" } },
+    { INDEX_op_andc_vec, { "r" } },
+    { INDEX_op_cmpeq_vec, { "r" } },
+    { INDEX_op_shufd_vec, { "r" } },
+#endif
+
 #if TCG_TARGET_REG_BITS == 64
     { INDEX_op_qemu_ld8u, { "r", "L" } },
     { INDEX_op_qemu_ld8s, { "r", "L" } },
@@ -2048,6 +2187,11 @@ static void tcg_target_qemu_prologue(TCGContext *s)
     /* jmp *tb.  */
     tcg_out_modrm(s, OPC_GRP5, EXT5_JMPN_Ev, tcg_target_call_iarg_regs[1]);
 
+    /* Return path for goto_ptr.  Set TCG_REG_EAX to 0 as exit_tb 0
+       would, and fall through to the rest of the epilogue.  */
+    s->code_gen_epilogue = s->code_ptr;
+    tcg_out_movi(s, TCG_TYPE_REG, TCG_REG_EAX, 0);
+
     /* TB epilogue */
     tb_ret_addr = s->code_ptr;
 
@@ -107,7 +107,12 @@ typedef enum {
 #define TCG_TARGET_HAS_nand_i64         0
 #define TCG_TARGET_HAS_nor_i64          0
 #define TCG_TARGET_HAS_deposit_i64      1
+/* SSE2 is part of x86_64 */
+#define TCG_TARGET_HAS_vec              1
+#else
+#define TCG_TARGET_HAS_vec              0
 #endif
+#define TCG_TARGET_HAS_goto_ptr         1
 
 #define TCG_TARGET_deposit_i32_valid(ofs, len) \
     (((ofs) == 0 && (len) == 8) || ((ofs) == 8 && (len) == 8) || \
@@ -116,6 +121,9 @@ typedef enum {
 
 #define TCG_TARGET_HAS_GUEST_BASE
 
+/* The code buffer can be mapped twice, see tcg_code_rw().  */
+#define TCG_TARGET_SPLIT_WX
+
 /* Note: must be synced with dyngen-exec.h */
 #if TCG_TARGET_REG_BITS == 64
 # define TCG_AREG0 TCG_REG_R14
@@ -48,6 +48,8 @@ struct tcg_temp_info {
     uint16_t prev_copy;
     uint16_t next_copy;
     tcg_target_ulong val;
+    /* Only the bits set in MASK can be nonzero. */
+    tcg_target_ulong mask;
 };
 
 static struct tcg_temp_info temps[TCG_MAX_TEMPS];
@@ -82,11 +84,23 @@ static void reset_temp(TCGArg temp, int nb_temps, int nb_globals)
         new_base = temps[temp].val;
     }
     temps[temp].state = TCG_TEMP_ANY;
+    temps[temp].mask = -1;
     if (new_base != (TCGArg)-1 && temps[new_base].next_copy == new_base) {
         temps[new_base].state = TCG_TEMP_ANY;
     }
 }
 
+/* Forget everything about the temps, for example at the start of a
+   basic block. */
+static void reset_all_temps(int nb_temps)
+{
+    int i;
+    for (i = 0; i < nb_temps; i++) {
+        temps[i].state = TCG_TEMP_UNDEF;
+        temps[i].mask = -1;
+    }
+}
+
 static int op_bits(TCGOpcode op)
 {
     const TCGOpDef *def = &tcg_op_defs[op];
@@ -112,6 +126,7 @@ static void tcg_opt_gen_mov(TCGContext *s, TCGArg *gen_args, TCGArg dst,
 {
         reset_temp(dst, nb_temps, nb_globals);
         assert(temps[src].state != TCG_TEMP_COPY);
+        temps[dst].mask = temps[src].mask;
         /* Don't try to copy if one of temps is a global or either one
            is local and another is register */
         if (src >= nb_globals && dst >= nb_globals &&
@@ -139,6 +154,7 @@ static void tcg_opt_gen_movi(TCGArg *gen_args, TCGArg dst, TCGArg val,
         reset_temp(dst, nb_temps, nb_globals);
         temps[dst].state = TCG_TEMP_CONST;
         temps[dst].val = val;
+        temps[dst].mask = val;
         gen_args[0] = dst;
         gen_args[1] = val;
 }
@@ -157,6 +173,27 @@ static TCGOpcode op_to_mov(TCGOpcode op)
     }
 }
 
+/* Replace the operation at OPC, whose output is DST, by a copy of SRC.
+   Return the number of arguments written to GEN_ARGS. */
+static int tcg_opt_gen_copy(TCGContext *s, uint16_t *opc, TCGArg *gen_args,
+                            TCGArg dst, TCGArg src, int nb_temps,
+                            int nb_globals)
+{
+    if (temps[src].state == TCG_TEMP_CONST) {
+        *opc = op_to_movi(*opc);
+        tcg_opt_gen_movi(gen_args, dst, temps[src].val, nb_temps, nb_globals);
+        return 2;
+    }
+    if ((temps[dst].state == TCG_TEMP_COPY && temps[dst].val == src)
+        || dst == src) {
+        *opc = INDEX_op_nop;
+        return 0;
+    }
+    *opc = op_to_mov(*opc);
+    tcg_opt_gen_mov(s, gen_args, dst, src, nb_temps, nb_globals);
+    return 2;
+}
+
 static TCGArg do_constant_folding_2(TCGOpcode op, TCGArg x, TCGArg y)
 {
     switch (op) {
@@ -267,6 +304,102 @@ static TCGArg do_constant_folding(TCGOpcode op, TCGArg x, TCGArg y)
     return res;
 }
 
+static bool do_constant_folding_cond_32(uint32_t x, uint32_t y, TCGCond c)
+{
+    switch (c) {
+    case TCG_COND_EQ:
+        return x == y;
+    case TCG_COND_NE:
+        return x != y;
+    case TCG_COND_LT:
+        return (int32_t)x < (int32_t)y;
+    case TCG_COND_GE:
+        return (int32_t)x >= (int32_t)y;
+    case TCG_COND_LE:
+        return (int32_t)x <= (int32_t)y;
+    case TCG_COND_GT:
+        return (int32_t)x > (int32_t)y;
+    case TCG_COND_LTU:
+        return x < y;
+    case TCG_COND_GEU:
+        return x >= y;
+    case TCG_COND_LEU:
+        return x <= y;
+    case TCG_COND_GTU:
+        return x > y;
+    default:
+        tcg_abort();
+    }
+}
+
+static bool do_constant_folding_cond_64(uint64_t x, uint64_t y, TCGCond c)
+{
+    switch (c) {
+    case TCG_COND_EQ:
+        return x == y;
+    case TCG_COND_NE:
+        return x != y;
+    case TCG_COND_LT:
+        return (int64_t)x < (int64_t)y;
+    case TCG_COND_GE:
+        return (int64_t)x >= (int64_t)y;
+    case TCG_COND_LE:
+        return (int64_t)x <= (int64_t)y;
+    case TCG_COND_GT:
+        return (int64_t)x > (int64_t)y;
+    case TCG_COND_LTU:
+        return x < y;
+    case TCG_COND_GEU:
+        return x >= y;
+    case TCG_COND_LEU:
+        return x <= y;
+    case TCG_COND_GTU:
+        return x > y;
+    default:
+        tcg_abort();
+    }
+}
+
+/* Return 0 or 1 if the result of the comparison of temps X and Y is
+   known, 2 otherwise. */
+static TCGArg do_constant_folding_cond(TCGOpcode op, TCGArg x, TCGArg y,
+                                       TCGCond c)
+{
+    if (temps[x].state == TCG_TEMP_CONST && temps[y].state == TCG_TEMP_CONST) {
+        switch (op_bits(op)) {
+        case 32:
+            return do_constant_folding_cond_32(temps[x].val, temps[y].val, c);
+        case 64:
+            return do_constant_folding_cond_64(temps[x].val, temps[y].val, c);
+        default:
+            tcg_abort();
+        }
+    }
+    if (x == y) {
+        switch (c) {
+        case TCG_COND_EQ:
+        case TCG_COND_GE:
+        case TCG_COND_LE:
+        case TCG_COND_GEU:
+        case TCG_COND_LEU:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+    if (temps[y].state == TCG_TEMP_CONST && temps[y].val == 0) {
+        switch (c) {
+        case TCG_COND_LTU:
+            return 0;
+        case TCG_COND_GEU:
+            return 1;
+        default:
+            break;
+        }
+    }
+    return 2;
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
                                     TCGArg *args, TCGOpDef *tcg_op_defs)
@@ -276,6 +409,7 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
     const TCGOpDef *def;
     TCGArg *gen_args;
     TCGArg tmp;
+    tcg_target_ulong mask, affected;
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
        If this temp is a copy of other ones then this equivalence class'
@@ -285,7 +419,7 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
 
     nb_temps = s->nb_temps;
     nb_globals = s->nb_globals;
-    memset(temps, 0, nb_temps * sizeof(struct tcg_temp_info));
+    reset_all_temps(nb_temps);
 
     nb_ops = tcg_opc_ptr - gen_opc_buf;
     gen_args = args;
@@ -293,8 +427,7 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
         op = gen_opc_buf[op_index];
         def = &tcg_op_defs[op];
         /* Do copy propagation */
-        if (!(def->flags & (TCG_OPF_CALL_CLOBBER | TCG_OPF_SIDE_EFFECTS))) {
-            assert(op != INDEX_op_call);
+        if (op != INDEX_op_call) {
             for (i = def->nb_oargs; i < def->nb_oargs + def->nb_iargs; i++) {
                 if (temps[args[i]].state == TCG_TEMP_COPY) {
                     args[i] = temps[args[i]].val;
@@ -318,11 +451,29 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
                 args[2] = tmp;
             }
             break;
+        CASE_OP_32_64(brcond):
+            if (temps[args[0]].state == TCG_TEMP_CONST
+                && temps[args[1]].state != TCG_TEMP_CONST) {
+                tmp = args[0];
+                args[0] = args[1];
+                args[1] = tmp;
+                args[2] = tcg_swap_cond(args[2]);
+            }
+            break;
+        CASE_OP_32_64(setcond):
+            if (temps[args[1]].state == TCG_TEMP_CONST
+                && temps[args[2]].state != TCG_TEMP_CONST) {
+                tmp = args[1];
+                args[1] = args[2];
+                args[2] = tmp;
+                args[3] = tcg_swap_cond(args[3]);
+            }
+            break;
         default:
             break;
         }
 
-        /* Simplify expression if possible. */
+        /* Simplify expression for "op r, a, 0 => mov r, a" cases */
         switch (op) {
         CASE_OP_32_64(add):
         CASE_OP_32_64(sub):
@@ -331,27 +482,153 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
         CASE_OP_32_64(sar):
         CASE_OP_32_64(rotl):
         CASE_OP_32_64(rotr):
+        CASE_OP_32_64(or):
+        CASE_OP_32_64(xor):
             if (temps[args[1]].state == TCG_TEMP_CONST) {
                 /* Proceed with possible constant folding. */
                 break;
             }
             if (temps[args[2]].state == TCG_TEMP_CONST
                 && temps[args[2]].val == 0) {
-                if ((temps[args[0]].state == TCG_TEMP_COPY
-                    && temps[args[0]].val == args[1])
-                    || args[0] == args[1]) {
-                    args += 3;
-                    gen_opc_buf[op_index] = INDEX_op_nop;
-                } else {
-                    gen_opc_buf[op_index] = op_to_mov(op);
-                    tcg_opt_gen_mov(s, gen_args, args[0], args[1],
-                                    nb_temps, nb_globals);
-                    gen_args += 2;
-                    args += 3;
-                }
+                gen_args += tcg_opt_gen_copy(s, gen_opc_buf + op_index,
+                                             gen_args, args[0], args[1],
+                                             nb_temps, nb_globals);
+                args += 3;
                 continue;
             }
             break;
+        default:
+            break;
+        }
+
+        /* Simplify using the bits known to be zero.  MASK is computed for
+           operations with a single output; AFFECTED holds the input bits
+           that an "and" with a constant, or a zero extension, can clear. */
+        mask = -1;
+        affected = -1;
+        switch (op) {
+        CASE_OP_32_64(ext8s):
+            if ((temps[args[1]].mask & 0x80) != 0) {
+                break;
+            }
+            /* fallthrough */
+        CASE_OP_32_64(ext8u):
+            mask = 0xff;
+            goto and_const;
+        CASE_OP_32_64(ext16s):
+            if ((temps[args[1]].mask & 0x8000) != 0) {
+                break;
+            }
+            /* fallthrough */
+        CASE_OP_32_64(ext16u):
+            mask = 0xffff;
+            goto and_const;
+        case INDEX_op_ext32s_i64:
+            if ((temps[args[1]].mask & 0x80000000) != 0) {
+                break;
+            }
+            /* fallthrough */
+        case INDEX_op_ext32u_i64:
+            /* The input is an i32 temp, whose high bits are undefined on
+               64 bit hosts, so the extension is never dropped. */
+            mask = 0xffffffffU;
+            break;
+        CASE_OP_32_64(and):
+            mask = temps[args[2]].mask;
+            if (temps[args[2]].state == TCG_TEMP_CONST) {
+        and_const:
+                affected = temps[args[1]].mask & ~mask;
+            }
+            mask = temps[args[1]].mask & mask;
+            break;
+        CASE_OP_32_64(andc):
+            if (temps[args[2]].state == TCG_TEMP_CONST) {
+                mask = ~temps[args[2]].mask;
+                goto and_const;
+            }
+            mask = temps[args[1]].mask;
+            break;
+        case INDEX_op_sar_i32:
+            if (temps[args[2]].state == TCG_TEMP_CONST) {
+                mask = (int32_t)temps[args[1]].mask
+                       >> (temps[args[2]].val & 31);
+            }
+            break;
+        case INDEX_op_sar_i64:
+            if (temps[args[2]].state == TCG_TEMP_CONST) {
+                mask = (tcg_target_long)temps[args[1]].mask
+                       >> (temps[args[2]].val & 63);
+            }
+            break;
+        case INDEX_op_shr_i32:
+            if (temps[args[2]].state == TCG_TEMP_CONST) {
+                mask = (uint32_t)temps[args[1]].mask
+                       >> (temps[args[2]].val & 31);
+            }
+            break;
+        case INDEX_op_shr_i64:
+            if (temps[args[2]].state == TCG_TEMP_CONST) {
+                mask = temps[args[1]].mask >> (temps[args[2]].val & 63);
+            }
+            break;
+        CASE_OP_32_64(shl):
+            if (temps[args[2]].state == TCG_TEMP_CONST) {
+                mask = temps[args[1]].mask
+                       << (temps[args[2]].val & (op_bits(op) - 1));
+            }
+            break;
+        CASE_OP_32_64(or):
+        CASE_OP_32_64(xor):
+            mask = temps[args[1]].mask | temps[args[2]].mask;
+            break;
+        CASE_OP_32_64(setcond):
+            mask = 1;
+            break;
+        CASE_OP_32_64(ld8u):
+        case INDEX_op_qemu_ld8u:
+            mask = 0xff;
+            break;
+        CASE_OP_32_64(ld16u):
+        case INDEX_op_qemu_ld16u:
+            mask = 0xffff;
+            break;
+        case INDEX_op_ld32u_i64:
+#if TCG_TARGET_REG_BITS == 64
+        case INDEX_op_qemu_ld32u:
+#endif
+            mask = 0xffffffffU;
+            break;
+        default:
+            break;
+        }
+
+        /* 32 bit operations produce 32 bit results.  The guest memory
+           loads are not typed, but they are the only operations that
+           clobber the call registers. */
+        if (!(def->flags & (TCG_OPF_CALL_CLOBBER | TCG_OPF_64BIT))) {
+            mask &= 0xffffffffU;
+            affected &= 0xffffffffU;
+        }
+
+        if (mask == 0) {
+            assert(def->nb_oargs == 1);
+            gen_opc_buf[op_index] = op_to_movi(op);
+            tcg_opt_gen_movi(gen_args, args[0], 0, nb_temps, nb_globals);
+            args += def->nb_args;
+            gen_args += 2;
+            continue;
+        }
+        if (affected == 0) {
+            assert(def->nb_oargs == 1);
+            gen_args += tcg_opt_gen_copy(s, gen_opc_buf + op_index, gen_args,
+                                         args[0], args[1], nb_temps,
+                                         nb_globals);
+            args += def->nb_args;
+            continue;
+        }
+
+        /* Simplify expression for "op r, a, 0 => movi r, 0" cases */
+        switch (op) {
         CASE_OP_32_64(mul):
             if ((temps[args[2]].state == TCG_TEMP_CONST
                 && temps[args[2]].val == 0)) {
@@ -362,19 +639,36 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
                 continue;
             }
             break;
+        default:
+            break;
+        }
+
+        /* Simplify expression for "op r, a, a => mov r, a" cases */
+        switch (op) {
         CASE_OP_32_64(or):
         CASE_OP_32_64(and):
             if (args[1] == args[2]) {
-                if (args[1] == args[0]) {
-                    args += 3;
-                    gen_opc_buf[op_index] = INDEX_op_nop;
-                } else {
-                    gen_opc_buf[op_index] = op_to_mov(op);
-                    tcg_opt_gen_mov(s, gen_args, args[0], args[1], nb_temps,
-                                    nb_globals);
-                    gen_args += 2;
-                    args += 3;
-                }
+                gen_args += tcg_opt_gen_copy(s, gen_opc_buf + op_index,
+                                             gen_args, args[0], args[1],
+                                             nb_temps, nb_globals);
+                args += 3;
+                continue;
+            }
+            break;
+        default:
+            break;
+        }
+
+        /* Simplify expression for "op r, a, a => movi r, 0" cases */
+        switch (op) {
+        CASE_OP_32_64(sub):
+        CASE_OP_32_64(xor):
+        CASE_OP_32_64(andc):
+            if (args[1] == args[2]) {
+                gen_opc_buf[op_index] = op_to_movi(op);
+                tcg_opt_gen_movi(gen_args, args[0], 0, nb_temps, nb_globals);
+                args += 3;
+                gen_args += 2;
                 continue;
             }
             break;
@@ -429,6 +723,7 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
                 break;
             } else {
                 reset_temp(args[0], nb_temps, nb_globals);
+                temps[args[0]].mask = mask;
                 gen_args[0] = args[0];
                 gen_args[1] = args[1];
                 gen_args += 2;
@@ -462,6 +757,7 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
                 break;
             } else {
                 reset_temp(args[0], nb_temps, nb_globals);
+                temps[args[0]].mask = mask;
                 gen_args[0] = args[0];
                 gen_args[1] = args[1];
                 gen_args[2] = args[2];
@@ -469,9 +765,20 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
                 args += 3;
                 break;
             }
+        CASE_OP_32_64(setcond):
+            tmp = do_constant_folding_cond(op, args[1], args[2], args[3]);
+            if (tmp != 2) {
+                gen_opc_buf[op_index] = op_to_movi(op);
+                tcg_opt_gen_movi(gen_args, args[0], tmp, nb_temps, nb_globals);
+                gen_args += 2;
+                args += 4;
+                break;
+            }
+            goto do_default;
         case INDEX_op_call:
             nb_call_args = (args[0] >> 16) + (args[0] & 0xffff);
-            if (!(args[nb_call_args + 1] & (TCG_CALL_CONST | TCG_CALL_PURE))) {
+            if (!(args[nb_call_args + 1] & (TCG_CALL_NO_READ_GLOBALS |
+                                            TCG_CALL_NO_WRITE_GLOBALS))) {
                 for (i = 0; i < nb_globals; i++) {
                     reset_temp(i, nb_temps, nb_globals);
                 }
@@ -487,11 +794,25 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
                 i--;
             }
             break;
+        CASE_OP_32_64(brcond):
+            tmp = do_constant_folding_cond(op, args[0], args[1], args[2]);
+            if (tmp != 2) {
+                if (tmp) {
+                    reset_all_temps(nb_temps);
+                    gen_opc_buf[op_index] = INDEX_op_br;
+                    gen_args[0] = args[3];
+                    gen_args += 1;
+                } else {
+                    gen_opc_buf[op_index] = INDEX_op_nop;
+                }
+                args += 4;
+                break;
+            }
+            /* fallthrough */
         case INDEX_op_set_label:
         case INDEX_op_jmp:
         case INDEX_op_br:
-        CASE_OP_32_64(brcond):
-            memset(temps, 0, nb_temps * sizeof(struct tcg_temp_info));
+            reset_all_temps(nb_temps);
             for (i = 0; i < def->nb_args; i++) {
                 *gen_args = *args;
                 args++;
@@ -499,11 +820,16 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
             }
             break;
         default:
+        do_default:
             /* Default case: we do know nothing about operation so no
-               propagation is done.  We only trash output args.  */
+               propagation is done.  We only trash output args, and keep
+               the known zero bits of the first one.  */
             for (i = 0; i < def->nb_oargs; i++) {
                 reset_temp(args[i], nb_temps, nb_globals);
             }
+            if (def->nb_oargs) {
+                temps[args[0]].mask = mask;
+            }
             for (i = 0; i < def->nb_args; i++) {
                 gen_args[i] = args[i];
             }
@@ -516,10 +842,152 @@ static TCGArg *tcg_constant_folding(TCGContext *s, uint16_t *tcg_opc_ptr,
     return gen_args;
 }
 
+/* Size of the host memory access done by a load or store, 0 for other
+   operations. */
+static int ldst_size(TCGOpcode op)
+{
+    switch (op) {
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(ld8s):
+    CASE_OP_32_64(st8):
+        return 1;
+    CASE_OP_32_64(ld16u):
+    CASE_OP_32_64(ld16s):
+    CASE_OP_32_64(st16):
+        return 2;
+    case INDEX_op_ld_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_st_i32:
+    case INDEX_op_st32_i64:
+        return 4;
+    case INDEX_op_ld_i64:
+    case INDEX_op_st_i64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/* Return true if [OFS, OFS + SIZE) relative to the fixed register temp
+   BASE overlaps the canonical location of a global. */
+static bool ldst_overlaps_global(TCGContext *s, TCGArg base,
+                                 tcg_target_long ofs, int size)
+{
+    int i;
+
+    for (i = 0; i < s->nb_globals; i++) {
+        TCGTemp *ts = &s->temps[i];
+        int global_size = ts->type == TCG_TYPE_I64 ? 8 : 4;
+
+        if (!ts->fixed_reg && ts->mem_reg == s->temps[base].reg
+            && ts->mem_offset < ofs + size
+            && ofs < ts->mem_offset + global_size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#define MAX_PENDING_STORES 16
+
+typedef struct PendingStore {
+    int op_index;
+    TCGArg *args;
+    TCGArg base;
+    tcg_target_long ofs;
+    int size;
+} PendingStore;
+
+/* Remove the stores to the CPU state that are overwritten before anything
+   can read them, like the pc or flags that translators write back before
+   each instruction that may fault.  A pending store becomes visible to a
+   load from an overlapping location, to a load through another pointer,
+   and to every operation with side effects: helper calls, guest memory
+   accesses (they may fault) and branches.  Only stores relative to a
+   fixed register (env) are tracked, and not those to the canonical
+   location of a global, which the register allocator may load.  */
+static void tcg_dead_store_elimination(TCGContext *s, int nb_ops,
+                                       TCGArg *args, TCGOpDef *tcg_op_defs)
+{
+    PendingStore pending[MAX_PENDING_STORES];
+    int i, op_index, nb_pending, nb_args, size;
+    tcg_target_long ofs;
+    TCGOpcode op;
+    const TCGOpDef *def;
+
+    nb_pending = 0;
+    for (op_index = 0; op_index < nb_ops; op_index++, args += nb_args) {
+        op = gen_opc_buf[op_index];
+        def = &tcg_op_defs[op];
+        if (op == INDEX_op_call) {
+            nb_args = (args[0] >> 16) + (args[0] & 0xffff) + 3;
+        } else {
+            nb_args = def->nb_args;
+        }
+
+        size = ldst_size(op);
+        if (size == 0) {
+            if (def->flags & (TCG_OPF_SIDE_EFFECTS | TCG_OPF_CALL_CLOBBER
+                              | TCG_OPF_BB_END)) {
+                nb_pending = 0;
+            }
+            continue;
+        }
+        if (!s->temps[args[1]].fixed_reg) {
+            /* a load through another pointer may read any pending store,
+               a store through it does not make them visible */
+            if (def->nb_oargs) {
+                nb_pending = 0;
+            }
+            continue;
+        }
+
+        ofs = args[2];
+        for (i = 0; i < nb_pending; ) {
+            PendingStore *p = &pending[i];
+
+            if (p->base != args[1]) {
+                i++;
+            } else if (def->nb_oargs) {
+                /* the load keeps overlapping stores */
+                if (p->ofs < ofs + size && ofs < p->ofs + p->size) {
+                    *p = pending[--nb_pending];
+                } else {
+                    i++;
+                }
+            } else if (ofs <= p->ofs && p->ofs + p->size <= ofs + size) {
+                /* the store hides this one */
+                gen_opc_buf[p->op_index] = INDEX_op_nopn;
+                p->args[0] = 3;
+                p->args[2] = 3;
+                if (s->profile) {
+                    s->del_op_count++;
+                }
+                *p = pending[--nb_pending];
+            } else {
+                i++;
+            }
+        }
+
+        if (!def->nb_oargs && nb_pending < MAX_PENDING_STORES
+            && !ldst_overlaps_global(s, args[1], ofs, size)) {
+            pending[nb_pending].op_index = op_index;
+            pending[nb_pending].args = args;
+            pending[nb_pending].base = args[1];
+            pending[nb_pending].ofs = ofs;
+            pending[nb_pending].size = size;
+            nb_pending++;
+        }
+    }
+}
+
 TCGArg *tcg_optimize(TCGContext *s, uint16_t *tcg_opc_ptr,
         TCGArg *args, TCGOpDef *tcg_op_defs)
 {
     TCGArg *res;
     res = tcg_constant_folding(s, tcg_opc_ptr, args, tcg_op_defs);
+    tcg_dead_store_elimination(s, tcg_opc_ptr - gen_opc_buf, args,
+                               tcg_op_defs);
     return res;
 }
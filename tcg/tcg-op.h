@@ -389,6 +389,9 @@ static inline void tcg_gen_helperN(void *func, int flags, int sizemask,
                                    TCGArg ret, int nargs, TCGArg *args)
 {
     TCGv_ptr fn;
+    if (unlikely(tcg_ctx.profile_tb)) {
+        tcg_gen_profile_helper(func);
+    }
     fn = tcg_const_ptr(func);
     tcg_gen_callN(&tcg_ctx, fn, flags, sizemask, ret,
                   nargs, args);
@@ -396,9 +399,9 @@ static inline void tcg_gen_helperN(void *func, int flags, int sizemask,
 }
 
 /* Note: Both tcg_gen_helper32() and tcg_gen_helper64() are currently
-   reserved for helpers in tcg-runtime.c. These helpers are all const
-   and pure, hence the call to tcg_gen_callN() with TCG_CALL_CONST |
-   TCG_CALL_PURE. This may need to be adjusted if these functions
+   reserved for helpers in tcg-runtime.c. These helpers neither touch
+   globals nor have side effects, hence the call to tcg_gen_callN() with
+   TCG_CALL_NO_RWG_SE. This may need to be adjusted if these functions
    start to be used with other helpers. */
 static inline void tcg_gen_helper32(void *func, int sizemask, TCGv_i32 ret,
                                     TCGv_i32 a, TCGv_i32 b)
@@ -408,7 +411,7 @@ static inline void tcg_gen_helper32(void *func, int sizemask, TCGv_i32 ret,
     fn = tcg_const_ptr(func);
     args[0] = GET_TCGV_I32(a);
     args[1] = GET_TCGV_I32(b);
-    tcg_gen_callN(&tcg_ctx, fn, TCG_CALL_CONST | TCG_CALL_PURE, sizemask,
+    tcg_gen_callN(&tcg_ctx, fn, TCG_CALL_NO_RWG_SE, sizemask,
                   GET_TCGV_I32(ret), 2, args);
     tcg_temp_free_ptr(fn);
 }
@@ -421,7 +424,7 @@ static inline void tcg_gen_helper64(void *func, int sizemask, TCGv_i64 ret,
     fn = tcg_const_ptr(func);
     args[0] = GET_TCGV_I64(a);
     args[1] = GET_TCGV_I64(b);
-    tcg_gen_callN(&tcg_ctx, fn, TCG_CALL_CONST | TCG_CALL_PURE, sizemask,
+    tcg_gen_callN(&tcg_ctx, fn, TCG_CALL_NO_RWG_SE, sizemask,
                   GET_TCGV_I64(ret), 2, args);
     tcg_temp_free_ptr(fn);
 }
@@ -2164,6 +2167,10 @@ static inline void tcg_gen_debug_insn_start(uint64_t pc)
 static inline void tcg_gen_exit_tb(tcg_target_long val)
 {
     tcg_gen_op1i(INDEX_op_exit_tb, val);
+    if (val) {
+        /* the TB address, plus the jump slot index */
+        tcg_mark_ptr_op(&tcg_ctx);
+    }
 }
 
 static inline void tcg_gen_goto_tb(int idx)
@@ -2171,6 +2178,12 @@ static inline void tcg_gen_goto_tb(int idx)
     tcg_gen_op1i(INDEX_op_goto_tb, idx);
 }
 
+static inline void tcg_gen_goto_ptr(TCGv_ptr addr)
+{
+    *gen_opc_ptr++ = INDEX_op_goto_ptr;
+    *gen_opparam_ptr++ = GET_TCGV_PTR(addr);
+}
+
 #if TCG_TARGET_REG_BITS == 32
 static inline void tcg_gen_qemu_ld8u(TCGv ret, TCGv addr, int mem_index)
 {
@@ -2522,3 +2535,237 @@ static inline void tcg_gen_qemu_st64(TCGv_i64 arg, TCGv addr, int mem_index)
                                                  TCGV_PTR_TO_NAT(A), (B))
 #define tcg_gen_ext_i32_ptr(R, A) tcg_gen_ext_i32_i64(TCGV_PTR_TO_NAT(R), (A))
 #endif /* TCG_TARGET_REG_BITS != 32 */
+
+/* Vector operations on OPRSZ (8 or 16) bytes of memory at BASE + offset,
+   made of lanes of (1 << VECE) bytes.  Operands may be the same but must
+   not partially overlap.  Backends with TCG_TARGET_HAS_vec implement them
+   with host SIMD instructions, otherwise they are expanded into 64-bit
+   integer operations.  */
+
+static inline void tcg_gen_vec_op(TCGOpcode opc, TCGv_ptr base,
+                                  tcg_target_long dofs, tcg_target_long aofs,
+                                  tcg_target_long bofs, int oprsz, int vece)
+{
+    *gen_opc_ptr++ = opc;
+    *gen_opparam_ptr++ = GET_TCGV_PTR(base);
+    *gen_opparam_ptr++ = dofs;
+    *gen_opparam_ptr++ = aofs;
+    *gen_opparam_ptr++ = bofs;
+    *gen_opparam_ptr++ = oprsz;
+    *gen_opparam_ptr++ = vece;
+}
+
+/* The top bit of each lane of a 64-bit chunk.  */
+static inline uint64_t tcg_vec_msb_mask(int vece)
+{
+    static const uint64_t masks[3] = {
+        0x8080808080808080ull, 0x8000800080008000ull, 0x8000000080000000ull
+    };
+    return masks[vece];
+}
+
+/* d = a + b in each lane without carries into the next lane: add the low
+   bits of the lanes, then compute the top bits separately.  */
+static inline void tcg_gen_vec_add64(int vece, TCGv_i64 d, TCGv_i64 a,
+                                     TCGv_i64 b)
+{
+    TCGv_i64 t1, t2, t3;
+    uint64_t m = tcg_vec_msb_mask(vece);
+
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    t3 = tcg_temp_new_i64();
+    tcg_gen_andi_i64(t1, a, ~m);
+    tcg_gen_andi_i64(t2, b, ~m);
+    tcg_gen_xor_i64(t3, a, b);
+    tcg_gen_add_i64(d, t1, t2);
+    tcg_gen_andi_i64(t3, t3, m);
+    tcg_gen_xor_i64(d, d, t3);
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t3);
+}
+
+/* d = a - b in each lane: set the top bits of a so that no lane borrows
+   from the next one.  */
+static inline void tcg_gen_vec_sub64(int vece, TCGv_i64 d, TCGv_i64 a,
+                                     TCGv_i64 b)
+{
+    TCGv_i64 t1, t2, t3;
+    uint64_t m = tcg_vec_msb_mask(vece);
+
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    t3 = tcg_temp_new_i64();
+    tcg_gen_ori_i64(t1, a, m);
+    tcg_gen_andi_i64(t2, b, ~m);
+    tcg_gen_not_i64(t3, b);
+    tcg_gen_xor_i64(t3, t3, a);
+    tcg_gen_sub_i64(d, t1, t2);
+    tcg_gen_andi_i64(t3, t3, m);
+    tcg_gen_xor_i64(d, d, t3);
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t3);
+}
+
+/* d = all ones in the lanes where a == b, zero elsewhere.  */
+static inline void tcg_gen_vec_cmpeq64(int vece, TCGv_i64 d, TCGv_i64 a,
+                                       TCGv_i64 b)
+{
+    TCGv_i64 t1, t2;
+    uint64_t m;
+
+    if (vece == 3) {
+        tcg_gen_setcond_i64(TCG_COND_EQ, d, a, b);
+        tcg_gen_neg_i64(d, d);
+        return;
+    }
+    m = tcg_vec_msb_mask(vece);
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    /* the top bit of a lane of t1 is set iff the lane of a ^ b is not 0 */
+    tcg_gen_xor_i64(t2, a, b);
+    tcg_gen_andi_i64(t1, t2, ~m);
+    tcg_gen_addi_i64(t1, t1, ~m);
+    tcg_gen_or_i64(t1, t1, t2);
+    tcg_gen_not_i64(t1, t1);
+    tcg_gen_andi_i64(t1, t1, m);
+    /* spread the top bit over the whole lane */
+    tcg_gen_shri_i64(t2, t1, (8 << vece) - 1);
+    tcg_gen_sub_i64(d, t1, t2);
+    tcg_gen_or_i64(d, d, t1);
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+}
+
+static inline void tcg_gen_vec_expand(TCGOpcode opc, TCGv_ptr base,
+                                      tcg_target_long dofs,
+                                      tcg_target_long aofs,
+                                      tcg_target_long bofs,
+                                      int oprsz, int vece)
+{
+    TCGv_i64 a, b;
+    int i;
+
+    if (TCG_TARGET_HAS_vec && !(opc == INDEX_op_cmpeq_vec && vece == 3)) {
+        tcg_gen_vec_op(opc, base, dofs, aofs, bofs, oprsz, vece);
+        return;
+    }
+    a = tcg_temp_new_i64();
+    b = tcg_temp_new_i64();
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_ld_i64(a, base, aofs + i);
+        tcg_gen_ld_i64(b, base, bofs + i);
+        switch (opc) {
+        case INDEX_op_add_vec:
+            if (vece == 3) {
+                tcg_gen_add_i64(a, a, b);
+            } else {
+                tcg_gen_vec_add64(vece, a, a, b);
+            }
+            break;
+        case INDEX_op_sub_vec:
+            if (vece == 3) {
+                tcg_gen_sub_i64(a, a, b);
+            } else {
+                tcg_gen_vec_sub64(vece, a, a, b);
+            }
+            break;
+        case INDEX_op_and_vec:
+            tcg_gen_and_i64(a, a, b);
+            break;
+        case INDEX_op_or_vec:
+            tcg_gen_or_i64(a, a, b);
+            break;
+        case INDEX_op_xor_vec:
+            tcg_gen_xor_i64(a, a, b);
+            break;
+        case INDEX_op_andc_vec:
+            tcg_gen_andc_i64(a, a, b);
+            break;
+        case INDEX_op_cmpeq_vec:
+            tcg_gen_vec_cmpeq64(vece, a, a, b);
+            break;
+        default:
+            tcg_abort();
+        }
+        tcg_gen_st_i64(a, base, dofs + i);
+    }
+    tcg_temp_free_i64(a);
+    tcg_temp_free_i64(b);
+}
+
+static inline void tcg_gen_vec_add(int oprsz, int vece, TCGv_ptr base,
+                                   tcg_target_long dofs, tcg_target_long aofs,
+                                   tcg_target_long bofs)
+{
+    tcg_gen_vec_expand(INDEX_op_add_vec, base, dofs, aofs, bofs, oprsz, vece);
+}
+
+static inline void tcg_gen_vec_sub(int oprsz, int vece, TCGv_ptr base,
+                                   tcg_target_long dofs, tcg_target_long aofs,
+                                   tcg_target_long bofs)
+{
+    tcg_gen_vec_expand(INDEX_op_sub_vec, base, dofs, aofs, bofs, oprsz, vece);
+}
+
+static inline void tcg_gen_vec_and(int oprsz, TCGv_ptr base,
+                                   tcg_target_long dofs, tcg_target_long aofs,
+                                   tcg_target_long bofs)
+{
+    tcg_gen_vec_expand(INDEX_op_and_vec, base, dofs, aofs, bofs, oprsz, 0);
+}
+
+static inline void tcg_gen_vec_or(int oprsz, TCGv_ptr base,
+                                  tcg_target_long dofs, tcg_target_long aofs,
+                                  tcg_target_long bofs)
+{
+    tcg_gen_vec_expand(INDEX_op_or_vec, base, dofs, aofs, bofs, oprsz, 0);
+}
+
+static inline void tcg_gen_vec_xor(int oprsz, TCGv_ptr base,
+                                   tcg_target_long dofs, tcg_target_long aofs,
+                                   tcg_target_long bofs)
+{
+    tcg_gen_vec_expand(INDEX_op_xor_vec, base, dofs, aofs, bofs, oprsz, 0);
+}
+
+/* d = a & ~b */
+static inline void tcg_gen_vec_andc(int oprsz, TCGv_ptr base,
+                                    tcg_target_long dofs, tcg_target_long aofs,
+                                    tcg_target_long bofs)
+{
+    tcg_gen_vec_expand(INDEX_op_andc_vec, base, dofs, aofs, bofs, oprsz, 0);
+}
+
+static inline void tcg_gen_vec_cmpeq(int oprsz, int vece, TCGv_ptr base,
+                                     tcg_target_long dofs,
+                                     tcg_target_long aofs,
+                                     tcg_target_long bofs)
+{
+    tcg_gen_vec_expand(INDEX_op_cmpeq_vec, base, dofs, aofs, bofs, oprsz,
+                       vece);
+}
+
+/* Lane i of the 16 bytes at dofs gets lane (order >> (2 * i)) & 3 of the
+   16 bytes at aofs, counting 32-bit lanes in memory order.  */
+static inline void tcg_gen_vec_shufd(TCGv_ptr base, tcg_target_long dofs,
+                                     tcg_target_long aofs, int order)
+{
+    TCGv_i32 t[4];
+    int i;
+
+    if (TCG_TARGET_HAS_vec) {
+        tcg_gen_vec_op(INDEX_op_shufd_vec, base, dofs, aofs, order, 16, 2);
+        return;
+    }
+    for (i = 0; i < 4; i++) {
+        t[i] = tcg_temp_new_i32();
+        tcg_gen_ld_i32(t[i], base, aofs + ((order >> (2 * i)) & 3) * 4);
+    }
+    for (i = 0; i < 4; i++) {
+        tcg_gen_st_i32(t[i], base, dofs + i * 4);
+        tcg_temp_free_i32(t[i]);
+    }
+}
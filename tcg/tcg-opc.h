@@ -158,6 +158,17 @@ DEF(eqv_i64, 1, 2, 0, IMPL64 | IMPL(TCG_TARGET_HAS_eqv_i64))
 DEF(nand_i64, 1, 2, 0, IMPL64 | IMPL(TCG_TARGET_HAS_nand_i64))
 DEF(nor_i64, 1, 2, 0, IMPL64 | IMPL(TCG_TARGET_HAS_nor_i64))
 
+/* vector ops: base, dofs, aofs, bofs, oprsz, vece (see tcg_gen_vec_op) */
+DEF(add_vec, 0, 1, 5, TCG_OPF_SIDE_EFFECTS | IMPL(TCG_TARGET_HAS_vec))
+DEF(sub_vec, 0, 1, 5, TCG_OPF_SIDE_EFFECTS | IMPL(TCG_TARGET_HAS_vec))
+DEF(and_vec, 0, 1, 5, TCG_OPF_SIDE_EFFECTS | IMPL(TCG_TARGET_HAS_vec))
+DEF(or_vec, 0, 1, 5, TCG_OPF_SIDE_EFFECTS | IMPL(TCG_TARGET_HAS_vec))
+DEF(xor_vec, 0, 1, 5, TCG_OPF_SIDE_EFFECTS | IMPL(TCG_TARGET_HAS_vec))
+DEF(andc_vec, 0, 1, 5, TCG_OPF_SIDE_EFFECTS | IMPL(TCG_TARGET_HAS_vec))
+DEF(cmpeq_vec, 0, 1, 5, TCG_OPF_SIDE_EFFECTS | IMPL(TCG_TARGET_HAS_vec))
+/* bofs is the shuffle order */
+DEF(shufd_vec, 0, 1, 5, TCG_OPF_SIDE_EFFECTS | IMPL(TCG_TARGET_HAS_vec))
+
 /* QEMU specific */
 #if TARGET_LONG_BITS > TCG_TARGET_REG_BITS
 DEF(debug_insn_start, 0, 0, 2, 0)
@@ -166,6 +177,8 @@ DEF(debug_insn_start, 0, 0, 1, 0)
 #endif
 DEF(exit_tb, 0, 0, 1, TCG_OPF_BB_END | TCG_OPF_SIDE_EFFECTS)
 DEF(goto_tb, 0, 0, 1, TCG_OPF_BB_END | TCG_OPF_SIDE_EFFECTS)
+DEF(goto_ptr, 0, 1, 0,
+    TCG_OPF_BB_END | TCG_OPF_SIDE_EFFECTS | IMPL(TCG_TARGET_HAS_goto_ptr))
 /* Note: even if TARGET_LONG_BITS is not defined, the INDEX_op
    constants must be defined */
 #if TCG_TARGET_REG_BITS == 32
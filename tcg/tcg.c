@@ -107,18 +107,19 @@ TCGArg *gen_opparam_ptr;
 
 static inline void tcg_out8(TCGContext *s, uint8_t v)
 {
-    *s->code_ptr++ = v;
+    *tcg_code_rw(s->code_ptr) = v;
+    s->code_ptr++;
 }
 
 static inline void tcg_out16(TCGContext *s, uint16_t v)
 {
-    *(uint16_t *)s->code_ptr = v;
+    *(uint16_t *)tcg_code_rw(s->code_ptr) = v;
     s->code_ptr += 2;
 }
 
 static inline void tcg_out32(TCGContext *s, uint32_t v)
 {
-    *(uint32_t *)s->code_ptr = v;
+    *(uint32_t *)tcg_code_rw(s->code_ptr) = v;
     s->code_ptr += 4;
 }
 
@@ -298,6 +299,8 @@ void tcg_func_start(TCGContext *s)
     s->labels = tcg_malloc(sizeof(TCGLabel) * TCG_MAX_LABELS);
     s->nb_labels = 0;
     s->current_frame_offset = s->frame_start;
+    s->nb_ptr_ops = 0;
+    s->ops_analyzed = 0;
 
     gen_opc_ptr = gen_opc_buf;
     gen_opparam_ptr = gen_opparam_buf;
@@ -551,6 +554,28 @@ TCGv_i64 tcg_const_i64(int64_t val)
     return t0;
 }
 
+/* record that the last parameter of the last op is a host pointer */
+void tcg_mark_ptr_op(TCGContext *s)
+{
+    if (s->nb_ptr_ops < TCG_MAX_PTR_OPS) {
+        s->ptr_ops[s->nb_ptr_ops] = gen_opc_ptr - 1 - gen_opc_buf;
+        s->ptr_vals[s->nb_ptr_ops] = gen_opparam_ptr[-1];
+    }
+    s->nb_ptr_ops++;
+}
+
+TCGv_ptr tcg_const_ptr_internal(tcg_target_long val)
+{
+    TCGv_ptr t0;
+#if TCG_TARGET_REG_BITS == 32
+    t0 = TCGV_NAT_TO_PTR(tcg_const_i32(val));
+#else
+    t0 = TCGV_NAT_TO_PTR(tcg_const_i64(val));
+#endif
+    tcg_mark_ptr_op(&tcg_ctx);
+    return t0;
+}
+
 TCGv_i32 tcg_const_local_i32(int32_t val)
 {
     TCGv_i32 t0;
@@ -1254,9 +1279,9 @@ static void tcg_liveness_analysis(TCGContext *s)
                 args++;
                 call_flags = args[nb_oargs + nb_iargs];
 
-                /* pure functions can be removed if their result is not
-                   used */
-                if (call_flags & TCG_CALL_PURE) {
+                /* calls without side effects can be removed if their
+                   result is not used */
+                if (call_flags & TCG_CALL_NO_SIDE_EFFECTS) {
                     for(i = 0; i < nb_oargs; i++) {
                         arg = args[i];
                         if (!dead_temps[arg])
@@ -1277,7 +1302,7 @@ static void tcg_liveness_analysis(TCGContext *s)
                         dead_temps[arg] = 1;
                     }
                     
-                    if (!(call_flags & TCG_CALL_CONST)) {
+                    if (!(call_flags & TCG_CALL_NO_READ_GLOBALS)) {
                         /* globals are live (they may be used by the call) */
                         memset(dead_temps, 0, s->nb_globals);
                     }
@@ -1332,9 +1357,9 @@ static void tcg_liveness_analysis(TCGContext *s)
                         goto do_not_remove;
                 }
                 tcg_set_nop(s, gen_opc_buf + op_index, args, def->nb_args);
-#ifdef CONFIG_PROFILER
-                s->del_op_count++;
-#endif
+                if (s->profile) {
+                    s->del_op_count++;
+                }
             } else {
             do_not_remove:
 
@@ -1570,6 +1595,52 @@ static void save_globals(TCGContext *s, TCGRegSet allocated_regs)
     }
 }
 
+/* store a temporary to memory if needed, but keep it in its register.
+   Constants are stored through a scratch register and stay constants. */
+static void temp_sync(TCGContext *s, int temp, TCGRegSet allocated_regs)
+{
+    TCGTemp *ts;
+    int reg;
+
+    ts = &s->temps[temp];
+    if (!ts->fixed_reg) {
+        switch(ts->val_type) {
+        case TEMP_VAL_REG:
+            if (!ts->mem_coherent) {
+                if (!ts->mem_allocated)
+                    temp_allocate_frame(s, temp);
+                tcg_out_st(s, ts->type, ts->reg, ts->mem_reg, ts->mem_offset);
+                ts->mem_coherent = 1;
+            }
+            break;
+        case TEMP_VAL_CONST:
+            reg = tcg_reg_alloc(s, tcg_target_available_regs[ts->type],
+                                allocated_regs);
+            if (!ts->mem_allocated)
+                temp_allocate_frame(s, temp);
+            tcg_out_movi(s, ts->type, reg, ts->val);
+            tcg_out_st(s, ts->type, reg, ts->mem_reg, ts->mem_offset);
+            break;
+        case TEMP_VAL_DEAD:
+        case TEMP_VAL_MEM:
+            break;
+        default:
+            tcg_abort();
+        }
+    }
+}
+
+/* store all globals to their canonical location, keeping the copies
+   in host registers valid */
+static void sync_globals(TCGContext *s, TCGRegSet allocated_regs)
+{
+    int i;
+
+    for(i = 0; i < s->nb_globals; i++) {
+        temp_sync(s, i, allocated_regs);
+    }
+}
+
 /* at the end of a basic block, we assume all temporaries are dead and
    all globals are stored at their canonical location. */
 static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
@@ -1990,9 +2061,13 @@ static int tcg_reg_alloc_call(TCGContext *s, const TCGOpDef *def,
         }
     }
     
-    /* store globals and free associated registers (we assume the call
-       can modify any global. */
-    if (!(flags & TCG_CALL_CONST)) {
+    /* globals the call may read must be in memory; if it may also write
+       them, the copies in host registers become stale */
+    if (flags & TCG_CALL_NO_READ_GLOBALS) {
+        /* nothing to do */
+    } else if (flags & TCG_CALL_NO_WRITE_GLOBALS) {
+        sync_globals(s, allocated_regs);
+    } else {
         save_globals(s, allocated_regs);
     }
 
@@ -2025,32 +2100,10 @@ static int tcg_reg_alloc_call(TCGContext *s, const TCGOpDef *def,
     return nb_iargs + nb_oargs + def->nb_cargs + 1;
 }
 
-#ifdef CONFIG_PROFILER
-
-static int64_t tcg_table_op_count[NB_OPS];
-
-static void dump_op_count(void)
-{
-    int i;
-    FILE *f;
-    f = fopen("/tmp/op.log", "w");
-    for(i = INDEX_op_end; i < NB_OPS; i++) {
-        fprintf(f, "%s %" PRId64 "\n", tcg_op_defs[i].name, tcg_table_op_count[i]);
-    }
-    fclose(f);
-}
-#endif
-
-
-static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
-                                      long search_pc)
+/* Optimize the ops of the TB being generated and compute the liveness of
+   their arguments.  tcg_gen_code does it unless it was done already.  */
+void tcg_analyze_ops(TCGContext *s)
 {
-    TCGOpcode opc;
-    int op_index;
-    const TCGOpDef *def;
-    unsigned int dead_args;
-    const TCGArg *args;
-
 #ifdef DEBUG_DISAS
     if (unlikely(qemu_loglevel_mask(CPU_LOG_TB_OP))) {
         qemu_log("OP:\n");
@@ -2064,13 +2117,13 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
         tcg_optimize(s, gen_opc_ptr, gen_opparam_buf, tcg_op_defs);
 #endif
 
-#ifdef CONFIG_PROFILER
-    s->la_time -= profile_getclock();
-#endif
+    if (s->profile) {
+        s->la_time -= profile_getclock();
+    }
     tcg_liveness_analysis(s);
-#ifdef CONFIG_PROFILER
-    s->la_time += profile_getclock();
-#endif
+    if (s->profile) {
+        s->la_time += profile_getclock();
+    }
 
 #ifdef DEBUG_DISAS
     if (unlikely(qemu_loglevel_mask(CPU_LOG_TB_OP_OPT))) {
@@ -2079,6 +2132,21 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
         qemu_log("\n");
     }
 #endif
+    s->ops_analyzed = 1;
+}
+
+static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
+                                      long search_pc)
+{
+    TCGOpcode opc;
+    int op_index;
+    const TCGOpDef *def;
+    unsigned int dead_args;
+    const TCGArg *args;
+
+    if (!s->ops_analyzed) {
+        tcg_analyze_ops(s);
+    }
 
     tcg_reg_alloc_start(s);
 
@@ -2090,9 +2158,6 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
 
     for(;;) {
         opc = gen_opc_buf[op_index];
-#ifdef CONFIG_PROFILER
-        tcg_table_op_count[opc]++;
-#endif
         def = &tcg_op_defs[opc];
 #if 0
         printf("%s: %d %d %d\n", def->name,
@@ -2174,8 +2239,7 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
 
 int tcg_gen_code(TCGContext *s, uint8_t *gen_code_buf)
 {
-#ifdef CONFIG_PROFILER
-    {
+    if (s->profile) {
         int n;
         n = (gen_opc_ptr - gen_opc_buf);
         s->op_count += n;
@@ -2186,7 +2250,6 @@ int tcg_gen_code(TCGContext *s, uint8_t *gen_code_buf)
         if (s->nb_temps > s->temp_count_max)
             s->temp_count_max = s->nb_temps;
     }
-#endif
 
     tcg_gen_code_common(s, gen_code_buf, -1);
 
@@ -2206,12 +2269,91 @@ int tcg_gen_code_search_pc(TCGContext *s, uint8_t *gen_code_buf, long offset)
     return tcg_gen_code_common(s, gen_code_buf, offset);
 }
 
-#ifdef CONFIG_PROFILER
+/* Emit code that increments a 64-bit counter at a fixed host address.  */
+void tcg_gen_profile_count(uint64_t *counter)
+{
+    TCGv_ptr ptr = tcg_const_ptr(counter);
+    TCGv_i64 count = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
+/* Count the calls to 'func' if it is a registered helper.  */
+void tcg_gen_profile_helper(void *func)
+{
+    TCGHelperInfo *th = tcg_find_helper(&tcg_ctx, (tcg_target_ulong)func);
+
+    if (th) {
+        tcg_gen_profile_count(&th->count);
+    }
+}
+
+void tcg_profile_reset(TCGContext *s)
+{
+    int i;
+
+    s->tb_count1 = 0;
+    s->tb_count = 0;
+    s->op_count = 0;
+    s->op_count_max = 0;
+    s->temp_count = 0;
+    s->temp_count_max = 0;
+    s->del_op_count = 0;
+    s->code_in_len = 0;
+    s->code_out_len = 0;
+    s->interm_time = 0;
+    s->code_time = 0;
+    s->la_time = 0;
+    s->restore_count = 0;
+    s->restore_time = 0;
+    for (i = 0; i < s->nb_helpers; i++) {
+        s->helpers[i].count = 0;
+    }
+}
+
+/* Fill 'top' with the (at most n) most called helpers, most called
+   first, and return how many were found.  */
+int tcg_profile_top_helpers(TCGContext *s, TCGHelperInfo **top, int n)
+{
+    int i, j, nb_top = 0;
+    TCGHelperInfo *th;
+
+    for (i = 0; i < s->nb_helpers; i++) {
+        th = &s->helpers[i];
+        if (th->count == 0) {
+            continue;
+        }
+        for (j = nb_top; j > 0 && top[j - 1]->count < th->count; j--) {
+            if (j < n) {
+                top[j] = top[j - 1];
+            }
+        }
+        if (j < n) {
+            top[j] = th;
+            if (nb_top < n) {
+                nb_top++;
+            }
+        }
+    }
+    return nb_top;
+}
+
 void tcg_dump_info(FILE *f, fprintf_function cpu_fprintf)
 {
     TCGContext *s = &tcg_ctx;
+    TCGHelperInfo *top[10];
     int64_t tot;
+    int i, n;
 
+    if (!s->profile && s->tb_count1 == 0) {
+        cpu_fprintf(f, "[TCG profiling disabled, see \"jit_profile\"]\n");
+        return;
+    }
+    cpu_fprintf(f, "\nTCG profile (%s):\n", s->profile ? "on" : "off");
     tot = s->interm_time + s->code_time;
     cpu_fprintf(f, "JIT cycles          %" PRId64 " (%0.3f s at 2.4 GHz)\n",
                 tot, tot / 2.4e9);
@@ -2229,6 +2371,8 @@ void tcg_dump_info(FILE *f, fprintf_function cpu_fprintf)
                 (double)s->temp_count / s->tb_count : 0,
                 s->temp_count_max);
     
+    cpu_fprintf(f, "cycles/TB           %0.1f\n",
+                s->tb_count ? (double)tot / s->tb_count : 0);
     cpu_fprintf(f, "cycles/op           %0.1f\n", 
                 s->op_count ? (double)tot / s->op_count : 0);
     cpu_fprintf(f, "cycles/in byte      %0.1f\n", 
@@ -2248,14 +2392,13 @@ void tcg_dump_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "  avg cycles        %0.1f\n",
                 s->restore_count ? (double)s->restore_time / s->restore_count : 0);
 
-    dump_op_count();
-}
-#else
-void tcg_dump_info(FILE *f, fprintf_function cpu_fprintf)
-{
-    cpu_fprintf(f, "[TCG profiler not compiled]\n");
+    n = tcg_profile_top_helpers(s, top, ARRAY_SIZE(top));
+    for (i = 0; i < n; i++) {
+        cpu_fprintf(f, "%s%-20s %" PRIu64 " calls\n",
+                    i == 0 ? "top helpers:\n  " : "  ",
+                    top[i]->name, top[i]->count);
+    }
 }
-#endif
 
 #ifdef ELF_HOST_MACHINE
 /* In order to use this feature, the backend needs to do three things:
@@ -144,6 +144,7 @@ typedef struct TCGPool {
 #define TCG_MAX_LABELS 512
 
 #define TCG_MAX_TEMPS 512
+#define TCG_MAX_PTR_OPS 256
 
 /* when the size of the arguments of a called function is smaller than
    this value, they are statically allocated in the TB stack frame */
@@ -252,14 +253,23 @@ typedef int TCGv_i64;
 #define TCGV_UNUSED_I64(x) x = MAKE_TCGV_I64(-1)
 
 /* call flags */
-/* A pure function only reads its arguments and TCG global variables
-   and cannot raise exceptions. Hence a call to a pure function can be
-   safely suppressed if the return value is not used. */
-#define TCG_CALL_PURE           0x0010 
-/* A const function only reads its arguments and does not use TCG
-   global variables. Hence a call to such a function does not
-   save TCG global variables back to their canonical location. */
-#define TCG_CALL_CONST          0x0020
+/* Helper does not read globals (either directly or through an exception).
+   It implies TCG_CALL_NO_WRITE_GLOBALS.  Globals are neither saved to
+   their canonical location nor reloaded around the call. */
+#define TCG_CALL_NO_READ_GLOBALS    0x0010
+/* Helper does not write globals.  Globals are stored back to their
+   canonical location before the call but stay in their host registers. */
+#define TCG_CALL_NO_WRITE_GLOBALS   0x0020
+/* Helper has no side effects and cannot raise exceptions: the call can be
+   suppressed if its return value is not used. */
+#define TCG_CALL_NO_SIDE_EFFECTS    0x0040
+
+/* convenience versions of the most used call flags */
+#define TCG_CALL_NO_RWG         TCG_CALL_NO_READ_GLOBALS
+#define TCG_CALL_NO_WG          TCG_CALL_NO_WRITE_GLOBALS
+#define TCG_CALL_NO_SE          TCG_CALL_NO_SIDE_EFFECTS
+#define TCG_CALL_NO_RWG_SE      (TCG_CALL_NO_RWG | TCG_CALL_NO_SE)
+#define TCG_CALL_NO_WG_SE       (TCG_CALL_NO_WG | TCG_CALL_NO_SE)
 
 /* used to align parameters */
 #define TCG_CALL_DUMMY_TCGV     MAKE_TCGV_I32(-1)
@@ -326,6 +336,7 @@ typedef struct TCGTemp {
 typedef struct TCGHelperInfo {
     tcg_target_ulong func;
     const char *name;
+    uint64_t count; /* calls made by code translated while profiling */
 } TCGHelperInfo;
 
 typedef struct TCGContext TCGContext;
@@ -347,6 +358,9 @@ struct TCGContext {
     uint16_t *tb_next_offset;
     uint16_t *tb_jmp_offset; /* != NULL if USE_DIRECT_JUMP */
 
+    /* goto_ptr support: returns 0 to cpu_exec(), set by the backend */
+    uint8_t *code_gen_epilogue;
+
     /* liveness analysis */
     uint16_t *op_dead_args; /* for each operation, each bit tells if the
                                corresponding argument is dead */
@@ -363,13 +377,25 @@ struct TCGContext {
     uint8_t *code_ptr;
     TCGTemp static_temps[TCG_MAX_TEMPS];
 
+    /* movi and exit_tb ops whose constant is a host pointer (helpers, TB
+       addresses) and the pointers, so that the ops of a TB can be
+       relocated.  nb_ptr_ops may exceed TCG_MAX_PTR_OPS, the extra ones
+       are not recorded.  */
+    int nb_ptr_ops;
+    int ptr_ops[TCG_MAX_PTR_OPS];
+    tcg_target_ulong ptr_vals[TCG_MAX_PTR_OPS];
+
+    /* set once tcg_analyze_ops has run */
+    int ops_analyzed;
+
     TCGHelperInfo *helpers;
     int nb_helpers;
     int allocated_helpers;
     int helpers_sorted;
 
-#ifdef CONFIG_PROFILER
-    /* profiling info */
+    /* profiling info, only updated while 'profile' is set */
+    int profile;
+    int profile_tb; /* count the helper calls of the TB being generated */
     int64_t tb_count1;
     int64_t tb_count;
     int64_t op_count; /* total insn count */
@@ -384,7 +410,6 @@ struct TCGContext {
     int64_t la_time;
     int64_t restore_count;
     int64_t restore_time;
-#endif
 
 #ifdef CONFIG_DEBUG_TCG
     int temps_in_use;
@@ -539,7 +564,6 @@ void tcg_add_target_add_op_defs(const TCGTargetOpDef *tdefs);
 #define TCGV_NAT_TO_PTR(n) MAKE_TCGV_PTR(GET_TCGV_I32(n))
 #define TCGV_PTR_TO_NAT(n) MAKE_TCGV_I32(GET_TCGV_PTR(n))
 
-#define tcg_const_ptr(V) TCGV_NAT_TO_PTR(tcg_const_i32((tcg_target_long)(V)))
 #define tcg_global_reg_new_ptr(R, N) \
     TCGV_NAT_TO_PTR(tcg_global_reg_new_i32((R), (N)))
 #define tcg_global_mem_new_ptr(R, O, N) \
@@ -550,7 +574,6 @@ void tcg_add_target_add_op_defs(const TCGTargetOpDef *tdefs);
 #define TCGV_NAT_TO_PTR(n) MAKE_TCGV_PTR(GET_TCGV_I64(n))
 #define TCGV_PTR_TO_NAT(n) MAKE_TCGV_I64(GET_TCGV_PTR(n))
 
-#define tcg_const_ptr(V) TCGV_NAT_TO_PTR(tcg_const_i64((tcg_target_long)(V)))
 #define tcg_global_reg_new_ptr(R, N) \
     TCGV_NAT_TO_PTR(tcg_global_reg_new_i64((R), (N)))
 #define tcg_global_mem_new_ptr(R, O, N) \
@@ -559,6 +582,10 @@ void tcg_add_target_add_op_defs(const TCGTargetOpDef *tdefs);
 #define tcg_temp_free_ptr(T) tcg_temp_free_i64(TCGV_PTR_TO_NAT(T))
 #endif
 
+TCGv_ptr tcg_const_ptr_internal(tcg_target_long val);
+#define tcg_const_ptr(V) tcg_const_ptr_internal((tcg_target_long)(V))
+void tcg_mark_ptr_op(TCGContext *s);
+
 void tcg_gen_callN(TCGContext *s, TCGv_ptr func, unsigned int flags,
                    int sizemask, TCGArg ret, int nargs, TCGArg *args);
 
@@ -571,7 +598,12 @@ TCGArg *tcg_optimize(TCGContext *s, uint16_t *tcg_opc_ptr, TCGArg *args,
 /* only used for debugging purposes */
 void tcg_register_helper(void *func, const char *name);
 const char *tcg_helper_get_name(TCGContext *s, void *func);
+void tcg_gen_profile_count(uint64_t *counter);
+void tcg_gen_profile_helper(void *func);
+void tcg_profile_reset(TCGContext *s);
+int tcg_profile_top_helpers(TCGContext *s, TCGHelperInfo **top, int n);
 void tcg_dump_ops(TCGContext *s);
+void tcg_analyze_ops(TCGContext *s);
 
 void dump_ops(const uint16_t *opc_buf, const TCGArg *opparam_buf);
 TCGv_i32 tcg_const_i32(int32_t val);
@@ -579,7 +611,25 @@ TCGv_i64 tcg_const_i64(int64_t val);
 TCGv_i32 tcg_const_local_i32(int32_t val);
 TCGv_i64 tcg_const_local_i64(int64_t val);
 
-extern uint8_t code_gen_prologue[];
+extern uint8_t *code_gen_prologue;
+
+/* With -tcg-buffer split-wx the code buffer is mapped twice, executable
+   and writable; code pointers always refer to the executable mapping and
+   the backend stores through the writable one, code_gen_rw_offset bytes
+   away.  */
+#ifdef TCG_TARGET_SPLIT_WX
+extern uintptr_t code_gen_rw_offset;
+
+static inline uint8_t *tcg_code_rw(uint8_t *p)
+{
+    return p + code_gen_rw_offset;
+}
+#else
+static inline uint8_t *tcg_code_rw(uint8_t *p)
+{
+    return p;
+}
+#endif
 
 /* TCG targets may use a different definition of tcg_qemu_tb_exec. */
 #if !defined(tcg_qemu_tb_exec)
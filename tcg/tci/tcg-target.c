@@ -68,6 +68,7 @@ static uint8_t *tb_ret_addr;
 static const TCGTargetOpDef tcg_target_op_defs[] = {
     { INDEX_op_exit_tb, { NULL } },
     { INDEX_op_goto_tb, { NULL } },
+    { INDEX_op_goto_ptr, { R } },
     { INDEX_op_call, { RI } },
     { INDEX_op_jmp, { RI } },
     { INDEX_op_br, { NULL } },
@@ -84,9 +85,9 @@ static const TCGTargetOpDef tcg_target_op_defs[] = {
     { INDEX_op_st16_i32, { R, R } },
     { INDEX_op_st_i32, { R, R } },
 
-    { INDEX_op_add_i32, { R, RI, RI } },
-    { INDEX_op_sub_i32, { R, RI, RI } },
-    { INDEX_op_mul_i32, { R, RI, RI } },
+    { INDEX_op_add_i32, { R, R, RI } },
+    { INDEX_op_sub_i32, { R, R, RI } },
+    { INDEX_op_mul_i32, { R, R, RI } },
 #if TCG_TARGET_HAS_div_i32
     { INDEX_op_div_i32, { R, R, R } },
     { INDEX_op_divu_i32, { R, R, R } },
@@ -96,32 +97,30 @@ static const TCGTargetOpDef tcg_target_op_defs[] = {
     { INDEX_op_div2_i32, { R, R, "0", "1", R } },
     { INDEX_op_divu2_i32, { R, R, "0", "1", R } },
 #endif
-    /* TODO: Does R, RI, RI result in faster code than R, R, RI?
-       If both operands are constants, we can optimize. */
-    { INDEX_op_and_i32, { R, RI, RI } },
+    { INDEX_op_and_i32, { R, R, RI } },
 #if TCG_TARGET_HAS_andc_i32
-    { INDEX_op_andc_i32, { R, RI, RI } },
+    { INDEX_op_andc_i32, { R, R, RI } },
 #endif
 #if TCG_TARGET_HAS_eqv_i32
-    { INDEX_op_eqv_i32, { R, RI, RI } },
+    { INDEX_op_eqv_i32, { R, R, RI } },
 #endif
 #if TCG_TARGET_HAS_nand_i32
-    { INDEX_op_nand_i32, { R, RI, RI } },
+    { INDEX_op_nand_i32, { R, R, RI } },
 #endif
 #if TCG_TARGET_HAS_nor_i32
-    { INDEX_op_nor_i32, { R, RI, RI } },
+    { INDEX_op_nor_i32, { R, R, RI } },
 #endif
-    { INDEX_op_or_i32, { R, RI, RI } },
+    { INDEX_op_or_i32, { R, R, RI } },
 #if TCG_TARGET_HAS_orc_i32
-    { INDEX_op_orc_i32, { R, RI, RI } },
+    { INDEX_op_orc_i32, { R, R, RI } },
 #endif
-    { INDEX_op_xor_i32, { R, RI, RI } },
-    { INDEX_op_shl_i32, { R, RI, RI } },
-    { INDEX_op_shr_i32, { R, RI, RI } },
-    { INDEX_op_sar_i32, { R, RI, RI } },
+    { INDEX_op_xor_i32, { R, R, RI } },
+    { INDEX_op_shl_i32, { R, R, RI } },
+    { INDEX_op_shr_i32, { R, R, RI } },
+    { INDEX_op_sar_i32, { R, R, RI } },
 #if TCG_TARGET_HAS_rot_i32
-    { INDEX_op_rotl_i32, { R, RI, RI } },
-    { INDEX_op_rotr_i32, { R, RI, RI } },
+    { INDEX_op_rotl_i32, { R, R, RI } },
+    { INDEX_op_rotr_i32, { R, R, RI } },
 #endif
 
     { INDEX_op_brcond_i32, { R, RI } },
@@ -132,12 +131,11 @@ static const TCGTargetOpDef tcg_target_op_defs[] = {
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
 #if TCG_TARGET_REG_BITS == 32
-    /* TODO: Support R, R, R, R, RI, RI? Will it be faster? */
     { INDEX_op_add2_i32, { R, R, R, R, R, R } },
     { INDEX_op_sub2_i32, { R, R, R, R, R, R } },
-    { INDEX_op_brcond2_i32, { R, R, RI, RI } },
+    { INDEX_op_brcond2_i32, { R, R, R, R } },
     { INDEX_op_mulu2_i32, { R, R, R, R } },
-    { INDEX_op_setcond2_i32, { R, R, R, RI, RI } },
+    { INDEX_op_setcond2_i32, { R, R, R, R, R } },
 #endif
 
 #if TCG_TARGET_HAS_not_i32
@@ -164,9 +162,9 @@ static const TCGTargetOpDef tcg_target_op_defs[] = {
     { INDEX_op_st32_i64, { R, R } },
     { INDEX_op_st_i64, { R, R } },
 
-    { INDEX_op_add_i64, { R, RI, RI } },
-    { INDEX_op_sub_i64, { R, RI, RI } },
-    { INDEX_op_mul_i64, { R, RI, RI } },
+    { INDEX_op_add_i64, { R, R, RI } },
+    { INDEX_op_sub_i64, { R, R, RI } },
+    { INDEX_op_mul_i64, { R, R, RI } },
 #if TCG_TARGET_HAS_div_i64
     { INDEX_op_div_i64, { R, R, R } },
     { INDEX_op_divu_i64, { R, R, R } },
@@ -176,30 +174,30 @@ static const TCGTargetOpDef tcg_target_op_defs[] = {
     { INDEX_op_div2_i64, { R, R, "0", "1", R } },
     { INDEX_op_divu2_i64, { R, R, "0", "1", R } },
 #endif
-    { INDEX_op_and_i64, { R, RI, RI } },
+    { INDEX_op_and_i64, { R, R, RI } },
 #if TCG_TARGET_HAS_andc_i64
-    { INDEX_op_andc_i64, { R, RI, RI } },
+    { INDEX_op_andc_i64, { R, R, RI } },
 #endif
 #if TCG_TARGET_HAS_eqv_i64
-    { INDEX_op_eqv_i64, { R, RI, RI } },
+    { INDEX_op_eqv_i64, { R, R, RI } },
 #endif
 #if TCG_TARGET_HAS_nand_i64
-    { INDEX_op_nand_i64, { R, RI, RI } },
+    { INDEX_op_nand_i64, { R, R, RI } },
 #endif
 #if TCG_TARGET_HAS_nor_i64
-    { INDEX_op_nor_i64, { R, RI, RI } },
+    { INDEX_op_nor_i64, { R, R, RI } },
 #endif
-    { INDEX_op_or_i64, { R, RI, RI } },
+    { INDEX_op_or_i64, { R, R, RI } },
 #if TCG_TARGET_HAS_orc_i64
-    { INDEX_op_orc_i64, { R, RI, RI } },
+    { INDEX_op_orc_i64, { R, R, RI } },
 #endif
-    { INDEX_op_xor_i64, { R, RI, RI } },
-    { INDEX_op_shl_i64, { R, RI, RI } },
-    { INDEX_op_shr_i64, { R, RI, RI } },
-    { INDEX_op_sar_i64, { R, RI, RI } },
+    { INDEX_op_xor_i64, { R, R, RI } },
+    { INDEX_op_shl_i64, { R, R, RI } },
+    { INDEX_op_shr_i64, { R, R, RI } },
+    { INDEX_op_sar_i64, { R, R, RI } },
 #if TCG_TARGET_HAS_rot_i64
-    { INDEX_op_rotl_i64, { R, RI, RI } },
-    { INDEX_op_rotr_i64, { R, RI, RI } },
+    { INDEX_op_rotl_i64, { R, R, RI } },
+    { INDEX_op_rotr_i64, { R, R, RI } },
 #endif
     { INDEX_op_brcond_i64, { R, RI } },
 
@@ -300,25 +298,26 @@ static const int tcg_target_reg_alloc_order[] = {
 #endif
 };
 
-#if MAX_OPC_PARAM_IARGS != 4
-# error Fix needed, number of supported input arguments changed!
-#endif
-
+/* Helpers take up to 5 arguments (DEF_HELPER_FLAGS_5), all of them are
+   passed in registers.  tcg_qemu_tb_exec must use the same list.  */
 static const int tcg_target_call_iarg_regs[] = {
     TCG_REG_R0,
     TCG_REG_R1,
     TCG_REG_R2,
     TCG_REG_R3,
-#if TCG_TARGET_REG_BITS == 32
-    /* 32 bit hosts need 2 * MAX_OPC_PARAM_IARGS registers. */
 #if 0 /* used for TCG_REG_CALL_STACK */
     TCG_REG_R4,
 #endif
     TCG_REG_R5,
+#if TCG_TARGET_REG_BITS == 32
+    /* 32 bit hosts need 2 * 5 registers. */
     TCG_REG_R6,
-    TCG_REG_R7,
 #if TCG_TARGET_NB_REGS >= 16
+    /* TCG_REG_R7 is TCG_AREG0. */
     TCG_REG_R8,
+    TCG_REG_R9,
+    TCG_REG_R10,
+    TCG_REG_R11,
 #else
 # error Too few input registers available
 #endif
@@ -373,14 +372,17 @@ static const char *const tcg_target_reg_names[TCG_TARGET_NB_REGS] = {
 };
 #endif
 
+/* code_ptr is the off field of a branch. */
 static void patch_reloc(uint8_t *code_ptr, int type,
                         tcg_target_long value, tcg_target_long addend)
 {
     /* tcg_out_reloc always uses the same type, addend. */
-    assert(type == sizeof(tcg_target_long));
+    tcg_target_long disp = value - (tcg_target_long)(code_ptr + 4);
+
+    assert(type == 4);
     assert(addend == 0);
-    assert(value != 0);
-    *(tcg_target_long *)code_ptr = value;
+    assert(disp == (int32_t)disp);
+    *(int32_t *)code_ptr = disp;
 }
 
 /* Parse target specific constraints. */
@@ -403,171 +405,212 @@ static int target_parse_constraint(TCGArgConstraint *ct, const char **pct_str)
 }
 
 #if defined(CONFIG_DEBUG_TCG_INTERPRETER)
+static const char *const tci_op_names[TCI_NB_OPS] = {
+#define DEF(name) [TCI_##name] = #name,
+#include "tci-opc.h"
+#undef DEF
+};
+
 /* Show current bytecode. Used by tcg interpreter. */
 void tci_disas(uint8_t opc)
 {
-    const TCGOpDef *def = &tcg_op_defs[opc];
-    fprintf(stderr, "TCG %s %u, %u, %u\n",
-            def->name, def->nb_oargs, def->nb_iargs, def->nb_cargs);
+    fprintf(stderr, "TCI %s\n",
+            opc < TCI_NB_OPS ? tci_op_names[opc] : "illegal");
 }
 #endif
 
-/* Write value (native size). */
-static void tcg_out_i(TCGContext *s, tcg_target_ulong v)
-{
-    *(tcg_target_ulong *)s->code_ptr = v;
-    s->code_ptr += sizeof(tcg_target_ulong);
-}
-
-/* Write 64 bit value. */
-static void tcg_out64(TCGContext *s, uint64_t v)
-{
-    *(uint64_t *)s->code_ptr = v;
-    s->code_ptr += sizeof(v);
-}
+#if TCG_TARGET_REG_BITS == 64
+# define TCI_ld         TCI_ld64
+# define TCI_st         TCI_st64
+# define TCI_add        TCI_add_i64
+# define TCI_addi       TCI_addi_i64
+# define TCI_brcondi    TCI_brcondi_i64
+#else
+# define TCI_ld         TCI_ld32u
+# define TCI_st         TCI_st32
+# define TCI_add        TCI_add_i32
+# define TCI_addi       TCI_addi_i32
+# define TCI_brcondi    TCI_brcondi_i32
+#endif
 
-/* Write opcode. */
-static void tcg_out_op_t(TCGContext *s, TCGOpcode op)
+/* Super-instruction for a pair of instructions, or -1. */
+static int tci_super_opc(int first, int second)
 {
-    tcg_out8(s, op);
-    tcg_out8(s, 0);
+    switch (first) {
+    case TCI_ld:
+        switch (second) {
+        case TCI_ld:
+            return TCI_ld_ld;
+        case TCI_add:
+            return TCI_ld_add;
+        case TCI_addi:
+            return TCI_ld_addi;
+        }
+        break;
+    case TCI_st:
+        switch (second) {
+        case TCI_st:
+            return TCI_st_st;
+        case TCI_brcondi:
+            return TCI_st_brcondi;
+        }
+        break;
+    case TCI_movi:
+        switch (second) {
+        case TCI_st:
+            return TCI_movi_st;
+#if TCG_TARGET_REG_BITS == 64
+        case TCI_st32:
+            return TCI_movi_st32;
+#endif
+        }
+        break;
+    }
+    return -1;
 }
 
-/* Write register. */
-static void tcg_out_r(TCGContext *s, TCGArg t0)
+/* Turn the previous instruction into a super-instruction that also
+   executes insn.  Nothing is fused across translation blocks, nor with
+   an instruction that already is the second half of a pair.  */
+static void tci_fuse(TCGContext *s, TCIInsn *insn)
 {
-    assert(t0 < TCG_TARGET_NB_REGS);
-    tcg_out8(s, t0);
-}
+    TCIInsn *prev = insn - 1;
+    int opc;
 
-/* Write register or constant (native size). */
-static void tcg_out_ri(TCGContext *s, int const_arg, TCGArg arg)
-{
-    if (const_arg) {
-        assert(const_arg == 1);
-        tcg_out8(s, TCG_CONST);
-        tcg_out_i(s, arg);
-    } else {
-        tcg_out_r(s, arg);
+    if ((uint8_t *)prev < s->code_buf) {
+        return;
+    }
+    /* The super-instructions come last in tci-opc.h. */
+    if ((uint8_t *)(prev - 1) >= s->code_buf && prev[-1].opc >= TCI_ld_ld) {
+        return;
+    }
+    opc = tci_super_opc(prev->opc, insn->opc);
+    if (opc >= 0) {
+        prev->opc = opc;
     }
 }
 
-/* Write register or constant (32 bit). */
-static void tcg_out_ri32(TCGContext *s, int const_arg, TCGArg arg)
+/* Write one instruction. */
+static TCIInsn *tci_out_insn(TCGContext *s, TCIOpcode opc, TCGArg r0,
+                             TCGArg r1, TCGArg r2, tcg_target_long off,
+                             tcg_target_ulong imm)
 {
-    if (const_arg) {
-        assert(const_arg == 1);
-        tcg_out8(s, TCG_CONST);
-        tcg_out32(s, arg);
-    } else {
-        tcg_out_r(s, arg);
-    }
+    TCIInsn *insn = (TCIInsn *)s->code_ptr;
+
+    assert(r0 < TCG_TARGET_NB_REGS);
+    assert(r1 < TCG_TARGET_NB_REGS);
+    assert(r2 < TCG_TARGET_NB_REGS);
+    assert(off == (int32_t)off);
+    insn->opc = opc;
+    insn->r0 = r0;
+    insn->r1 = r1;
+    insn->r2 = r2;
+    insn->off = off;
+    insn->imm = imm;
+    s->code_ptr += sizeof(TCIInsn);
+    tci_fuse(s, insn);
+    return insn;
 }
 
-#if TCG_TARGET_REG_BITS == 64
-/* Write register or constant (64 bit). */
-static void tcg_out_ri64(TCGContext *s, int const_arg, TCGArg arg)
+/* Point the off field of a branch to a label. */
+static void tci_out_label(TCGContext *s, TCIInsn *insn, TCGArg arg)
 {
-    if (const_arg) {
-        assert(const_arg == 1);
-        tcg_out8(s, TCG_CONST);
-        tcg_out64(s, arg);
-    } else {
-        tcg_out_r(s, arg);
-    }
+    tcg_out_reloc(s, (uint8_t *)&insn->off, 4, arg, 0);
 }
-#endif
 
-/* Write label. */
-static void tci_out_label(TCGContext *s, TCGArg arg)
+#if TCG_TARGET_REG_BITS == 32
+/* Pack register numbers into imm, see TCI_IMM_REG. */
+static tcg_target_ulong tci_imm_regs(TCGArg r0, TCGArg r1, TCGArg r2)
 {
-    TCGLabel *label = &s->labels[arg];
-    if (label->has_value) {
-        tcg_out_i(s, label->u.value);
-        assert(label->u.value);
-    } else {
-        tcg_out_reloc(s, s->code_ptr, sizeof(tcg_target_ulong), arg, 0);
-        s->code_ptr += sizeof(tcg_target_ulong);
-    }
+    assert(r0 < TCG_TARGET_NB_REGS);
+    assert(r1 < TCG_TARGET_NB_REGS);
+    assert(r2 < TCG_TARGET_NB_REGS);
+    return r0 | (r1 << 8) | (r2 << 16);
 }
+#endif
 
 static void tcg_out_ld(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg1,
                        tcg_target_long arg2)
 {
-    uint8_t *old_code_ptr = s->code_ptr;
     if (type == TCG_TYPE_I32) {
-        tcg_out_op_t(s, INDEX_op_ld_i32);
-        tcg_out_r(s, ret);
-        tcg_out_r(s, arg1);
-        tcg_out32(s, arg2);
+        tci_out_insn(s, TCI_ld32u, ret, arg1, 0, arg2, 0);
     } else {
         assert(type == TCG_TYPE_I64);
 #if TCG_TARGET_REG_BITS == 64
-        tcg_out_op_t(s, INDEX_op_ld_i64);
-        tcg_out_r(s, ret);
-        tcg_out_r(s, arg1);
-        assert(arg2 == (uint32_t)arg2);
-        tcg_out32(s, arg2);
+        tci_out_insn(s, TCI_ld64, ret, arg1, 0, arg2, 0);
 #else
         TODO();
 #endif
     }
-    old_code_ptr[1] = s->code_ptr - old_code_ptr;
 }
 
 static void tcg_out_mov(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg)
 {
-    uint8_t *old_code_ptr = s->code_ptr;
     assert(ret != arg);
-#if TCG_TARGET_REG_BITS == 32
-    tcg_out_op_t(s, INDEX_op_mov_i32);
-#else
-    tcg_out_op_t(s, INDEX_op_mov_i64);
-#endif
-    tcg_out_r(s, ret);
-    tcg_out_r(s, arg);
-    old_code_ptr[1] = s->code_ptr - old_code_ptr;
+    tci_out_insn(s, TCI_mov, ret, arg, 0, 0, 0);
 }
 
 static void tcg_out_movi(TCGContext *s, TCGType type,
                          TCGReg t0, tcg_target_long arg)
 {
-    uint8_t *old_code_ptr = s->code_ptr;
-    uint32_t arg32 = arg;
-    if (type == TCG_TYPE_I32 || arg == arg32) {
-        tcg_out_op_t(s, INDEX_op_movi_i32);
-        tcg_out_r(s, t0);
-        tcg_out32(s, arg32);
+    if (type == TCG_TYPE_I32) {
+        arg = (uint32_t)arg;
+    }
+    tci_out_insn(s, TCI_movi, t0, 0, 0, 0, arg);
+}
+
+/* Operation with a register or constant second input operand. */
+static void tci_out_binary(TCGContext *s, TCIOpcode opc, TCIOpcode opci,
+                           const TCGArg *args, const int *const_args)
+{
+    if (const_args[2]) {
+        tci_out_insn(s, opci, args[0], args[1], 0, 0, args[2]);
     } else {
-        assert(type == TCG_TYPE_I64);
-#if TCG_TARGET_REG_BITS == 64
-        tcg_out_op_t(s, INDEX_op_movi_i64);
-        tcg_out_r(s, t0);
-        tcg_out64(s, arg);
+        tci_out_insn(s, opc, args[0], args[1], args[2], 0, 0);
+    }
+}
+
+static void tci_out_qemu_ldst(TCGContext *s, TCIOpcode opc,
+                              const TCGArg *args, int is64)
+{
+    TCGArg data, data_high = 0, addr, addr_high = 0;
+
+    data = *args++;
+#if TCG_TARGET_REG_BITS == 32
+    if (is64) {
+        data_high = *args++;
+    }
+#endif
+    addr = *args++;
+#if TARGET_LONG_BITS > TCG_TARGET_REG_BITS
+    addr_high = *args++;
+#endif
+#ifdef CONFIG_SOFTMMU
+    tci_out_insn(s, opc, data, addr, data_high, *args, addr_high);
 #else
-        TODO();
+    /* In user mode only the low part of the address is used. */
+    (void)addr_high;
+    tci_out_insn(s, opc, data, addr, data_high, 0, GUEST_BASE);
 #endif
-    }
-    old_code_ptr[1] = s->code_ptr - old_code_ptr;
 }
 
 static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
                        const int *const_args)
 {
-    uint8_t *old_code_ptr = s->code_ptr;
-
-    tcg_out_op_t(s, opc);
+    TCIInsn *insn;
 
     switch (opc) {
     case INDEX_op_exit_tb:
-        tcg_out64(s, args[0]);
+        tci_out_insn(s, TCI_exit_tb, 0, 0, 0, 0, args[0]);
         break;
     case INDEX_op_goto_tb:
         if (s->tb_jmp_offset) {
-            /* Direct jump method. */
+            /* Direct jump method.  Until the jump is patched by
+               tb_set_jmp_target, it goes to the next instruction. */
             assert(args[0] < ARRAY_SIZE(s->tb_jmp_offset));
-            s->tb_jmp_offset[args[0]] = s->code_ptr - s->code_buf;
-            tcg_out32(s, 0);
+            insn = tci_out_insn(s, TCI_goto_tb, 0, 0, 0, 0, 0);
+            insn->off = s->code_ptr - (uint8_t *)(&insn->off + 1);
+            s->tb_jmp_offset[args[0]] = (uint8_t *)&insn->off - s->code_buf;
         } else {
             /* Indirect jump method. */
             TODO();
@@ -575,256 +618,333 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
         assert(args[0] < ARRAY_SIZE(s->tb_next_offset));
         s->tb_next_offset[args[0]] = s->code_ptr - s->code_buf;
         break;
+    case INDEX_op_goto_ptr:
+        tci_out_insn(s, TCI_goto_ptr, args[0], 0, 0, 0, 0);
+        break;
     case INDEX_op_br:
-        tci_out_label(s, args[0]);
+        insn = tci_out_insn(s, TCI_br, 0, 0, 0, 0, 0);
+        tci_out_label(s, insn, args[0]);
         break;
     case INDEX_op_call:
-        tcg_out_ri(s, const_args[0], args[0]);
+        if (const_args[0]) {
+            tci_out_insn(s, TCI_call, 0, 0, 0, 0, args[0]);
+        } else {
+            tci_out_insn(s, TCI_callr, args[0], 0, 0, 0, 0);
+        }
         break;
     case INDEX_op_jmp:
         TODO();
         break;
     case INDEX_op_setcond_i32:
-        tcg_out_r(s, args[0]);
-        tcg_out_r(s, args[1]);
-        tcg_out_ri32(s, const_args[2], args[2]);
-        tcg_out8(s, args[3]);   /* condition */
+        if (const_args[2]) {
+            tci_out_insn(s, TCI_setcondi_i32, args[0], args[1], 0, args[3],
+                         (uint32_t)args[2]);
+        } else {
+            tci_out_insn(s, TCI_setcond_i32, args[0], args[1], args[2],
+                         args[3], 0);
+        }
+        break;
+    case INDEX_op_brcond_i32:
+        if (const_args[1]) {
+            insn = tci_out_insn(s, TCI_brcondi_i32, args[0], 0, args[2], 0,
+                                (uint32_t)args[1]);
+        } else {
+            insn = tci_out_insn(s, TCI_brcond_i32, args[0], args[1], args[2],
+                                0, 0);
+        }
+        tci_out_label(s, insn, args[3]);
         break;
 #if TCG_TARGET_REG_BITS == 32
     case INDEX_op_setcond2_i32:
-        /* setcond2_i32 cond, t0, t1_low, t1_high, t2_low, t2_high */
-        tcg_out_r(s, args[0]);
-        tcg_out_r(s, args[1]);
-        tcg_out_r(s, args[2]);
-        tcg_out_ri32(s, const_args[3], args[3]);
-        tcg_out_ri32(s, const_args[4], args[4]);
-        tcg_out8(s, args[5]);   /* condition */
+        /* setcond2_i32 t0, t1_low, t1_high, t2_low, t2_high, cond */
+        tci_out_insn(s, TCI_setcond2_i32, args[0], args[1], args[2], args[5],
+                     tci_imm_regs(args[3], args[4], 0));
+        break;
+    case INDEX_op_brcond2_i32:
+        insn = tci_out_insn(s, TCI_brcond2_i32, args[0], args[1], args[2], 0,
+                            tci_imm_regs(args[3], args[4], 0));
+        tci_out_label(s, insn, args[5]);
+        break;
+    case INDEX_op_add2_i32:
+        tci_out_insn(s, TCI_add2_i32, args[0], args[1], args[2], 0,
+                     tci_imm_regs(args[3], args[4], args[5]));
+        break;
+    case INDEX_op_sub2_i32:
+        tci_out_insn(s, TCI_sub2_i32, args[0], args[1], args[2], 0,
+                     tci_imm_regs(args[3], args[4], args[5]));
+        break;
+    case INDEX_op_mulu2_i32:
+        tci_out_insn(s, TCI_mulu2_i32, args[0], args[1], args[2], 0,
+                     tci_imm_regs(args[3], 0, 0));
         break;
 #elif TCG_TARGET_REG_BITS == 64
     case INDEX_op_setcond_i64:
-        tcg_out_r(s, args[0]);
-        tcg_out_r(s, args[1]);
-        tcg_out_ri64(s, const_args[2], args[2]);
-        tcg_out8(s, args[3]);   /* condition */
+        if (const_args[2]) {
+            tci_out_insn(s, TCI_setcondi_i64, args[0], args[1], 0, args[3],
+                         args[2]);
+        } else {
+            tci_out_insn(s, TCI_setcond_i64, args[0], args[1], args[2],
+                         args[3], 0);
+        }
+        break;
+    case INDEX_op_brcond_i64:
+        if (const_args[1]) {
+            insn = tci_out_insn(s, TCI_brcondi_i64, args[0], 0, args[2], 0,
+                                args[1]);
+        } else {
+            insn = tci_out_insn(s, TCI_brcond_i64, args[0], args[1], args[2],
+                                0, 0);
+        }
+        tci_out_label(s, insn, args[3]);
         break;
 #endif
+    case INDEX_op_mov_i32:
     case INDEX_op_movi_i32:
-        TODO(); /* Handled by tcg_out_movi? */
+        TODO(); /* Handled by tcg_out_mov, tcg_out_movi. */
         break;
+
     case INDEX_op_ld8u_i32:
+    case INDEX_op_ld8u_i64:
+        tci_out_insn(s, TCI_ld8u, args[0], args[1], 0, args[2], 0);
+        break;
     case INDEX_op_ld8s_i32:
+        tci_out_insn(s, TCI_ld8s_i32, args[0], args[1], 0, args[2], 0);
+        break;
     case INDEX_op_ld16u_i32:
+    case INDEX_op_ld16u_i64:
+        tci_out_insn(s, TCI_ld16u, args[0], args[1], 0, args[2], 0);
+        break;
     case INDEX_op_ld16s_i32:
+        tci_out_insn(s, TCI_ld16s_i32, args[0], args[1], 0, args[2], 0);
+        break;
     case INDEX_op_ld_i32:
-    case INDEX_op_st8_i32:
-    case INDEX_op_st16_i32:
-    case INDEX_op_st_i32:
-    case INDEX_op_ld8u_i64:
-    case INDEX_op_ld8s_i64:
-    case INDEX_op_ld16u_i64:
-    case INDEX_op_ld16s_i64:
     case INDEX_op_ld32u_i64:
-    case INDEX_op_ld32s_i64:
-    case INDEX_op_ld_i64:
+        tci_out_insn(s, TCI_ld32u, args[0], args[1], 0, args[2], 0);
+        break;
+    case INDEX_op_st8_i32:
     case INDEX_op_st8_i64:
+        tci_out_insn(s, TCI_st8, args[0], args[1], 0, args[2], 0);
+        break;
+    case INDEX_op_st16_i32:
     case INDEX_op_st16_i64:
+        tci_out_insn(s, TCI_st16, args[0], args[1], 0, args[2], 0);
+        break;
+    case INDEX_op_st_i32:
     case INDEX_op_st32_i64:
-    case INDEX_op_st_i64:
-        tcg_out_r(s, args[0]);
-        tcg_out_r(s, args[1]);
-        assert(args[2] == (uint32_t)args[2]);
-        tcg_out32(s, args[2]);
+        tci_out_insn(s, TCI_st32, args[0], args[1], 0, args[2], 0);
         break;
+
     case INDEX_op_add_i32:
+        tci_out_binary(s, TCI_add_i32, TCI_addi_i32, args, const_args);
+        break;
     case INDEX_op_sub_i32:
+        tci_out_binary(s, TCI_sub_i32, TCI_subi_i32, args, const_args);
+        break;
     case INDEX_op_mul_i32:
+        tci_out_binary(s, TCI_mul_i32, TCI_muli_i32, args, const_args);
+        break;
     case INDEX_op_and_i32:
-    case INDEX_op_andc_i32:     /* Optional (TCG_TARGET_HAS_andc_i32). */
-    case INDEX_op_eqv_i32:      /* Optional (TCG_TARGET_HAS_eqv_i32). */
-    case INDEX_op_nand_i32:     /* Optional (TCG_TARGET_HAS_nand_i32). */
-    case INDEX_op_nor_i32:      /* Optional (TCG_TARGET_HAS_nor_i32). */
+        tci_out_binary(s, TCI_and_i32, TCI_andi_i32, args, const_args);
+        break;
     case INDEX_op_or_i32:
-    case INDEX_op_orc_i32:      /* Optional (TCG_TARGET_HAS_orc_i32). */
+        tci_out_binary(s, TCI_or_i32, TCI_ori_i32, args, const_args);
+        break;
     case INDEX_op_xor_i32:
+        tci_out_binary(s, TCI_xor_i32, TCI_xori_i32, args, const_args);
+        break;
     case INDEX_op_shl_i32:
+        tci_out_binary(s, TCI_shl_i32, TCI_shli_i32, args, const_args);
+        break;
     case INDEX_op_shr_i32:
+        tci_out_binary(s, TCI_shr_i32, TCI_shri_i32, args, const_args);
+        break;
     case INDEX_op_sar_i32:
+        tci_out_binary(s, TCI_sar_i32, TCI_sari_i32, args, const_args);
+        break;
     case INDEX_op_rotl_i32:     /* Optional (TCG_TARGET_HAS_rot_i32). */
+        tci_out_binary(s, TCI_rotl_i32, TCI_rotli_i32, args, const_args);
+        break;
     case INDEX_op_rotr_i32:     /* Optional (TCG_TARGET_HAS_rot_i32). */
-        tcg_out_r(s, args[0]);
-        tcg_out_ri32(s, const_args[1], args[1]);
-        tcg_out_ri32(s, const_args[2], args[2]);
+        tci_out_binary(s, TCI_rotr_i32, TCI_rotri_i32, args, const_args);
+        break;
+    case INDEX_op_div_i32:      /* Optional (TCG_TARGET_HAS_div_i32). */
+        tci_out_insn(s, TCI_div_i32, args[0], args[1], args[2], 0, 0);
+        break;
+    case INDEX_op_divu_i32:     /* Optional (TCG_TARGET_HAS_div_i32). */
+        tci_out_insn(s, TCI_divu_i32, args[0], args[1], args[2], 0, 0);
+        break;
+    case INDEX_op_rem_i32:      /* Optional (TCG_TARGET_HAS_div_i32). */
+        tci_out_insn(s, TCI_rem_i32, args[0], args[1], args[2], 0, 0);
+        break;
+    case INDEX_op_remu_i32:     /* Optional (TCG_TARGET_HAS_div_i32). */
+        tci_out_insn(s, TCI_remu_i32, args[0], args[1], args[2], 0, 0);
+        break;
+    case INDEX_op_div2_i32:     /* Optional (TCG_TARGET_HAS_div2_i32). */
+    case INDEX_op_divu2_i32:    /* Optional (TCG_TARGET_HAS_div2_i32). */
+        TODO();
+        break;
+
+    case INDEX_op_not_i32:      /* Optional (TCG_TARGET_HAS_not_i32). */
+        tci_out_insn(s, TCI_not_i32, args[0], args[1], 0, 0, 0);
+        break;
+    case INDEX_op_neg_i32:      /* Optional (TCG_TARGET_HAS_neg_i32). */
+        tci_out_insn(s, TCI_neg_i32, args[0], args[1], 0, 0, 0);
+        break;
+    case INDEX_op_ext8s_i32:    /* Optional (TCG_TARGET_HAS_ext8s_i32). */
+        tci_out_insn(s, TCI_ext8s_i32, args[0], args[1], 0, 0, 0);
+        break;
+    case INDEX_op_ext16s_i32:   /* Optional (TCG_TARGET_HAS_ext16s_i32). */
+        tci_out_insn(s, TCI_ext16s_i32, args[0], args[1], 0, 0, 0);
+        break;
+    case INDEX_op_ext8u_i32:    /* Optional (TCG_TARGET_HAS_ext8u_i32). */
+    case INDEX_op_ext8u_i64:    /* Optional (TCG_TARGET_HAS_ext8u_i64). */
+        tci_out_insn(s, TCI_ext8u, args[0], args[1], 0, 0, 0);
+        break;
+    case INDEX_op_ext16u_i32:   /* Optional (TCG_TARGET_HAS_ext16u_i32). */
+    case INDEX_op_ext16u_i64:   /* Optional (TCG_TARGET_HAS_ext16u_i64). */
+        tci_out_insn(s, TCI_ext16u, args[0], args[1], 0, 0, 0);
+        break;
+    case INDEX_op_bswap16_i32:  /* Optional (TCG_TARGET_HAS_bswap16_i32). */
+    case INDEX_op_bswap16_i64:  /* Optional (TCG_TARGET_HAS_bswap16_i64). */
+        tci_out_insn(s, TCI_bswap16, args[0], args[1], 0, 0, 0);
+        break;
+    case INDEX_op_bswap32_i32:  /* Optional (TCG_TARGET_HAS_bswap32_i32). */
+    case INDEX_op_bswap32_i64:  /* Optional (TCG_TARGET_HAS_bswap32_i64). */
+        tci_out_insn(s, TCI_bswap32, args[0], args[1], 0, 0, 0);
         break;
 
 #if TCG_TARGET_REG_BITS == 64
     case INDEX_op_mov_i64:
     case INDEX_op_movi_i64:
-        TODO();
+        TODO(); /* Handled by tcg_out_mov, tcg_out_movi. */
+        break;
+
+    case INDEX_op_ld8s_i64:
+        tci_out_insn(s, TCI_ld8s_i64, args[0], args[1], 0, args[2], 0);
+        break;
+    case INDEX_op_ld16s_i64:
+        tci_out_insn(s, TCI_ld16s_i64, args[0], args[1], 0, args[2], 0);
         break;
+    case INDEX_op_ld32s_i64:
+        tci_out_insn(s, TCI_ld32s_i64, args[0], args[1], 0, args[2], 0);
+        break;
+    case INDEX_op_ld_i64:
+        tci_out_insn(s, TCI_ld64, args[0], args[1], 0, args[2], 0);
+        break;
+    case INDEX_op_st_i64:
+        tci_out_insn(s, TCI_st64, args[0], args[1], 0, args[2], 0);
+        break;
+
     case INDEX_op_add_i64:
+        tci_out_binary(s, TCI_add_i64, TCI_addi_i64, args, const_args);
+        break;
     case INDEX_op_sub_i64:
+        tci_out_binary(s, TCI_sub_i64, TCI_subi_i64, args, const_args);
+        break;
     case INDEX_op_mul_i64:
+        tci_out_binary(s, TCI_mul_i64, TCI_muli_i64, args, const_args);
+        break;
     case INDEX_op_and_i64:
-    case INDEX_op_andc_i64:     /* Optional (TCG_TARGET_HAS_andc_i64). */
-    case INDEX_op_eqv_i64:      /* Optional (TCG_TARGET_HAS_eqv_i64). */
-    case INDEX_op_nand_i64:     /* Optional (TCG_TARGET_HAS_nand_i64). */
-    case INDEX_op_nor_i64:      /* Optional (TCG_TARGET_HAS_nor_i64). */
+        tci_out_binary(s, TCI_and_i64, TCI_andi_i64, args, const_args);
+        break;
     case INDEX_op_or_i64:
-    case INDEX_op_orc_i64:      /* Optional (TCG_TARGET_HAS_orc_i64). */
+        tci_out_binary(s, TCI_or_i64, TCI_ori_i64, args, const_args);
+        break;
     case INDEX_op_xor_i64:
+        tci_out_binary(s, TCI_xor_i64, TCI_xori_i64, args, const_args);
+        break;
     case INDEX_op_shl_i64:
+        tci_out_binary(s, TCI_shl_i64, TCI_shli_i64, args, const_args);
+        break;
     case INDEX_op_shr_i64:
+        tci_out_binary(s, TCI_shr_i64, TCI_shri_i64, args, const_args);
+        break;
     case INDEX_op_sar_i64:
-        /* TODO: Implementation of rotl_i64, rotr_i64 missing in tci.c. */
+        tci_out_binary(s, TCI_sar_i64, TCI_sari_i64, args, const_args);
+        break;
     case INDEX_op_rotl_i64:     /* Optional (TCG_TARGET_HAS_rot_i64). */
+        tci_out_binary(s, TCI_rotl_i64, TCI_rotli_i64, args, const_args);
+        break;
     case INDEX_op_rotr_i64:     /* Optional (TCG_TARGET_HAS_rot_i64). */
-        tcg_out_r(s, args[0]);
-        tcg_out_ri64(s, const_args[1], args[1]);
-        tcg_out_ri64(s, const_args[2], args[2]);
+        tci_out_binary(s, TCI_rotr_i64, TCI_rotri_i64, args, const_args);
         break;
     case INDEX_op_div_i64:      /* Optional (TCG_TARGET_HAS_div_i64). */
+        tci_out_insn(s, TCI_div_i64, args[0], args[1], args[2], 0, 0);
+        break;
     case INDEX_op_divu_i64:     /* Optional (TCG_TARGET_HAS_div_i64). */
+        tci_out_insn(s, TCI_divu_i64, args[0], args[1], args[2], 0, 0);
+        break;
     case INDEX_op_rem_i64:      /* Optional (TCG_TARGET_HAS_div_i64). */
+        tci_out_insn(s, TCI_rem_i64, args[0], args[1], args[2], 0, 0);
+        break;
     case INDEX_op_remu_i64:     /* Optional (TCG_TARGET_HAS_div_i64). */
-        TODO();
+        tci_out_insn(s, TCI_remu_i64, args[0], args[1], args[2], 0, 0);
         break;
     case INDEX_op_div2_i64:     /* Optional (TCG_TARGET_HAS_div2_i64). */
     case INDEX_op_divu2_i64:    /* Optional (TCG_TARGET_HAS_div2_i64). */
         TODO();
         break;
-    case INDEX_op_brcond_i64:
-        tcg_out_r(s, args[0]);
-        tcg_out_ri64(s, const_args[1], args[1]);
-        tcg_out8(s, args[2]);           /* condition */
-        tci_out_label(s, args[3]);
-        break;
-    case INDEX_op_bswap16_i64:  /* Optional (TCG_TARGET_HAS_bswap16_i64). */
-    case INDEX_op_bswap32_i64:  /* Optional (TCG_TARGET_HAS_bswap32_i64). */
-    case INDEX_op_bswap64_i64:  /* Optional (TCG_TARGET_HAS_bswap64_i64). */
+
     case INDEX_op_not_i64:      /* Optional (TCG_TARGET_HAS_not_i64). */
-    case INDEX_op_neg_i64:      /* Optional (TCG_TARGET_HAS_neg_i64). */
-    case INDEX_op_ext8s_i64:    /* Optional (TCG_TARGET_HAS_ext8s_i64). */
-    case INDEX_op_ext8u_i64:    /* Optional (TCG_TARGET_HAS_ext8u_i64). */
-    case INDEX_op_ext16s_i64:   /* Optional (TCG_TARGET_HAS_ext16s_i64). */
-    case INDEX_op_ext16u_i64:   /* Optional (TCG_TARGET_HAS_ext16u_i64). */
-    case INDEX_op_ext32s_i64:   /* Optional (TCG_TARGET_HAS_ext32s_i64). */
-    case INDEX_op_ext32u_i64:   /* Optional (TCG_TARGET_HAS_ext32u_i64). */
-#endif /* TCG_TARGET_REG_BITS == 64 */
-    case INDEX_op_neg_i32:      /* Optional (TCG_TARGET_HAS_neg_i32). */
-    case INDEX_op_not_i32:      /* Optional (TCG_TARGET_HAS_not_i32). */
-    case INDEX_op_ext8s_i32:    /* Optional (TCG_TARGET_HAS_ext8s_i32). */
-    case INDEX_op_ext16s_i32:   /* Optional (TCG_TARGET_HAS_ext16s_i32). */
-    case INDEX_op_ext8u_i32:    /* Optional (TCG_TARGET_HAS_ext8u_i32). */
-    case INDEX_op_ext16u_i32:   /* Optional (TCG_TARGET_HAS_ext16u_i32). */
-    case INDEX_op_bswap16_i32:  /* Optional (TCG_TARGET_HAS_bswap16_i32). */
-    case INDEX_op_bswap32_i32:  /* Optional (TCG_TARGET_HAS_bswap32_i32). */
-        tcg_out_r(s, args[0]);
-        tcg_out_r(s, args[1]);
+        tci_out_insn(s, TCI_not_i64, args[0], args[1], 0, 0, 0);
         break;
-    case INDEX_op_div_i32:      /* Optional (TCG_TARGET_HAS_div_i32). */
-    case INDEX_op_divu_i32:     /* Optional (TCG_TARGET_HAS_div_i32). */
-    case INDEX_op_rem_i32:      /* Optional (TCG_TARGET_HAS_div_i32). */
-    case INDEX_op_remu_i32:     /* Optional (TCG_TARGET_HAS_div_i32). */
-        tcg_out_r(s, args[0]);
-        tcg_out_ri32(s, const_args[1], args[1]);
-        tcg_out_ri32(s, const_args[2], args[2]);
+    case INDEX_op_neg_i64:      /* Optional (TCG_TARGET_HAS_neg_i64). */
+        tci_out_insn(s, TCI_neg_i64, args[0], args[1], 0, 0, 0);
         break;
-    case INDEX_op_div2_i32:     /* Optional (TCG_TARGET_HAS_div2_i32). */
-    case INDEX_op_divu2_i32:    /* Optional (TCG_TARGET_HAS_div2_i32). */
-        TODO();
+    case INDEX_op_ext8s_i64:    /* Optional (TCG_TARGET_HAS_ext8s_i64). */
+        tci_out_insn(s, TCI_ext8s_i64, args[0], args[1], 0, 0, 0);
         break;
-#if TCG_TARGET_REG_BITS == 32
-    case INDEX_op_add2_i32:
-    case INDEX_op_sub2_i32:
-        tcg_out_r(s, args[0]);
-        tcg_out_r(s, args[1]);
-        tcg_out_r(s, args[2]);
-        tcg_out_r(s, args[3]);
-        tcg_out_r(s, args[4]);
-        tcg_out_r(s, args[5]);
+    case INDEX_op_ext16s_i64:   /* Optional (TCG_TARGET_HAS_ext16s_i64). */
+        tci_out_insn(s, TCI_ext16s_i64, args[0], args[1], 0, 0, 0);
         break;
-    case INDEX_op_brcond2_i32:
-        tcg_out_r(s, args[0]);
-        tcg_out_r(s, args[1]);
-        tcg_out_ri32(s, const_args[2], args[2]);
-        tcg_out_ri32(s, const_args[3], args[3]);
-        tcg_out8(s, args[4]);           /* condition */
-        tci_out_label(s, args[5]);
+    case INDEX_op_ext32s_i64:   /* Optional (TCG_TARGET_HAS_ext32s_i64). */
+        tci_out_insn(s, TCI_ext32s_i64, args[0], args[1], 0, 0, 0);
         break;
-    case INDEX_op_mulu2_i32:
-        tcg_out_r(s, args[0]);
-        tcg_out_r(s, args[1]);
-        tcg_out_r(s, args[2]);
-        tcg_out_r(s, args[3]);
+    case INDEX_op_ext32u_i64:   /* Optional (TCG_TARGET_HAS_ext32u_i64). */
+        tci_out_insn(s, TCI_ext32u, args[0], args[1], 0, 0, 0);
         break;
-#endif
-    case INDEX_op_brcond_i32:
-        tcg_out_r(s, args[0]);
-        tcg_out_ri32(s, const_args[1], args[1]);
-        tcg_out8(s, args[2]);           /* condition */
-        tci_out_label(s, args[3]);
+    case INDEX_op_bswap64_i64:  /* Optional (TCG_TARGET_HAS_bswap64_i64). */
+        tci_out_insn(s, TCI_bswap64, args[0], args[1], 0, 0, 0);
         break;
+#endif /* TCG_TARGET_REG_BITS == 64 */
+
     case INDEX_op_qemu_ld8u:
+        tci_out_qemu_ldst(s, TCI_qemu_ld8u, args, 0);
+        break;
     case INDEX_op_qemu_ld8s:
+        tci_out_qemu_ldst(s, TCI_qemu_ld8s, args, 0);
+        break;
     case INDEX_op_qemu_ld16u:
+        tci_out_qemu_ldst(s, TCI_qemu_ld16u, args, 0);
+        break;
     case INDEX_op_qemu_ld16s:
+        tci_out_qemu_ldst(s, TCI_qemu_ld16s, args, 0);
+        break;
     case INDEX_op_qemu_ld32:
 #if TCG_TARGET_REG_BITS == 64
-    case INDEX_op_qemu_ld32s:
     case INDEX_op_qemu_ld32u:
 #endif
-        tcg_out_r(s, *args++);
-        tcg_out_r(s, *args++);
-#if TARGET_LONG_BITS > TCG_TARGET_REG_BITS
-        tcg_out_r(s, *args++);
-#endif
-#ifdef CONFIG_SOFTMMU
-        tcg_out_i(s, *args);
-#endif
+        tci_out_qemu_ldst(s, TCI_qemu_ld32u, args, 0);
+        break;
+#if TCG_TARGET_REG_BITS == 64
+    case INDEX_op_qemu_ld32s:
+        tci_out_qemu_ldst(s, TCI_qemu_ld32s, args, 0);
         break;
-    case INDEX_op_qemu_ld64:
-        tcg_out_r(s, *args++);
-#if TCG_TARGET_REG_BITS == 32
-        tcg_out_r(s, *args++);
-#endif
-        tcg_out_r(s, *args++);
-#if TARGET_LONG_BITS > TCG_TARGET_REG_BITS
-        tcg_out_r(s, *args++);
-#endif
-#ifdef CONFIG_SOFTMMU
-        tcg_out_i(s, *args);
 #endif
+    case INDEX_op_qemu_ld64:
+        tci_out_qemu_ldst(s, TCI_qemu_ld64, args, 1);
         break;
     case INDEX_op_qemu_st8:
+        tci_out_qemu_ldst(s, TCI_qemu_st8, args, 0);
+        break;
     case INDEX_op_qemu_st16:
+        tci_out_qemu_ldst(s, TCI_qemu_st16, args, 0);
+        break;
     case INDEX_op_qemu_st32:
-#ifdef CONFIG_TCG_PASS_AREG0
-        tcg_out_r(s, TCG_AREG0);
-#endif
-        tcg_out_r(s, *args++);
-        tcg_out_r(s, *args++);
-#if TARGET_LONG_BITS > TCG_TARGET_REG_BITS
-        tcg_out_r(s, *args++);
-#endif
-#ifdef CONFIG_SOFTMMU
-        tcg_out_i(s, *args);
-#endif
+        tci_out_qemu_ldst(s, TCI_qemu_st32, args, 0);
         break;
     case INDEX_op_qemu_st64:
-#ifdef CONFIG_TCG_PASS_AREG0
-        tcg_out_r(s, TCG_AREG0);
-#endif
-        tcg_out_r(s, *args++);
-#if TCG_TARGET_REG_BITS == 32
-        tcg_out_r(s, *args++);
-#endif
-        tcg_out_r(s, *args++);
-#if TARGET_LONG_BITS > TCG_TARGET_REG_BITS
-        tcg_out_r(s, *args++);
-#endif
-#ifdef CONFIG_SOFTMMU
-        tcg_out_i(s, *args);
-#endif
+        tci_out_qemu_ldst(s, TCI_qemu_st64, args, 1);
         break;
     case INDEX_op_end:
         TODO();
@@ -833,30 +953,21 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
         fprintf(stderr, "Missing: %s\n", tcg_op_defs[opc].name);
         tcg_abort();
     }
-    old_code_ptr[1] = s->code_ptr - old_code_ptr;
 }
 
 static void tcg_out_st(TCGContext *s, TCGType type, TCGReg arg, TCGReg arg1,
                        tcg_target_long arg2)
 {
-    uint8_t *old_code_ptr = s->code_ptr;
     if (type == TCG_TYPE_I32) {
-        tcg_out_op_t(s, INDEX_op_st_i32);
-        tcg_out_r(s, arg);
-        tcg_out_r(s, arg1);
-        tcg_out32(s, arg2);
+        tci_out_insn(s, TCI_st32, arg, arg1, 0, arg2, 0);
     } else {
         assert(type == TCG_TYPE_I64);
 #if TCG_TARGET_REG_BITS == 64
-        tcg_out_op_t(s, INDEX_op_st_i64);
-        tcg_out_r(s, arg);
-        tcg_out_r(s, arg1);
-        tcg_out32(s, arg2);
+        tci_out_insn(s, TCI_st64, arg, arg1, 0, arg2, 0);
 #else
         TODO();
 #endif
     }
-    old_code_ptr[1] = s->code_ptr - old_code_ptr;
 }
 
 /* Test if a constant matches the constraint. */
@@ -904,5 +1015,8 @@ static void tcg_target_init(TCGContext *s)
 /* Generate global QEMU prologue and epilogue code. */
 static void tcg_target_qemu_prologue(TCGContext *s)
 {
+    /* Return path for goto_ptr. */
+    s->code_gen_epilogue = s->code_ptr;
+    tci_out_insn(s, TCI_exit_tb, 0, 0, 0, 0, 0);
     tb_ret_addr = s->code_ptr;
 }
@@ -75,6 +75,8 @@
 #define TCG_TARGET_HAS_not_i32          1
 #define TCG_TARGET_HAS_orc_i32          0
 #define TCG_TARGET_HAS_rot_i32          1
+#define TCG_TARGET_HAS_vec              0
+#define TCG_TARGET_HAS_goto_ptr         1
 
 #if TCG_TARGET_REG_BITS == 64
 #define TCG_TARGET_HAS_bswap16_i64      1
@@ -82,7 +84,7 @@
 #define TCG_TARGET_HAS_bswap64_i64      1
 #define TCG_TARGET_HAS_deposit_i64      0
 /* Not more than one of the next two defines must be 1. */
-#define TCG_TARGET_HAS_div_i64          0
+#define TCG_TARGET_HAS_div_i64          1
 #define TCG_TARGET_HAS_div2_i64         0
 #define TCG_TARGET_HAS_ext8s_i64        1
 #define TCG_TARGET_HAS_ext16s_i64       1
@@ -148,10 +150,32 @@ typedef enum {
     TCG_REG_R31,
 #endif
 #endif
-    /* Special value UINT8_MAX is used by TCI to encode constant values. */
-    TCG_CONST = UINT8_MAX
 } TCGReg;
 
+/* Opcodes of the interpreter.  They are not the TCG opcodes: TCG
+   operations with constant operands and common pairs of operations get
+   opcodes of their own, so that the interpreter never has to look at
+   the form of an operand.  */
+typedef enum {
+#define DEF(name) TCI_##name,
+#include "tci-opc.h"
+#undef DEF
+    TCI_NB_OPS
+} TCIOpcode;
+
+/* Bytecode instruction.  All instructions have the same size, so the
+   interpreter decodes them with plain loads and can dispatch on the
+   opcode without looking at the rest of the instruction first.  */
+typedef struct TCIInsn {
+    uint8_t opc;                /* TCIOpcode */
+    uint8_t r0, r1, r2;         /* register numbers */
+    int32_t off;                /* memory offset, branch displacement */
+    tcg_target_ulong imm;       /* constant operand */
+} TCIInsn;
+
+/* Register number n packed into imm by operations with many operands. */
+#define TCI_IMM_REG(insn, n)    (((insn)->imm >> ((n) * 8)) & 0xff)
+
 void tci_disas(uint8_t opc);
 
 tcg_target_ulong tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr);
@@ -0,0 +1,161 @@
+/*
+ * Tiny Code Interpreter for QEMU - opcodes
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Every TCI instruction is a TCIInsn (see tcg-target.h).  The fields used
+ * by each opcode are noted below: r0...r2 are register numbers, off is the
+ * 32 bit field and imm the constant.  Branch displacements in off are
+ * relative to the end of the off field, like the tb_set_jmp_target1 patch.
+ *
+ * Opcodes with an "i" after the operation (addi_i32, setcondi_i64...)
+ * take their second input operand from imm instead of r2.  Host loads and
+ * stores which behave the same for 32 and 64 bit values share an opcode,
+ * as do zero extensions.
+ *
+ * DEF(name)
+ */
+
+/* control flow */
+DEF(call)               /* imm = function */
+DEF(callr)              /* r0 = function */
+DEF(br)                 /* off = label */
+DEF(exit_tb)            /* imm = return value */
+DEF(goto_tb)            /* off = patched by tb_set_jmp_target */
+DEF(goto_ptr)           /* r0 = instruction */
+
+DEF(mov)                /* r0 = r1 */
+DEF(movi)               /* r0 = imm */
+
+/* host memory: r0 = value, r1 = base, off = offset */
+DEF(ld8u)
+DEF(ld8s_i32)
+DEF(ld16u)
+DEF(ld16s_i32)
+DEF(ld32u)
+DEF(st8)
+DEF(st16)
+DEF(st32)
+#if TCG_TARGET_REG_BITS == 64
+DEF(ld8s_i64)
+DEF(ld16s_i64)
+DEF(ld32s_i64)
+DEF(ld64)
+DEF(st64)
+#endif
+
+/* r0 = r1 op r2, or r0 = r1 op imm */
+#define DEF_BINARY(name, type) DEF(name##_##type) DEF(name##i_##type)
+DEF_BINARY(add, i32)
+DEF_BINARY(sub, i32)
+DEF_BINARY(mul, i32)
+DEF_BINARY(and, i32)
+DEF_BINARY(or, i32)
+DEF_BINARY(xor, i32)
+DEF_BINARY(shl, i32)
+DEF_BINARY(shr, i32)
+DEF_BINARY(sar, i32)
+DEF_BINARY(rotl, i32)
+DEF_BINARY(rotr, i32)
+DEF(div_i32)
+DEF(divu_i32)
+DEF(rem_i32)
+DEF(remu_i32)
+#if TCG_TARGET_REG_BITS == 64
+DEF_BINARY(add, i64)
+DEF_BINARY(sub, i64)
+DEF_BINARY(mul, i64)
+DEF_BINARY(and, i64)
+DEF_BINARY(or, i64)
+DEF_BINARY(xor, i64)
+DEF_BINARY(shl, i64)
+DEF_BINARY(shr, i64)
+DEF_BINARY(sar, i64)
+DEF_BINARY(rotl, i64)
+DEF_BINARY(rotr, i64)
+DEF(div_i64)
+DEF(divu_i64)
+DEF(rem_i64)
+DEF(remu_i64)
+#endif
+#undef DEF_BINARY
+
+/* r0 = op r1 */
+DEF(not_i32)
+DEF(neg_i32)
+DEF(ext8s_i32)
+DEF(ext16s_i32)
+DEF(ext8u)
+DEF(ext16u)
+DEF(bswap16)
+DEF(bswap32)
+#if TCG_TARGET_REG_BITS == 64
+DEF(not_i64)
+DEF(neg_i64)
+DEF(ext8s_i64)
+DEF(ext16s_i64)
+DEF(ext32s_i64)
+DEF(ext32u)
+DEF(bswap64)
+#endif
+
+/* r0 = r1 cond r2, or r0 = r1 cond imm; off = condition */
+DEF(setcond_i32)
+DEF(setcondi_i32)
+/* if (r0 cond r1), or if (r0 cond imm), branch to off; r2 = condition */
+DEF(brcond_i32)
+DEF(brcondi_i32)
+#if TCG_TARGET_REG_BITS == 64
+DEF(setcond_i64)
+DEF(setcondi_i64)
+DEF(brcond_i64)
+DEF(brcondi_i64)
+#else
+/* The operations on register pairs have more operands than TCIInsn has
+   register fields.  The remaining register numbers are packed into the
+   bytes of imm, see TCI_IMM_REG.  */
+DEF(add2_i32)           /* r0:r1 = r2:imm0 + imm1:imm2 (low:high) */
+DEF(sub2_i32)           /* r0:r1 = r2:imm0 - imm1:imm2 */
+DEF(mulu2_i32)          /* r0:r1 = r2 * imm0 */
+DEF(setcond2_i32)       /* r0 = r1:r2 cond imm0:imm1; off = condition */
+DEF(brcond2_i32)        /* if (r0:r1 cond r2:imm0) goto off; imm1 = cond */
+#endif
+
+/* guest memory: r0 = value, r1 = address, r2 = high half of a 64 bit
+   value on 32 bit hosts.  With softmmu, off is the mmu index and imm
+   holds the register with the high half of the address (TCI_IMM_REG 0)
+   if the guest address does not fit in a host register.  In user mode
+   imm is GUEST_BASE.  */
+DEF(qemu_ld8u)
+DEF(qemu_ld8s)
+DEF(qemu_ld16u)
+DEF(qemu_ld16s)
+DEF(qemu_ld32u)
+#if TCG_TARGET_REG_BITS == 64
+DEF(qemu_ld32s)
+#endif
+DEF(qemu_ld64)
+DEF(qemu_st8)
+DEF(qemu_st16)
+DEF(qemu_st32)
+DEF(qemu_st64)
+
+/* Super-instructions.  They execute the next instruction as well, which
+   keeps its own opcode and fields so that a branch to it still works.
+   The pairs are the most frequent ones in x86 guest code; ld and st are
+   the host register sized loads and stores (ld64/st64 or ld32u/st32).
+   TCG saves the globals before the end of a basic block, so a guest
+   "cmp; jcc" usually ends up as a store followed by brcondi.
+   The super-instructions must stay at the end of the list.  */
+DEF(ld_ld)
+DEF(ld_add)
+DEF(ld_addi)
+DEF(st_st)
+DEF(movi_st)
+DEF(st_brcondi)
+#if TCG_TARGET_REG_BITS == 64
+DEF(movi_st32)
+#endif
@@ -20,40 +20,33 @@
 #include "dis-asm.h"
 #include "tcg/tcg.h"
 
+static const char *const tci_op_names[TCI_NB_OPS] = {
+#define DEF(name) [TCI_##name] = #name,
+#include "tci-opc.h"
+#undef DEF
+};
+
 /* Disassemble TCI bytecode. */
 int print_insn_tci(bfd_vma addr, disassemble_info *info)
 {
-    int length;
-    uint8_t byte;
+    TCIInsn insn;
     int status;
-    TCGOpcode op;
-
-    status = info->read_memory_func(addr, &byte, 1, info);
-    if (status != 0) {
-        info->memory_error_func(status, addr, info);
-        return -1;
-    }
-    op = byte;
 
-    addr++;
-    status = info->read_memory_func(addr, &byte, 1, info);
+    status = info->read_memory_func(addr, (bfd_byte *)&insn, sizeof(insn),
+                                    info);
     if (status != 0) {
         info->memory_error_func(status, addr, info);
         return -1;
     }
-    length = byte;
 
-    if (op >= tcg_op_defs_max) {
-        info->fprintf_func(info->stream, "illegal opcode %d", op);
+    if (insn.opc >= TCI_NB_OPS) {
+        info->fprintf_func(info->stream, "illegal opcode %d", insn.opc);
     } else {
-        const TCGOpDef *def = &tcg_op_defs[op];
-        int nb_oargs = def->nb_oargs;
-        int nb_iargs = def->nb_iargs;
-        int nb_cargs = def->nb_cargs;
-        /* TODO: Improve disassembler output. */
-        info->fprintf_func(info->stream, "%s\to=%d i=%d c=%d",
-                           def->name, nb_oargs, nb_iargs, nb_cargs);
+        info->fprintf_func(info->stream,
+                           "%-12s r%d, r%d, r%d, off=%d, imm=0x%" PRIx64,
+                           tci_op_names[insn.opc], insn.r0, insn.r1, insn.r2,
+                           insn.off, (uint64_t)insn.imm);
     }
 
-    return length;
+    return sizeof(insn);
 }
@@ -29,25 +29,18 @@
 #include "exec-all.h"           /* MAX_OPC_PARAM_IARGS */
 #include "tcg-op.h"
 
-/* Marker for missing code. */
-#define TODO() \
-    do { \
-        fprintf(stderr, "TODO %s:%u: %s()\n", \
-                __FILE__, __LINE__, __func__); \
-        tcg_abort(); \
-    } while (0)
-
-#if MAX_OPC_PARAM_IARGS != 4
-# error Fix needed, number of supported input arguments changed!
-#endif
+/* Helpers take up to 5 arguments (DEF_HELPER_FLAGS_5), see
+   tcg_target_call_iarg_regs.  */
 #if TCG_TARGET_REG_BITS == 32
 typedef uint64_t (*helper_function)(tcg_target_ulong, tcg_target_ulong,
+                                    tcg_target_ulong, tcg_target_ulong,
                                     tcg_target_ulong, tcg_target_ulong,
                                     tcg_target_ulong, tcg_target_ulong,
                                     tcg_target_ulong, tcg_target_ulong);
 #else
 typedef uint64_t (*helper_function)(tcg_target_ulong, tcg_target_ulong,
-                                    tcg_target_ulong, tcg_target_ulong);
+                                    tcg_target_ulong, tcg_target_ulong,
+                                    tcg_target_ulong);
 #endif
 
 /* TCI can optionally use a global register variable for env. */
@@ -59,10 +52,11 @@ CPUArchState *env;
    which makes them a little faster. */
 #if defined(GETPC)
 uintptr_t tci_tb_ptr;
+# define tci_save_pc(insn) (tci_tb_ptr = (uintptr_t)(insn))
+#else
+# define tci_save_pc(insn) ((void)0)
 #endif
 
-static tcg_target_ulong tci_reg[TCG_TARGET_NB_REGS];
-
 #if !defined(CONFIG_TCG_PASS_AREG0)
 # define helper_ldb_mmu(env, addr, mmu_idx) __ldb_mmu(addr, mmu_idx)
 # define helper_ldw_mmu(env, addr, mmu_idx) __ldw_mmu(addr, mmu_idx)
@@ -74,1145 +68,582 @@ static tcg_target_ulong tci_reg[TCG_TARGET_NB_REGS];
 # define helper_stq_mmu(env, addr, val, mmu_idx) __stq_mmu(addr, val, mmu_idx)
 #endif /* !CONFIG_TCG_PASS_AREG0 */
 
-static tcg_target_ulong tci_read_reg(TCGReg index)
-{
-    assert(index < ARRAY_SIZE(tci_reg));
-    return tci_reg[index];
-}
-
-#if TCG_TARGET_HAS_ext8s_i32 || TCG_TARGET_HAS_ext8s_i64
-static int8_t tci_read_reg8s(TCGReg index)
-{
-    return (int8_t)tci_read_reg(index);
-}
-#endif
-
-#if TCG_TARGET_HAS_ext16s_i32 || TCG_TARGET_HAS_ext16s_i64
-static int16_t tci_read_reg16s(TCGReg index)
-{
-    return (int16_t)tci_read_reg(index);
-}
-#endif
-
-#if TCG_TARGET_REG_BITS == 64
-static int32_t tci_read_reg32s(TCGReg index)
+static inline bool tci_compare32(uint32_t u0, uint32_t u1, TCGCond condition)
 {
-    return (int32_t)tci_read_reg(index);
-}
-#endif
-
-static uint8_t tci_read_reg8(TCGReg index)
-{
-    return (uint8_t)tci_read_reg(index);
-}
-
-static uint16_t tci_read_reg16(TCGReg index)
-{
-    return (uint16_t)tci_read_reg(index);
-}
-
-static uint32_t tci_read_reg32(TCGReg index)
-{
-    return (uint32_t)tci_read_reg(index);
-}
-
-#if TCG_TARGET_REG_BITS == 64
-static uint64_t tci_read_reg64(TCGReg index)
-{
-    return tci_read_reg(index);
+    switch (condition) {
+    case TCG_COND_EQ:
+        return u0 == u1;
+    case TCG_COND_NE:
+        return u0 != u1;
+    case TCG_COND_LT:
+        return (int32_t)u0 < (int32_t)u1;
+    case TCG_COND_GE:
+        return (int32_t)u0 >= (int32_t)u1;
+    case TCG_COND_LE:
+        return (int32_t)u0 <= (int32_t)u1;
+    case TCG_COND_GT:
+        return (int32_t)u0 > (int32_t)u1;
+    case TCG_COND_LTU:
+        return u0 < u1;
+    case TCG_COND_GEU:
+        return u0 >= u1;
+    case TCG_COND_LEU:
+        return u0 <= u1;
+    case TCG_COND_GTU:
+        return u0 > u1;
+    default:
+        tcg_abort();
+    }
 }
-#endif
 
-static void tci_write_reg(TCGReg index, tcg_target_ulong value)
+static inline bool tci_compare64(uint64_t u0, uint64_t u1, TCGCond condition)
 {
-    assert(index < ARRAY_SIZE(tci_reg));
-    assert(index != TCG_AREG0);
-    tci_reg[index] = value;
+    switch (condition) {
+    case TCG_COND_EQ:
+        return u0 == u1;
+    case TCG_COND_NE:
+        return u0 != u1;
+    case TCG_COND_LT:
+        return (int64_t)u0 < (int64_t)u1;
+    case TCG_COND_GE:
+        return (int64_t)u0 >= (int64_t)u1;
+    case TCG_COND_LE:
+        return (int64_t)u0 <= (int64_t)u1;
+    case TCG_COND_GT:
+        return (int64_t)u0 > (int64_t)u1;
+    case TCG_COND_LTU:
+        return u0 < u1;
+    case TCG_COND_GEU:
+        return u0 >= u1;
+    case TCG_COND_LEU:
+        return u0 <= u1;
+    case TCG_COND_GTU:
+        return u0 > u1;
+    default:
+        tcg_abort();
+    }
 }
 
-static void tci_write_reg8s(TCGReg index, int8_t value)
+static inline uint32_t tci_rol32(uint32_t v, unsigned n)
 {
-    tci_write_reg(index, value);
+    return (v << (n & 31)) | (v >> (-n & 31));
 }
 
-static void tci_write_reg16s(TCGReg index, int16_t value)
+static inline uint32_t tci_ror32(uint32_t v, unsigned n)
 {
-    tci_write_reg(index, value);
+    return (v >> (n & 31)) | (v << (-n & 31));
 }
 
 #if TCG_TARGET_REG_BITS == 64
-static void tci_write_reg32s(TCGReg index, int32_t value)
-{
-    tci_write_reg(index, value);
-}
-#endif
-
-static void tci_write_reg8(TCGReg index, uint8_t value)
+static inline uint64_t tci_rol64(uint64_t v, unsigned n)
 {
-    tci_write_reg(index, value);
+    return (v << (n & 63)) | (v >> (-n & 63));
 }
 
-static void tci_write_reg16(TCGReg index, uint16_t value)
+static inline uint64_t tci_ror64(uint64_t v, unsigned n)
 {
-    tci_write_reg(index, value);
+    return (v >> (n & 63)) | (v << (-n & 63));
 }
-
-static void tci_write_reg32(TCGReg index, uint32_t value)
-{
-    tci_write_reg(index, value);
-}
-
-#if TCG_TARGET_REG_BITS == 32
-static void tci_write_reg64(uint32_t high_index, uint32_t low_index,
-                            uint64_t value)
-{
-    tci_write_reg(low_index, value);
-    tci_write_reg(high_index, value >> 32);
-}
-#elif TCG_TARGET_REG_BITS == 64
-static void tci_write_reg64(TCGReg index, uint64_t value)
-{
-    tci_write_reg(index, value);
-}
-#endif
-
-#if TCG_TARGET_REG_BITS == 32
+#else
 /* Create a 64 bit value from two 32 bit values. */
-static uint64_t tci_uint64(uint32_t high, uint32_t low)
+static inline uint64_t tci_uint64(uint32_t high, uint32_t low)
 {
     return ((uint64_t)high << 32) + low;
 }
 #endif
 
-/* Read constant (native size) from bytecode. */
-static tcg_target_ulong tci_read_i(uint8_t **tb_ptr)
-{
-    tcg_target_ulong value = *(tcg_target_ulong *)(*tb_ptr);
-    *tb_ptr += sizeof(value);
-    return value;
-}
-
-/* Read constant (32 bit) from bytecode. */
-static uint32_t tci_read_i32(uint8_t **tb_ptr)
-{
-    uint32_t value = *(uint32_t *)(*tb_ptr);
-    *tb_ptr += sizeof(value);
-    return value;
-}
-
-#if TCG_TARGET_REG_BITS == 64
-/* Read constant (64 bit) from bytecode. */
-static uint64_t tci_read_i64(uint8_t **tb_ptr)
-{
-    uint64_t value = *(uint64_t *)(*tb_ptr);
-    *tb_ptr += sizeof(value);
-    return value;
-}
-#endif
-
-/* Read indexed register (native size) from bytecode. */
-static tcg_target_ulong tci_read_r(uint8_t **tb_ptr)
-{
-    tcg_target_ulong value = tci_read_reg(**tb_ptr);
-    *tb_ptr += 1;
-    return value;
-}
-
-/* Read indexed register (8 bit) from bytecode. */
-static uint8_t tci_read_r8(uint8_t **tb_ptr)
-{
-    uint8_t value = tci_read_reg8(**tb_ptr);
-    *tb_ptr += 1;
-    return value;
-}
-
-#if TCG_TARGET_HAS_ext8s_i32 || TCG_TARGET_HAS_ext8s_i64
-/* Read indexed register (8 bit signed) from bytecode. */
-static int8_t tci_read_r8s(uint8_t **tb_ptr)
-{
-    int8_t value = tci_read_reg8s(**tb_ptr);
-    *tb_ptr += 1;
-    return value;
-}
-#endif
-
-/* Read indexed register (16 bit) from bytecode. */
-static uint16_t tci_read_r16(uint8_t **tb_ptr)
+/* Destination of a branch, goto_tb or super-instruction.  */
+static inline const TCIInsn *tci_branch_target(const TCIInsn *insn)
 {
-    uint16_t value = tci_read_reg16(**tb_ptr);
-    *tb_ptr += 1;
-    return value;
+    return (const TCIInsn *)((const uint8_t *)(&insn->off + 1) + insn->off);
 }
 
-#if TCG_TARGET_HAS_ext16s_i32 || TCG_TARGET_HAS_ext16s_i64
-/* Read indexed register (16 bit signed) from bytecode. */
-static int16_t tci_read_r16s(uint8_t **tb_ptr)
-{
-    int16_t value = tci_read_reg16s(**tb_ptr);
-    *tb_ptr += 1;
-    return value;
-}
-#endif
-
-/* Read indexed register (32 bit) from bytecode. */
-static uint32_t tci_read_r32(uint8_t **tb_ptr)
-{
-    uint32_t value = tci_read_reg32(**tb_ptr);
-    *tb_ptr += 1;
-    return value;
-}
-
-#if TCG_TARGET_REG_BITS == 32
-/* Read two indexed registers (2 * 32 bit) from bytecode. */
-static uint64_t tci_read_r64(uint8_t **tb_ptr)
-{
-    uint32_t low = tci_read_r32(tb_ptr);
-    return tci_uint64(tci_read_r32(tb_ptr), low);
-}
-#elif TCG_TARGET_REG_BITS == 64
-/* Read indexed register (32 bit signed) from bytecode. */
-static int32_t tci_read_r32s(uint8_t **tb_ptr)
-{
-    int32_t value = tci_read_reg32s(**tb_ptr);
-    *tb_ptr += 1;
-    return value;
-}
-
-/* Read indexed register (64 bit) from bytecode. */
-static uint64_t tci_read_r64(uint8_t **tb_ptr)
-{
-    uint64_t value = tci_read_reg64(**tb_ptr);
-    *tb_ptr += 1;
-    return value;
-}
-#endif
-
-/* Read indexed register(s) with target address from bytecode. */
-static target_ulong tci_read_ulong(uint8_t **tb_ptr)
+/* Guest memory accesses.  */
+#ifdef CONFIG_SOFTMMU
+static inline target_ulong tci_guest_addr(const tcg_target_ulong *regs,
+                                          const TCIInsn *insn)
 {
-    target_ulong taddr = tci_read_r(tb_ptr);
+    target_ulong taddr = regs[insn->r1];
 #if TARGET_LONG_BITS > TCG_TARGET_REG_BITS
-    taddr += (uint64_t)tci_read_r(tb_ptr) << 32;
+    taddr |= (uint64_t)regs[TCI_IMM_REG(insn, 0)] << 32;
 #endif
     return taddr;
 }
 
-/* Read indexed register or constant (native size) from bytecode. */
-static tcg_target_ulong tci_read_ri(uint8_t **tb_ptr)
-{
-    tcg_target_ulong value;
-    TCGReg r = **tb_ptr;
-    *tb_ptr += 1;
-    if (r == TCG_CONST) {
-        value = tci_read_i(tb_ptr);
-    } else {
-        value = tci_read_reg(r);
-    }
-    return value;
-}
-
-/* Read indexed register or constant (32 bit) from bytecode. */
-static uint32_t tci_read_ri32(uint8_t **tb_ptr)
+# define qemu_ld_ub \
+    helper_ldb_mmu(env, tci_guest_addr(regs, insn), insn->off)
+# define qemu_ld_uw \
+    helper_ldw_mmu(env, tci_guest_addr(regs, insn), insn->off)
+# define qemu_ld_ul \
+    helper_ldl_mmu(env, tci_guest_addr(regs, insn), insn->off)
+# define qemu_ld_q \
+    helper_ldq_mmu(env, tci_guest_addr(regs, insn), insn->off)
+# define qemu_st_b(x) \
+    helper_stb_mmu(env, tci_guest_addr(regs, insn), x, insn->off)
+# define qemu_st_w(x) \
+    helper_stw_mmu(env, tci_guest_addr(regs, insn), x, insn->off)
+# define qemu_st_l(x) \
+    helper_stl_mmu(env, tci_guest_addr(regs, insn), x, insn->off)
+# define qemu_st_q(x) \
+    helper_stq_mmu(env, tci_guest_addr(regs, insn), x, insn->off)
+#else
+/* imm is GUEST_BASE.  */
+static inline void *tci_guest_addr(const tcg_target_ulong *regs,
+                                   const TCIInsn *insn)
 {
-    uint32_t value;
-    TCGReg r = **tb_ptr;
-    *tb_ptr += 1;
-    if (r == TCG_CONST) {
-        value = tci_read_i32(tb_ptr);
-    } else {
-        value = tci_read_reg32(r);
-    }
-    return value;
+    return (void *)(uintptr_t)((target_ulong)regs[insn->r1] + insn->imm);
 }
 
-#if TCG_TARGET_REG_BITS == 32
-/* Read two indexed registers or constants (2 * 32 bit) from bytecode. */
-static uint64_t tci_read_ri64(uint8_t **tb_ptr)
-{
-    uint32_t low = tci_read_ri32(tb_ptr);
-    return tci_uint64(tci_read_ri32(tb_ptr), low);
-}
-#elif TCG_TARGET_REG_BITS == 64
-/* Read indexed register or constant (64 bit) from bytecode. */
-static uint64_t tci_read_ri64(uint8_t **tb_ptr)
-{
-    uint64_t value;
-    TCGReg r = **tb_ptr;
-    *tb_ptr += 1;
-    if (r == TCG_CONST) {
-        value = tci_read_i64(tb_ptr);
-    } else {
-        value = tci_read_reg64(r);
-    }
-    return value;
-}
+# define qemu_ld_ub     (*(uint8_t *)tci_guest_addr(regs, insn))
+# define qemu_ld_uw     tswap16(*(uint16_t *)tci_guest_addr(regs, insn))
+# define qemu_ld_ul     tswap32(*(uint32_t *)tci_guest_addr(regs, insn))
+# define qemu_ld_q      tswap64(*(uint64_t *)tci_guest_addr(regs, insn))
+# define qemu_st_b(x)   (*(uint8_t *)tci_guest_addr(regs, insn) = (x))
+# define qemu_st_w(x)   (*(uint16_t *)tci_guest_addr(regs, insn) = tswap16(x))
+# define qemu_st_l(x)   (*(uint32_t *)tci_guest_addr(regs, insn) = tswap32(x))
+# define qemu_st_q(x)   (*(uint64_t *)tci_guest_addr(regs, insn) = tswap64(x))
 #endif
 
-static target_ulong tci_read_label(uint8_t **tb_ptr)
-{
-    target_ulong label = tci_read_i(tb_ptr);
-    assert(label != 0);
-    return label;
-}
+/*
+ * Dispatch.  With GCC, every handler ends with an indirect jump through
+ * a table of label addresses straight to the handler of the next
+ * instruction ("threaded code"), so the host branch predictor sees one
+ * indirect branch per handler instead of a single one for the whole
+ * interpreter.  Other compilers get the plain switch.
+ */
+#if defined(__GNUC__)
+# define CASE(name)     case TCI_##name: L_##name
+# define NEXT() \
+    do { \
+        insn = ip++; \
+        assert(insn->opc < TCI_NB_OPS); \
+        goto *dispatch[insn->opc]; \
+    } while (0)
+#else
+# define CASE(name)     case TCI_##name
+# define NEXT()         continue
+#endif
 
-static bool tci_compare32(uint32_t u0, uint32_t u1, TCGCond condition)
-{
-    bool result = false;
-    int32_t i0 = u0;
-    int32_t i1 = u1;
-    switch (condition) {
-    case TCG_COND_EQ:
-        result = (u0 == u1);
-        break;
-    case TCG_COND_NE:
-        result = (u0 != u1);
-        break;
-    case TCG_COND_LT:
-        result = (i0 < i1);
-        break;
-    case TCG_COND_GE:
-        result = (i0 >= i1);
-        break;
-    case TCG_COND_LE:
-        result = (i0 <= i1);
-        break;
-    case TCG_COND_GT:
-        result = (i0 > i1);
-        break;
-    case TCG_COND_LTU:
-        result = (u0 < u1);
-        break;
-    case TCG_COND_GEU:
-        result = (u0 >= u1);
-        break;
-    case TCG_COND_LEU:
-        result = (u0 <= u1);
-        break;
-    case TCG_COND_GTU:
-        result = (u0 > u1);
-        break;
-    default:
-        TODO();
-    }
-    return result;
-}
+#define REG0            regs[insn->r0]
+#define REG1            regs[insn->r1]
+#define REG2            regs[insn->r2]
 
-static bool tci_compare64(uint64_t u0, uint64_t u1, TCGCond condition)
-{
-    bool result = false;
-    int64_t i0 = u0;
-    int64_t i1 = u1;
-    switch (condition) {
-    case TCG_COND_EQ:
-        result = (u0 == u1);
-        break;
-    case TCG_COND_NE:
-        result = (u0 != u1);
-        break;
-    case TCG_COND_LT:
-        result = (i0 < i1);
-        break;
-    case TCG_COND_GE:
-        result = (i0 >= i1);
-        break;
-    case TCG_COND_LE:
-        result = (i0 <= i1);
-        break;
-    case TCG_COND_GT:
-        result = (i0 > i1);
-        break;
-    case TCG_COND_LTU:
-        result = (u0 < u1);
-        break;
-    case TCG_COND_GEU:
-        result = (u0 >= u1);
-        break;
-    case TCG_COND_LEU:
-        result = (u0 <= u1);
-        break;
-    case TCG_COND_GTU:
-        result = (u0 > u1);
-        break;
-    default:
-        TODO();
-    }
-    return result;
-}
+/* Host register sized operations, shared with the super-instructions.  */
+#define TCI_LD(i) \
+    (regs[(i)->r0] = *(tcg_target_ulong *)(regs[(i)->r1] + (i)->off))
+#define TCI_ST(i) \
+    (*(tcg_target_ulong *)(regs[(i)->r1] + (i)->off) = regs[(i)->r0])
+#if TCG_TARGET_REG_BITS == 64
+# define tci_compare    tci_compare64
+#else
+# define tci_compare    tci_compare32
+#endif
+
+/* Binary operation with a register or constant second operand.  */
+#define BINARY_I32(name, expr) \
+    CASE(name##_i32): { \
+        uint32_t a = REG1, b = REG2; \
+        REG0 = (uint32_t)(expr); \
+    } \
+    NEXT(); \
+    CASE(name##i_i32): { \
+        uint32_t a = REG1, b = insn->imm; \
+        REG0 = (uint32_t)(expr); \
+    } \
+    NEXT()
+
+#define BINARY_I64(name, expr) \
+    CASE(name##_i64): { \
+        uint64_t a = REG1, b = REG2; \
+        REG0 = (expr); \
+    } \
+    NEXT(); \
+    CASE(name##i_i64): { \
+        uint64_t a = REG1, b = insn->imm; \
+        REG0 = (expr); \
+    } \
+    NEXT()
 
 /* Interpret pseudo code in tb. */
 tcg_target_ulong tcg_qemu_tb_exec(CPUArchState *cpustate, uint8_t *tb_ptr)
 {
-    tcg_target_ulong next_tb = 0;
+#if defined(__GNUC__)
+    static const void *const dispatch[TCI_NB_OPS] = {
+#define DEF(name) [TCI_##name] = &&L_##name,
+#include "tci-opc.h"
+#undef DEF
+    };
+#endif
+    tcg_target_ulong regs[TCG_TARGET_NB_REGS];
+    const TCIInsn *ip = (const TCIInsn *)tb_ptr;
+    const TCIInsn *insn;
+    tcg_target_ulong func;
+    uint64_t tmp64;
 
     env = cpustate;
-    tci_reg[TCG_AREG0] = (tcg_target_ulong)env;
+    regs[TCG_AREG0] = (tcg_target_ulong)env;
     assert(tb_ptr);
 
     for (;;) {
-#if defined(GETPC)
-        tci_tb_ptr = (uintptr_t)tb_ptr;
-#endif
-        TCGOpcode opc = tb_ptr[0];
-#if !defined(NDEBUG)
-        uint8_t op_size = tb_ptr[1];
-        uint8_t *old_code_ptr = tb_ptr;
-#endif
-        tcg_target_ulong t0;
-        tcg_target_ulong t1;
-        tcg_target_ulong t2;
-        tcg_target_ulong label;
-        TCGCond condition;
-        target_ulong taddr;
-#ifndef CONFIG_SOFTMMU
-        tcg_target_ulong host_addr;
-#endif
-        uint8_t tmp8;
-        uint16_t tmp16;
-        uint32_t tmp32;
-        uint64_t tmp64;
+        insn = ip++;
+        switch (insn->opc) {
+
+            /* Control flow. */
+
+        CASE(callr):
+            func = REG0;
+            goto do_call;
+        CASE(call):
+            func = insn->imm;
+        do_call:
+            tci_save_pc(insn);
 #if TCG_TARGET_REG_BITS == 32
-        uint64_t v64;
-#endif
-
-        /* Skip opcode and size entry. */
-        tb_ptr += 2;
-
-        switch (opc) {
-        case INDEX_op_end:
-        case INDEX_op_nop:
-            break;
-        case INDEX_op_nop1:
-        case INDEX_op_nop2:
-        case INDEX_op_nop3:
-        case INDEX_op_nopn:
-        case INDEX_op_discard:
-            TODO();
-            break;
-        case INDEX_op_set_label:
-            TODO();
-            break;
-        case INDEX_op_call:
-            t0 = tci_read_ri(&tb_ptr);
-#if TCG_TARGET_REG_BITS == 32
-            tmp64 = ((helper_function)t0)(tci_read_reg(TCG_REG_R0),
-                                          tci_read_reg(TCG_REG_R1),
-                                          tci_read_reg(TCG_REG_R2),
-                                          tci_read_reg(TCG_REG_R3),
-                                          tci_read_reg(TCG_REG_R5),
-                                          tci_read_reg(TCG_REG_R6),
-                                          tci_read_reg(TCG_REG_R7),
-                                          tci_read_reg(TCG_REG_R8));
-            tci_write_reg(TCG_REG_R0, tmp64);
-            tci_write_reg(TCG_REG_R1, tmp64 >> 32);
+            tmp64 = ((helper_function)func)(regs[TCG_REG_R0], regs[TCG_REG_R1],
+                                            regs[TCG_REG_R2], regs[TCG_REG_R3],
+                                            regs[TCG_REG_R5], regs[TCG_REG_R6],
+                                            regs[TCG_REG_R8], regs[TCG_REG_R9],
+                                            regs[TCG_REG_R10],
+                                            regs[TCG_REG_R11]);
+            regs[TCG_REG_R0] = tmp64;
+            regs[TCG_REG_R1] = tmp64 >> 32;
 #else
-            tmp64 = ((helper_function)t0)(tci_read_reg(TCG_REG_R0),
-                                          tci_read_reg(TCG_REG_R1),
-                                          tci_read_reg(TCG_REG_R2),
-                                          tci_read_reg(TCG_REG_R3));
-            tci_write_reg(TCG_REG_R0, tmp64);
-#endif
-            break;
-        case INDEX_op_jmp:
-        case INDEX_op_br:
-            label = tci_read_label(&tb_ptr);
-            assert(tb_ptr == old_code_ptr + op_size);
-            tb_ptr = (uint8_t *)label;
-            continue;
-        case INDEX_op_setcond_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            condition = *tb_ptr++;
-            tci_write_reg32(t0, tci_compare32(t1, t2, condition));
-            break;
-#if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_setcond2_i32:
-            t0 = *tb_ptr++;
-            tmp64 = tci_read_r64(&tb_ptr);
-            v64 = tci_read_ri64(&tb_ptr);
-            condition = *tb_ptr++;
-            tci_write_reg32(t0, tci_compare64(tmp64, v64, condition));
-            break;
-#elif TCG_TARGET_REG_BITS == 64
-        case INDEX_op_setcond_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            condition = *tb_ptr++;
-            tci_write_reg64(t0, tci_compare64(t1, t2, condition));
-            break;
-#endif
-        case INDEX_op_mov_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(&tb_ptr);
-            tci_write_reg32(t0, t1);
-            break;
-        case INDEX_op_movi_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_i32(&tb_ptr);
-            tci_write_reg32(t0, t1);
-            break;
-
-            /* Load/store operations (32 bit). */
-
-        case INDEX_op_ld8u_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            tci_write_reg8(t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i32:
-        case INDEX_op_ld16u_i32:
-            TODO();
-            break;
-        case INDEX_op_ld16s_i32:
-            TODO();
-            break;
-        case INDEX_op_ld_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            tci_write_reg32(t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i32:
-            t0 = tci_read_r8(&tb_ptr);
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i32:
-            t0 = tci_read_r16(&tb_ptr);
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i32:
-            t0 = tci_read_r32(&tb_ptr);
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            *(uint32_t *)(t1 + t2) = t0;
-            break;
-
-            /* Arithmetic operations (32 bit). */
-
-        case INDEX_op_add_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 * t2);
-            break;
-#if TCG_TARGET_HAS_div_i32
-        case INDEX_op_div_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, (int32_t)t1 / (int32_t)t2);
-            break;
-        case INDEX_op_divu_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 / t2);
-            break;
-        case INDEX_op_rem_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, (int32_t)t1 % (int32_t)t2);
-            break;
-        case INDEX_op_remu_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 % t2);
-            break;
-#elif TCG_TARGET_HAS_div2_i32
-        case INDEX_op_div2_i32:
-        case INDEX_op_divu2_i32:
-            TODO();
-            break;
-#endif
-        case INDEX_op_and_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 & t2);
-            break;
-        case INDEX_op_or_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 ^ t2);
-            break;
-
-            /* Shift/rotate operations (32 bit). */
-
-        case INDEX_op_shl_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 << t2);
-            break;
-        case INDEX_op_shr_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, t1 >> t2);
-            break;
-        case INDEX_op_sar_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, ((int32_t)t1 >> t2));
-            break;
-#if TCG_TARGET_HAS_rot_i32
-        case INDEX_op_rotl_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, (t1 << t2) | (t1 >> (32 - t2)));
-            break;
-        case INDEX_op_rotr_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri32(&tb_ptr);
-            t2 = tci_read_ri32(&tb_ptr);
-            tci_write_reg32(t0, (t1 >> t2) | (t1 << (32 - t2)));
-            break;
-#endif
-        case INDEX_op_brcond_i32:
-            t0 = tci_read_r32(&tb_ptr);
-            t1 = tci_read_ri32(&tb_ptr);
-            condition = *tb_ptr++;
-            label = tci_read_label(&tb_ptr);
-            if (tci_compare32(t0, t1, condition)) {
-                assert(tb_ptr == old_code_ptr + op_size);
-                tb_ptr = (uint8_t *)label;
-                continue;
+            tmp64 = ((helper_function)func)(regs[TCG_REG_R0], regs[TCG_REG_R1],
+                                            regs[TCG_REG_R2], regs[TCG_REG_R3],
+                                            regs[TCG_REG_R5]);
+            regs[TCG_REG_R0] = tmp64;
+#endif
+            NEXT();
+        CASE(br):
+        CASE(goto_tb):
+            ip = tci_branch_target(insn);
+            NEXT();
+        CASE(goto_ptr):
+            ip = (const TCIInsn *)REG0;
+            NEXT();
+        CASE(exit_tb):
+            return insn->imm;
+
+        CASE(mov):
+            REG0 = REG1;
+            NEXT();
+        CASE(movi):
+            REG0 = insn->imm;
+            NEXT();
+
+            /* Load/store operations. */
+
+        CASE(ld8u):
+            REG0 = *(uint8_t *)(REG1 + insn->off);
+            NEXT();
+        CASE(ld8s_i32):
+            REG0 = (uint32_t)*(int8_t *)(REG1 + insn->off);
+            NEXT();
+        CASE(ld16u):
+            REG0 = *(uint16_t *)(REG1 + insn->off);
+            NEXT();
+        CASE(ld16s_i32):
+            REG0 = (uint32_t)*(int16_t *)(REG1 + insn->off);
+            NEXT();
+        CASE(ld32u):
+            REG0 = *(uint32_t *)(REG1 + insn->off);
+            NEXT();
+        CASE(st8):
+            *(uint8_t *)(REG1 + insn->off) = REG0;
+            NEXT();
+        CASE(st16):
+            *(uint16_t *)(REG1 + insn->off) = REG0;
+            NEXT();
+        CASE(st32):
+            *(uint32_t *)(REG1 + insn->off) = REG0;
+            NEXT();
+#if TCG_TARGET_REG_BITS == 64
+        CASE(ld8s_i64):
+            REG0 = *(int8_t *)(REG1 + insn->off);
+            NEXT();
+        CASE(ld16s_i64):
+            REG0 = *(int16_t *)(REG1 + insn->off);
+            NEXT();
+        CASE(ld32s_i64):
+            REG0 = *(int32_t *)(REG1 + insn->off);
+            NEXT();
+        CASE(ld64):
+            REG0 = *(uint64_t *)(REG1 + insn->off);
+            NEXT();
+        CASE(st64):
+            *(uint64_t *)(REG1 + insn->off) = REG0;
+            NEXT();
+#endif
+
+            /* Arithmetic operations. */
+
+        BINARY_I32(add, a + b);
+        BINARY_I32(sub, a - b);
+        BINARY_I32(mul, a * b);
+        BINARY_I32(and, a & b);
+        BINARY_I32(or, a | b);
+        BINARY_I32(xor, a ^ b);
+        BINARY_I32(shl, a << (b & 31));
+        BINARY_I32(shr, a >> (b & 31));
+        BINARY_I32(sar, (int32_t)a >> (b & 31));
+        BINARY_I32(rotl, tci_rol32(a, b));
+        BINARY_I32(rotr, tci_ror32(a, b));
+        CASE(div_i32):
+            REG0 = (uint32_t)((int32_t)REG1 / (int32_t)REG2);
+            NEXT();
+        CASE(divu_i32):
+            REG0 = (uint32_t)REG1 / (uint32_t)REG2;
+            NEXT();
+        CASE(rem_i32):
+            REG0 = (uint32_t)((int32_t)REG1 % (int32_t)REG2);
+            NEXT();
+        CASE(remu_i32):
+            REG0 = (uint32_t)REG1 % (uint32_t)REG2;
+            NEXT();
+#if TCG_TARGET_REG_BITS == 64
+        BINARY_I64(add, a + b);
+        BINARY_I64(sub, a - b);
+        BINARY_I64(mul, a * b);
+        BINARY_I64(and, a & b);
+        BINARY_I64(or, a | b);
+        BINARY_I64(xor, a ^ b);
+        BINARY_I64(shl, a << (b & 63));
+        BINARY_I64(shr, a >> (b & 63));
+        BINARY_I64(sar, (int64_t)a >> (b & 63));
+        BINARY_I64(rotl, tci_rol64(a, b));
+        BINARY_I64(rotr, tci_ror64(a, b));
+        CASE(div_i64):
+            REG0 = (int64_t)REG1 / (int64_t)REG2;
+            NEXT();
+        CASE(divu_i64):
+            REG0 = (uint64_t)REG1 / (uint64_t)REG2;
+            NEXT();
+        CASE(rem_i64):
+            REG0 = (int64_t)REG1 % (int64_t)REG2;
+            NEXT();
+        CASE(remu_i64):
+            REG0 = (uint64_t)REG1 % (uint64_t)REG2;
+            NEXT();
+#endif
+
+        CASE(not_i32):
+            REG0 = (uint32_t)~REG1;
+            NEXT();
+        CASE(neg_i32):
+            REG0 = (uint32_t)-REG1;
+            NEXT();
+        CASE(ext8s_i32):
+            REG0 = (uint32_t)(int8_t)REG1;
+            NEXT();
+        CASE(ext16s_i32):
+            REG0 = (uint32_t)(int16_t)REG1;
+            NEXT();
+        CASE(ext8u):
+            REG0 = (uint8_t)REG1;
+            NEXT();
+        CASE(ext16u):
+            REG0 = (uint16_t)REG1;
+            NEXT();
+        CASE(bswap16):
+            REG0 = bswap16(REG1);
+            NEXT();
+        CASE(bswap32):
+            REG0 = bswap32(REG1);
+            NEXT();
+#if TCG_TARGET_REG_BITS == 64
+        CASE(not_i64):
+            REG0 = ~REG1;
+            NEXT();
+        CASE(neg_i64):
+            REG0 = -REG1;
+            NEXT();
+        CASE(ext8s_i64):
+            REG0 = (int8_t)REG1;
+            NEXT();
+        CASE(ext16s_i64):
+            REG0 = (int16_t)REG1;
+            NEXT();
+        CASE(ext32s_i64):
+            REG0 = (int32_t)REG1;
+            NEXT();
+        CASE(ext32u):
+            REG0 = (uint32_t)REG1;
+            NEXT();
+        CASE(bswap64):
+            REG0 = bswap64(REG1);
+            NEXT();
+#endif
+
+            /* Comparisons. */
+
+        CASE(setcond_i32):
+            REG0 = tci_compare32(REG1, REG2, insn->off);
+            NEXT();
+        CASE(setcondi_i32):
+            REG0 = tci_compare32(REG1, insn->imm, insn->off);
+            NEXT();
+        CASE(brcond_i32):
+            if (tci_compare32(REG0, REG1, insn->r2)) {
+                ip = tci_branch_target(insn);
             }
-            break;
-#if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_add2_i32:
-            t0 = *tb_ptr++;
-            t1 = *tb_ptr++;
-            tmp64 = tci_read_r64(&tb_ptr);
-            tmp64 += tci_read_r64(&tb_ptr);
-            tci_write_reg64(t1, t0, tmp64);
-            break;
-        case INDEX_op_sub2_i32:
-            t0 = *tb_ptr++;
-            t1 = *tb_ptr++;
-            tmp64 = tci_read_r64(&tb_ptr);
-            tmp64 -= tci_read_r64(&tb_ptr);
-            tci_write_reg64(t1, t0, tmp64);
-            break;
-        case INDEX_op_brcond2_i32:
-            tmp64 = tci_read_r64(&tb_ptr);
-            v64 = tci_read_ri64(&tb_ptr);
-            condition = *tb_ptr++;
-            label = tci_read_label(&tb_ptr);
-            if (tci_compare64(tmp64, v64, condition)) {
-                assert(tb_ptr == old_code_ptr + op_size);
-                tb_ptr = (uint8_t *)label;
-                continue;
+            NEXT();
+        CASE(brcondi_i32):
+            if (tci_compare32(REG0, insn->imm, insn->r2)) {
+                ip = tci_branch_target(insn);
             }
-            break;
-        case INDEX_op_mulu2_i32:
-            t0 = *tb_ptr++;
-            t1 = *tb_ptr++;
-            t2 = tci_read_r32(&tb_ptr);
-            tmp64 = tci_read_r32(&tb_ptr);
-            tci_write_reg64(t1, t0, t2 * tmp64);
-            break;
-#endif /* TCG_TARGET_REG_BITS == 32 */
-#if TCG_TARGET_HAS_ext8s_i32
-        case INDEX_op_ext8s_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8s(&tb_ptr);
-            tci_write_reg32(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_ext16s_i32
-        case INDEX_op_ext16s_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16s(&tb_ptr);
-            tci_write_reg32(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_ext8u_i32
-        case INDEX_op_ext8u_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8(&tb_ptr);
-            tci_write_reg32(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_ext16u_i32
-        case INDEX_op_ext16u_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(&tb_ptr);
-            tci_write_reg32(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_bswap16_i32
-        case INDEX_op_bswap16_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(&tb_ptr);
-            tci_write_reg32(t0, bswap16(t1));
-            break;
-#endif
-#if TCG_TARGET_HAS_bswap32_i32
-        case INDEX_op_bswap32_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(&tb_ptr);
-            tci_write_reg32(t0, bswap32(t1));
-            break;
-#endif
-#if TCG_TARGET_HAS_not_i32
-        case INDEX_op_not_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(&tb_ptr);
-            tci_write_reg32(t0, ~t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_neg_i32
-        case INDEX_op_neg_i32:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(&tb_ptr);
-            tci_write_reg32(t0, -t1);
-            break;
-#endif
+            NEXT();
 #if TCG_TARGET_REG_BITS == 64
-        case INDEX_op_mov_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(&tb_ptr);
-            tci_write_reg64(t0, t1);
-            break;
-        case INDEX_op_movi_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_i64(&tb_ptr);
-            tci_write_reg64(t0, t1);
-            break;
-
-            /* Load/store operations (64 bit). */
-
-        case INDEX_op_ld8u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            tci_write_reg8(t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i64:
-        case INDEX_op_ld16u_i64:
-        case INDEX_op_ld16s_i64:
-            TODO();
-            break;
-        case INDEX_op_ld32u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            tci_write_reg32(t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld32s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            tci_write_reg32s(t0, *(int32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            tci_write_reg64(t0, *(uint64_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i64:
-            t0 = tci_read_r8(&tb_ptr);
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i64:
-            t0 = tci_read_r16(&tb_ptr);
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st32_i64:
-            t0 = tci_read_r32(&tb_ptr);
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            *(uint32_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i64:
-            t0 = tci_read_r64(&tb_ptr);
-            t1 = tci_read_r(&tb_ptr);
-            t2 = tci_read_i32(&tb_ptr);
-            *(uint64_t *)(t1 + t2) = t0;
-            break;
-
-            /* Arithmetic operations (64 bit). */
-
-        case INDEX_op_add_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            tci_write_reg64(t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            tci_write_reg64(t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            tci_write_reg64(t0, t1 * t2);
-            break;
-#if TCG_TARGET_HAS_div_i64
-        case INDEX_op_div_i64:
-        case INDEX_op_divu_i64:
-        case INDEX_op_rem_i64:
-        case INDEX_op_remu_i64:
-            TODO();
-            break;
-#elif TCG_TARGET_HAS_div2_i64
-        case INDEX_op_div2_i64:
-        case INDEX_op_divu2_i64:
-            TODO();
-            break;
-#endif
-        case INDEX_op_and_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            tci_write_reg64(t0, t1 & t2);
-            break;
-        case INDEX_op_or_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            tci_write_reg64(t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            tci_write_reg64(t0, t1 ^ t2);
-            break;
-
-            /* Shift/rotate operations (64 bit). */
-
-        case INDEX_op_shl_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            tci_write_reg64(t0, t1 << t2);
-            break;
-        case INDEX_op_shr_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            tci_write_reg64(t0, t1 >> t2);
-            break;
-        case INDEX_op_sar_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_ri64(&tb_ptr);
-            t2 = tci_read_ri64(&tb_ptr);
-            tci_write_reg64(t0, ((int64_t)t1 >> t2));
-            break;
-#if TCG_TARGET_HAS_rot_i64
-        case INDEX_op_rotl_i64:
-        case INDEX_op_rotr_i64:
-            TODO();
-            break;
-#endif
-        case INDEX_op_brcond_i64:
-            t0 = tci_read_r64(&tb_ptr);
-            t1 = tci_read_ri64(&tb_ptr);
-            condition = *tb_ptr++;
-            label = tci_read_label(&tb_ptr);
-            if (tci_compare64(t0, t1, condition)) {
-                assert(tb_ptr == old_code_ptr + op_size);
-                tb_ptr = (uint8_t *)label;
-                continue;
+        CASE(setcond_i64):
+            REG0 = tci_compare64(REG1, REG2, insn->off);
+            NEXT();
+        CASE(setcondi_i64):
+            REG0 = tci_compare64(REG1, insn->imm, insn->off);
+            NEXT();
+        CASE(brcond_i64):
+            if (tci_compare64(REG0, REG1, insn->r2)) {
+                ip = tci_branch_target(insn);
             }
-            break;
-#if TCG_TARGET_HAS_ext8u_i64
-        case INDEX_op_ext8u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8(&tb_ptr);
-            tci_write_reg64(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_ext8s_i64
-        case INDEX_op_ext8s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r8s(&tb_ptr);
-            tci_write_reg64(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_ext16s_i64
-        case INDEX_op_ext16s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16s(&tb_ptr);
-            tci_write_reg64(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_ext16u_i64
-        case INDEX_op_ext16u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(&tb_ptr);
-            tci_write_reg64(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_ext32s_i64
-        case INDEX_op_ext32s_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32s(&tb_ptr);
-            tci_write_reg64(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_ext32u_i64
-        case INDEX_op_ext32u_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(&tb_ptr);
-            tci_write_reg64(t0, t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_bswap16_i64
-        case INDEX_op_bswap16_i64:
-            TODO();
-            t0 = *tb_ptr++;
-            t1 = tci_read_r16(&tb_ptr);
-            tci_write_reg64(t0, bswap16(t1));
-            break;
-#endif
-#if TCG_TARGET_HAS_bswap32_i64
-        case INDEX_op_bswap32_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r32(&tb_ptr);
-            tci_write_reg64(t0, bswap32(t1));
-            break;
-#endif
-#if TCG_TARGET_HAS_bswap64_i64
-        case INDEX_op_bswap64_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(&tb_ptr);
-            tci_write_reg64(t0, bswap64(t1));
-            break;
-#endif
-#if TCG_TARGET_HAS_not_i64
-        case INDEX_op_not_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(&tb_ptr);
-            tci_write_reg64(t0, ~t1);
-            break;
-#endif
-#if TCG_TARGET_HAS_neg_i64
-        case INDEX_op_neg_i64:
-            t0 = *tb_ptr++;
-            t1 = tci_read_r64(&tb_ptr);
-            tci_write_reg64(t0, -t1);
-            break;
+            NEXT();
+        CASE(brcondi_i64):
+            if (tci_compare64(REG0, insn->imm, insn->r2)) {
+                ip = tci_branch_target(insn);
+            }
+            NEXT();
+#else
+        CASE(add2_i32):
+            tmp64 = tci_uint64(regs[TCI_IMM_REG(insn, 0)], REG2) +
+                    tci_uint64(regs[TCI_IMM_REG(insn, 2)],
+                               regs[TCI_IMM_REG(insn, 1)]);
+            REG0 = tmp64;
+            REG1 = tmp64 >> 32;
+            NEXT();
+        CASE(sub2_i32):
+            tmp64 = tci_uint64(regs[TCI_IMM_REG(insn, 0)], REG2) -
+                    tci_uint64(regs[TCI_IMM_REG(insn, 2)],
+                               regs[TCI_IMM_REG(insn, 1)]);
+            REG0 = tmp64;
+            REG1 = tmp64 >> 32;
+            NEXT();
+        CASE(mulu2_i32):
+            tmp64 = (uint64_t)REG2 * regs[TCI_IMM_REG(insn, 0)];
+            REG0 = tmp64;
+            REG1 = tmp64 >> 32;
+            NEXT();
+        CASE(setcond2_i32):
+            REG0 = tci_compare64(tci_uint64(REG2, REG1),
+                                 tci_uint64(regs[TCI_IMM_REG(insn, 1)],
+                                            regs[TCI_IMM_REG(insn, 0)]),
+                                 insn->off);
+            NEXT();
+        CASE(brcond2_i32):
+            if (tci_compare64(tci_uint64(REG1, REG0),
+                              tci_uint64(regs[TCI_IMM_REG(insn, 0)], REG2),
+                              TCI_IMM_REG(insn, 1))) {
+                ip = tci_branch_target(insn);
+            }
+            NEXT();
 #endif
-#endif /* TCG_TARGET_REG_BITS == 64 */
 
             /* QEMU specific operations. */
 
-#if TARGET_LONG_BITS > TCG_TARGET_REG_BITS
-        case INDEX_op_debug_insn_start:
-            TODO();
-            break;
-#else
-        case INDEX_op_debug_insn_start:
-            TODO();
-            break;
-#endif
-        case INDEX_op_exit_tb:
-            next_tb = *(uint64_t *)tb_ptr;
-            goto exit;
-            break;
-        case INDEX_op_goto_tb:
-            t0 = tci_read_i32(&tb_ptr);
-            assert(tb_ptr == old_code_ptr + op_size);
-            tb_ptr += (int32_t)t0;
-            continue;
-        case INDEX_op_qemu_ld8u:
-            t0 = *tb_ptr++;
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            tmp8 = helper_ldb_mmu(env, taddr, tci_read_i(&tb_ptr));
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            tmp8 = *(uint8_t *)(host_addr + GUEST_BASE);
-#endif
-            tci_write_reg8(t0, tmp8);
-            break;
-        case INDEX_op_qemu_ld8s:
-            t0 = *tb_ptr++;
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            tmp8 = helper_ldb_mmu(env, taddr, tci_read_i(&tb_ptr));
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            tmp8 = *(uint8_t *)(host_addr + GUEST_BASE);
-#endif
-            tci_write_reg8s(t0, tmp8);
-            break;
-        case INDEX_op_qemu_ld16u:
-            t0 = *tb_ptr++;
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            tmp16 = helper_ldw_mmu(env, taddr, tci_read_i(&tb_ptr));
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            tmp16 = tswap16(*(uint16_t *)(host_addr + GUEST_BASE));
-#endif
-            tci_write_reg16(t0, tmp16);
-            break;
-        case INDEX_op_qemu_ld16s:
-            t0 = *tb_ptr++;
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            tmp16 = helper_ldw_mmu(env, taddr, tci_read_i(&tb_ptr));
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            tmp16 = tswap16(*(uint16_t *)(host_addr + GUEST_BASE));
-#endif
-            tci_write_reg16s(t0, tmp16);
-            break;
+        CASE(qemu_ld8u):
+            tci_save_pc(insn);
+            REG0 = (uint8_t)qemu_ld_ub;
+            NEXT();
+        CASE(qemu_ld8s):
+            tci_save_pc(insn);
+            REG0 = (int8_t)qemu_ld_ub;
+            NEXT();
+        CASE(qemu_ld16u):
+            tci_save_pc(insn);
+            REG0 = (uint16_t)qemu_ld_uw;
+            NEXT();
+        CASE(qemu_ld16s):
+            tci_save_pc(insn);
+            REG0 = (int16_t)qemu_ld_uw;
+            NEXT();
+        CASE(qemu_ld32u):
+            tci_save_pc(insn);
+            REG0 = (uint32_t)qemu_ld_ul;
+            NEXT();
 #if TCG_TARGET_REG_BITS == 64
-        case INDEX_op_qemu_ld32u:
-            t0 = *tb_ptr++;
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            tmp32 = helper_ldl_mmu(env, taddr, tci_read_i(&tb_ptr));
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            tmp32 = tswap32(*(uint32_t *)(host_addr + GUEST_BASE));
-#endif
-            tci_write_reg32(t0, tmp32);
-            break;
-        case INDEX_op_qemu_ld32s:
-            t0 = *tb_ptr++;
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            tmp32 = helper_ldl_mmu(env, taddr, tci_read_i(&tb_ptr));
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            tmp32 = tswap32(*(uint32_t *)(host_addr + GUEST_BASE));
-#endif
-            tci_write_reg32s(t0, tmp32);
-            break;
-#endif /* TCG_TARGET_REG_BITS == 64 */
-        case INDEX_op_qemu_ld32:
-            t0 = *tb_ptr++;
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            tmp32 = helper_ldl_mmu(env, taddr, tci_read_i(&tb_ptr));
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            tmp32 = tswap32(*(uint32_t *)(host_addr + GUEST_BASE));
-#endif
-            tci_write_reg32(t0, tmp32);
-            break;
-        case INDEX_op_qemu_ld64:
-            t0 = *tb_ptr++;
+        CASE(qemu_ld32s):
+            tci_save_pc(insn);
+            REG0 = (int32_t)qemu_ld_ul;
+            NEXT();
+#endif
+        CASE(qemu_ld64):
+            tci_save_pc(insn);
+            tmp64 = qemu_ld_q;
+            REG0 = tmp64;
 #if TCG_TARGET_REG_BITS == 32
-            t1 = *tb_ptr++;
-#endif
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            tmp64 = helper_ldq_mmu(env, taddr, tci_read_i(&tb_ptr));
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            tmp64 = tswap64(*(uint64_t *)(host_addr + GUEST_BASE));
-#endif
-            tci_write_reg(t0, tmp64);
+            REG2 = tmp64 >> 32;
+#endif
+            NEXT();
+        CASE(qemu_st8):
+            tci_save_pc(insn);
+            qemu_st_b(REG0);
+            NEXT();
+        CASE(qemu_st16):
+            tci_save_pc(insn);
+            qemu_st_w(REG0);
+            NEXT();
+        CASE(qemu_st32):
+            tci_save_pc(insn);
+            qemu_st_l(REG0);
+            NEXT();
+        CASE(qemu_st64):
+            tci_save_pc(insn);
 #if TCG_TARGET_REG_BITS == 32
-            tci_write_reg(t1, tmp64 >> 32);
-#endif
-            break;
-        case INDEX_op_qemu_st8:
-            t0 = tci_read_r8(&tb_ptr);
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            t2 = tci_read_i(&tb_ptr);
-            helper_stb_mmu(env, taddr, t0, t2);
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            *(uint8_t *)(host_addr + GUEST_BASE) = t0;
-#endif
-            break;
-        case INDEX_op_qemu_st16:
-            t0 = tci_read_r16(&tb_ptr);
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            t2 = tci_read_i(&tb_ptr);
-            helper_stw_mmu(env, taddr, t0, t2);
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            *(uint16_t *)(host_addr + GUEST_BASE) = tswap16(t0);
-#endif
-            break;
-        case INDEX_op_qemu_st32:
-            t0 = tci_read_r32(&tb_ptr);
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            t2 = tci_read_i(&tb_ptr);
-            helper_stl_mmu(env, taddr, t0, t2);
-#else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            *(uint32_t *)(host_addr + GUEST_BASE) = tswap32(t0);
-#endif
-            break;
-        case INDEX_op_qemu_st64:
-            tmp64 = tci_read_r64(&tb_ptr);
-            taddr = tci_read_ulong(&tb_ptr);
-#ifdef CONFIG_SOFTMMU
-            t2 = tci_read_i(&tb_ptr);
-            helper_stq_mmu(env, taddr, tmp64, t2);
+            qemu_st_q(tci_uint64(REG2, REG0));
 #else
-            host_addr = (tcg_target_ulong)taddr;
-            assert(taddr == host_addr);
-            *(uint64_t *)(host_addr + GUEST_BASE) = tswap64(tmp64);
+            qemu_st_q(REG0);
+#endif
+            NEXT();
+
+            /* Super-instructions. */
+
+        CASE(ld_ld):
+            TCI_LD(insn);
+            TCI_LD(ip);
+            ip++;
+            NEXT();
+        CASE(ld_add):
+            TCI_LD(insn);
+            insn = ip++;
+            REG0 = REG1 + REG2;
+            NEXT();
+        CASE(ld_addi):
+            TCI_LD(insn);
+            insn = ip++;
+            REG0 = REG1 + insn->imm;
+            NEXT();
+        CASE(st_st):
+            TCI_ST(insn);
+            TCI_ST(ip);
+            ip++;
+            NEXT();
+        CASE(movi_st):
+            REG0 = insn->imm;
+            TCI_ST(ip);
+            ip++;
+            NEXT();
+        CASE(st_brcondi):
+            TCI_ST(insn);
+            insn = ip++;
+            if (tci_compare(REG0, insn->imm, insn->r2)) {
+                ip = tci_branch_target(insn);
+            }
+            NEXT();
+#if TCG_TARGET_REG_BITS == 64
+        CASE(movi_st32):
+            REG0 = insn->imm;
+            *(uint32_t *)(regs[ip->r1] + ip->off) = regs[ip->r0];
+            ip++;
+            NEXT();
 #endif
-            break;
+
         default:
-            TODO();
-            break;
+            tcg_abort();
         }
-        assert(tb_ptr == old_code_ptr + op_size);
     }
-exit:
-    return next_tb;
 }
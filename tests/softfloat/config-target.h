@@ -0,0 +1,2 @@
+/* tests/test-softfloat.c builds softfloat.c without a target: no TARGET_*
+   macros, so that the generic NaN and tininess rules are used.  */
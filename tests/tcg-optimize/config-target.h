@@ -0,0 +1,6 @@
+/* tests/test-tcg-optimize.c builds optimize.c for a 32 bit guest, like
+   i386 or ARM, without a target.  */
+#define TARGET_LONG_BITS 32
+
+/* only used by the prototypes of tcg-target.h */
+typedef struct CPUArchState CPUArchState;
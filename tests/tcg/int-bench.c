@@ -0,0 +1,180 @@
+/*
+ * Integer loop microbenchmarks for the i386 and x86_64 translators.
+ *
+ * Each kernel is a small loop built around a common flag producer and
+ * consumer pair (inc/cmp/jl, dec/jnz, test/jle, adc chains, setcc and
+ * cmov...).  The kernels print a checksum, which must be the same as on
+ * a real CPU, and the time they took:
+ *
+ *   make int-bench-i386 && qemu-i386 ./int-bench-i386
+ *
+ * An optional argument scales the number of iterations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define ITERS   20000000
+
+static double now_ms(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/* inc; cmp; jl */
+static uint32_t bench_count(uint32_t n)
+{
+    uint32_t i = 0, sum = 0;
+
+    asm volatile("1: addl %[i], %[sum]\n"
+                 "   incl %[i]\n"
+                 "   cmpl %[n], %[i]\n"
+                 "   jl 1b\n"
+                 : [i] "+r" (i), [sum] "+r" (sum)
+                 : [n] "r" (n));
+    return sum;
+}
+
+/* dec; jnz with a rotate in the body */
+static uint32_t bench_dec(uint32_t n)
+{
+    uint32_t sum = 0x12345678;
+
+    asm volatile("1: xorl %[n], %[sum]\n"
+                 "   roll $5, %[sum]\n"
+                 "   decl %[n]\n"
+                 "   jnz 1b\n"
+                 : [n] "+r" (n), [sum] "+r" (sum));
+    return sum;
+}
+
+/* test; jle and cmp; jbe on a pseudo random sequence */
+static uint32_t bench_test(uint32_t n)
+{
+    uint32_t x = 1, a = 0, b = 0;
+
+    asm volatile("1: imull $1103515245, %[x], %[x]\n"
+                 "   addl $12345, %[x]\n"
+                 "   testl %[x], %[x]\n"
+                 "   jle 2f\n"
+                 "   incl %[a]\n"
+                 "2: cmpl $0x40000000, %[x]\n"
+                 "   jbe 3f\n"
+                 "   addl %[x], %[b]\n"
+                 "3: decl %[n]\n"
+                 "   jnz 1b\n"
+                 : [n] "+r" (n), [x] "+r" (x), [a] "+r" (a), [b] "+r" (b));
+    return a ^ b;
+}
+
+/* 96 bit additions: add; adc; adc */
+static uint32_t bench_adc(uint32_t n)
+{
+    uint32_t lo = 0, mid = 0, hi = 0;
+
+    asm volatile("1: addl $0x9e3779b9, %[lo]\n"
+                 "   adcl $0x7f4a7c15, %[mid]\n"
+                 "   adcl $0, %[hi]\n"
+                 "   subl $1, %[n]\n"
+                 "   jnz 1b\n"
+                 : [n] "+r" (n), [lo] "+r" (lo), [mid] "+r" (mid),
+                   [hi] "+r" (hi));
+    return lo ^ mid ^ hi;
+}
+
+/* cmp; setb and cmp; cmovl */
+static uint32_t bench_setcc(uint32_t n)
+{
+    uint32_t x = 7, cnt = 0, min = 0xffffffff, t;
+
+    asm volatile("1: imull $69069, %[x], %[x]\n"
+                 "   incl %[x]\n"
+                 "   xorl %[t], %[t]\n"
+                 "   cmpl $0x80000000, %[x]\n"
+                 "   setb %b[t]\n"
+                 "   addl %[t], %[cnt]\n"
+                 "   cmpl %[min], %[x]\n"
+                 "   cmovl %[x], %[min]\n"
+                 "   decl %[n]\n"
+                 "   jnz 1b\n"
+                 : [n] "+r" (n), [x] "+r" (x), [cnt] "+r" (cnt),
+                   [min] "+r" (min), [t] "=&q" (t));
+    return cnt ^ min;
+}
+
+/* compiler generated code */
+static uint32_t bench_collatz(uint32_t n)
+{
+    uint32_t i, steps = 0;
+
+    for (i = 1; i < n / 64; i++) {
+        uint32_t x = i;
+        while (x != 1) {
+            x = (x & 1) ? 3 * x + 1 : x / 2;
+            steps++;
+        }
+    }
+    return steps;
+}
+
+static uint32_t bench_sieve(uint32_t n)
+{
+    static uint8_t flags[8192];
+    uint32_t i, j, count = 0, pass;
+
+    for (pass = 0; pass < n / 100000; pass++) {
+        for (i = 0; i < sizeof(flags); i++) {
+            flags[i] = 1;
+        }
+        for (i = 2; i < sizeof(flags); i++) {
+            if (flags[i]) {
+                for (j = i + i; j < sizeof(flags); j += i) {
+                    flags[j] = 0;
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static const struct {
+    const char *name;
+    uint32_t (*fn)(uint32_t n);
+} benches[] = {
+    { "count", bench_count },
+    { "dec", bench_dec },
+    { "test", bench_test },
+    { "adc", bench_adc },
+    { "setcc", bench_setcc },
+    { "collatz", bench_collatz },
+    { "sieve", bench_sieve },
+};
+
+int main(int argc, char **argv)
+{
+    double start, total = 0;
+    uint32_t sum;
+    int i, scale = 1;
+
+    if (argc > 1) {
+        scale = atoi(argv[1]);
+        if (scale < 1) {
+            scale = 1;
+        }
+    }
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        start = now_ms();
+        sum = benches[i].fn(ITERS * scale);
+        start = now_ms() - start;
+        total += start;
+        printf("%-8s %08x %8.1f ms\n", benches[i].name, sum, start);
+    }
+    printf("%-8s %8s %8.1f ms\n", "total", "", total);
+    return 0;
+}
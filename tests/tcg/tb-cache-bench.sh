@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# Benchmark for the linux-user translation cache (-tb-cache).
+#
+# Runs the kind of short lived tools that a shell script driven build
+# starts over and over (sh, sed, grep, sort, wc, cat) on the files of a
+# source directory, each of them under QEMU, and prints the time taken
+# without the cache, with an empty cache and with the cache filled by the
+# previous run:
+#
+#   tests/tcg/tb-cache-bench.sh x86_64-linux-user/qemu-x86_64 [dir] [runs]
+#
+# The tools are the host ones, so QEMU must be the linux-user emulator for
+# the host architecture.  Host address space randomization changes where
+# shared libraries are loaded, which defeats the cache for them; the
+# script uses setarch -R when it is available.
+
+qemu=$1
+dir=${2:-$(dirname "$0")/../../tcg}
+runs=${3:-1}
+
+if test -z "$qemu" || ! test -x "$qemu"; then
+    echo "usage: $0 qemu-binary [source-dir] [runs]" >&2
+    exit 1
+fi
+
+norand=
+if setarch $(uname -m) -R true 2>/dev/null; then
+    norand="setarch $(uname -m) -R"
+fi
+
+cache=$(mktemp -d)
+out=$(mktemp)
+trap 'rm -rf "$cache" "$out"' EXIT
+
+# tool program args...
+tool() {
+    $norand $qemu $opts "$@" > "$out" 2>/dev/null
+}
+
+build() {
+    for f in "$dir"/*.c "$dir"/*.h; do
+        tool /bin/sh -c "test -f $f && echo $f"
+        tool /bin/sed -e 's/[a-z_]*(/&/g' "$f"
+        tool /bin/grep -c -e '^#include' "$f"
+        tool /bin/sort "$f"
+        tool /usr/bin/wc -l "$f"
+        tool /bin/cat "$f" "$f"
+    done
+}
+
+now() {
+    date +%s%N
+}
+
+# run name clear-cache-first qemu-options
+run() {
+    name=$1
+    clear=$2
+    opts=$3
+    total=0
+    i=0
+    while test $i -lt $runs; do
+        if test $clear = yes; then
+            rm -f "$cache"/*
+        fi
+        start=$(now)
+        build
+        total=$((total + $(now) - start))
+        i=$((i + 1))
+    done
+    echo "$name: $((total / 1000000 / runs)) ms"
+}
+
+run "no cache" no ""
+run "cold cache" yes "-tb-cache $cache"
+run "warm cache" no "-tb-cache $cache"
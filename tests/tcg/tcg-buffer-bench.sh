@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# Benchmark for the pages and mapping of the translation buffer
+# (-tcg-buffer).
+#
+# Boots a Linux kernel with no root file system once per setting; the
+# kernel panics when it gets to mounting root and, with panic=-1 and
+# -no-reboot, QEMU exits right away.  For each setting the script prints
+# the boot time and, when the perf tool can count them, the iTLB misses of
+# QEMU per million host instructions:
+#
+#   tests/tcg/tcg-buffer-bench.sh x86_64-softmmu/qemu-system-x86_64 bzImage [runs]
+#
+# The guest has 1GB of RAM, so that the translation buffer is 256MB.
+# hugetlb needs pages in /proc/sys/vm/nr_hugepages, QEMU falls back to
+# thp otherwise.
+
+qemu=$1
+kernel=$2
+runs=${3:-1}
+
+if test -z "$qemu" || ! test -x "$qemu" || ! test -f "$kernel"; then
+    echo "usage: $0 qemu-system-binary kernel [runs]" >&2
+    exit 1
+fi
+
+bios=$(dirname "$0")/../../pc-bios
+out=$(mktemp)
+trap 'rm -f "$out"' EXIT
+
+perf=
+if perf stat -e iTLB-load-misses true >/dev/null 2>&1; then
+    perf="perf stat -x , -e iTLB-load-misses,instructions -o $out"
+fi
+
+now() {
+    date +%s%N
+}
+
+# run tcg-buffer-setting
+run() {
+    total=0
+    misses=0
+    insns=0
+    i=0
+    while test $i -lt $runs; do
+        start=$(now)
+        $perf $qemu -L "$bios" -m 1024 -kernel "$kernel" \
+            -append "console=ttyS0 panic=-1" -display none -serial null \
+            -no-reboot -tcg-buffer $1 >/dev/null 2>&1
+        total=$((total + $(now) - start))
+        if test -n "$perf"; then
+            misses=$((misses + $(awk -F, '/iTLB-load-misses/ { print $1 }' "$out")))
+            insns=$((insns + $(awk -F, '/instructions/ { print $1 }' "$out")))
+        fi
+        i=$((i + 1))
+    done
+    if test -n "$perf" && test $insns -gt 0; then
+        echo "$1: $((total / 1000000 / runs)) ms," \
+             "$((misses * 1000000 / insns)) iTLB misses per 1M instructions"
+    else
+        echo "$1: $((total / 1000000 / runs)) ms"
+    fi
+}
+
+for setting in small thp hugetlb small,split-wx thp,split-wx; do
+    run $setting
+done
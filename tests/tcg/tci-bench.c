@@ -0,0 +1,152 @@
+/*
+ * CPU bound benchmarks for the TCG interpreter (TCI).
+ *
+ * Portable C, so that it can be built for any guest that runs on a host
+ * without a native TCG backend.  The kernels exercise what the
+ * interpreter spends its time on: a bytecode dispatch loop with indirect
+ * calls, loads and stores through pointers, and compare and branch
+ * chains.  Each kernel prints a checksum, which must be the same as on a
+ * real CPU, and the time it took:
+ *
+ *   make tci-bench-x86_64 && qemu-x86_64 ./tci-bench-x86_64
+ *
+ * An optional argument scales the number of iterations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define ITERS   10000
+
+static double now_ms(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+typedef uint32_t (*opfn)(uint32_t a, uint32_t b);
+
+static uint32_t op_add(uint32_t a, uint32_t b) { return a + b; }
+static uint32_t op_xor(uint32_t a, uint32_t b) { return a ^ (b << 1); }
+static uint32_t op_mul(uint32_t a, uint32_t b) { return a * (b | 1); }
+static uint32_t op_sub(uint32_t a, uint32_t b) { return a - (b >> 1); }
+
+static opfn ops[4] = { op_add, op_xor, op_mul, op_sub };
+
+/* switch dispatch over a small bytecode, with indirect calls */
+static uint32_t bench_dispatch(uint32_t n)
+{
+    unsigned char code[256];
+    uint32_t acc = 1, i, pc;
+
+    for (i = 0; i < 256; i++) {
+        code[i] = (i * 7 + 3) % 6;
+    }
+    for (i = 0; i < n; i++) {
+        for (pc = 0; pc < 256; pc++) {
+            switch (code[pc]) {
+            case 0:
+                acc = ops[acc & 3](acc, pc);
+                break;
+            case 1:
+                acc += 3;
+                break;
+            case 2:
+                acc ^= pc;
+                break;
+            case 3:
+                acc = ops[pc & 3](acc, i);
+                break;
+            case 4:
+                acc = (acc << 3) | (acc >> 29);
+                break;
+            default:
+                acc -= i;
+                break;
+            }
+        }
+    }
+    return acc;
+}
+
+/* loads, adds and stores through pointers */
+static uint32_t bench_memory(uint32_t n)
+{
+    static uint32_t a[1024], b[1024];
+    uint32_t i, j, sum = 0;
+
+    for (j = 0; j < 1024; j++) {
+        a[j] = j * 2654435761u;
+    }
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 1024; j++) {
+            b[j] = a[j] + b[(j + 1) & 1023];
+        }
+        for (j = 0; j < 1024; j += 2) {
+            a[j] ^= b[j];
+            a[j + 1] += b[j + 1];
+        }
+    }
+    for (j = 0; j < 1024; j++) {
+        sum += a[j] ^ b[j];
+    }
+    return sum;
+}
+
+/* chains of compares and branches */
+static uint32_t bench_branch(uint32_t n)
+{
+    uint32_t i, j, x = 12345, count = 0;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 256; j++) {
+            x = x * 1103515245 + 12345;
+            if ((x >> 16) < 0x4000) {
+                count += 1;
+            } else if ((x >> 16) < 0x8000) {
+                count += 2;
+            } else if ((x & 0xff) == j) {
+                count += 3;
+            } else if ((int32_t)x < 0) {
+                count ^= j;
+            }
+        }
+    }
+    return count;
+}
+
+static const struct {
+    const char *name;
+    uint32_t (*fn)(uint32_t n);
+} benches[] = {
+    { "dispatch", bench_dispatch },
+    { "memory", bench_memory },
+    { "branch", bench_branch },
+};
+
+int main(int argc, char **argv)
+{
+    double start, total = 0;
+    uint32_t sum;
+    int i, scale = 1;
+
+    if (argc > 1) {
+        scale = atoi(argv[1]);
+        if (scale < 1) {
+            scale = 1;
+        }
+    }
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        start = now_ms();
+        sum = benches[i].fn(ITERS * scale);
+        start = now_ms() - start;
+        total += start;
+        printf("%-8s %08x %8.1f ms\n", benches[i].name, sum, start);
+    }
+    printf("%-8s %8s %8.1f ms\n", "total", "", total);
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <pthread.h>
 #include <sys/wait.h>
 #include <sched.h>
+#include <sys/time.h>
 
 void *thread1_func(void *arg)
 {
@@ -44,8 +45,99 @@ void test_pthread(void)
     printf("End of pthread test.\n");
 }
 
+/* Scaling test: N threads doing some computation and atomic updates of
+   shared counters.  Each thread runs the same amount of work, so the
+   time should stay the same as N grows as long as there are enough host
+   CPUs, and the counters must not lose any update:
+
+     qemu-i386 ./testthread 4 [iterations]  */
+
+#define SCALE_MAX_THREADS 64
+
+static unsigned long scale_iters = 200000;
+static volatile unsigned long scale_counter;
+static unsigned long scale_locked_counter;
+static pthread_mutex_t scale_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long scale_work(unsigned long x)
+{
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        x = x * 1103515245 + 12345;
+        x ^= x >> 7;
+    }
+    return x;
+}
+
+void *scale_thread_func(void *arg)
+{
+    unsigned long i, x = (unsigned long)arg;
+
+    for (i = 0; i < scale_iters; i++) {
+        x = scale_work(x);
+        __sync_fetch_and_add(&scale_counter, 1);
+        if ((i & 63) == 0) {
+            pthread_mutex_lock(&scale_mutex);
+            scale_locked_counter++;
+            pthread_mutex_unlock(&scale_mutex);
+        }
+    }
+    return (void *)x;
+}
+
+static double now_ms(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+int test_scaling(int nthreads)
+{
+    pthread_t tid[SCALE_MAX_THREADS];
+    unsigned long locked;
+    double start;
+    int i;
+
+    start = now_ms();
+    for (i = 0; i < nthreads; i++) {
+        pthread_create(&tid[i], NULL, scale_thread_func, (void *)(long)i);
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    start = now_ms() - start;
+
+    locked = nthreads * ((scale_iters + 63) / 64);
+    printf("%d threads: %8.1f ms\n", nthreads, start);
+    if (scale_counter != nthreads * scale_iters ||
+        scale_locked_counter != locked) {
+        printf("lost updates: counter %lu, expected %lu; "
+               "locked counter %lu, expected %lu\n",
+               scale_counter, nthreads * scale_iters,
+               scale_locked_counter, locked);
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
+    int nthreads;
+
+    if (argc > 1) {
+        nthreads = atoi(argv[1]);
+        if (nthreads < 1 || nthreads > SCALE_MAX_THREADS) {
+            fprintf(stderr, "usage: %s [threads [iterations]]\n", argv[0]);
+            return 1;
+        }
+        if (argc > 2) {
+            scale_iters = strtoul(argv[2], NULL, 0);
+        }
+        return test_scaling(nthreads);
+    }
     test_pthread();
     return 0;
 }
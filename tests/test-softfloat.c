@@ -0,0 +1,226 @@
+/*
+ * softfloat host FPU fast path tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The fast path is only taken when the inexact flag is already set, so
+ * running each operation once with no flags and once with the inexact flag
+ * set compares it against the soft-float code on the same operands.  The
+ * results and the other flags must be the same, bit for bit.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "softfloat.c"
+
+/* biased towards the cases the fast path must leave to the soft-float code */
+static uint32_t rand_exp(int max)
+{
+    switch (g_test_rand_int_range(0, 8)) {
+    case 0:
+        return 0;                       /* zero or denormal */
+    case 1:
+        return max;                     /* infinity or NaN */
+    case 2:
+        return g_test_rand_int_range(1, 64);
+    case 3:
+        return g_test_rand_int_range(max - 64, max);
+    default:
+        return g_test_rand_int_range(1, max);
+    }
+}
+
+static float32 rand_float32(void)
+{
+    uint32_t frac = g_test_rand_int() & 0x007fffff;
+
+    if (g_test_rand_int_range(0, 8) == 0) {
+        frac = 0;
+    }
+    return make_float32(((uint32_t)g_test_rand_int_range(0, 2) << 31) |
+                        (rand_exp(0xff) << 23) | frac);
+}
+
+static float64 rand_float64(void)
+{
+    uint64_t frac = (((uint64_t)g_test_rand_int() << 32) | g_test_rand_int()) &
+                    LIT64(0x000fffffffffffff);
+
+    if (g_test_rand_int_range(0, 8) == 0) {
+        frac = 0;
+    }
+    return make_float64(((uint64_t)g_test_rand_int_range(0, 2) << 63) |
+                        ((uint64_t)rand_exp(0x7ff) << 52) | frac);
+}
+
+static int iterations(void)
+{
+    return g_test_quick() ? 20000 : 1000000;
+}
+
+/* the rounding mode is always nearest-even, which the fast path needs */
+static void init_status(float_status *s, int config, int flags)
+{
+    memset(s, 0, sizeof(*s));
+    set_float_detect_tininess(config & 1 ? float_tininess_before_rounding :
+                              float_tininess_after_rounding, s);
+    set_flush_to_zero(!!(config & 2), s);
+    set_flush_inputs_to_zero(!!(config & 4), s);
+    set_float_exception_flags(flags, s);
+}
+
+#define NB_CONFIGS 8
+
+static void check_flags(float_status *soft, float_status *hard)
+{
+    g_assert_cmphex(get_float_exception_flags(soft) | float_flag_inexact, ==,
+                    get_float_exception_flags(hard));
+}
+
+typedef float32 float32_binop(float32, float32 STATUS_PARAM);
+typedef float64 float64_binop(float64, float64 STATUS_PARAM);
+
+static void check_float32_binop(float32_binop *op)
+{
+    float_status soft, hard;
+    float32 a, b, rs, rh;
+    int i, config;
+
+    for (i = 0; i < iterations(); i++) {
+        a = rand_float32();
+        b = rand_float32();
+        /* close operands, to get cancellations */
+        if (g_test_rand_int_range(0, 4) == 0) {
+            b = make_float32(float32_val(a) ^ g_test_rand_int_range(0, 4) ^
+                             (g_test_rand_int_range(0, 2) << 31));
+        }
+        for (config = 0; config < NB_CONFIGS; config++) {
+            init_status(&soft, config, 0);
+            init_status(&hard, config, float_flag_inexact);
+            rs = op(a, b, &soft);
+            rh = op(a, b, &hard);
+            g_assert_cmphex(float32_val(rs), ==, float32_val(rh));
+            check_flags(&soft, &hard);
+        }
+    }
+}
+
+static void check_float64_binop(float64_binop *op)
+{
+    float_status soft, hard;
+    float64 a, b, rs, rh;
+    int i, config;
+
+    for (i = 0; i < iterations(); i++) {
+        a = rand_float64();
+        b = rand_float64();
+        if (g_test_rand_int_range(0, 4) == 0) {
+            b = make_float64(float64_val(a) ^ g_test_rand_int_range(0, 4) ^
+                             ((uint64_t)g_test_rand_int_range(0, 2) << 63));
+        }
+        for (config = 0; config < NB_CONFIGS; config++) {
+            init_status(&soft, config, 0);
+            init_status(&hard, config, float_flag_inexact);
+            rs = op(a, b, &soft);
+            rh = op(a, b, &hard);
+            g_assert_cmphex(float64_val(rs), ==, float64_val(rh));
+            check_flags(&soft, &hard);
+        }
+    }
+}
+
+static void test_float32_add(void)
+{
+    check_float32_binop(float32_add);
+}
+
+static void test_float32_sub(void)
+{
+    check_float32_binop(float32_sub);
+}
+
+static void test_float32_mul(void)
+{
+    check_float32_binop(float32_mul);
+}
+
+static void test_float32_div(void)
+{
+    check_float32_binop(float32_div);
+}
+
+static void test_float32_sqrt(void)
+{
+    float_status soft, hard;
+    float32 a, rs, rh;
+    int i, config;
+
+    for (i = 0; i < iterations(); i++) {
+        a = rand_float32();
+        for (config = 0; config < NB_CONFIGS; config++) {
+            init_status(&soft, config, 0);
+            init_status(&hard, config, float_flag_inexact);
+            rs = float32_sqrt(a, &soft);
+            rh = float32_sqrt(a, &hard);
+            g_assert_cmphex(float32_val(rs), ==, float32_val(rh));
+            check_flags(&soft, &hard);
+        }
+    }
+}
+
+static void test_float64_add(void)
+{
+    check_float64_binop(float64_add);
+}
+
+static void test_float64_sub(void)
+{
+    check_float64_binop(float64_sub);
+}
+
+static void test_float64_mul(void)
+{
+    check_float64_binop(float64_mul);
+}
+
+static void test_float64_div(void)
+{
+    check_float64_binop(float64_div);
+}
+
+static void test_float64_sqrt(void)
+{
+    float_status soft, hard;
+    float64 a, rs, rh;
+    int i, config;
+
+    for (i = 0; i < iterations(); i++) {
+        a = rand_float64();
+        for (config = 0; config < NB_CONFIGS; config++) {
+            init_status(&soft, config, 0);
+            init_status(&hard, config, float_flag_inexact);
+            rs = float64_sqrt(a, &soft);
+            rh = float64_sqrt(a, &hard);
+            g_assert_cmphex(float64_val(rs), ==, float64_val(rh));
+            check_flags(&soft, &hard);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/softfloat/float32/add", test_float32_add);
+    g_test_add_func("/softfloat/float32/sub", test_float32_sub);
+    g_test_add_func("/softfloat/float32/mul", test_float32_mul);
+    g_test_add_func("/softfloat/float32/div", test_float32_div);
+    g_test_add_func("/softfloat/float32/sqrt", test_float32_sqrt);
+    g_test_add_func("/softfloat/float64/add", test_float64_add);
+    g_test_add_func("/softfloat/float64/sub", test_float64_sub);
+    g_test_add_func("/softfloat/float64/mul", test_float64_mul);
+    g_test_add_func("/softfloat/float64/div", test_float64_div);
+    g_test_add_func("/softfloat/float64/sqrt", test_float64_sqrt);
+    return g_test_run();
+}
@@ -0,0 +1,301 @@
+/*
+ * TCG optimizer tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Each test builds an op stream like the ones the i386 and ARM translators
+ * generate for a few guest instructions, runs the optimizer on it and
+ * compares the result, without the nops, with the expected op stream.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "optimize.c"
+
+TCGContext tcg_ctx;
+uint16_t *gen_opc_ptr;
+TCGArg *gen_opparam_ptr;
+uint16_t gen_opc_buf[64];
+TCGArg gen_opparam_buf[256];
+
+TCGOpDef tcg_op_defs[] = {
+#define DEF(s, oargs, iargs, cargs, flags) \
+    { #s, oargs, iargs, cargs, iargs + oargs + cargs, flags },
+#include "tcg-opc.h"
+#undef DEF
+};
+
+/* env fields that are not globals */
+#define EIP_OFFSET      0x40
+#define CC_OP_OFFSET    0x44
+
+enum {
+    ENV,
+    R0,                 /* globals at env + 0, 4, 8, 12 */
+    R1,
+    CC_SRC,
+    CC_DST,
+    T0,
+    T1,
+    T2,
+    T3,
+    LOC0,
+    NB_TEMPS
+};
+
+static void start(void)
+{
+    static const char * const names[NB_TEMPS] = {
+        "env", "r0", "r1", "cc_src", "cc_dst", "t0", "t1", "t2", "t3", "loc0"
+    };
+    TCGContext *s = &tcg_ctx;
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    s->temps = s->static_temps;
+    s->nb_globals = T0;
+    s->nb_temps = NB_TEMPS;
+    for (i = 0; i < NB_TEMPS; i++) {
+        TCGTemp *ts = &s->temps[i];
+
+        ts->base_type = ts->type = TCG_TYPE_I32;
+        ts->name = names[i];
+        if (i == ENV) {
+            ts->base_type = ts->type = TCG_TYPE_PTR;
+            ts->fixed_reg = 1;
+            ts->reg = TCG_AREG0;
+        } else if (i < T0) {
+            ts->mem_reg = TCG_AREG0;
+            ts->mem_offset = (i - R0) * 4;
+            ts->mem_allocated = 1;
+        }
+    }
+    s->temps[LOC0].temp_local = 1;
+
+    gen_opc_ptr = gen_opc_buf;
+    gen_opparam_ptr = gen_opparam_buf;
+}
+
+static void op(TCGOpcode opc, TCGArg a0, TCGArg a1, TCGArg a2, TCGArg a3)
+{
+    const TCGArg args[4] = { a0, a1, a2, a3 };
+    int i;
+
+    *gen_opc_ptr++ = opc;
+    for (i = 0; i < tcg_op_defs[opc].nb_args; i++) {
+        *gen_opparam_ptr++ = args[i];
+    }
+}
+
+/* Optimize the op stream and return it as "op arg,arg; op arg..." */
+static const char *optimize(void)
+{
+    static char buf[1024];
+    const TCGArg *args = gen_opparam_buf;
+    const uint16_t *opc;
+    size_t len = 0;
+    int i;
+
+    tcg_optimize(&tcg_ctx, gen_opc_ptr, gen_opparam_buf, tcg_op_defs);
+
+    buf[0] = 0;
+    for (opc = gen_opc_buf; opc < gen_opc_ptr; opc++) {
+        const TCGOpDef *def = &tcg_op_defs[*opc];
+
+        if (*opc == INDEX_op_nop) {
+            continue;
+        }
+        if (*opc == INDEX_op_nopn) {
+            args += args[0];
+            continue;
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%s ",
+                        len ? "; " : "", def->name);
+        for (i = 0; i < def->nb_args; i++) {
+            if (i < def->nb_oargs + def->nb_iargs) {
+                len += snprintf(buf + len, sizeof(buf) - len, "%s%s",
+                                i ? "," : "", tcg_ctx.temps[args[i]].name);
+            } else {
+                len += snprintf(buf + len, sizeof(buf) - len, "%s$0x%" PRIx64,
+                                i ? "," : "", op_bits(*opc) == 32
+                                ? (uint64_t)(uint32_t)args[i]
+                                : (uint64_t)args[i]);
+            }
+        }
+        args += def->nb_args;
+    }
+    g_assert(len < sizeof(buf));
+    return buf;
+}
+
+/* movzbl %al, %ecx; and $0xff, %ecx */
+static void test_i386_movzbl_and(void)
+{
+    start();
+    op(INDEX_op_ext8u_i32, T0, R0, 0, 0);
+    op(INDEX_op_movi_i32, T1, 0xff, 0, 0);
+    op(INDEX_op_and_i32, T0, T0, T1, 0);
+    op(INDEX_op_mov_i32, R1, T0, 0, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "ext8u_i32 t0,r0; movi_i32 t1,$0xff; mov_i32 r1,t0");
+}
+
+/* movzwl (mem), %eax; movzwl %ax, %eax; shr $16, %eax */
+static void test_i386_movzwl_shr(void)
+{
+    start();
+    op(INDEX_op_qemu_ld16u, T0, T1, 0, 0);
+    op(INDEX_op_ext16u_i32, T2, T0, 0, 0);
+    op(INDEX_op_movi_i32, T3, 16, 0, 0);
+    op(INDEX_op_shr_i32, T2, T2, T3, 0);
+    op(INDEX_op_mov_i32, R0, T2, 0, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "qemu_ld16u t0,t1,$0x0; mov_i32 t2,t0; movi_i32 t3,$0x10; "
+                    "movi_i32 t2,$0x0; movi_i32 r0,$0x0");
+}
+
+/* movsbl of a value known to be positive: and $0x7f, %eax; movsbl %al, %ecx */
+static void test_i386_movsbl_positive(void)
+{
+    start();
+    op(INDEX_op_movi_i32, T1, 0x7f, 0, 0);
+    op(INDEX_op_and_i32, T0, R0, T1, 0);
+    op(INDEX_op_ext8s_i32, T2, T0, 0, 0);
+    op(INDEX_op_mov_i32, R1, T2, 0, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "movi_i32 t1,$0x7f; and_i32 t0,r0,t1; mov_i32 t2,t0; "
+                    "mov_i32 r1,t0");
+}
+
+/* sub %eax, %eax and xor %eax, %eax, once the copies are propagated */
+static void test_i386_sub_xor_self(void)
+{
+    start();
+    op(INDEX_op_ld_i32, T0, ENV, 0x20, 0);
+    op(INDEX_op_mov_i32, T1, T0, 0, 0);
+    op(INDEX_op_sub_i32, T2, T0, T1, 0);
+    op(INDEX_op_xor_i32, T3, T1, T0, 0);
+    op(INDEX_op_add_i32, R0, T2, T3, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "ld_i32 t0,env,$0x20; mov_i32 t1,t0; movi_i32 t2,$0x0; "
+                    "movi_i32 t3,$0x0; movi_i32 r0,$0x0");
+}
+
+/* the eip written back before each instruction that may fault */
+static void test_i386_dead_eip_store(void)
+{
+    start();
+    op(INDEX_op_movi_i32, T0, 0x1000, 0, 0);
+    op(INDEX_op_st_i32, T0, ENV, EIP_OFFSET, 0);
+    op(INDEX_op_add_i32, R0, R0, R1, 0);
+    op(INDEX_op_movi_i32, T0, 0x1002, 0, 0);
+    op(INDEX_op_st_i32, T0, ENV, EIP_OFFSET, 0);
+    op(INDEX_op_qemu_ld32, R1, R0, 0, 0);
+    op(INDEX_op_movi_i32, T0, 0x1005, 0, 0);
+    op(INDEX_op_st_i32, T0, ENV, EIP_OFFSET, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "movi_i32 t0,$0x1000; add_i32 r0,r0,r1; "
+                    "movi_i32 t0,$0x1002; st_i32 t0,env,$0x40; "
+                    "qemu_ld32 r1,r0,$0x0; movi_i32 t0,$0x1005; "
+                    "st_i32 t0,env,$0x40");
+}
+
+/* stores that are read back, or that overlap a global, are kept */
+static void test_i386_live_stores(void)
+{
+    start();
+    op(INDEX_op_st_i32, R0, ENV, CC_OP_OFFSET, 0);
+    op(INDEX_op_ld8u_i32, T0, ENV, CC_OP_OFFSET + 1, 0);
+    op(INDEX_op_st_i32, R1, ENV, CC_OP_OFFSET, 0);
+    op(INDEX_op_st_i32, T0, ENV, 0, 0);
+    op(INDEX_op_st_i32, T1, ENV, 0, 0);
+    op(INDEX_op_st16_i32, T0, ENV, EIP_OFFSET, 0);
+    op(INDEX_op_st_i32, T1, ENV, EIP_OFFSET + 1, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "st_i32 r0,env,$0x44; ld8u_i32 t0,env,$0x45; "
+                    "st_i32 r1,env,$0x44; st_i32 t0,env,$0x0; "
+                    "st_i32 t1,env,$0x0; st16_i32 t0,env,$0x40; "
+                    "st_i32 t1,env,$0x41");
+}
+
+/* mov r0, r1, lsl #0; orr r0, r0, #0; and r1, r0, #0xffffffff */
+static void test_arm_identities(void)
+{
+    start();
+    op(INDEX_op_movi_i32, T1, 0, 0, 0);
+    op(INDEX_op_shl_i32, T0, R1, T1, 0);
+    op(INDEX_op_or_i32, T2, T0, T1, 0);
+    op(INDEX_op_movi_i32, T3, -1, 0, 0);
+    op(INDEX_op_and_i32, T2, T2, T3, 0);
+    op(INDEX_op_mov_i32, R1, T2, 0, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "movi_i32 t1,$0x0; mov_i32 t0,r1; mov_i32 t2,t0; "
+                    "movi_i32 t3,$0xffffffff; mov_i32 r1,t0");
+}
+
+/* uxtb r0, r1, ror #24: the byte is already zero extended by the shift */
+static void test_arm_uxtb_shift(void)
+{
+    start();
+    op(INDEX_op_movi_i32, T1, 24, 0, 0);
+    op(INDEX_op_shr_i32, T0, R1, T1, 0);
+    op(INDEX_op_ext8u_i32, T0, T0, 0, 0);
+    op(INDEX_op_mov_i32, R0, T0, 0, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "movi_i32 t1,$0x18; shr_i32 t0,r1,t1; mov_i32 r0,t0");
+}
+
+/* movs r0, #0; beq label; the flags are constants */
+static void test_arm_constant_branch(void)
+{
+    start();
+    op(INDEX_op_movi_i32, T0, 0, 0, 0);
+    op(INDEX_op_mov_i32, LOC0, T0, 0, 0);
+    op(INDEX_op_movi_i32, T1, 0, 0, 0);
+    op(INDEX_op_brcond_i32, LOC0, T1, TCG_COND_NE, 0);
+    op(INDEX_op_movi_i32, T2, 1, 0, 0);
+    op(INDEX_op_add_i32, R0, LOC0, T2, 0);
+    op(INDEX_op_brcond_i32, T1, LOC0, TCG_COND_EQ, 1);
+    op(INDEX_op_mov_i32, R1, T2, 0, 0);
+    op(INDEX_op_set_label, 1, 0, 0, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "movi_i32 t0,$0x0; movi_i32 loc0,$0x0; movi_i32 t1,$0x0; "
+                    "movi_i32 t2,$0x1; movi_i32 r0,$0x1; br $0x1; "
+                    "mov_i32 r1,t2; set_label $0x1");
+}
+
+/* conditions that do not depend on the value of the operands */
+static void test_arm_trivial_conditions(void)
+{
+    start();
+    op(INDEX_op_setcond_i32, T0, R0, R0, TCG_COND_LE);
+    op(INDEX_op_movi_i32, T1, 0, 0, 0);
+    op(INDEX_op_setcond_i32, T2, R1, T1, TCG_COND_LTU);
+    op(INDEX_op_setcond_i32, T3, R1, T1, TCG_COND_LT);
+    op(INDEX_op_brcond_i32, R0, R0, TCG_COND_NE, 0);
+    g_assert_cmpstr(optimize(), ==,
+                    "movi_i32 t0,$0x1; movi_i32 t1,$0x0; movi_i32 t2,$0x0; "
+                    "setcond_i32 t3,r1,t1,$0x2");
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/tcg/optimize/i386/movzbl-and", test_i386_movzbl_and);
+    g_test_add_func("/tcg/optimize/i386/movzwl-shr", test_i386_movzwl_shr);
+    g_test_add_func("/tcg/optimize/i386/movsbl-positive",
+                    test_i386_movsbl_positive);
+    g_test_add_func("/tcg/optimize/i386/sub-xor-self", test_i386_sub_xor_self);
+    g_test_add_func("/tcg/optimize/i386/dead-eip-store",
+                    test_i386_dead_eip_store);
+    g_test_add_func("/tcg/optimize/i386/live-stores", test_i386_live_stores);
+    g_test_add_func("/tcg/optimize/arm/identities", test_arm_identities);
+    g_test_add_func("/tcg/optimize/arm/uxtb-shift", test_arm_uxtb_shift);
+    g_test_add_func("/tcg/optimize/arm/constant-branch",
+                    test_arm_constant_branch);
+    g_test_add_func("/tcg/optimize/arm/trivial-conditions",
+                    test_arm_trivial_conditions);
+    return g_test_run();
+}
@@ -0,0 +1,279 @@
+/*
+ * QEMU block layer thread pool
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The worker management follows posix-aio-compat.c: threads are created on
+ * demand up to max_threads and completions are signalled to the I/O thread
+ * through a pipe, so that qemu_aio_wait() notices them.
+ */
+
+#include "qemu-common.h"
+#include "qemu-queue.h"
+#include "qemu-thread.h"
+#include "qemu-aio.h"
+#include "trace.h"
+#include "thread-pool.h"
+
+enum ThreadState {
+    THREAD_QUEUED,
+    THREAD_ACTIVE,
+    THREAD_DONE,
+};
+
+typedef struct ThreadPoolElement {
+    BlockDriverAIOCB common;
+    ThreadPoolFunc *func;
+    void *arg;
+    QEMUBH *bh;
+
+    /* Protected by lock */
+    enum ThreadState state;
+    int ret;
+
+    /* Access to this list is protected by lock */
+    QTAILQ_ENTRY(ThreadPoolElement) reqs;
+
+    /* Only accessed from the I/O thread */
+    QLIST_ENTRY(ThreadPoolElement) all;
+} ThreadPoolElement;
+
+static QemuMutex lock;
+static QemuCond request_cond;
+static QTAILQ_HEAD(, ThreadPoolElement) request_list =
+    QTAILQ_HEAD_INITIALIZER(request_list);
+static int max_threads = 64;
+static int cur_threads;
+static int idle_threads;
+
+static QLIST_HEAD(, ThreadPoolElement) head = QLIST_HEAD_INITIALIZER(head);
+static bool initialized;
+static int notify_fds[2] = { -1, -1 };
+
+static void thread_pool_notify(void)
+{
+    char byte = 0;
+    ssize_t ret;
+
+    do {
+        ret = write(notify_fds[1], &byte, sizeof(byte));
+    } while (ret < 0 && errno == EINTR);
+
+    /* EAGAIN means the pipe is full, and a wakeup is pending anyway */
+    if (ret < 0 && errno != EAGAIN) {
+        fprintf(stderr, "thread pool: failed to notify I/O thread: %s\n",
+                strerror(errno));
+        abort();
+    }
+}
+
+static void *worker_thread(void *unused)
+{
+    ThreadPoolElement *req;
+    int ret;
+
+    qemu_mutex_lock(&lock);
+    for (;;) {
+        while (QTAILQ_EMPTY(&request_list)) {
+            idle_threads++;
+            qemu_cond_wait(&request_cond, &lock);
+            idle_threads--;
+        }
+
+        req = QTAILQ_FIRST(&request_list);
+        QTAILQ_REMOVE(&request_list, req, reqs);
+        req->state = THREAD_ACTIVE;
+        qemu_mutex_unlock(&lock);
+
+        ret = req->func(req->arg);
+
+        qemu_mutex_lock(&lock);
+        req->ret = ret;
+        req->state = THREAD_DONE;
+        qemu_mutex_unlock(&lock);
+
+        thread_pool_notify();
+
+        qemu_mutex_lock(&lock);
+    }
+
+    return NULL;
+}
+
+static void spawn_thread(void)
+{
+    QemuThread thread;
+
+    cur_threads++;
+    qemu_thread_create(&thread, worker_thread, NULL, QEMU_THREAD_DETACHED);
+}
+
+static void thread_pool_complete(ThreadPoolElement *elem)
+{
+    trace_thread_pool_complete(elem, elem->common.opaque, elem->ret);
+    QLIST_REMOVE(elem, all);
+    if (elem->bh) {
+        qemu_bh_delete(elem->bh);
+    }
+    elem->common.cb(elem->common.opaque, elem->ret);
+    qemu_aio_release(elem);
+}
+
+static void thread_pool_completion_read(void *opaque)
+{
+    ThreadPoolElement *elem;
+    char bytes[16];
+    ssize_t len;
+
+    /* read all bytes from the notification pipe */
+    for (;;) {
+        len = read(notify_fds[0], bytes, sizeof(bytes));
+        if (len == -1 && errno == EINTR) {
+            continue;
+        }
+        if (len == sizeof(bytes)) {
+            continue;
+        }
+        break;
+    }
+
+restart:
+    QLIST_FOREACH(elem, &head, all) {
+        int state;
+
+        qemu_mutex_lock(&lock);
+        state = elem->state;
+        qemu_mutex_unlock(&lock);
+
+        if (state == THREAD_DONE) {
+            /* The callback may submit new work or complete other requests,
+             * so start over afterwards. */
+            thread_pool_complete(elem);
+            goto restart;
+        }
+    }
+}
+
+static int thread_pool_active(void *opaque)
+{
+    return !QLIST_EMPTY(&head);
+}
+
+static void thread_pool_cancel(BlockDriverAIOCB *acb)
+{
+    ThreadPoolElement *elem = container_of(acb, ThreadPoolElement, common);
+
+    trace_thread_pool_cancel(elem, elem->common.opaque);
+
+    qemu_mutex_lock(&lock);
+    if (elem->state == THREAD_QUEUED) {
+        QTAILQ_REMOVE(&request_list, elem, reqs);
+        elem->state = THREAD_DONE;
+    }
+    /* A running request cannot be interrupted, wait for it to finish */
+    while (elem->state != THREAD_DONE) {
+        qemu_mutex_unlock(&lock);
+        g_thread_yield();
+        qemu_mutex_lock(&lock);
+    }
+    qemu_mutex_unlock(&lock);
+
+    QLIST_REMOVE(elem, all);
+    if (elem->bh) {
+        qemu_bh_delete(elem->bh);
+    }
+    qemu_aio_release(elem);
+}
+
+static AIOPool thread_pool_cb_pool = {
+    .aiocb_size         = sizeof(ThreadPoolElement),
+    .cancel             = thread_pool_cancel,
+};
+
+static void thread_pool_inline_bh(void *opaque)
+{
+    thread_pool_complete(opaque);
+}
+
+static void thread_pool_init(void)
+{
+    initialized = true;
+
+    qemu_mutex_init(&lock);
+    qemu_cond_init(&request_cond);
+
+#ifndef _WIN32
+    if (qemu_pipe(notify_fds) == -1) {
+        notify_fds[0] = notify_fds[1] = -1;
+        return;
+    }
+    fcntl(notify_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(notify_fds[1], F_SETFL, O_NONBLOCK);
+    qemu_aio_set_fd_handler(notify_fds[0], thread_pool_completion_read, NULL,
+                            thread_pool_active, NULL);
+#endif
+}
+
+BlockDriverAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
+                                         BlockDriverCompletionFunc *cb,
+                                         void *opaque)
+{
+    ThreadPoolElement *req;
+
+    if (!initialized) {
+        thread_pool_init();
+    }
+
+    req = qemu_aio_get(&thread_pool_cb_pool, NULL, cb, opaque);
+    req->func = func;
+    req->arg = arg;
+    req->bh = NULL;
+    req->state = THREAD_QUEUED;
+    req->ret = -EINPROGRESS;
+    QLIST_INSERT_HEAD(&head, req, all);
+
+    trace_thread_pool_submit(req, arg);
+
+    if (notify_fds[0] == -1) {
+        /* No way to get completions back, run the function right here */
+        req->ret = func(arg);
+        req->state = THREAD_DONE;
+        req->bh = qemu_bh_new(thread_pool_inline_bh, req);
+        qemu_bh_schedule(req->bh);
+        return &req->common;
+    }
+
+    qemu_mutex_lock(&lock);
+    if (idle_threads == 0 && cur_threads < max_threads) {
+        spawn_thread();
+    }
+    QTAILQ_INSERT_TAIL(&request_list, req, reqs);
+    qemu_cond_signal(&request_cond);
+    qemu_mutex_unlock(&lock);
+
+    return &req->common;
+}
+
+typedef struct ThreadPoolCo {
+    Coroutine *co;
+    int ret;
+} ThreadPoolCo;
+
+static void thread_pool_co_cb(void *opaque, int ret)
+{
+    ThreadPoolCo *co = opaque;
+
+    co->ret = ret;
+    qemu_coroutine_enter(co->co, NULL);
+}
+
+int coroutine_fn thread_pool_submit_co(ThreadPoolFunc *func, void *arg)
+{
+    ThreadPoolCo tpc = { .co = qemu_coroutine_self(), .ret = -EINPROGRESS };
+
+    assert(qemu_in_coroutine());
+    thread_pool_submit_aio(func, arg, thread_pool_co_cb, &tpc);
+    qemu_coroutine_yield();
+    return tpc.ret;
+}
@@ -0,0 +1,30 @@
+/*
+ * QEMU block layer thread pool
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_THREAD_POOL_H
+#define QEMU_THREAD_POOL_H 1
+
+#include "qemu-common.h"
+#include "qemu-aio.h"
+#include "qemu-coroutine.h"
+
+typedef int ThreadPoolFunc(void *opaque);
+
+/*
+ * Run func(arg) in a worker thread.  cb is invoked from the main loop (or
+ * from qemu_aio_wait) with the return value of func once it has finished.
+ * func must not touch any block layer state; it is meant for CPU-bound work
+ * such as (de)compressing or encrypting a buffer.
+ */
+BlockDriverAIOCB *thread_pool_submit_aio(ThreadPoolFunc *func, void *arg,
+                                         BlockDriverCompletionFunc *cb,
+                                         void *opaque);
+
+/* Like thread_pool_submit_aio, but yields the calling coroutine */
+int coroutine_fn thread_pool_submit_co(ThreadPoolFunc *func, void *arg);
+
+#endif
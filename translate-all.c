@@ -45,6 +45,16 @@ void cpu_gen_init(void)
     tcg_context_init(&tcg_ctx); 
 }
 
+/* TBs translated while profiling count their executions and the helper
+   calls they make.  */
+static void gen_tb_profile_start(TCGContext *s, TranslationBlock *tb)
+{
+    s->profile_tb = (tb->cflags & CF_PROFILE) != 0;
+    if (s->profile_tb) {
+        tcg_gen_profile_count(&tb->profile_count);
+    }
+}
+
 /* return non zero if the very first instruction is invalid so that
    the virtual CPU can trigger an exception.
 
@@ -56,18 +66,25 @@ int cpu_gen_code(CPUArchState *env, TranslationBlock *tb, int *gen_code_size_ptr
     TCGContext *s = &tcg_ctx;
     uint8_t *gen_code_buf;
     int gen_code_size;
-#ifdef CONFIG_PROFILER
-    int64_t ti;
-#endif
+    int64_t ti = 0;
 
-#ifdef CONFIG_PROFILER
-    s->tb_count1++; /* includes aborted translations because of
-                       exceptions */
-    ti = profile_getclock();
-#endif
+    if (s->profile) {
+        s->tb_count1++; /* includes aborted translations because of
+                           exceptions */
+        ti = profile_getclock();
+    }
     tcg_func_start(s);
 
-    gen_intermediate_code(env, tb);
+    gen_tb_profile_start(s, tb);
+    if (!tb_cache_enabled || !tb_cache_lookup(env, tb)) {
+        gen_intermediate_code(env, tb);
+        if (tb_cache_enabled) {
+            /* the cache keeps the ops as the backend gets them */
+            tcg_analyze_ops(s);
+            tb_cache_add(env, tb);
+        }
+    }
+    s->profile_tb = 0;
 
     /* generate machine code */
     gen_code_buf = tb->tc_ptr;
@@ -82,18 +99,18 @@ int cpu_gen_code(CPUArchState *env, TranslationBlock *tb, int *gen_code_size_ptr
     s->tb_next = tb->tb_next;
 #endif
 
-#ifdef CONFIG_PROFILER
-    s->tb_count++;
-    s->interm_time += profile_getclock() - ti;
-    s->code_time -= profile_getclock();
-#endif
+    if (s->profile) {
+        s->tb_count++;
+        s->interm_time += profile_getclock() - ti;
+        s->code_time -= profile_getclock();
+    }
     gen_code_size = tcg_gen_code(s, gen_code_buf);
     *gen_code_size_ptr = gen_code_size;
-#ifdef CONFIG_PROFILER
-    s->code_time += profile_getclock();
-    s->code_in_len += tb->size;
-    s->code_out_len += gen_code_size;
-#endif
+    if (s->profile) {
+        s->code_time += profile_getclock();
+        s->code_in_len += tb->size;
+        s->code_out_len += gen_code_size;
+    }
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_OUT_ASM)) {
@@ -106,24 +123,40 @@ int cpu_gen_code(CPUArchState *env, TranslationBlock *tb, int *gen_code_size_ptr
     return 0;
 }
 
+static int cpu_restore_state_locked(TranslationBlock *tb,
+                                    CPUArchState *env, uintptr_t searched_pc);
+
 /* The cpu state corresponding to 'searched_pc' is restored.
  */
 int cpu_restore_state(TranslationBlock *tb,
                       CPUArchState *env, uintptr_t searched_pc)
+{
+    int ret;
+
+    /* retranslating uses the global TCG context */
+    tb_lock_acquire();
+    ret = cpu_restore_state_locked(tb, env, searched_pc);
+    tb_lock_release();
+    return ret;
+}
+
+static int cpu_restore_state_locked(TranslationBlock *tb,
+                                    CPUArchState *env, uintptr_t searched_pc)
 {
     TCGContext *s = &tcg_ctx;
     int j;
     uintptr_t tc_ptr;
-#ifdef CONFIG_PROFILER
-    int64_t ti;
-#endif
+    int64_t ti = 0;
 
-#ifdef CONFIG_PROFILER
-    ti = profile_getclock();
-#endif
+    if (s->profile) {
+        ti = profile_getclock();
+    }
     tcg_func_start(s);
 
+    /* the ops must be the same as when the TB was translated */
+    gen_tb_profile_start(s, tb);
     gen_intermediate_code_pc(env, tb);
+    s->profile_tb = 0;
 
     if (use_icount) {
         /* Reset the cycle counter to the start of the block.  */
@@ -155,9 +188,9 @@ int cpu_restore_state(TranslationBlock *tb,
 
     restore_state_to_opc(env, tb, j);
 
-#ifdef CONFIG_PROFILER
-    s->restore_time += profile_getclock() - ti;
-    s->restore_count++;
-#endif
+    if (s->profile) {
+        s->restore_time += profile_getclock() - ti;
+        s->restore_count++;
+    }
     return 0;
 }
@@ -265,7 +265,7 @@ int kvm_allowed = 0;
 int xen_allowed = 0;
 uint32_t xen_domid;
 enum xen_mode xen_mode = XEN_EMULATE;
-static int tcg_tb_size;
+static unsigned long tcg_tb_size;
 
 static int default_serial = 1;
 static int default_parallel = 1;
@@ -2347,6 +2347,7 @@ int main(int argc, char **argv, char **envp)
     int i;
     int snapshot, linux_boot;
     const char *icount_option = NULL;
+    const char *tcg_threads_option = NULL;
     const char *initrd_filename;
     const char *kernel_filename, *kernel_cmdline;
     char boot_devices[33] = "cad"; /* default to HD->floppy->CD-ROM */
@@ -3183,15 +3184,36 @@ int main(int argc, char **argv, char **envp)
                 }
                 configure_rtc(opts);
                 break;
-            case QEMU_OPTION_tb_size:
-                tcg_tb_size = strtol(optarg, NULL, 0);
-                if (tcg_tb_size < 0) {
-                    tcg_tb_size = 0;
+            case QEMU_OPTION_tb_size: {
+                long value;
+                char *end;
+
+                value = strtol(optarg, &end, 0);
+                if (value < 0 || *end || end == optarg) {
+                    fprintf(stderr, "qemu: invalid tb size: %s\n", optarg);
+                    exit(1);
+                }
+                if (value > tcg_exec_max_size() / (1024 * 1024)) {
+                    fprintf(stderr, "qemu: tb size too large, this host "
+                            "supports at most %lu MB\n",
+                            tcg_exec_max_size() / (1024 * 1024));
+                    exit(1);
                 }
+                tcg_tb_size = value;
                 break;
+            }
             case QEMU_OPTION_icount:
                 icount_option = optarg;
                 break;
+            case QEMU_OPTION_tcg_threads:
+                tcg_threads_option = optarg;
+                break;
+            case QEMU_OPTION_tcg_perf:
+                configure_tcg_perf(optarg);
+                break;
+            case QEMU_OPTION_tcg_buffer:
+                configure_tcg_buffer(optarg);
+                break;
             case QEMU_OPTION_incoming:
                 incoming = optarg;
                 runstate_set(RUN_STATE_INMIGRATE);
@@ -3500,6 +3522,7 @@ int main(int argc, char **argv, char **envp)
         exit(1);
     }
     configure_icount(icount_option);
+    configure_tcg_threads(tcg_threads_option);
 
     if (net_init_clients() < 0) {
         exit(1);